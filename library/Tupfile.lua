@@ -3,7 +3,7 @@ DoOnce 'library/c/Tupfile.lua'
 LuxemCXX = Define.Library
 {
 	Name = 'luxem-cxx',
-	Sources = Item 'read.cxx' + 'write.cxx' + 'struct.cxx' + 'misc.cxx',
+	Sources = Item 'read.cxx' + 'write.cxx' + 'struct.cxx' + 'misc.cxx' + 'parallel.cxx' + 'persistent.cxx' + 'diff.cxx' + 'index.cxx' + 'stream.cxx' + 'compress.cxx' + 'schema.cxx' + 'ascii16.cxx' + 'serialize.cxx' + 'literal.cxx' + 'image.cxx' + 'pipeline.cxx' + 'columnar.cxx' + 'dedup.cxx' + 'registry.cxx',
 	Objects = LuxemCObjects,
 }
 
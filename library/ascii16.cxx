@@ -0,0 +1,206 @@
+#include "ascii16.h"
+
+#include <sstream>
+#include <stdexcept>
+
+#if defined(__x86_64__) && defined(__GNUC__)
+#define LUXEM_CXX_ASCII16_X86
+#include <immintrin.h>
+#elif defined(__aarch64__)
+#define LUXEM_CXX_ASCII16_NEON
+#include <arm_neon.h>
+#endif
+
+namespace luxem
+{
+
+static void encode_scalar(uint8_t const *pointer, size_t length, char *out)
+{
+	for (size_t index = 0; index < length; ++index)
+	{
+		out[index * 2] = static_cast<char>('a' + (pointer[index] >> 4));
+		out[index * 2 + 1] = static_cast<char>('a' + (pointer[index] & 0xf));
+	}
+}
+
+// Returns false if any character is outside a-p
+static bool decode_scalar(char const *pointer, size_t length, uint8_t *out)
+{
+	uint8_t invalid = 0;
+	for (size_t index = 0; index < length / 2; ++index)
+	{
+		uint8_t high = static_cast<uint8_t>(pointer[index * 2] - 'a');
+		uint8_t low = static_cast<uint8_t>(pointer[index * 2 + 1] - 'a');
+		invalid |= high | low;
+		out[index] = static_cast<uint8_t>((high << 4) | (low & 0xf));
+	}
+	return (invalid & 0xf0) == 0;
+}
+
+#ifdef LUXEM_CXX_ASCII16_X86
+static void encode_sse2(uint8_t const *pointer, size_t length, char *out)
+{
+	auto const mask = _mm_set1_epi8(0xf);
+	auto const base = _mm_set1_epi8('a');
+	size_t index = 0;
+	for (; index + 16 <= length; index += 16)
+	{
+		auto data = _mm_loadu_si128(reinterpret_cast<__m128i const *>(pointer + index));
+		auto high = _mm_add_epi8(_mm_and_si128(_mm_srli_epi16(data, 4), mask), base);
+		auto low = _mm_add_epi8(_mm_and_si128(data, mask), base);
+		_mm_storeu_si128(reinterpret_cast<__m128i *>(out + index * 2), _mm_unpacklo_epi8(high, low));
+		_mm_storeu_si128(reinterpret_cast<__m128i *>(out + index * 2 + 16), _mm_unpackhi_epi8(high, low));
+	}
+	encode_scalar(pointer + index, length - index, out + index * 2);
+}
+
+// Each 16 bit lane holds a character pair, high nibble first
+static inline __m128i combine_sse2(__m128i pairs)
+{
+	return _mm_or_si128(
+		_mm_slli_epi16(_mm_and_si128(pairs, _mm_set1_epi16(0xff)), 4),
+		_mm_srli_epi16(pairs, 8));
+}
+
+static bool decode_sse2(char const *pointer, size_t length, uint8_t *out)
+{
+	auto const base = _mm_set1_epi8('a');
+	auto invalid = _mm_setzero_si128();
+	size_t index = 0;
+	for (; index + 32 <= length; index += 32)
+	{
+		auto first = _mm_sub_epi8(_mm_loadu_si128(reinterpret_cast<__m128i const *>(pointer + index)), base);
+		auto second = _mm_sub_epi8(_mm_loadu_si128(reinterpret_cast<__m128i const *>(pointer + index + 16)), base);
+		invalid = _mm_or_si128(invalid, _mm_or_si128(first, second));
+		_mm_storeu_si128(reinterpret_cast<__m128i *>(out + index / 2),
+			_mm_packus_epi16(combine_sse2(first), combine_sse2(second)));
+	}
+	if (_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_and_si128(invalid, _mm_set1_epi8(static_cast<char>(0xf0))), _mm_setzero_si128())) != 0xffff)
+		return false;
+	return decode_scalar(pointer + index, length - index, out + index / 2);
+}
+
+__attribute__((target("avx2"))) static void encode_avx2(uint8_t const *pointer, size_t length, char *out)
+{
+	auto const mask = _mm256_set1_epi8(0xf);
+	auto const base = _mm256_set1_epi8('a');
+	size_t index = 0;
+	for (; index + 32 <= length; index += 32)
+	{
+		// Reorder the 8 byte quarters so the in-lane unpacks produce contiguous output
+		auto data = _mm256_permute4x64_epi64(
+			_mm256_loadu_si256(reinterpret_cast<__m256i const *>(pointer + index)), 0xd8);
+		auto high = _mm256_add_epi8(_mm256_and_si256(_mm256_srli_epi16(data, 4), mask), base);
+		auto low = _mm256_add_epi8(_mm256_and_si256(data, mask), base);
+		_mm256_storeu_si256(reinterpret_cast<__m256i *>(out + index * 2), _mm256_unpacklo_epi8(high, low));
+		_mm256_storeu_si256(reinterpret_cast<__m256i *>(out + index * 2 + 32), _mm256_unpackhi_epi8(high, low));
+	}
+	encode_sse2(pointer + index, length - index, out + index * 2);
+}
+
+__attribute__((target("avx2"))) static inline __m256i combine_avx2(__m256i pairs)
+{
+	return _mm256_or_si256(
+		_mm256_slli_epi16(_mm256_and_si256(pairs, _mm256_set1_epi16(0xff)), 4),
+		_mm256_srli_epi16(pairs, 8));
+}
+
+__attribute__((target("avx2"))) static bool decode_avx2(char const *pointer, size_t length, uint8_t *out)
+{
+	auto const base = _mm256_set1_epi8('a');
+	auto invalid = _mm256_setzero_si256();
+	size_t index = 0;
+	for (; index + 64 <= length; index += 64)
+	{
+		auto first = _mm256_sub_epi8(_mm256_loadu_si256(reinterpret_cast<__m256i const *>(pointer + index)), base);
+		auto second = _mm256_sub_epi8(_mm256_loadu_si256(reinterpret_cast<__m256i const *>(pointer + index + 32)), base);
+		invalid = _mm256_or_si256(invalid, _mm256_or_si256(first, second));
+		auto packed = _mm256_packus_epi16(combine_avx2(first), combine_avx2(second));
+		_mm256_storeu_si256(reinterpret_cast<__m256i *>(out + index / 2), _mm256_permute4x64_epi64(packed, 0xd8));
+	}
+	if (!_mm256_testz_si256(invalid, _mm256_set1_epi8(static_cast<char>(0xf0)))) return false;
+	return decode_sse2(pointer + index, length - index, out + index / 2);
+}
+#endif
+
+#ifdef LUXEM_CXX_ASCII16_NEON
+static void encode_neon(uint8_t const *pointer, size_t length, char *out)
+{
+	auto const mask = vdupq_n_u8(0xf);
+	auto const base = vdupq_n_u8('a');
+	size_t index = 0;
+	for (; index + 16 <= length; index += 16)
+	{
+		auto data = vld1q_u8(pointer + index);
+		uint8x16x2_t pairs;
+		pairs.val[0] = vaddq_u8(vshrq_n_u8(data, 4), base);
+		pairs.val[1] = vaddq_u8(vandq_u8(data, mask), base);
+		vst2q_u8(reinterpret_cast<uint8_t *>(out + index * 2), pairs);
+	}
+	encode_scalar(pointer + index, length - index, out + index * 2);
+}
+
+static bool decode_neon(char const *pointer, size_t length, uint8_t *out)
+{
+	auto const base = vdupq_n_u8('a');
+	auto invalid = vdupq_n_u8(0);
+	size_t index = 0;
+	for (; index + 32 <= length; index += 32)
+	{
+		auto pairs = vld2q_u8(reinterpret_cast<uint8_t const *>(pointer + index));
+		auto high = vsubq_u8(pairs.val[0], base);
+		auto low = vsubq_u8(pairs.val[1], base);
+		invalid = vorrq_u8(invalid, vorrq_u8(high, low));
+		vst1q_u8(out + index / 2, vorrq_u8(vshlq_n_u8(high, 4), low));
+	}
+	if (vmaxvq_u8(invalid) > 0xf) return false;
+	return decode_scalar(pointer + index, length - index, out + index / 2);
+}
+#endif
+
+struct ascii16_kernels
+{
+	char const *name;
+	void (*encode)(uint8_t const *pointer, size_t length, char *out);
+	bool (*decode)(char const *pointer, size_t length, uint8_t *out);
+};
+
+static ascii16_kernels const &select_kernels(void)
+{
+	static ascii16_kernels const selected = []()
+	{
+#ifdef LUXEM_CXX_ASCII16_X86
+		if (__builtin_cpu_supports("avx2")) return ascii16_kernels{"avx2", encode_avx2, decode_avx2};
+		return ascii16_kernels{"sse2", encode_sse2, decode_sse2};
+#elif defined(LUXEM_CXX_ASCII16_NEON)
+		return ascii16_kernels{"neon", encode_neon, decode_neon};
+#else
+		return ascii16_kernels{"scalar", encode_scalar, decode_scalar};
+#endif
+	}();
+	return selected;
+}
+
+void encode_ascii16(uint8_t const *pointer, size_t length, char *out)
+{
+	select_kernels().encode(pointer, length, out);
+}
+
+void decode_ascii16(char const *pointer, size_t length, uint8_t *out)
+{
+	if (length % 2) throw std::runtime_error("Ascii16 data has odd length.");
+	if (select_kernels().decode(pointer, length, out)) return;
+	size_t offset = 0;
+	while ((pointer[offset] >= 'a') && (pointer[offset] <= 'p')) ++offset;
+	std::stringstream message;
+	message << "Invalid ascii16 character at offset " << offset << ".";
+	throw std::runtime_error(message.str());
+}
+
+char const *ascii16_kernel(void)
+{
+	return select_kernels().name;
+}
+
+}
+
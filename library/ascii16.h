@@ -0,0 +1,25 @@
+#ifndef luxem_cxx_ascii16_h
+#define luxem_cxx_ascii16_h
+
+#include <cstddef>
+#include <cstdint>
+
+namespace luxem
+{
+
+inline size_t ascii16_encoded_size(size_t length) { return length * 2; }
+inline size_t ascii16_decoded_size(size_t length) { return length / 2; }
+
+// Writes exactly ascii16_encoded_size(length) characters to out
+void encode_ascii16(uint8_t const *pointer, size_t length, char *out);
+
+// Writes exactly ascii16_decoded_size(length) bytes to out, raises on odd length or characters outside a-p
+void decode_ascii16(char const *pointer, size_t length, uint8_t *out);
+
+// Name of the kernel picked for this cpu: avx2, sse2, neon or scalar
+char const *ascii16_kernel(void);
+
+}
+
+#endif
+
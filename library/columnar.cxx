@@ -0,0 +1,379 @@
+#include "columnar.h"
+
+#include <sstream>
+#include <stdexcept>
+#include <cstdlib>
+#include <cerrno>
+
+namespace luxem
+{
+
+static size_t const no_column = static_cast<size_t>(-1);
+
+column::column(std::string const &name, format data_format, bool nullable) :
+	name(name),
+	data_format(data_format),
+	nullable(nullable),
+	rows(0),
+	offsets(1, 0)
+	{}
+
+std::string const &column::get_name(void) const { return name; }
+
+column::format column::get_format(void) const { return data_format; }
+
+bool column::is_nullable(void) const { return nullable; }
+
+size_t column::size(void) const { return rows; }
+
+void column::clear(void)
+{
+	rows = 0;
+	ints.clear();
+	uints.clear();
+	doubles.clear();
+	bools.clear();
+	text.clear();
+	offsets.assign(1, 0);
+	present.clear();
+}
+
+void column::reserve(size_t rows)
+{
+	switch (data_format)
+	{
+		case format::string: offsets.reserve(rows + 1); break;
+		case format::integer: ints.reserve(rows); break;
+		case format::unsigned_integer: uints.reserve(rows); break;
+		case format::decimal: doubles.reserve(rows); break;
+		case format::boolean: bools.reserve(rows); break;
+	}
+	if (nullable) present.reserve(rows);
+}
+
+std::vector<int64_t> const &column::get_ints(void) const { return ints; }
+
+std::vector<uint64_t> const &column::get_uints(void) const { return uints; }
+
+std::vector<double> const &column::get_doubles(void) const { return doubles; }
+
+std::vector<uint8_t> const &column::get_bools(void) const { return bools; }
+
+std::string const &column::get_text(void) const { return text; }
+
+std::vector<uint64_t> const &column::get_offsets(void) const { return offsets; }
+
+std::string column::get_string(size_t row) const
+{
+	expect(format::string);
+	return text.substr(offsets[row], offsets[row + 1] - offsets[row]);
+}
+
+std::vector<uint8_t> const &column::get_present(void) const { return present; }
+
+bool column::is_null(size_t row) const { return nullable && !present[row]; }
+
+void column::expect(format wanted) const
+{
+	if (wanted == data_format) return;
+	std::stringstream message;
+	message << "Column '" << name << "' has a different format.";
+	throw std::runtime_error(message.str());
+}
+
+void column::push_present(bool has_value)
+{
+	if (nullable) present.push_back(has_value);
+	++rows;
+}
+
+void column::push_int(int64_t data)
+{
+	expect(format::integer);
+	ints.push_back(data);
+	push_present(true);
+}
+
+void column::push_uint(uint64_t data)
+{
+	expect(format::unsigned_integer);
+	uints.push_back(data);
+	push_present(true);
+}
+
+void column::push_double(double data)
+{
+	expect(format::decimal);
+	doubles.push_back(data);
+	push_present(true);
+}
+
+void column::push_bool(bool data)
+{
+	expect(format::boolean);
+	bools.push_back(data);
+	push_present(true);
+}
+
+void column::push_string(char const *pointer, size_t length)
+{
+	expect(format::string);
+	text.append(pointer, length);
+	offsets.push_back(text.size());
+	push_present(true);
+}
+
+void column::push_string(std::string const &data) { push_string(data.data(), data.size()); }
+
+void column::push_null(void)
+{
+	if (!nullable)
+	{
+		std::stringstream message;
+		message << "Column '" << name << "' isn't nullable.";
+		throw std::runtime_error(message.str());
+	}
+	switch (data_format)
+	{
+		case format::string: offsets.push_back(text.size()); break;
+		case format::integer: ints.push_back(0); break;
+		case format::unsigned_integer: uints.push_back(0); break;
+		case format::decimal: doubles.push_back(0); break;
+		case format::boolean: bools.push_back(0); break;
+	}
+	push_present(false);
+}
+
+void column::push_text(std::string const &data, size_t row)
+{
+	auto begin = data.c_str();
+	char *end = nullptr;
+	errno = 0;
+	// Unlike the strto functions, no leading space is allowed
+	bool valid = !data.empty() && (data[0] != ' ') && (data[0] != '\t') && (data[0] != '\n') && (data[0] != '\r');
+	switch (data_format)
+	{
+		case format::string:
+			push_string(data);
+			return;
+		case format::integer:
+		{
+			auto parsed = strtoll(begin, &end, 10);
+			if (!valid || (errno == ERANGE) || (end != begin + data.size())) break;
+			push_int(parsed);
+			return;
+		}
+		case format::unsigned_integer:
+		{
+			auto parsed = strtoull(begin, &end, 10);
+			if (!valid || (data[0] == '-') || (errno == ERANGE) || (end != begin + data.size())) break;
+			push_uint(parsed);
+			return;
+		}
+		case format::decimal:
+		{
+			auto parsed = strtod(begin, &end);
+			if (!valid || (errno == ERANGE) || (end != begin + data.size())) break;
+			push_double(parsed);
+			return;
+		}
+		case format::boolean:
+			if (data == "true") push_bool(true);
+			else if (data == "false") push_bool(false);
+			else break;
+			return;
+	}
+	std::stringstream message;
+	message << "Row " << row << " column '" << name << "' can't hold '" << data << "'.";
+	throw std::runtime_error(message.str());
+}
+
+columnar_reader::columnar_reader(std::vector<column> &&columns) :
+	raw_reader(
+		[this]() { begin(true); },
+		[this]() { end(false); },
+		[this]() { begin(false); },
+		[this]() { end(true); },
+		[this](std::string &&data) { if (in_row && (depth == row_depth + 1)) find_column(data); },
+		[](std::string &&) {},
+		[this](std::string &&data) { take_primitive(std::move(data)); }
+	),
+	columns(std::move(columns)),
+	ignore_unknown(false),
+	depth(0),
+	row_depth(0),
+	in_array(false),
+	in_row(false),
+	rows(0),
+	guess(0),
+	current(no_column)
+{
+	for (size_t index = 0; index < this->columns.size(); ++index)
+		if (!lookup.emplace(this->columns[index].get_name(), index).second)
+		{
+			std::stringstream message;
+			message << "Column '" << this->columns[index].get_name() << "' is listed twice.";
+			throw std::runtime_error(message.str());
+		}
+	filled.resize(this->columns.size(), 0);
+}
+
+columnar_reader &columnar_reader::set_ignore_unknown(bool ignore)
+{
+	ignore_unknown = ignore;
+	return *this;
+}
+
+size_t columnar_reader::get_row_count(void) const { return rows; }
+
+std::vector<column> &columnar_reader::get_columns(void) { return columns; }
+
+column &columnar_reader::get_column(std::string const &name)
+{
+	auto found = lookup.find(name);
+	if (found == lookup.end())
+	{
+		std::stringstream message;
+		message << "No column '" << name << "'.";
+		throw std::runtime_error(message.str());
+	}
+	return columns[found->second];
+}
+
+std::vector<column> columnar_reader::take(void)
+{
+	std::vector<column> out;
+	out.swap(columns);
+	columns.reserve(out.size());
+	for (auto const &taken : out) columns.emplace_back(taken.get_name(), taken.get_format(), taken.is_nullable());
+	rows = 0;
+	filled.assign(columns.size(), 0);
+	return out;
+}
+
+void columnar_reader::fail_row(std::string const &problem) const
+{
+	std::stringstream message;
+	message << "Row " << rows << " " << problem;
+	throw std::runtime_error(message.str());
+}
+
+void columnar_reader::begin(bool is_object)
+{
+	if (!in_row)
+	{
+		if (!is_object && (depth == 0)) in_array = true;
+		else if (!is_object || ((depth > 0) && !in_array)) fail_row("isn't an object.");
+		else
+		{
+			in_row = true;
+			row_depth = depth;
+			guess = 0;
+			current = no_column;
+		}
+	}
+	// Containers are only allowed under members being ignored
+	else if ((depth == row_depth + 1) && (current != no_column))
+		fail_row("column '" + columns[current].get_name() + "' isn't a primitive.");
+	++depth;
+}
+
+void columnar_reader::end(bool is_array)
+{
+	--depth;
+	if (in_row && (depth == row_depth)) row_end();
+	else if (is_array && (depth == 0)) in_array = false;
+}
+
+void columnar_reader::take_primitive(std::string &&data)
+{
+	if (!in_row) fail_row("isn't an object.");
+	if ((depth != row_depth + 1) || (current == no_column)) return;
+	// The first value of a repeated member wins
+	if (filled[current] == rows + 1) return;
+	filled[current] = rows + 1;
+	columns[current].push_text(data, rows);
+}
+
+void columnar_reader::find_column(std::string const &key)
+{
+	if ((guess < columns.size()) && (columns[guess].get_name() == key)) current = guess;
+	else
+	{
+		auto found = lookup.find(key);
+		if (found != lookup.end()) current = found->second;
+		else if (ignore_unknown) current = no_column;
+		else fail_row("has no column for '" + key + "'.");
+	}
+	if (current != no_column) guess = current + 1;
+}
+
+void columnar_reader::row_end(void)
+{
+	in_row = false;
+	for (size_t index = 0; index < columns.size(); ++index)
+	{
+		if (filled[index] == rows + 1) continue;
+		if (!columns[index].is_nullable()) fail_row("is missing column '" + columns[index].get_name() + "'.");
+		columns[index].push_null();
+	}
+	++rows;
+}
+
+std::vector<column> read_columns(std::string const &data, std::vector<column> &&columns)
+{
+	columnar_reader reader(std::move(columns));
+	reader.feed(data);
+	return reader.take();
+}
+
+void write_columns(raw_writer &writer, std::vector<column> const &columns)
+{
+	size_t rows = columns.empty() ? 0 : columns[0].size();
+	for (auto const &data : columns)
+		if (data.size() != rows)
+		{
+			std::stringstream message;
+			message << "Column '" << data.get_name() << "' has " << data.size() << " rows, expected " << rows << ".";
+			throw std::runtime_error(message.str());
+		}
+
+	// Numbers are rendered as native primitives are
+	primitive scratch;
+	char buffer[32];
+	writer.array_begin();
+	for (size_t row = 0; row < rows; ++row)
+	{
+		writer.object_begin();
+		for (auto const &data : columns)
+		{
+			if (data.is_null(row)) continue;
+			writer.key(data.get_name());
+			switch (data.get_format())
+			{
+				case column::format::string:
+				{
+					auto const &offsets = data.get_offsets();
+					writer.primitive(data.get_text().data() + offsets[row], offsets[row + 1] - offsets[row]);
+					continue;
+				}
+				case column::format::integer: scratch.set_int(data.get_ints()[row]); break;
+				case column::format::unsigned_integer: scratch.set_uint(data.get_uints()[row]); break;
+				case column::format::decimal: scratch.set_double(data.get_doubles()[row]); break;
+				case column::format::boolean: scratch.set_bool(data.get_bools()[row] != 0); break;
+			}
+			writer.primitive(buffer, scratch.format_native(buffer));
+		}
+		writer.object_end();
+	}
+	writer.array_end();
+}
+
+std::string write_columns(std::vector<column> const &columns)
+{
+	raw_writer writer;
+	write_columns(writer, columns);
+	return writer.dump();
+}
+
+}
@@ -0,0 +1,122 @@
+#ifndef luxem_cxx_columnar_h
+#define luxem_cxx_columnar_h
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <unordered_map>
+
+#include "read.h"
+#include "write.h"
+
+namespace luxem
+{
+
+// One field of a run of flat records, stored contiguously by type
+struct column
+{
+	enum class format : uint8_t
+	{
+		string,
+		integer,
+		unsigned_integer,
+		decimal,
+		boolean
+	};
+
+	column(std::string const &name, format data_format, bool nullable = false);
+
+	std::string const &get_name(void) const;
+	format get_format(void) const;
+	bool is_nullable(void) const;
+
+	size_t size(void) const;
+	void clear(void);
+	void reserve(size_t rows);
+
+	// Only the vector matching the format is filled; null rows hold 0 or an empty string
+	std::vector<int64_t> const &get_ints(void) const;
+	std::vector<uint64_t> const &get_uints(void) const;
+	std::vector<double> const &get_doubles(void) const;
+	// Bytes rather than std::vector<bool>, so the data is addressable
+	std::vector<uint8_t> const &get_bools(void) const;
+	// Strings are packed end to end; row r is text[offsets[r], offsets[r + 1])
+	std::string const &get_text(void) const;
+	std::vector<uint64_t> const &get_offsets(void) const;
+	std::string get_string(size_t row) const;
+	// Empty unless nullable, otherwise 1 for rows with a value
+	std::vector<uint8_t> const &get_present(void) const;
+	bool is_null(size_t row) const;
+
+	void push_int(int64_t data);
+	void push_uint(uint64_t data);
+	void push_double(double data);
+	void push_bool(bool data);
+	void push_string(char const *pointer, size_t length);
+	void push_string(std::string const &data);
+	void push_null(void);
+
+	// PRIVATE
+		std::string name;
+		format data_format;
+		bool nullable;
+		size_t rows;
+		std::vector<int64_t> ints;
+		std::vector<uint64_t> uints;
+		std::vector<double> doubles;
+		std::vector<uint8_t> bools;
+		std::string text;
+		std::vector<uint64_t> offsets;
+		std::vector<uint8_t> present;
+
+		void expect(format wanted) const;
+		void push_present(bool has_value);
+		// Parses primitive text straight into the column
+		void push_text(std::string const &data, size_t row);
+};
+
+// Reads objects at the top level or in top-level arrays into columns, without building records
+struct columnar_reader : raw_reader
+{
+	columnar_reader(std::vector<column> &&columns);
+
+	// Members without a column are an error unless ignored
+	columnar_reader &set_ignore_unknown(bool ignore);
+
+	size_t get_row_count(void) const;
+	std::vector<column> &get_columns(void);
+	column &get_column(std::string const &name);
+	// Moves the columns out, leaving empty ones with the same spec
+	std::vector<column> take(void);
+
+	// PRIVATE
+		std::vector<column> columns;
+		std::unordered_map<std::string, size_t> lookup;
+		bool ignore_unknown;
+		size_t depth;
+		size_t row_depth;
+		bool in_array;
+		bool in_row;
+		size_t rows;
+		// Records usually list their fields in the same order, so the next column is guessed before hashing
+		size_t guess;
+		size_t current;
+		std::vector<size_t> filled;
+
+		void begin(bool is_object);
+		void end(bool is_array);
+		void take_primitive(std::string &&data);
+		void row_end(void);
+		void find_column(std::string const &key);
+		void fail_row(std::string const &problem) const;
+};
+
+std::vector<column> read_columns(std::string const &data, std::vector<column> &&columns);
+
+// Writes an array with one object per row; null members are left out
+void write_columns(raw_writer &writer, std::vector<column> const &columns);
+std::string write_columns(std::vector<column> const &columns);
+
+}
+
+#endif
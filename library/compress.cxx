@@ -0,0 +1,557 @@
+#include "compress.h"
+
+#include <sstream>
+#include <stdexcept>
+#include <algorithm>
+#include <climits>
+#include <cstring>
+#include <cerrno>
+
+#include <unistd.h>
+
+#ifdef LUXEM_CXX_ZLIB
+#include <zlib.h>
+#endif
+#ifdef LUXEM_CXX_ZSTD
+#include <zstd.h>
+#endif
+
+#include "stream.h"
+
+namespace luxem
+{
+
+static size_t const input_size = 1 << 16;
+static size_t const output_size = 1 << 16;
+
+static char const *get_name(compression format)
+{
+	switch (format)
+	{
+		case compression::automatic: return "automatic";
+		case compression::none: return "none";
+		case compression::gzip: return "gzip";
+		case compression::zstd: return "zstd";
+	}
+	return "unknown";
+}
+
+static void throw_unsupported(compression format)
+{
+	std::stringstream message;
+	message << "Support for " << get_name(format) << " compression was not built.";
+	throw std::runtime_error(message.str());
+}
+
+bool compression_supported(compression format)
+{
+	switch (format)
+	{
+		case compression::automatic: return true;
+		case compression::none: return true;
+#ifdef LUXEM_CXX_ZLIB
+		case compression::gzip: return true;
+#endif
+#ifdef LUXEM_CXX_ZSTD
+		case compression::zstd: return true;
+#endif
+		default: return false;
+	}
+}
+
+compression detect_compression(char const *pointer, size_t length)
+{
+	auto bytes = reinterpret_cast<unsigned char const *>(pointer);
+	if ((length >= 2) && (bytes[0] == 0x1f) && (bytes[1] == 0x8b)) return compression::gzip;
+	if ((length >= 4) && (bytes[0] == 0x28) && (bytes[1] == 0xb5) && (bytes[2] == 0x2f) && (bytes[3] == 0xfd))
+		return compression::zstd;
+	return compression::none;
+}
+
+struct decompressor::codec
+{
+	virtual ~codec(void) {}
+	virtual void process(char const *&input, size_t &input_length, char *&output, size_t &output_length) = 0;
+	// True between compressed frames, where the input may legitimately end
+	virtual bool at_boundary(void) const = 0;
+};
+
+struct compressor::codec
+{
+	virtual ~codec(void) {}
+	// Returns true once a finishing call has flushed everything
+	virtual bool process(char const *&input, size_t &input_length, char *&output, size_t &output_length, bool finish) = 0;
+};
+
+namespace
+{
+
+struct plain_decoder : decompressor::codec
+{
+	void process(char const *&input, size_t &input_length, char *&output, size_t &output_length) override
+	{
+		auto length = std::min(input_length, output_length);
+		std::memcpy(output, input, length);
+		input += length;
+		input_length -= length;
+		output += length;
+		output_length -= length;
+	}
+
+	bool at_boundary(void) const override { return true; }
+};
+
+struct plain_encoder : compressor::codec
+{
+	bool process(char const *&input, size_t &input_length, char *&output, size_t &output_length, bool) override
+	{
+		auto length = std::min(input_length, output_length);
+		std::memcpy(output, input, length);
+		input += length;
+		input_length -= length;
+		output += length;
+		output_length -= length;
+		return input_length == 0;
+	}
+};
+
+#ifdef LUXEM_CXX_ZLIB
+static void throw_zlib_error(char const *action, z_stream const &stream)
+{
+	std::stringstream message;
+	message << "Failed to " << action << " gzip data";
+	if (stream.msg) message << ": " << stream.msg;
+	message << ".";
+	throw std::runtime_error(message.str());
+}
+
+struct gzip_decoder : decompressor::codec
+{
+	z_stream stream;
+	bool boundary;
+
+	gzip_decoder(void) : boundary(true)
+	{
+		std::memset(&stream, 0, sizeof(stream));
+		if (inflateInit2(&stream, 15 + 32) != Z_OK) throw_zlib_error("initialize", stream);
+	}
+
+	~gzip_decoder(void) { inflateEnd(&stream); }
+
+	void process(char const *&input, size_t &input_length, char *&output, size_t &output_length) override
+	{
+		if ((input_length == 0) && boundary) return;
+		stream.next_in = reinterpret_cast<Bytef *>(const_cast<char *>(input));
+		stream.avail_in = static_cast<uInt>(std::min<size_t>(input_length, UINT_MAX));
+		stream.next_out = reinterpret_cast<Bytef *>(output);
+		stream.avail_out = static_cast<uInt>(std::min<size_t>(output_length, UINT_MAX));
+		auto available_in = stream.avail_in;
+		auto available_out = stream.avail_out;
+		auto result = inflate(&stream, Z_NO_FLUSH);
+		size_t consumed = available_in - stream.avail_in;
+		size_t produced = available_out - stream.avail_out;
+		input += consumed;
+		input_length -= consumed;
+		output += produced;
+		output_length -= produced;
+		if (consumed > 0) boundary = false;
+		if (result == Z_STREAM_END)
+		{
+			// Concatenated members decode as one stream, like gunzip
+			if (inflateReset(&stream) != Z_OK) throw_zlib_error("decompress", stream);
+			boundary = true;
+		}
+		else if ((result != Z_OK) && (result != Z_BUF_ERROR)) throw_zlib_error("decompress", stream);
+	}
+
+	bool at_boundary(void) const override { return boundary; }
+};
+
+struct gzip_encoder : compressor::codec
+{
+	z_stream stream;
+
+	gzip_encoder(int level)
+	{
+		std::memset(&stream, 0, sizeof(stream));
+		if (deflateInit2(&stream, level == 0 ? Z_DEFAULT_COMPRESSION : level, Z_DEFLATED, 15 + 16, 8, Z_DEFAULT_STRATEGY) != Z_OK)
+			throw_zlib_error("initialize", stream);
+	}
+
+	~gzip_encoder(void) { deflateEnd(&stream); }
+
+	bool process(char const *&input, size_t &input_length, char *&output, size_t &output_length, bool finish) override
+	{
+		stream.next_in = reinterpret_cast<Bytef *>(const_cast<char *>(input));
+		stream.avail_in = static_cast<uInt>(std::min<size_t>(input_length, UINT_MAX));
+		stream.next_out = reinterpret_cast<Bytef *>(output);
+		stream.avail_out = static_cast<uInt>(std::min<size_t>(output_length, UINT_MAX));
+		auto available_in = stream.avail_in;
+		auto available_out = stream.avail_out;
+		auto result = deflate(&stream, finish ? Z_FINISH : Z_NO_FLUSH);
+		size_t consumed = available_in - stream.avail_in;
+		size_t produced = available_out - stream.avail_out;
+		input += consumed;
+		input_length -= consumed;
+		output += produced;
+		output_length -= produced;
+		if (result == Z_STREAM_END) return true;
+		if ((result != Z_OK) && (result != Z_BUF_ERROR)) throw_zlib_error("compress", stream);
+		return false;
+	}
+};
+#endif
+
+#ifdef LUXEM_CXX_ZSTD
+static void check_zstd(size_t result, char const *action)
+{
+	if (!ZSTD_isError(result)) return;
+	std::stringstream message;
+	message << "Failed to " << action << " zstd data: " << ZSTD_getErrorName(result) << ".";
+	throw std::runtime_error(message.str());
+}
+
+struct zstd_decoder : decompressor::codec
+{
+	ZSTD_DStream *stream;
+	bool boundary;
+
+	zstd_decoder(void) : stream(ZSTD_createDStream()), boundary(true)
+	{
+		if (!stream) throw std::runtime_error("Failed to initialize zstd data decompression.");
+		check_zstd(ZSTD_initDStream(stream), "initialize");
+	}
+
+	~zstd_decoder(void) { ZSTD_freeDStream(stream); }
+
+	void process(char const *&input, size_t &input_length, char *&output, size_t &output_length) override
+	{
+		if ((input_length == 0) && boundary) return;
+		ZSTD_inBuffer in{input, input_length, 0};
+		ZSTD_outBuffer out{output, output_length, 0};
+		auto result = ZSTD_decompressStream(stream, &out, &in);
+		check_zstd(result, "decompress");
+		input += in.pos;
+		input_length -= in.pos;
+		output += out.pos;
+		output_length -= out.pos;
+		// 0 means a frame was completed and fully flushed; concatenated frames continue transparently
+		if ((in.pos > 0) || (out.pos > 0)) boundary = result == 0;
+	}
+
+	bool at_boundary(void) const override { return boundary; }
+};
+
+struct zstd_encoder : compressor::codec
+{
+	ZSTD_CCtx *context;
+
+	zstd_encoder(int level) : context(ZSTD_createCCtx())
+	{
+		if (!context) throw std::runtime_error("Failed to initialize zstd data compression.");
+		if (level != 0) check_zstd(ZSTD_CCtx_setParameter(context, ZSTD_c_compressionLevel, level), "initialize");
+	}
+
+	~zstd_encoder(void) { ZSTD_freeCCtx(context); }
+
+	bool process(char const *&input, size_t &input_length, char *&output, size_t &output_length, bool finish) override
+	{
+		ZSTD_inBuffer in{input, input_length, 0};
+		ZSTD_outBuffer out{output, output_length, 0};
+		auto result = ZSTD_compressStream2(context, &out, &in, finish ? ZSTD_e_end : ZSTD_e_continue);
+		check_zstd(result, "compress");
+		input += in.pos;
+		input_length -= in.pos;
+		output += out.pos;
+		output_length -= out.pos;
+		return finish && (result == 0);
+	}
+};
+#endif
+
+}
+
+decompressor::decompressor(std::function<size_t(char *pointer, size_t length)> const &source, compression format) :
+	source(source),
+	format(format),
+	input(input_size),
+	input_head(0),
+	input_used(0),
+	input_end(false)
+{
+	start(format);
+}
+
+decompressor::decompressor(int descriptor, compression format) :
+	source([descriptor](char *pointer, size_t length)
+	{
+		while (true)
+		{
+			auto got = ::read(descriptor, pointer, length);
+			if (got >= 0) return static_cast<size_t>(got);
+			if (errno == EINTR) continue;
+			std::stringstream message;
+			message << "Failed to read compressed stream: " << strerror(errno);
+			throw std::runtime_error(message.str());
+		}
+	}),
+	format(format),
+	input(input_size),
+	input_head(0),
+	input_used(0),
+	input_end(false)
+{
+	start(format);
+}
+
+decompressor::~decompressor(void) {}
+
+void decompressor::start(compression format)
+{
+	if (format == compression::automatic)
+	{
+		while ((input_used < 4) && !input_end) refill();
+		format = detect_compression(input.data(), input_used);
+	}
+	this->format = format;
+	switch (format)
+	{
+		case compression::none: decoder = std::make_unique<plain_decoder>(); break;
+#ifdef LUXEM_CXX_ZLIB
+		case compression::gzip: decoder = std::make_unique<gzip_decoder>(); break;
+#endif
+#ifdef LUXEM_CXX_ZSTD
+		case compression::zstd: decoder = std::make_unique<zstd_decoder>(); break;
+#endif
+		default: throw_unsupported(format);
+	}
+}
+
+void decompressor::refill(void)
+{
+	if (input_head > 0)
+	{
+		std::memmove(input.data(), input.data() + input_head, input_used - input_head);
+		input_used -= input_head;
+		input_head = 0;
+	}
+	if (input_used == input.size()) input.resize(input.size() * 2);
+	auto got = source(input.data() + input_used, input.size() - input_used);
+	if (got == 0) input_end = true;
+	input_used += got;
+}
+
+size_t decompressor::read(char *pointer, size_t length)
+{
+	if (length == 0) return 0;
+	char *output = pointer;
+	size_t output_length = length;
+	while (true)
+	{
+		char const *next = input.data() + input_head;
+		size_t available = input_used - input_head;
+		decoder->process(next, available, output, output_length);
+		auto consumed = (input_used - input_head) - available;
+		input_head += consumed;
+		if (output_length < length) return length - output_length;
+		if (consumed > 0) continue;
+		if (input_end)
+		{
+			if ((input_head < input_used) || !decoder->at_boundary())
+			{
+				std::stringstream message;
+				message << "Compressed " << get_name(format) << " data is truncated or corrupt.";
+				throw std::runtime_error(message.str());
+			}
+			return 0;
+		}
+		refill();
+	}
+}
+
+compression decompressor::get_format(void) const { return format; }
+
+compressor::compressor(std::function<void(char const *pointer, size_t length)> const &sink, compression format, int level) :
+	sink(sink),
+	output(output_size),
+	finished(false)
+{
+	switch (format)
+	{
+		case compression::none: encoder = std::make_unique<plain_encoder>(); break;
+#ifdef LUXEM_CXX_ZLIB
+		case compression::gzip: encoder = std::make_unique<gzip_encoder>(level); break;
+#endif
+#ifdef LUXEM_CXX_ZSTD
+		case compression::zstd: encoder = std::make_unique<zstd_encoder>(level); break;
+#endif
+		default: throw_unsupported(format);
+	}
+	(void)level;
+}
+
+compressor::compressor(int descriptor, compression format, int level) :
+	compressor([descriptor](char const *pointer, size_t length)
+	{
+		while (length > 0)
+		{
+			auto wrote = ::write(descriptor, pointer, length);
+			if (wrote < 0)
+			{
+				if (errno == EINTR) continue;
+				std::stringstream message;
+				message << "Failed to write compressed stream: " << strerror(errno);
+				throw std::runtime_error(message.str());
+			}
+			pointer += wrote;
+			length -= static_cast<size_t>(wrote);
+		}
+	}, format, level)
+{
+}
+
+compressor::~compressor(void) {}
+
+void compressor::process(char const *pointer, size_t length, bool finish)
+{
+	while (true)
+	{
+		char *next = output.data();
+		size_t available = output.size();
+		auto done = encoder->process(pointer, length, next, available, finish);
+		auto produced = output.size() - available;
+		if (produced > 0) sink(output.data(), produced);
+		if (finish ? done : (length == 0)) return;
+	}
+}
+
+void compressor::write(char const *pointer, size_t length)
+{
+	if (finished) throw std::runtime_error("Writing to a finished compressed stream.");
+	process(pointer, length, false);
+}
+
+void compressor::write(std::string const &chunk) { write(chunk.data(), chunk.size()); }
+
+void compressor::finish(void)
+{
+	if (finished) return;
+	finished = true;
+	process(nullptr, 0, true);
+}
+
+background_source::background_source(
+	std::function<size_t(char *pointer, size_t length)> const &source,
+	size_t block_size,
+	size_t block_count) :
+	source(source),
+	blocks(std::max<size_t>(block_count, 1)),
+	current(nullptr),
+	current_offset(0),
+	ended(false),
+	stopping(false)
+{
+	for (auto &block : blocks)
+	{
+		block.data.resize(std::max<size_t>(block_size, 1));
+		block.length = 0;
+		free_blocks.push_back(&block);
+	}
+	producer = std::thread([this]() { produce(); });
+}
+
+background_source::~background_source(void)
+{
+	{
+		std::lock_guard<std::mutex> guard(mutex);
+		stopping = true;
+	}
+	changed.notify_all();
+	producer.join();
+}
+
+void background_source::produce(void)
+{
+	while (true)
+	{
+		block *target;
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+			changed.wait(lock, [this]() { return stopping || !free_blocks.empty(); });
+			if (stopping) return;
+			target = free_blocks.front();
+			free_blocks.pop_front();
+		}
+		size_t got = 0;
+		try
+		{
+			got = source(target->data.data(), target->data.size());
+		}
+		catch (...)
+		{
+			std::lock_guard<std::mutex> guard(mutex);
+			error = std::current_exception();
+			ended = true;
+			changed.notify_all();
+			return;
+		}
+		std::lock_guard<std::mutex> guard(mutex);
+		if (got == 0)
+		{
+			ended = true;
+			free_blocks.push_back(target);
+			changed.notify_all();
+			return;
+		}
+		target->length = got;
+		full_blocks.push_back(target);
+		changed.notify_all();
+	}
+}
+
+size_t background_source::read(char *pointer, size_t length)
+{
+	if (!current)
+	{
+		std::unique_lock<std::mutex> lock(mutex);
+		changed.wait(lock, [this]() { return !full_blocks.empty() || ended; });
+		if (full_blocks.empty())
+		{
+			if (error) std::rethrow_exception(error);
+			return 0;
+		}
+		current = full_blocks.front();
+		full_blocks.pop_front();
+		current_offset = 0;
+	}
+	auto count = std::min(length, current->length - current_offset);
+	std::memcpy(pointer, current->data.data() + current_offset, count);
+	current_offset += count;
+	if (current_offset == current->length)
+	{
+		{
+			std::lock_guard<std::mutex> guard(mutex);
+			free_blocks.push_back(current);
+		}
+		current = nullptr;
+		changed.notify_all();
+	}
+	return count;
+}
+
+void feed_compressed(raw_reader &reader, int descriptor, bool background, compression format)
+{
+	decompressor input(descriptor, format);
+	auto decompressed = [&input](char *pointer, size_t length) { return input.read(pointer, length); };
+	stream_feeder feeder(reader);
+	if (!background)
+	{
+		feeder.feed_all(decompressed);
+		return;
+	}
+	background_source overlapped(decompressed);
+	feeder.feed_all([&overlapped](char *pointer, size_t length) { return overlapped.read(pointer, length); });
+}
+
+}
+
@@ -0,0 +1,132 @@
+#ifndef luxem_cxx_compress_h
+#define luxem_cxx_compress_h
+
+#include <string>
+#include <vector>
+#include <deque>
+#include <memory>
+#include <functional>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <exception>
+
+#include "read.h"
+
+namespace luxem
+{
+
+// gzip needs LUXEM_CXX_ZLIB and zlib, zstd needs LUXEM_CXX_ZSTD and libzstd
+enum class compression
+{
+	automatic,
+	none,
+	gzip,
+	zstd
+};
+
+bool compression_supported(compression format);
+compression detect_compression(char const *pointer, size_t length);
+
+struct decompressor
+{
+	decompressor(std::function<size_t(char *pointer, size_t length)> const &source, compression format = compression::automatic);
+	decompressor(int descriptor, compression format = compression::automatic);
+	~decompressor(void);
+
+	decompressor(decompressor const &) = delete;
+	decompressor(decompressor &&) = delete;
+	decompressor &operator =(decompressor const &) = delete;
+	decompressor &operator =(decompressor &&) = delete;
+
+	// Same contract as a stream_feeder source, 0 means the end of the decompressed data
+	size_t read(char *pointer, size_t length);
+
+	compression get_format(void) const;
+
+	// PRIVATE
+		struct codec;
+
+		std::function<size_t(char *pointer, size_t length)> source;
+		compression format;
+		std::unique_ptr<codec> decoder;
+		std::vector<char> input;
+		size_t input_head;
+		size_t input_used;
+		bool input_end;
+
+		void refill(void);
+		void start(compression format);
+};
+
+struct compressor
+{
+	compressor(std::function<void(char const *pointer, size_t length)> const &sink, compression format, int level = 0);
+	compressor(int descriptor, compression format, int level = 0);
+	~compressor(void);
+
+	compressor(compressor const &) = delete;
+	compressor(compressor &&) = delete;
+	compressor &operator =(compressor const &) = delete;
+	compressor &operator =(compressor &&) = delete;
+
+	void write(char const *pointer, size_t length);
+	void write(std::string const &chunk);
+	// Must be called to complete the compressed stream
+	void finish(void);
+
+	// PRIVATE
+		struct codec;
+
+		std::function<void(char const *pointer, size_t length)> sink;
+		std::unique_ptr<codec> encoder;
+		std::vector<char> output;
+		bool finished;
+
+		void process(char const *pointer, size_t length, bool finish);
+};
+
+struct background_source
+{
+	background_source(
+		std::function<size_t(char *pointer, size_t length)> const &source,
+		size_t block_size = 1 << 18,
+		size_t block_count = 4);
+	~background_source(void);
+
+	background_source(background_source const &) = delete;
+	background_source(background_source &&) = delete;
+	background_source &operator =(background_source const &) = delete;
+	background_source &operator =(background_source &&) = delete;
+
+	size_t read(char *pointer, size_t length);
+
+	// PRIVATE
+		struct block
+		{
+			std::vector<char> data;
+			size_t length;
+		};
+
+		std::function<size_t(char *pointer, size_t length)> source;
+		std::vector<block> blocks;
+		std::deque<block *> free_blocks;
+		std::deque<block *> full_blocks;
+		block *current;
+		size_t current_offset;
+		bool ended;
+		bool stopping;
+		std::exception_ptr error;
+		std::mutex mutex;
+		std::condition_variable changed;
+		std::thread producer;
+
+		void produce(void);
+};
+
+void feed_compressed(raw_reader &reader, int descriptor, bool background = true, compression format = compression::automatic);
+
+}
+
+#endif
+
@@ -0,0 +1,231 @@
+#include "dedup.h"
+
+#include <functional>
+#include <algorithm>
+
+namespace luxem
+{
+
+static uint64_t mix(uint64_t hash, uint64_t data)
+	{ return hash ^ (data + 0x9e3779b97f4a7c15ull + (hash << 6) + (hash >> 2)); }
+
+static uint64_t hash_text(std::string const &text) { return std::hash<std::string>()(text); }
+
+// Children are interned already, so their addresses stand in for their contents
+static uint64_t hash_shallow(value const &data)
+{
+	uint64_t out = static_cast<uint64_t>(data.get_kind());
+	if (data.has_type()) out = mix(out, hash_text(data.get_type()));
+	switch (data.get_kind())
+	{
+		case value::kind::primitive:
+			return mix(out, hash_text(static_cast<primitive const &>(data).get_primitive()));
+		case value::kind::array:
+			for (auto const &element : static_cast<array const &>(data).get_data())
+				out = mix(out, reinterpret_cast<uintptr_t>(element.get()));
+			return out;
+		case value::kind::object:
+			for (auto const &member : static_cast<object const &>(data).get_data())
+				out = mix(mix(out, hash_text(member.first)), reinterpret_cast<uintptr_t>(member.second.get()));
+			return out;
+		default:
+			return mix(out, reinterpret_cast<uintptr_t>(&data));
+	}
+}
+
+static bool equal_shallow(value const &first, value const &second)
+{
+	if (first.get_kind() != second.get_kind()) return false;
+	if (first.has_type() != second.has_type()) return false;
+	if (first.has_type() && (first.get_type() != second.get_type())) return false;
+	switch (first.get_kind())
+	{
+		case value::kind::primitive:
+			return static_cast<primitive const &>(first).get_primitive() == static_cast<primitive const &>(second).get_primitive();
+		case value::kind::array:
+		{
+			auto const &left = static_cast<array const &>(first).get_data();
+			auto const &right = static_cast<array const &>(second).get_data();
+			if (left.size() != right.size()) return false;
+			for (size_t index = 0; index < left.size(); ++index)
+				if (left[index] != right[index]) return false;
+			return true;
+		}
+		case value::kind::object:
+		{
+			auto const &left = static_cast<object const &>(first).get_data();
+			auto const &right = static_cast<object const &>(second).get_data();
+			if (left.size() != right.size()) return false;
+			for (auto member = left.begin(), other = right.begin(); member != left.end(); ++member, ++other)
+				if ((member->first != other->first) || (member->second != other->second)) return false;
+			return true;
+		}
+		default:
+			return &first == &second;
+	}
+}
+
+static size_t const minimum_sweep = 1024;
+
+subtree_table::subtree_table(void) : hits(0), sweep_at(minimum_sweep) {}
+
+// A live entry keeps its children alive, so the child addresses it was hashed and compared by can't be reused
+std::shared_ptr<value> subtree_table::intern(std::shared_ptr<value> &&data)
+{
+	auto hash = hash_shallow(*data);
+	auto candidates = nodes.equal_range(hash);
+	for (auto candidate = candidates.first; candidate != candidates.second;)
+	{
+		auto existing = candidate->second.lock();
+		if (!existing)
+		{
+			candidate = nodes.erase(candidate);
+			continue;
+		}
+		if (equal_shallow(*existing, *data))
+		{
+			++hits;
+			return existing;
+		}
+		++candidate;
+	}
+	nodes.emplace(hash, data);
+	if (nodes.size() >= sweep_at) sweep();
+	return std::move(data);
+}
+
+void subtree_table::sweep(void)
+{
+	for (auto node = nodes.begin(); node != nodes.end();)
+	{
+		if (node->second.expired()) node = nodes.erase(node);
+		else ++node;
+	}
+	sweep_at = std::max(minimum_sweep, nodes.size() * 2);
+}
+
+size_t subtree_table::size(void) const
+{
+	size_t out = 0;
+	for (auto const &node : nodes) if (!node.second.expired()) ++out;
+	return out;
+}
+
+size_t subtree_table::get_hits(void) const { return hits; }
+
+void subtree_table::clear(void)
+{
+	nodes.clear();
+	hits = 0;
+	sweep_at = minimum_sweep;
+}
+
+void deduplicate(std::shared_ptr<value> &root, subtree_table &table)
+{
+	if (root->is<array>())
+		for (auto &element : root->as<array>().get_data()) deduplicate(element, table);
+	else if (root->is<object>())
+		for (auto &member : root->as<object>().get_data()) deduplicate(member.second, table);
+	root = table.intern(std::move(root));
+}
+
+void deduplicate(std::shared_ptr<value> &root)
+{
+	subtree_table table;
+	deduplicate(root, table);
+}
+
+// Text inside the string object itself, in the short string buffer, costs nothing extra
+static size_t text_bytes(std::string const &text)
+{
+	auto begin = reinterpret_cast<char const *>(&text);
+	if ((text.data() >= begin) && (text.data() < begin + sizeof(text))) return 0;
+	return text.capacity() + 1;
+}
+
+// make_shared puts the node after a control block of two counts and a vtable pointer
+static size_t const control_bytes = 2 * sizeof(void *);
+// Red-black tree nodes carry a color and three links
+static size_t const map_node_bytes = 4 * sizeof(void *);
+
+namespace
+{
+	// Totals are kept per distinct node, so shared subtrees are walked once however often they're referenced
+	struct measurer
+	{
+		struct totals
+		{
+			size_t nodes;
+			size_t bytes;
+		};
+
+		std::unordered_map<value const *, totals> seen;
+		memory_report report{0, 0, 0, 0};
+
+		void measure(value const &root)
+		{
+			auto out = visit(root);
+			report.nodes += out.nodes;
+			report.bytes += out.bytes;
+		}
+
+		totals visit(value const &data)
+		{
+			auto found = seen.find(&data);
+			if (found != seen.end()) return found->second;
+			size_t own = control_bytes;
+			totals children{0, 0};
+			if (data.has_type()) own += sizeof(std::string) + text_bytes(data.get_type());
+			switch (data.get_kind())
+			{
+				case value::kind::primitive:
+					own += sizeof(primitive) + text_bytes(static_cast<primitive const &>(data).get_primitive());
+					break;
+				case value::kind::array:
+				{
+					auto const &elements = static_cast<array const &>(data).get_data();
+					own += sizeof(array) + elements.capacity() * sizeof(std::shared_ptr<value>);
+					for (auto const &element : elements) add(children, visit(*element));
+					break;
+				}
+				case value::kind::object:
+					own += sizeof(object);
+					for (auto const &member : static_cast<object const &>(data).get_data())
+					{
+						own += map_node_bytes + sizeof(member) + text_bytes(member.first);
+						add(children, visit(*member.second));
+					}
+					break;
+				default:
+					break;
+			}
+			report.distinct_nodes += 1;
+			report.distinct_bytes += own;
+			totals out{children.nodes + 1, children.bytes + own};
+			seen.emplace(&data, out);
+			return out;
+		}
+
+		static void add(totals &out, totals const &child)
+		{
+			out.nodes += child.nodes;
+			out.bytes += child.bytes;
+		}
+	};
+}
+
+memory_report report_memory(value const &root)
+{
+	measurer state;
+	state.measure(root);
+	return state.report;
+}
+
+memory_report report_memory(std::vector<std::shared_ptr<value>> const &documents)
+{
+	measurer state;
+	for (auto const &document : documents) state.measure(*document);
+	return state.report;
+}
+
+}
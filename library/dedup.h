@@ -0,0 +1,56 @@
+#ifndef luxem_cxx_dedup_h
+#define luxem_cxx_dedup_h
+
+#include <cstdint>
+#include <memory>
+#include <vector>
+#include <unordered_map>
+
+#include "struct.h"
+
+namespace luxem
+{
+
+// Hash-consing for value trees; nodes shared through the table must not be modified afterwards.  Nodes are held weakly,
+// so only nodes still referenced elsewhere are shared, and the table never keeps a tree alive
+struct subtree_table
+{
+	subtree_table(void);
+
+	// Returns an existing node equal to data, or adds data; data's children should already be interned,
+	// since they're compared by address
+	std::shared_ptr<value> intern(std::shared_ptr<value> &&data);
+
+	// Nodes still alive
+	size_t size(void) const;
+	size_t get_hits(void) const;
+	void clear(void);
+
+	// PRIVATE
+		std::unordered_multimap<uint64_t, std::weak_ptr<value>> nodes;
+		size_t hits;
+		// Entries of freed nodes are swept out when the table reaches this size, so it stays within twice the live nodes
+		size_t sweep_at;
+
+		void sweep(void);
+};
+
+// Interns every subtree of root, children first, replacing them in place
+void deduplicate(std::shared_ptr<value> &root, subtree_table &table);
+void deduplicate(std::shared_ptr<value> &root);
+
+// Heap use estimates; totals count shared nodes once per reference, as if every copy were separate
+struct memory_report
+{
+	size_t nodes;
+	size_t distinct_nodes;
+	size_t bytes;
+	size_t distinct_bytes;
+};
+
+memory_report report_memory(value const &root);
+memory_report report_memory(std::vector<std::shared_ptr<value>> const &documents);
+
+}
+
+#endif
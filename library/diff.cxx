@@ -0,0 +1,463 @@
+#include "diff.h"
+
+#include <sstream>
+#include <stdexcept>
+#include <unordered_map>
+#include <functional>
+#include <algorithm>
+#include <string>
+
+namespace luxem
+{
+
+static std::string const set_name("set");
+static std::string const remove_name("remove");
+static std::string const insert_name("insert");
+static std::string const move_name("move");
+
+static size_t combine_hash(size_t seed, size_t value)
+	{ return seed ^ (value + 0x9e3779b97f4a7c15ull + (seed << 6) + (seed >> 2)); }
+
+struct differ
+{
+	ad &operations;
+	std::vector<std::string> location;
+	std::unordered_map<value const *, size_t> hashes;
+
+	differ(ad &operations) : operations(operations) {}
+
+	size_t hash(value const &node)
+	{
+		auto found = hashes.find(&node);
+		if (found != hashes.end()) return found->second;
+		size_t out = node.has_type() ? std::hash<std::string>()(node.get_type()) : 0;
+		if (node.is<primitive>())
+			out = combine_hash(combine_hash(out, 1), std::hash<std::string>()(node.as<primitive>().get_primitive()));
+		else if (node.is<object>())
+		{
+			out = combine_hash(out, 2);
+			for (auto &member : node.as<object>().get_data())
+			{
+				out = combine_hash(out, std::hash<std::string>()(member.first));
+				out = combine_hash(out, member.second ? hash(*member.second) : 0);
+			}
+		}
+		else if (node.is<array>())
+		{
+			out = combine_hash(out, 3);
+			for (auto &element : node.as<array>().get_data())
+				out = combine_hash(out, element ? hash(*element) : 0);
+		}
+		hashes.emplace(&node, out);
+		return out;
+	}
+
+	bool same(std::shared_ptr<value> const &first, std::shared_ptr<value> const &second)
+	{
+		if (first == second) return true;
+		if (!first || !second) return false;
+		if (hash(*first) != hash(*second)) return false;
+		return equal(*first, *second);
+	}
+
+	std::shared_ptr<array> operation(std::string const &name)
+	{
+		auto out = std::make_shared<array>(name, ad{});
+		auto &data = out->get_data();
+		data.reserve(location.size() + 2);
+		for (auto &element : location) data.emplace_back(std::make_shared<primitive>(std::string(element)));
+		operations.emplace_back(out);
+		return out;
+	}
+
+	void set(std::shared_ptr<value> const &to)
+		{ operation(set_name)->get_data().emplace_back(to); }
+
+	void compare(std::shared_ptr<value> const &from, std::shared_ptr<value> const &to)
+	{
+		if (from == to) return;
+		if (!from || !to ||
+			(from->has_type() != to->has_type()) ||
+			(from->has_type() && (from->get_type() != to->get_type())) ||
+			(from->get_kind() != to->get_kind()))
+		{
+			set(to);
+			return;
+		}
+		if (from->is<object>()) compare_object(from->as<object>().get_data(), to->as<object>().get_data());
+		else if (from->is<array>()) compare_array(from->as<array>().get_data(), to->as<array>().get_data());
+		else if (!same(from, to)) set(to);
+	}
+
+	void compare_object(od const &from, od const &to)
+	{
+		auto from_member = from.begin();
+		auto to_member = to.begin();
+		while ((from_member != from.end()) || (to_member != to.end()))
+		{
+			if ((to_member == to.end()) || ((from_member != from.end()) && (from_member->first < to_member->first)))
+			{
+				location.push_back(from_member->first);
+				operation(remove_name);
+				location.pop_back();
+				++from_member;
+			}
+			else if ((from_member == from.end()) || (to_member->first < from_member->first))
+			{
+				location.push_back(to_member->first);
+				set(to_member->second);
+				location.pop_back();
+				++to_member;
+			}
+			else
+			{
+				location.push_back(to_member->first);
+				compare(from_member->second, to_member->second);
+				location.pop_back();
+				++from_member;
+				++to_member;
+			}
+		}
+	}
+
+	void compare_array(ad const &from, ad const &to)
+	{
+		size_t prefix = 0;
+		while ((prefix < from.size()) && (prefix < to.size()) && same(from[prefix], to[prefix])) ++prefix;
+		size_t suffix = 0;
+		while ((suffix < from.size() - prefix) && (suffix < to.size() - prefix) &&
+			same(from[from.size() - 1 - suffix], to[to.size() - 1 - suffix])) ++suffix;
+		size_t from_end = from.size() - suffix;
+		size_t to_end = to.size() - suffix;
+		if ((prefix == from_end) && (prefix == to_end)) return;
+
+		size_t const unmatched = static_cast<size_t>(-1);
+		size_t const replaced = static_cast<size_t>(-2);
+		auto paired = [unmatched, replaced](size_t match) { return (match != unmatched) && (match != replaced); };
+		std::vector<size_t> from_match(from_end - prefix, unmatched);
+		std::vector<size_t> to_match(to_end - prefix, unmatched);
+		std::vector<bool> to_identical(to_end - prefix, false);
+
+		// Match unchanged elements, which may have moved
+		std::unordered_map<size_t, std::vector<size_t>> candidates;
+		for (size_t index = from_end; index > prefix; --index)
+			candidates[from[index - 1] ? hash(*from[index - 1]) : 0].push_back(index - 1);
+		for (size_t index = prefix; index < to_end; ++index)
+		{
+			auto found = candidates.find(to[index] ? hash(*to[index]) : 0);
+			if (found == candidates.end()) continue;
+			auto &indices = found->second;
+			for (size_t candidate = indices.size(); candidate > 0; --candidate)
+			{
+				auto from_index = indices[candidate - 1];
+				if (!same(from[from_index], to[index])) continue;
+				from_match[from_index - prefix] = index;
+				to_match[index - prefix] = from_index;
+				to_identical[index - prefix] = true;
+				indices.erase(indices.begin() + (candidate - 1));
+				break;
+			}
+		}
+
+		// Pair the remaining elements in order, so edits inside an element are diffed rather than replaced
+		{
+			size_t from_index = prefix;
+			size_t to_index = prefix;
+			while (true)
+			{
+				while ((from_index < from_end) && (from_match[from_index - prefix] != unmatched)) ++from_index;
+				while ((to_index < to_end) && (to_match[to_index - prefix] != unmatched)) ++to_index;
+				if ((from_index == from_end) || (to_index == to_end)) break;
+				if (from[from_index] && to[to_index] && (from[from_index]->get_kind() == to[to_index]->get_kind()))
+				{
+					from_match[from_index - prefix] = to_index;
+					to_match[to_index - prefix] = from_index;
+				}
+				else
+				{
+					from_match[from_index - prefix] = replaced;
+					to_match[to_index - prefix] = replaced;
+				}
+				++from_index;
+				++to_index;
+			}
+		}
+
+		for (size_t index = from_end; index > prefix; --index)
+		{
+			if (paired(from_match[index - 1 - prefix])) continue;
+			location.push_back(std::to_string(index - 1));
+			operation(remove_name);
+			location.pop_back();
+		}
+
+		// Elements in the longest run that kept its relative order stay put, and the rest are moved
+		std::vector<bool> stable(from_end - prefix, false);
+		{
+			std::vector<size_t> tails;
+			std::vector<size_t> predecessors(to_end - prefix, unmatched);
+			for (size_t index = prefix; index < to_end; ++index)
+			{
+				auto match = to_match[index - prefix];
+				if (!paired(match)) continue;
+				auto tail = std::lower_bound(tails.begin(), tails.end(), match,
+					[&to_match, prefix](size_t tail_index, size_t match) { return to_match[tail_index - prefix] < match; });
+				if (tail != tails.begin()) predecessors[index - prefix] = *(tail - 1);
+				if (tail == tails.end()) tails.push_back(index);
+				else *tail = index;
+			}
+			for (auto index = tails.empty() ? unmatched : tails.back(); index != unmatched; index = predecessors[index - prefix])
+				stable[to_match[index - prefix] - prefix] = true;
+		}
+
+		// Ids are from indices, or to indices offset by from.size() for inserted elements
+		std::vector<size_t> working;
+		working.reserve(to_end - prefix);
+		for (size_t index = prefix; index < from_end; ++index)
+			if (paired(from_match[index - prefix])) working.push_back(index);
+		auto position_of = [&working](size_t id)
+			{ return static_cast<size_t>(std::find(working.begin(), working.end(), id) - working.begin()); };
+		auto id_of = [&to_match, &paired, prefix, &from](size_t index)
+		{
+			auto match = to_match[index - prefix];
+			return paired(match) ? match : from.size() + index;
+		};
+
+		// Each moved or inserted element is placed directly after its new predecessor
+		for (size_t index = prefix; index < to_end; ++index)
+		{
+			auto match = to_match[index - prefix];
+			if (paired(match) && stable[match - prefix]) continue;
+			size_t destination = index == prefix ? 0 : position_of(id_of(index - 1)) + 1;
+			if (!paired(match))
+			{
+				location.push_back(std::to_string(prefix + destination));
+				operation(insert_name)->get_data().emplace_back(to[index]);
+				location.pop_back();
+				working.insert(working.begin() + destination, id_of(index));
+				continue;
+			}
+			auto position = position_of(match);
+			if (position < destination) --destination;
+			if (position == destination) continue;
+			auto move = operation(move_name);
+			move->get_data().emplace_back(std::make_shared<primitive>(std::to_string(prefix + position)));
+			move->get_data().emplace_back(std::make_shared<primitive>(std::to_string(prefix + destination)));
+			working.erase(working.begin() + position);
+			working.insert(working.begin() + destination, match);
+		}
+
+		for (size_t index = prefix; index < to_end; ++index)
+		{
+			auto match = to_match[index - prefix];
+			if (!paired(match) || to_identical[index - prefix]) continue;
+			location.push_back(std::to_string(index));
+			compare(from[match], to[index]);
+			location.pop_back();
+		}
+	}
+};
+
+bool equal(value const &first, value const &second)
+{
+	if (&first == &second) return true;
+	if (first.has_type() != second.has_type()) return false;
+	if (first.has_type() && (first.get_type() != second.get_type())) return false;
+	if (first.get_kind() != second.get_kind()) return false;
+	if (first.is<primitive>()) return first.as<primitive>().get_primitive() == second.as<primitive>().get_primitive();
+	if (first.is<object>())
+	{
+		auto &first_data = first.as<object>().get_data();
+		auto &second_data = second.as<object>().get_data();
+		if (first_data.size() != second_data.size()) return false;
+		for (auto first_member = first_data.begin(), second_member = second_data.begin();
+			first_member != first_data.end();
+			++first_member, ++second_member)
+		{
+			if (first_member->first != second_member->first) return false;
+			if (first_member->second == second_member->second) continue;
+			if (!first_member->second || !second_member->second) return false;
+			if (!equal(*first_member->second, *second_member->second)) return false;
+		}
+		return true;
+	}
+	if (first.is<array>())
+	{
+		auto &first_data = first.as<array>().get_data();
+		auto &second_data = second.as<array>().get_data();
+		if (first_data.size() != second_data.size()) return false;
+		for (size_t index = 0; index < first_data.size(); ++index)
+		{
+			if (first_data[index] == second_data[index]) continue;
+			if (!first_data[index] || !second_data[index]) return false;
+			if (!equal(*first_data[index], *second_data[index])) return false;
+		}
+		return true;
+	}
+	std::stringstream message;
+	message << "Encountered uncomparable type " << first.get_name() << " while trying to compare trees.";
+	throw std::runtime_error(message.str());
+}
+
+std::shared_ptr<value> clone(std::shared_ptr<value> const &root)
+{
+	if (!root) return {};
+	std::shared_ptr<value> out;
+	if (root->is<primitive>())
+		out = std::make_shared<primitive>(std::string(root->as<primitive>().get_primitive()));
+	else if (root->is<object>())
+	{
+		od data;
+		for (auto &member : root->as<object>().get_data())
+			data.emplace_hint(data.end(), member.first, clone(member.second));
+		out = std::make_shared<object>(std::move(data));
+	}
+	else if (root->is<array>())
+	{
+		ad data;
+		data.reserve(root->as<array>().get_data().size());
+		for (auto &element : root->as<array>().get_data()) data.emplace_back(clone(element));
+		out = std::make_shared<array>(std::move(data));
+	}
+	else
+	{
+		std::stringstream message;
+		message << "Encountered uncopyable type " << root->get_name() << " while trying to copy tree.";
+		throw std::runtime_error(message.str());
+	}
+	if (root->has_type()) out->set_type(root->get_type());
+	return out;
+}
+
+std::shared_ptr<array> diff(std::shared_ptr<value> const &from, std::shared_ptr<value> const &to)
+{
+	auto out = std::make_shared<array>();
+	differ(out->get_data()).compare(from, to);
+	return out;
+}
+
+static void throw_patch_error(ad const &operation, size_t level, char const *problem)
+{
+	std::stringstream message;
+	message << "Patch " << problem << " at ";
+	for (size_t index = 0; index < level; ++index)
+		message << "/" << operation[index]->as<primitive>().get_primitive();
+	throw std::runtime_error(message.str());
+}
+
+static size_t parse_index(ad const &operation, size_t level, size_t bound)
+{
+	auto &text = operation[level]->as<primitive>().get_primitive();
+	size_t index = 0;
+	if (text.empty()) throw_patch_error(operation, level + 1, "has invalid index");
+	for (auto character : text)
+	{
+		if ((character < '0') || (character > '9')) throw_patch_error(operation, level + 1, "has invalid index");
+		index = index * 10 + (character - '0');
+	}
+	if (index >= bound) throw_patch_error(operation, level + 1, "index is out of range");
+	return index;
+}
+
+static std::shared_ptr<value> &resolve(std::shared_ptr<value> &root, ad const &operation, size_t depth)
+{
+	std::shared_ptr<value> *current = &root;
+	for (size_t level = 0; level < depth; ++level)
+	{
+		if (!*current) throw_patch_error(operation, level, "path doesn't exist");
+		auto &node = **current;
+		if (node.is<object>())
+		{
+			auto &data = node.as<object>().get_data();
+			auto found = data.find(operation[level]->as<primitive>().get_primitive());
+			if (found == data.end()) throw_patch_error(operation, level + 1, "path doesn't exist");
+			current = &found->second;
+		}
+		else if (node.is<array>())
+		{
+			auto &data = node.as<array>().get_data();
+			current = &data[parse_index(operation, level, data.size())];
+		}
+		else throw_patch_error(operation, level, "path descends into a primitive");
+	}
+	return *current;
+}
+
+static ad &resolve_array(std::shared_ptr<value> &root, ad const &operation, size_t depth)
+{
+	auto &container = resolve(root, operation, depth);
+	if (!container || !container->is<array>()) throw_patch_error(operation, depth, "expected an array");
+	return container->as<array>().get_data();
+}
+
+void apply(std::shared_ptr<value> &root, std::shared_ptr<value> const &patch)
+{
+	for (auto &element : patch->as<array>().get_data())
+	{
+		auto &operation = element->as<array>().get_data();
+		if (!element->has_type()) throw std::runtime_error("Patch operation has no type.");
+		auto &name = element->get_type();
+		if (name == set_name)
+		{
+			if (operation.empty()) throw std::runtime_error("Patch set operation has no value.");
+			auto depth = operation.size() - 1;
+			if (depth == 0)
+			{
+				root = clone(operation.back());
+				continue;
+			}
+			auto &parent = resolve(root, operation, depth - 1);
+			if (parent && parent->is<object>())
+				parent->as<object>().get_data()[operation[depth - 1]->as<primitive>().get_primitive()] = clone(operation.back());
+			else if (parent && parent->is<array>())
+			{
+				auto &data = parent->as<array>().get_data();
+				data[parse_index(operation, depth - 1, data.size())] = clone(operation.back());
+			}
+			else throw_patch_error(operation, depth - 1, "expected a container");
+		}
+		else if (name == remove_name)
+		{
+			if (operation.empty()) throw std::runtime_error("Patch remove operation has no path.");
+			auto depth = operation.size();
+			auto &parent = resolve(root, operation, depth - 1);
+			if (parent && parent->is<object>())
+			{
+				if (parent->as<object>().get_data().erase(operation[depth - 1]->as<primitive>().get_primitive()) == 0)
+					throw_patch_error(operation, depth, "path doesn't exist");
+			}
+			else if (parent && parent->is<array>())
+			{
+				auto &data = parent->as<array>().get_data();
+				data.erase(data.begin() + parse_index(operation, depth - 1, data.size()));
+			}
+			else throw_patch_error(operation, depth - 1, "expected a container");
+		}
+		else if (name == insert_name)
+		{
+			if (operation.size() < 2) throw std::runtime_error("Patch insert operation needs an index and a value.");
+			auto depth = operation.size() - 1;
+			auto &data = resolve_array(root, operation, depth - 1);
+			data.insert(data.begin() + parse_index(operation, depth - 1, data.size() + 1), clone(operation.back()));
+		}
+		else if (name == move_name)
+		{
+			if (operation.size() < 2) throw std::runtime_error("Patch move operation needs two indices.");
+			auto depth = operation.size() - 2;
+			auto &data = resolve_array(root, operation, depth);
+			auto from = parse_index(operation, depth, data.size());
+			auto to = parse_index(operation, depth + 1, data.size());
+			if (from > to) std::rotate(data.begin() + to, data.begin() + from, data.begin() + from + 1);
+			else std::rotate(data.begin() + from, data.begin() + from + 1, data.begin() + to + 1);
+		}
+		else
+		{
+			std::stringstream message;
+			message << "Unknown patch operation '" << name << "'.";
+			throw std::runtime_error(message.str());
+		}
+	}
+}
+
+}
+
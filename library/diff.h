@@ -0,0 +1,20 @@
+#ifndef luxem_cxx_diff_h
+#define luxem_cxx_diff_h
+
+#include <memory>
+
+#include "struct.h"
+
+namespace luxem
+{
+
+std::shared_ptr<array> diff(std::shared_ptr<value> const &from, std::shared_ptr<value> const &to);
+void apply(std::shared_ptr<value> &root, std::shared_ptr<value> const &patch);
+
+bool equal(value const &first, value const &second);
+std::shared_ptr<value> clone(std::shared_ptr<value> const &root);
+
+}
+
+#endif
+
@@ -0,0 +1,538 @@
+#include "image.h"
+
+#include <sstream>
+#include <stdexcept>
+#include <unordered_map>
+#include <cstring>
+#include <cerrno>
+#include <cstdlib>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <strings.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+
+#include "misc.h"
+
+namespace luxem
+{
+
+// Layout, all integers little endian and every node and string 8 byte aligned:
+// header: magic, version, 3 zero bytes, u64 image size, u64 document count, u64 offset of the root offsets
+// string: u64 length, bytes, NUL
+// node: u8 kind, u8 native kind, 6 zero bytes, u64 type string offset or 0, then
+//   primitive: u64 text string offset, u64 native number bits
+//   array: u64 count, count u64 element offsets
+//   object: u64 count, count pairs of u64 key string offset and u64 value offset, sorted by key
+static char const image_magic[] = {'l', 'x', 'i', 'm'};
+static unsigned char const image_version = 1;
+static size_t const header_size = 32;
+
+enum : uint8_t
+{
+	primitive_node = 1,
+	object_node = 2,
+	array_node = 3
+};
+
+static void throw_file_error(char const *action)
+{
+	std::stringstream message;
+	message << "Failed to " << action << ": " << strerror(errno);
+	throw std::runtime_error(message.str());
+}
+
+static void throw_corrupt(void)
+	{ throw std::runtime_error("Image is truncated or corrupt."); }
+
+static bool little_endian(void)
+{
+	uint16_t probe = 1;
+	char first;
+	std::memcpy(&first, &probe, 1);
+	return first == 1;
+}
+
+static uint64_t load(char const *base, size_t length, uint64_t offset)
+{
+	if ((offset > length) || (length - offset < 8)) throw_corrupt();
+	uint64_t out;
+	std::memcpy(&out, base + offset, 8);
+	return out;
+}
+
+struct image_builder
+{
+	std::string out;
+	std::unordered_map<std::string, uint64_t> strings;
+
+	image_builder(void) : out(header_size, '\0')
+	{
+		if (!little_endian()) throw std::runtime_error("Images can only be built on little endian machines.");
+	}
+
+	void align(void) { out.resize((out.size() + 7) / 8 * 8, '\0'); }
+
+	void put(uint64_t data)
+	{
+		char bytes[8];
+		std::memcpy(bytes, &data, 8);
+		out.append(bytes, 8);
+	}
+
+	void put_header(uint8_t kind, uint8_t native)
+	{
+		align();
+		out.push_back(static_cast<char>(kind));
+		out.push_back(static_cast<char>(native));
+		out.append(6, '\0');
+	}
+
+	// Keys and types repeat a lot, so each distinct string is stored once
+	uint64_t string(std::string const &text)
+	{
+		auto found = strings.find(text);
+		if (found != strings.end()) return found->second;
+		align();
+		uint64_t offset = out.size();
+		put(text.size());
+		out.append(text);
+		out.push_back('\0');
+		strings.emplace(text, offset);
+		return offset;
+	}
+
+	uint64_t type_of(value const &data) { return data.has_type() ? string(data.get_type()) : 0; }
+
+	uint64_t leaf(primitive const &data)
+	{
+		auto type = type_of(data);
+		uint64_t text;
+		if (data.has_text()) text = string(data.get_primitive());
+		else
+		{
+			char buffer[32];
+			text = string(std::string(buffer, data.format_native(buffer)));
+		}
+		uint64_t bits = 0;
+		switch (data.get_native_kind())
+		{
+			case primitive::native_kind::signed_integer: { auto number = data.get_int(); std::memcpy(&bits, &number, 8); break; }
+			case primitive::native_kind::unsigned_integer: bits = data.get_uint(); break;
+			case primitive::native_kind::floating: { auto number = data.get_double(); std::memcpy(&bits, &number, 8); break; }
+			case primitive::native_kind::boolean: bits = data.get_bool() ? 1 : 0; break;
+			default: break;
+		}
+		put_header(primitive_node, static_cast<uint8_t>(data.get_native_kind()));
+		uint64_t offset = out.size() - 8;
+		put(type);
+		put(text);
+		put(bits);
+		return offset;
+	}
+
+	// Children are written before their parent, so every offset is known when the parent is written
+	uint64_t tree(value const &root)
+	{
+		struct frame
+		{
+			value const *data;
+			std::vector<value const *> children;
+			std::vector<uint64_t> offsets;
+			size_t next;
+		};
+		auto open = [](value const &data)
+		{
+			frame out{&data, {}, {}, 0};
+			if (data.is<array>())
+				for (auto const &element : data.as<array>().get_data()) out.children.push_back(element.get());
+			else if (data.is<object>())
+				for (auto const &member : data.as<object>().get_data()) out.children.push_back(member.second.get());
+			else
+			{
+				std::stringstream message;
+				message << "Encountered unwritable type " << data.get_name() << " while trying to build image.";
+				throw std::runtime_error(message.str());
+			}
+			return out;
+		};
+
+		if (root.is<primitive>()) return leaf(root.as<primitive>());
+		std::vector<frame> stack;
+		stack.push_back(open(root));
+		while (true)
+		{
+			auto &top = stack.back();
+			if (top.next < top.children.size())
+			{
+				auto child = top.children[top.next++];
+				if (!child) throw std::runtime_error("Can't build an image of a null value.");
+				if (child->is<primitive>()) top.offsets.push_back(leaf(child->as<primitive>()));
+				else stack.push_back(open(*child));
+				continue;
+			}
+
+			auto type = type_of(*top.data);
+			uint64_t offset;
+			if (top.data->is<array>())
+			{
+				put_header(array_node, 0);
+				offset = out.size() - 8;
+				put(type);
+				put(top.offsets.size());
+				for (auto child : top.offsets) put(child);
+			}
+			else
+			{
+				std::vector<uint64_t> keys;
+				for (auto const &member : top.data->as<object>().get_data()) keys.push_back(string(member.first));
+				put_header(object_node, 0);
+				offset = out.size() - 8;
+				put(type);
+				put(top.offsets.size());
+				for (size_t index = 0; index < keys.size(); ++index)
+				{
+					put(keys[index]);
+					put(top.offsets[index]);
+				}
+			}
+			stack.pop_back();
+			if (stack.empty()) return offset;
+			stack.back().offsets.push_back(offset);
+		}
+	}
+
+	std::string finish(std::vector<uint64_t> const &roots)
+	{
+		align();
+		uint64_t roots_offset = out.size();
+		for (auto root : roots) put(root);
+		uint64_t fields[] = {out.size(), roots.size(), roots_offset};
+		std::memcpy(&out[0], image_magic, sizeof(image_magic));
+		out[sizeof(image_magic)] = static_cast<char>(image_version);
+		std::memcpy(&out[8], fields, sizeof(fields));
+		return std::move(out);
+	}
+};
+
+std::string build_image(value const &data)
+{
+	image_builder builder;
+	std::vector<uint64_t> roots{builder.tree(data)};
+	return builder.finish(roots);
+}
+
+std::string build_image(std::vector<std::shared_ptr<value>> const &documents)
+{
+	image_builder builder;
+	std::vector<uint64_t> roots;
+	for (auto const &document : documents) roots.push_back(builder.tree(*document));
+	return builder.finish(roots);
+}
+
+void write_image(std::vector<std::shared_ptr<value>> const &documents, FILE *file)
+{
+	auto data = build_image(documents);
+	if (fwrite(data.data(), 1, data.size(), file) != data.size()) throw_file_error("write image");
+}
+
+void save_image(std::vector<std::shared_ptr<value>> const &documents, std::string const &path)
+{
+	auto temporary = path + ".tmp";
+	FILE *file = fopen(temporary.c_str(), "wb");
+	if (!file) throw_file_error("open image");
+	{
+		finally cleanup([file]() { fclose(file); });
+		write_image(documents, file);
+		if (fflush(file) != 0) throw_file_error("write image");
+	}
+	if (std::rename(temporary.c_str(), path.c_str()) != 0) throw_file_error("replace image");
+}
+
+bool image_text::operator ==(std::string const &other) const
+	{ return (length == other.size()) && (std::memcmp(pointer, other.data(), length) == 0); }
+
+std::string image_text::str(void) const { return std::string(pointer, length); }
+
+image_node::image_node(char const *base, size_t length, uint64_t offset) : base(base), length(length), offset(offset)
+{
+	if ((offset < header_size) || (offset % 8 != 0)) throw_corrupt();
+	auto kind = this->kind();
+	if ((kind != primitive_node) && (kind != object_node) && (kind != array_node)) throw_corrupt();
+}
+
+uint8_t image_node::kind(void) const
+{
+	if (offset >= length) throw_corrupt();
+	return static_cast<uint8_t>(base[offset]);
+}
+
+uint64_t image_node::field(size_t index) const { return load(base, length, offset + 8 + index * 8); }
+
+image_text image_node::text(uint64_t offset) const
+{
+	auto size = load(base, length, offset);
+	if (length - offset - 8 <= size) throw_corrupt();
+	return image_text{base + offset + 8, static_cast<size_t>(size)};
+}
+
+bool image_node::is_primitive(void) const { return kind() == primitive_node; }
+bool image_node::is_object(void) const { return kind() == object_node; }
+bool image_node::is_array(void) const { return kind() == array_node; }
+
+bool image_node::has_type(void) const { return field(0) != 0; }
+
+image_text image_node::get_type(void) const
+{
+	if (!has_type()) throw std::runtime_error("Image value has no type.");
+	return text(field(0));
+}
+
+size_t image_node::size(void) const
+{
+	if (is_primitive()) throw std::runtime_error("Image primitive has no elements.");
+	return static_cast<size_t>(field(1));
+}
+
+image_node image_node::operator [](size_t index) const
+{
+	if (!is_array()) throw std::runtime_error("Expected array in image.");
+	if (index >= size()) throw std::runtime_error("Image array index out of range.");
+	return child(field(2 + index));
+}
+
+image_text image_node::get_key(size_t index) const
+{
+	if (!is_object()) throw std::runtime_error("Expected object in image.");
+	if (index >= size()) throw std::runtime_error("Image object index out of range.");
+	return text(field(2 + index * 2));
+}
+
+uint64_t image_node::find(std::string const &key) const
+{
+	if (!is_object()) throw std::runtime_error("Expected object in image.");
+	size_t low = 0, high = size();
+	while (low < high)
+	{
+		auto middle = low + (high - low) / 2;
+		auto candidate = text(field(2 + middle * 2));
+		auto common = std::min(candidate.length, key.size());
+		auto order = std::memcmp(candidate.pointer, key.data(), common);
+		if (order == 0) order = (candidate.length < key.size()) ? -1 : (candidate.length > key.size() ? 1 : 0);
+		if (order == 0) return field(3 + middle * 2);
+		if (order < 0) low = middle + 1;
+		else high = middle;
+	}
+	return 0;
+}
+
+bool image_node::has(std::string const &key) const { return find(key) != 0; }
+
+image_node image_node::operator [](std::string const &key) const
+{
+	auto found = find(key);
+	if (found == 0)
+	{
+		std::stringstream message;
+		message << "Image object has no key '" << key << "'.";
+		throw std::runtime_error(message.str());
+	}
+	return child(found);
+}
+
+// Children are always written before their parent, so an offset that doesn't point back could only form a cycle
+image_node image_node::child(uint64_t child_offset) const
+{
+	if (child_offset >= offset) throw_corrupt();
+	return image_node(base, length, child_offset);
+}
+
+image_text image_node::get_primitive(void) const
+{
+	if (!is_primitive()) throw std::runtime_error("Expected primitive in image.");
+	return text(field(1));
+}
+
+// Mirrors the conversions in primitive: stored natives are used directly, text is parsed
+int64_t image_node::get_int(void) const
+{
+	auto source = get_primitive();
+	auto bits = field(2);
+	double floating;
+	switch (static_cast<primitive::native_kind>(base[offset + 1]))
+	{
+		case primitive::native_kind::signed_integer:
+		case primitive::native_kind::unsigned_integer: return static_cast<int64_t>(bits);
+		case primitive::native_kind::floating: std::memcpy(&floating, &bits, 8); return static_cast<int64_t>(floating);
+		case primitive::native_kind::boolean: return bits ? 1 : 0;
+		default: return std::strtoll(source.pointer, nullptr, 10);
+	}
+}
+
+uint64_t image_node::get_uint(void) const
+{
+	auto source = get_primitive();
+	auto bits = field(2);
+	double floating;
+	switch (static_cast<primitive::native_kind>(base[offset + 1]))
+	{
+		case primitive::native_kind::signed_integer:
+		case primitive::native_kind::unsigned_integer: return bits;
+		case primitive::native_kind::floating: std::memcpy(&floating, &bits, 8); return static_cast<uint64_t>(floating);
+		case primitive::native_kind::boolean: return bits ? 1 : 0;
+		default: return std::strtoull(source.pointer, nullptr, 10);
+	}
+}
+
+double image_node::get_double(void) const
+{
+	auto source = get_primitive();
+	auto bits = field(2);
+	double floating;
+	switch (static_cast<primitive::native_kind>(base[offset + 1]))
+	{
+		case primitive::native_kind::signed_integer: return static_cast<double>(static_cast<int64_t>(bits));
+		case primitive::native_kind::unsigned_integer: return static_cast<double>(bits);
+		case primitive::native_kind::floating: std::memcpy(&floating, &bits, 8); return floating;
+		case primitive::native_kind::boolean: return bits ? 1 : 0;
+		default: return std::strtod(source.pointer, nullptr);
+	}
+}
+
+bool image_node::get_bool(void) const
+{
+	auto source = get_primitive();
+	auto bits = field(2);
+	double floating;
+	switch (static_cast<primitive::native_kind>(base[offset + 1]))
+	{
+		case primitive::native_kind::signed_integer:
+		case primitive::native_kind::unsigned_integer:
+		case primitive::native_kind::boolean: return bits != 0;
+		case primitive::native_kind::floating: std::memcpy(&floating, &bits, 8); return floating != 0;
+		default:
+			return (strcasecmp(source.pointer, "0") != 0) &&
+				(strcasecmp(source.pointer, "false") != 0) &&
+				(strcasecmp(source.pointer, "no") != 0);
+	}
+}
+
+std::shared_ptr<value> image_node::build(void) const
+{
+	auto leaf = [](image_node const &source)
+	{
+		auto out = std::make_shared<primitive>(source.get_primitive().str());
+		if (source.has_type()) out->set_type(source.get_type().str());
+		return out;
+	};
+	if (is_primitive()) return leaf(*this);
+
+	struct frame
+	{
+		image_node source;
+		size_t next;
+		size_t count;
+		array::array_data elements;
+		object::object_data members;
+	};
+	std::vector<frame> stack;
+	stack.push_back(frame{*this, 0, size(), {}, {}});
+	while (true)
+	{
+		auto &top = stack.back();
+		if (top.next < top.count)
+		{
+			auto index = top.next++;
+			auto child = top.source.is_array() ? top.source[index] : top.source.child(top.source.field(3 + index * 2));
+			std::shared_ptr<value> built;
+			if (child.is_primitive()) built = leaf(child);
+			else
+			{
+				stack.push_back(frame{child, 0, child.size(), {}, {}});
+				continue;
+			}
+			if (top.source.is_array()) top.elements.push_back(std::move(built));
+			else top.members.emplace(top.source.get_key(index).str(), std::move(built));
+			continue;
+		}
+
+		std::shared_ptr<value> built;
+		if (top.source.is_array()) built = std::make_shared<array>(std::move(top.elements));
+		else built = std::make_shared<object>(std::move(top.members));
+		if (top.source.has_type()) built->set_type(top.source.get_type().str());
+		stack.pop_back();
+		if (stack.empty()) return built;
+		auto &parent = stack.back();
+		if (parent.source.is_array()) parent.elements.push_back(std::move(built));
+		else parent.members.emplace(parent.source.get_key(parent.next - 1).str(), std::move(built));
+	}
+}
+
+image image::map(std::string const &path)
+{
+	int file = open(path.c_str(), O_RDONLY);
+	if (file < 0) throw_file_error("open image");
+	void *pointer;
+	size_t size;
+	{
+		finally cleanup([file]() { close(file); });
+		struct stat status;
+		if (fstat(file, &status) != 0) throw_file_error("stat image");
+		size = static_cast<size_t>(status.st_size);
+		if (size < header_size) throw_corrupt();
+		pointer = mmap(nullptr, size, PROT_READ, MAP_SHARED, file, 0);
+		if (pointer == MAP_FAILED) throw_file_error("map image");
+	}
+	try
+	{
+		image out(static_cast<char const *>(pointer), size);
+		out.mapped = true;
+		return out;
+	}
+	catch (...)
+	{
+		munmap(pointer, size);
+		throw;
+	}
+}
+
+image::image(char const *pointer, size_t length) : base(pointer), length(length), mapped(false)
+{
+	if (!little_endian()) throw std::runtime_error("Images can only be read on little endian machines.");
+	if ((length < header_size) || (std::memcmp(pointer, image_magic, sizeof(image_magic)) != 0))
+		throw std::runtime_error("Image has an unrecognized format.");
+	if (static_cast<unsigned char>(pointer[sizeof(image_magic)]) != image_version)
+		throw std::runtime_error("Image has an unsupported version.");
+	if (load(pointer, length, 8) != length) throw_corrupt();
+	count = load(pointer, length, 16);
+	roots = load(pointer, length, 24);
+	if ((roots > length) || ((length - roots) / 8 < count)) throw_corrupt();
+}
+
+image::image(image &&other) : base(other.base), length(other.length), mapped(other.mapped), count(other.count), roots(other.roots)
+{
+	other.base = nullptr;
+	other.mapped = false;
+}
+
+image::~image(void)
+	{ if (mapped) munmap(const_cast<char *>(base), length); }
+
+size_t image::size(void) const { return static_cast<size_t>(count); }
+
+image_node image::operator [](size_t index) const
+{
+	if (index >= count) throw std::runtime_error("Image document index out of range.");
+	return image_node(base, length, load(base, length, roots + index * 8));
+}
+
+std::vector<std::shared_ptr<value>> image::build(void) const
+{
+	std::vector<std::shared_ptr<value>> out;
+	out.reserve(count);
+	for (size_t index = 0; index < count; ++index) out.push_back((*this)[index].build());
+	return out;
+}
+
+}
@@ -0,0 +1,103 @@
+#ifndef luxem_cxx_image_h
+#define luxem_cxx_image_h
+
+#include <cstdio>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <memory>
+
+#include "struct.h"
+
+namespace luxem
+{
+
+// Document images hold trees with offsets instead of pointers, so they can be mapped and read in place
+
+std::string build_image(value const &data);
+std::string build_image(std::vector<std::shared_ptr<value>> const &documents);
+void write_image(std::vector<std::shared_ptr<value>> const &documents, FILE *file);
+// Written to a temporary file and renamed, so processes mapping the old image are unaffected
+void save_image(std::vector<std::shared_ptr<value>> const &documents, std::string const &path);
+
+// Points into the image; NUL terminated
+struct image_text
+{
+	char const *pointer;
+	size_t length;
+
+	bool operator ==(std::string const &other) const;
+	std::string str(void) const;
+};
+
+struct image_node
+{
+	bool is_primitive(void) const;
+	bool is_object(void) const;
+	bool is_array(void) const;
+
+	bool has_type(void) const;
+	image_text get_type(void) const;
+
+	// Elements or members
+	size_t size(void) const;
+	image_node operator [](size_t index) const;
+	image_text get_key(size_t index) const;
+
+	// Members are sorted by key and found by binary search
+	bool has(std::string const &key) const;
+	image_node operator [](std::string const &key) const;
+
+	image_text get_primitive(void) const;
+	// Numbers written from native primitives are read back without parsing
+	int64_t get_int(void) const;
+	uint64_t get_uint(void) const;
+	double get_double(void) const;
+	bool get_bool(void) const;
+
+	// Copies the subtree out of the image
+	std::shared_ptr<value> build(void) const;
+
+	// PRIVATE
+		char const *base;
+		size_t length;
+		uint64_t offset;
+
+		image_node(char const *base, size_t length, uint64_t offset);
+		uint8_t kind(void) const;
+		uint64_t field(size_t index) const;
+		image_text text(uint64_t offset) const;
+		uint64_t find(std::string const &key) const;
+		image_node child(uint64_t child_offset) const;
+
+		friend struct image;
+};
+
+struct image
+{
+	// Maps the file read-only; pages are shared with every other process mapping it
+	static image map(std::string const &path);
+	// Reads an image in memory owned by the caller
+	image(char const *pointer, size_t length);
+	image(image &&other);
+	image(image const &) = delete;
+	image &operator =(image const &) = delete;
+	image &operator =(image &&) = delete;
+	~image(void);
+
+	// Number of documents
+	size_t size(void) const;
+	image_node operator [](size_t index) const;
+	std::vector<std::shared_ptr<value>> build(void) const;
+
+	// PRIVATE
+		char const *base;
+		size_t length;
+		bool mapped;
+		uint64_t count;
+		uint64_t roots;
+};
+
+}
+
+#endif
@@ -0,0 +1,759 @@
+#include "index.h"
+
+#include <sstream>
+#include <stdexcept>
+#include <algorithm>
+#include <cstring>
+#include <cerrno>
+
+#include <sys/types.h>
+
+#include "misc.h"
+
+namespace luxem
+{
+
+static size_t const chunk_size = 1 << 16;
+static size_t const hash_window = 4096;
+static char const sidecar_magic[] = {'l', 'x', 'i', 'x'};
+static unsigned char const sidecar_version = 1;
+
+offset_scanner::offset_scanner(uint64_t position, bool unwrap_arrays) :
+	position(position),
+	current(state::between),
+	resume(state::between),
+	escaped(false),
+	unwrap_arrays(unwrap_arrays),
+	base(0),
+	depth(0)
+{
+}
+
+bool offset_scanner::scan(
+	char const *pointer,
+	size_t length,
+	std::function<bool(uint64_t offset)> const &begin,
+	std::function<bool(uint64_t offset)> const &end)
+{
+	size_t index = 0;
+	while (index < length)
+	{
+		char const character = pointer[index];
+		switch (current)
+		{
+			case state::between:
+				if (is_space(character) || (character == ','))
+					break;
+				if (character == '*')
+				{
+					resume = state::between;
+					current = state::comment;
+					break;
+				}
+				// Elements of an unwrapped array are at depth 1
+				if (unwrap_arrays && (base == 0) && (character == '['))
+				{
+					base = 1;
+					break;
+				}
+				if ((base == 1) && (character == ']'))
+				{
+					base = 0;
+					break;
+				}
+				current = state::element;
+				depth = base;
+				if (!begin(position + index))
+				{
+					position += index;
+					return false;
+				}
+				continue;
+
+			case state::element:
+				switch (character)
+				{
+					case '*': resume = state::element; current = state::comment; break;
+					case '(': current = state::type; break;
+					case '"': current = state::quote; break;
+					case '{': case '[': ++depth; break;
+					case '}': case ']':
+						if (depth > base) --depth;
+						if (depth == base)
+						{
+							current = state::between;
+							if (!end(position + index + 1))
+							{
+								position += index + 1;
+								return false;
+							}
+						}
+						break;
+					default:
+						if (!is_delimiter(character)) current = state::word;
+						break;
+				}
+				break;
+
+			case state::word:
+				if (!is_delimiter(character))
+					break;
+				if (depth > base)
+				{
+					current = state::element;
+					continue;
+				}
+				current = state::between;
+				if (!end(position + index))
+				{
+					position += index;
+					return false;
+				}
+				continue;
+
+			case state::quote:
+				if (escaped) escaped = false;
+				else if (character == '\\') escaped = true;
+				else if (character == '"')
+				{
+					if (depth > base)
+					{
+						current = state::element;
+						break;
+					}
+					current = state::between;
+					if (!end(position + index + 1))
+					{
+						position += index + 1;
+						return false;
+					}
+				}
+				break;
+
+			case state::type:
+				if (escaped) escaped = false;
+				else if (character == '\\') escaped = true;
+				else if (character == ')') current = state::element;
+				break;
+
+			case state::comment:
+				if (escaped) escaped = false;
+				else if (character == '\\') escaped = true;
+				else if (character == '*') current = resume;
+				break;
+		}
+		++index;
+	}
+	position += length;
+	return true;
+}
+
+bool offset_scanner::finish(std::function<bool(uint64_t offset)> const &end)
+{
+	if ((current != state::word) || (depth > base)) return true;
+	current = state::between;
+	return end(position);
+}
+
+uint64_t offset_scanner::get_position(void) const { return position; }
+
+static void throw_file_error(char const *action)
+{
+	std::stringstream message;
+	message << "Failed to " << action << ": " << strerror(errno);
+	throw std::runtime_error(message.str());
+}
+
+static void seek(FILE *file, uint64_t offset)
+	{ if (fseeko(file, static_cast<off_t>(offset), SEEK_SET) != 0) throw_file_error("seek in source"); }
+
+static uint64_t file_size(FILE *file)
+{
+	if (fseeko(file, 0, SEEK_END) != 0) throw_file_error("seek in source");
+	auto out = ftello(file);
+	if (out < 0) throw_file_error("get source size");
+	return static_cast<uint64_t>(out);
+}
+
+static size_t read_chunk(FILE *file, char *buffer, size_t length)
+{
+	auto out = fread(buffer, 1, length, file);
+	if ((out < length) && ferror(file)) throw_file_error("read source");
+	return out;
+}
+
+static uint64_t hash_range(FILE *file, uint64_t start, uint64_t stop)
+{
+	uint64_t out = 14695981039346656037ull;
+	char buffer[hash_window];
+	seek(file, start);
+	while (start < stop)
+	{
+		auto got = read_chunk(file, buffer, std::min<uint64_t>(sizeof(buffer), stop - start));
+		if (got == 0) break;
+		for (size_t index = 0; index < got; ++index)
+		{
+			out ^= static_cast<unsigned char>(buffer[index]);
+			out *= 1099511628211ull;
+		}
+		start += got;
+	}
+	return out;
+}
+
+offset_index::offset_index(size_t sample_interval) :
+	sample_interval(sample_interval),
+	count(0),
+	indexed_size(0),
+	head_hash(0),
+	tail_hash(0)
+{
+	if (sample_interval == 0) throw std::runtime_error("Index sample interval must be at least 1.");
+}
+
+size_t offset_index::get_sample_interval(void) const { return sample_interval; }
+
+size_t offset_index::get_count(void) const { return count; }
+
+uint64_t offset_index::get_indexed_size(void) const { return indexed_size; }
+
+std::vector<uint64_t> const &offset_index::get_samples(void) const { return samples; }
+
+bool offset_index::is_current(FILE *source) const
+{
+	if (indexed_size == 0) return true;
+	if (file_size(source) < indexed_size) return false;
+	auto window = std::min<uint64_t>(hash_window, indexed_size);
+	if (hash_range(source, 0, window) != head_hash) return false;
+	if (hash_range(source, indexed_size - window, indexed_size) != tail_hash) return false;
+	return true;
+}
+
+void offset_index::reset(void)
+{
+	count = 0;
+	indexed_size = 0;
+	head_hash = 0;
+	tail_hash = 0;
+	samples.clear();
+}
+
+void offset_index::observe(offset_scanner &scanner, char const *pointer, size_t length, uint64_t &pending)
+{
+	scanner.scan(pointer, length,
+		[&pending](uint64_t offset) { pending = offset; return true; },
+		[this, &pending](uint64_t offset)
+		{
+			if (count % sample_interval == 0) samples.push_back(pending);
+			++count;
+			indexed_size = offset;
+			return true;
+		});
+}
+
+void offset_index::seal(FILE *source)
+{
+	auto window = std::min<uint64_t>(hash_window, indexed_size);
+	head_hash = hash_range(source, 0, window);
+	tail_hash = hash_range(source, indexed_size - window, indexed_size);
+}
+
+void offset_index::update(FILE *source)
+{
+	if (!is_current(source)) reset();
+	seek(source, indexed_size);
+	offset_scanner scanner(indexed_size);
+	uint64_t pending = 0;
+	std::vector<char> buffer(chunk_size);
+	while (true)
+	{
+		auto got = read_chunk(source, buffer.data(), buffer.size());
+		if (got == 0) break;
+		observe(scanner, buffer.data(), got, pending);
+	}
+	seal(source);
+}
+
+void offset_index::feed(raw_reader &reader, FILE *source)
+{
+	reset();
+	seek(source, 0);
+	offset_scanner scanner;
+	uint64_t pending = 0;
+	std::vector<char> buffer(chunk_size);
+	size_t used = 0;
+	while (true)
+	{
+		if (used == buffer.size()) buffer.resize(buffer.size() * 2);
+		auto got = read_chunk(source, buffer.data() + used, buffer.size() - used);
+		observe(scanner, buffer.data() + used, got, pending);
+		used += got;
+		auto eaten = reader.feed(buffer.data(), used, got == 0);
+		std::memmove(buffer.data(), buffer.data() + eaten, used - eaten);
+		used -= eaten;
+		if (got == 0) break;
+	}
+	seal(source);
+}
+
+static void write_varint(std::string &out, uint64_t value)
+{
+	while (value >= 0x80)
+	{
+		out.push_back(static_cast<char>((value & 0x7f) | 0x80));
+		value >>= 7;
+	}
+	out.push_back(static_cast<char>(value));
+}
+
+static void write_fixed(std::string &out, uint64_t value)
+{
+	for (size_t shift = 0; shift < 64; shift += 8)
+		out.push_back(static_cast<char>((value >> shift) & 0xff));
+}
+
+struct sidecar_parser
+{
+	std::string const &data;
+	size_t position;
+
+	sidecar_parser(std::string const &data) : data(data), position(0) {}
+
+	void require(size_t length)
+		{ if (data.size() - position < length) throw std::runtime_error("Index sidecar is truncated."); }
+
+	uint64_t varint(void)
+	{
+		uint64_t out = 0;
+		for (size_t shift = 0; shift < 64; shift += 7)
+		{
+			require(1);
+			auto byte = static_cast<unsigned char>(data[position++]);
+			out |= static_cast<uint64_t>(byte & 0x7f) << shift;
+			if (!(byte & 0x80)) return out;
+		}
+		throw std::runtime_error("Index sidecar has an invalid number.");
+	}
+
+	uint64_t fixed(void)
+	{
+		require(8);
+		uint64_t out = 0;
+		for (size_t shift = 0; shift < 64; shift += 8)
+			out |= static_cast<uint64_t>(static_cast<unsigned char>(data[position++])) << shift;
+		return out;
+	}
+};
+
+void offset_index::save(FILE *sidecar) const
+{
+	std::string out(sidecar_magic, sizeof(sidecar_magic));
+	out.push_back(static_cast<char>(sidecar_version));
+	write_varint(out, sample_interval);
+	write_varint(out, count);
+	write_varint(out, indexed_size);
+	write_fixed(out, head_hash);
+	write_fixed(out, tail_hash);
+	write_varint(out, samples.size());
+	uint64_t previous = 0;
+	for (auto sample : samples)
+	{
+		write_varint(out, sample - previous);
+		previous = sample;
+	}
+	if (fwrite(out.data(), 1, out.size(), sidecar) != out.size()) throw_file_error("write index sidecar");
+}
+
+void offset_index::save(std::string const &path) const
+{
+	auto temporary = path + ".tmp";
+	FILE *sidecar = fopen(temporary.c_str(), "wb");
+	if (!sidecar) throw_file_error("open index sidecar");
+	{
+		finally cleanup([sidecar]() { fclose(sidecar); });
+		save(sidecar);
+		if (fflush(sidecar) != 0) throw_file_error("write index sidecar");
+	}
+	if (std::rename(temporary.c_str(), path.c_str()) != 0) throw_file_error("replace index sidecar");
+}
+
+offset_index offset_index::load(FILE *sidecar)
+{
+	std::string data;
+	char buffer[hash_window];
+	while (true)
+	{
+		auto got = fread(buffer, 1, sizeof(buffer), sidecar);
+		data.append(buffer, got);
+		if (got < sizeof(buffer)) break;
+	}
+	if (ferror(sidecar)) throw_file_error("read index sidecar");
+
+	sidecar_parser parser(data);
+	parser.require(sizeof(sidecar_magic) + 1);
+	if (data.compare(0, sizeof(sidecar_magic), sidecar_magic, sizeof(sidecar_magic)) != 0)
+		throw std::runtime_error("Index sidecar has an unrecognized format.");
+	if (static_cast<unsigned char>(data[sizeof(sidecar_magic)]) != sidecar_version)
+		throw std::runtime_error("Index sidecar has an unsupported version.");
+	parser.position = sizeof(sidecar_magic) + 1;
+
+	offset_index out(parser.varint());
+	out.count = parser.varint();
+	out.indexed_size = parser.varint();
+	out.head_hash = parser.fixed();
+	out.tail_hash = parser.fixed();
+	auto sample_count = parser.varint();
+	if (sample_count != (out.count + out.sample_interval - 1) / out.sample_interval)
+		throw std::runtime_error("Index sidecar has an inconsistent sample count.");
+	out.samples.reserve(sample_count);
+	uint64_t previous = 0;
+	for (uint64_t index = 0; index < sample_count; ++index)
+	{
+		previous += parser.varint();
+		out.samples.push_back(previous);
+	}
+	return out;
+}
+
+offset_index offset_index::load(std::string const &path)
+{
+	FILE *sidecar = fopen(path.c_str(), "rb");
+	if (!sidecar) throw_file_error("open index sidecar");
+	finally cleanup([sidecar]() { fclose(sidecar); });
+	return load(sidecar);
+}
+
+std::shared_ptr<value> offset_index::read(FILE *source, size_t record) const
+	{ return read(source, record, 1)[0]; }
+
+std::vector<std::shared_ptr<value>> offset_index::read(FILE *source, size_t first, size_t count) const
+{
+	if (count == 0) return {};
+
+	size_t sample = 0;
+	uint64_t start = 0;
+	if (!samples.empty())
+	{
+		sample = std::min<size_t>(first / sample_interval, samples.size() - 1);
+		start = samples[sample];
+	}
+	size_t element = sample * sample_interval;
+
+	seek(source, start);
+	offset_scanner scanner(start);
+	std::string text;
+	bool capturing = false;
+	uint64_t capture_start = 0;
+	bool done = false;
+	uint64_t capture_end = 0;
+	auto begin = [&](uint64_t offset)
+	{
+		if (element == first)
+		{
+			capturing = true;
+			capture_start = offset;
+		}
+		return true;
+	};
+	auto end = [&](uint64_t offset)
+	{
+		++element;
+		if (element < first + count) return true;
+		done = true;
+		capture_end = offset;
+		return false;
+	};
+	std::vector<char> buffer(chunk_size);
+	while (true)
+	{
+		auto chunk_start = scanner.get_position();
+		auto got = read_chunk(source, buffer.data(), buffer.size());
+		if (got == 0)
+		{
+			scanner.finish(end);
+			break;
+		}
+		scanner.scan(buffer.data(), got, begin, end);
+		if (capturing)
+		{
+			auto from = capture_start > chunk_start ? capture_start - chunk_start : 0;
+			auto to = done ? capture_end - chunk_start : got;
+			text.append(buffer.data() + from, to - from);
+		}
+		if (done) break;
+	}
+
+	if (!done)
+	{
+		std::stringstream message;
+		message << "Record " << (first + count - 1) << " is out of range, source has " << element << " records.";
+		throw std::runtime_error(message.str());
+	}
+	return read_struct(text);
+}
+
+static size_t const no_entry = static_cast<size_t>(-1);
+
+key_index::key_index(std::string const &key, bool sorted) : key(key), sorted(sorted) {}
+
+std::string const &key_index::get_key(void) const { return key; }
+
+bool key_index::is_sorted(void) const { return sorted; }
+
+size_t key_index::size(void) const { return entries.size(); }
+
+void key_index::add(std::string const &key_value, entry &&found)
+{
+	auto index = entries.size();
+	entries.push_back(std::move(found));
+	next.push_back(no_entry);
+	chain *matches = nullptr;
+	if (sorted)
+	{
+		auto inserted = ordered.emplace(key_value, chain{index, index});
+		if (inserted.second) return;
+		matches = &inserted.first->second;
+	}
+	else
+	{
+		auto inserted = hashed.emplace(key_value, chain{index, index});
+		if (inserted.second) return;
+		matches = &inserted.first->second;
+	}
+	next[matches->last] = index;
+	matches->last = index;
+}
+
+void key_index::collect(chain const &matches, std::vector<entry const *> &out) const
+{
+	for (auto index = matches.first; index != no_entry; index = next[index])
+		out.push_back(&entries[index]);
+}
+
+key_index::entry const *key_index::find(std::string const &key_value) const
+{
+	if (sorted)
+	{
+		auto found = ordered.find(key_value);
+		return found == ordered.end() ? nullptr : &entries[found->second.first];
+	}
+	auto found = hashed.find(key_value);
+	return found == hashed.end() ? nullptr : &entries[found->second.first];
+}
+
+std::vector<key_index::entry const *> key_index::find_all(std::string const &key_value) const
+{
+	std::vector<entry const *> out;
+	if (sorted)
+	{
+		auto found = ordered.find(key_value);
+		if (found != ordered.end()) collect(found->second, out);
+	}
+	else
+	{
+		auto found = hashed.find(key_value);
+		if (found != hashed.end()) collect(found->second, out);
+	}
+	return out;
+}
+
+std::vector<key_index::entry const *> key_index::range(std::string const &low, std::string const &high) const
+{
+	if (!sorted)
+	{
+		std::stringstream message;
+		message << "Index on '" << key << "' isn't sorted and can't answer range queries.";
+		throw std::runtime_error(message.str());
+	}
+	std::vector<entry const *> out;
+	for (auto found = ordered.lower_bound(low); (found != ordered.end()) && (found->first < high); ++found)
+		collect(found->second, out);
+	return out;
+}
+
+std::shared_ptr<value> key_index::read(FILE *source, entry const &found)
+{
+	seek(source, found.offset);
+	std::string text(found.length, '\0');
+	if (read_chunk(source, &text[0], text.size()) != text.size())
+		throw std::runtime_error("Indexed record is past the end of the source.");
+	auto documents = read_struct(text);
+	if (documents.size() != 1) throw std::runtime_error("Indexed record doesn't match the source.");
+	return std::move(documents[0]);
+}
+
+indexing_reader::indexing_reader(bool keep_records) :
+	keep_records(keep_records),
+	reader(nullptr),
+	scanner(0, true),
+	fed(0),
+	record_start(0),
+	records(0),
+	unwrapped(false),
+	typed(false),
+	has_key(false)
+{
+	if (keep_records)
+	{
+		builder.reset(new struct_builder());
+		builder->on_complete([this](std::shared_ptr<value> const &node, std::string const *key)
+		{
+			auto depth = builder->get_depth();
+			auto top = (depth == 0) ? node.get() : builder->get_open(0);
+			unwrapped = top->is<array>() && !top->has_type();
+			completed(depth, key, node->is<luxem::primitive>() ? &node->as<luxem::primitive>().get_primitive() : nullptr, node);
+		});
+		reader = builder.get();
+		return;
+	}
+	auto begin = [this](bool is_array)
+	{
+		if (events->get_depth() == 1) unwrapped = is_array && !typed;
+		typed = false;
+		has_key = false;
+	};
+	auto end = [this]()
+	{
+		completed(events->get_depth(), nullptr, nullptr, nullptr);
+		if (events->get_depth() == 0) unwrapped = false;
+	};
+	events.reset(new raw_reader(
+		[begin]() { begin(false); },
+		end,
+		[begin]() { begin(true); },
+		end,
+		[this](std::string &&data) { has_key = true; member_key = std::move(data); },
+		[this](std::string &&) { typed = true; },
+		[this](std::string &&data)
+		{
+			if (events->get_depth() == 0) unwrapped = false;
+			completed(events->get_depth(), has_key ? &member_key : nullptr, &data, nullptr);
+			typed = false;
+			has_key = false;
+		}));
+	reader = events.get();
+}
+
+key_index &indexing_reader::add_index(std::string const &key, bool sorted)
+{
+	if (fed > 0) throw std::runtime_error("Indexes must be added before feeding.");
+	indexes.emplace_back(new key_index(key, sorted));
+	return *indexes.back();
+}
+
+key_index const &indexing_reader::get_index(std::string const &key) const
+{
+	for (auto &index : indexes) if (index->get_key() == key) return *index;
+	std::stringstream message;
+	message << "No index on '" << key << "'.";
+	throw std::runtime_error(message.str());
+}
+
+// Both readers report each finished value here; depth counts its open ancestors, and only primitive members of records are indexed
+void indexing_reader::completed(size_t depth, std::string const *key, std::string const *text, std::shared_ptr<value> const &data)
+{
+	size_t record_depth = unwrapped ? 1 : 0;
+	if (depth < record_depth) return;
+	if (depth == record_depth)
+	{
+		record_end(data);
+		return;
+	}
+	if ((depth != record_depth + 1) || !key || !text) return;
+	for (auto &index : indexes)
+	{
+		if (index->get_key() != *key) continue;
+		// The first occurrence of a key wins, as when building
+		bool seen = false;
+		for (auto &earlier : found) if (earlier.first == index.get()) seen = true;
+		if (!seen) found.emplace_back(index.get(), *text);
+	}
+}
+
+void indexing_reader::record_end(std::shared_ptr<value> const &data)
+{
+	if (located.empty()) throw std::runtime_error("Record ended before the scanner found it.");
+	auto const here = located.front();
+	located.pop_front();
+	for (auto &indexed : found)
+		indexed.first->add(indexed.second, key_index::entry{records, here.offset, here.length, data});
+	found.clear();
+	++records;
+}
+
+size_t indexing_reader::feed(std::string const &data, bool finish)
+	{ return feed(data.data(), data.size(), finish); }
+
+size_t indexing_reader::feed(char const *pointer, size_t length, bool finish)
+{
+	// Callers feed the unconsumed tail again, and the scanner has already seen it
+	auto seen = scanner.get_position() - fed;
+	auto located_end = [this](uint64_t offset) { located.push_back(location{record_start, offset - record_start}); return true; };
+	if (seen < length)
+		scanner.scan(pointer + seen, length - seen,
+			[this](uint64_t offset) { record_start = offset; return true; },
+			located_end);
+	if (finish) scanner.finish(located_end);
+	auto eaten = reader->feed(pointer, length, finish);
+	fed += eaten;
+	return eaten;
+}
+
+void indexing_reader::feed(FILE *file)
+{
+	std::vector<char> buffer(chunk_size);
+	size_t used = 0;
+	while (true)
+	{
+		if (used == buffer.size()) buffer.resize(buffer.size() * 2);
+		auto got = read_chunk(file, buffer.data() + used, buffer.size() - used);
+		used += got;
+		auto eaten = feed(buffer.data(), used, got == 0);
+		std::memmove(buffer.data(), buffer.data() + eaten, used - eaten);
+		used -= eaten;
+		if (got == 0) break;
+	}
+}
+
+size_t indexing_reader::get_record_count(void) const { return records; }
+
+std::vector<std::shared_ptr<value>> indexing_reader::take(void)
+{
+	if (!keep_records) return {};
+	return builder->take();
+}
+
+offset_index index_file(std::string const &source_path, std::string const &sidecar_path, size_t sample_interval)
+{
+	FILE *source = fopen(source_path.c_str(), "rb");
+	if (!source) throw_file_error("open source");
+	finally cleanup([source]() { fclose(source); });
+
+	offset_index out(sample_interval);
+	bool loaded = false;
+	FILE *sidecar = fopen(sidecar_path.c_str(), "rb");
+	if (sidecar)
+	{
+		finally sidecar_cleanup([sidecar]() { fclose(sidecar); });
+		try
+		{
+			auto previous = offset_index::load(sidecar);
+			if (previous.get_sample_interval() == sample_interval)
+			{
+				out = std::move(previous);
+				loaded = true;
+			}
+		}
+		catch (std::runtime_error &) {}
+	}
+
+	auto previous_size = out.get_indexed_size();
+	auto previous_hash = out.tail_hash;
+	out.update(source);
+	if (!loaded || (out.get_indexed_size() != previous_size) || (out.tail_hash != previous_hash))
+		out.save(sidecar_path);
+	return out;
+}
+
+}
+
@@ -0,0 +1,196 @@
+#ifndef luxem_cxx_index_h
+#define luxem_cxx_index_h
+
+#include <cstdio>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <memory>
+#include <functional>
+#include <map>
+#include <unordered_map>
+#include <deque>
+
+#include "struct.h"
+#include "read.h"
+
+namespace luxem
+{
+
+struct offset_scanner
+{
+	// With unwrap_arrays, the elements of untyped top-level arrays are reported instead of the arrays
+	offset_scanner(uint64_t position = 0, bool unwrap_arrays = false);
+
+	// Callbacks receive absolute offsets of top-level element boundaries and may return false to stop early
+	bool scan(
+		char const *pointer,
+		size_t length,
+		std::function<bool(uint64_t offset)> const &begin,
+		std::function<bool(uint64_t offset)> const &end);
+	bool finish(std::function<bool(uint64_t offset)> const &end);
+
+	uint64_t get_position(void) const;
+
+	// PRIVATE
+		enum class state
+		{
+			between,
+			element,
+			word,
+			quote,
+			type,
+			comment
+		};
+		uint64_t position;
+		state current;
+		state resume;
+		bool escaped;
+		bool unwrap_arrays;
+		size_t base;
+		size_t depth;
+};
+
+struct offset_index
+{
+	offset_index(size_t sample_interval = 1);
+
+	size_t get_sample_interval(void) const;
+	size_t get_count(void) const;
+	uint64_t get_indexed_size(void) const;
+	std::vector<uint64_t> const &get_samples(void) const;
+
+	// Appended data is indexed incrementally, anything else restarts the index
+	bool is_current(FILE *source) const;
+	void update(FILE *source);
+	void feed(raw_reader &reader, FILE *source);
+
+	void save(FILE *sidecar) const;
+	void save(std::string const &path) const;
+	static offset_index load(FILE *sidecar);
+	static offset_index load(std::string const &path);
+
+	std::shared_ptr<value> read(FILE *source, size_t record) const;
+	std::vector<std::shared_ptr<value>> read(FILE *source, size_t first, size_t count) const;
+
+	// PRIVATE
+		size_t sample_interval;
+		size_t count;
+		uint64_t indexed_size;
+		uint64_t head_hash;
+		uint64_t tail_hash;
+		std::vector<uint64_t> samples;
+
+		void reset(void);
+		void observe(offset_scanner &scanner, char const *pointer, size_t length, uint64_t &pending);
+		void seal(FILE *source);
+};
+
+// Records indexed by the primitive value of one of their members; records without it, or where it isn't a
+// primitive, aren't indexed
+struct key_index
+{
+	struct entry
+	{
+		// Position among all records read, and where the record's text is in the source
+		size_t record;
+		uint64_t offset;
+		uint64_t length;
+		// Null if the reader only kept offsets
+		std::shared_ptr<value> data;
+	};
+
+	key_index(std::string const &key, bool sorted = false);
+
+	std::string const &get_key(void) const;
+	bool is_sorted(void) const;
+	size_t size(void) const;
+
+	// Matches are in record order; find returns null if there are none
+	entry const *find(std::string const &key_value) const;
+	std::vector<entry const *> find_all(std::string const &key_value) const;
+	// Sorted indexes only; key values compare as text, from low up to but not including high
+	std::vector<entry const *> range(std::string const &low, std::string const &high) const;
+
+	// Reads a record from a source indexed without keeping records
+	static std::shared_ptr<value> read(FILE *source, entry const &found);
+
+	// PRIVATE
+		// Records sharing a key value are chained through next, in record order
+		struct chain
+		{
+			size_t first;
+			size_t last;
+		};
+
+		std::string key;
+		bool sorted;
+		std::vector<entry> entries;
+		std::vector<size_t> next;
+		std::unordered_map<std::string, chain> hashed;
+		std::map<std::string, chain> ordered;
+
+		void add(std::string const &key_value, entry &&found);
+		void collect(chain const &matches, std::vector<entry const *> &out) const;
+};
+
+// Reads records and fills key indexes in the same pass; records are top-level values, or the elements
+// of untyped top-level arrays
+struct indexing_reader
+{
+	// Without keep_records no trees are built, and indexes only locate records in the source
+	indexing_reader(bool keep_records = true);
+
+	indexing_reader(indexing_reader const &) = delete;
+	indexing_reader(indexing_reader &&) = delete;
+	indexing_reader &operator =(indexing_reader const &) = delete;
+	indexing_reader &operator =(indexing_reader &&) = delete;
+
+	// Before feeding
+	key_index &add_index(std::string const &key, bool sorted = false);
+	key_index const &get_index(std::string const &key) const;
+
+	size_t feed(std::string const &data, bool finish = true);
+	size_t feed(char const *pointer, size_t length, bool finish = true);
+	void feed(FILE *file);
+
+	size_t get_record_count(void) const;
+	// Moves out the top-level documents completed so far, when keeping records
+	std::vector<std::shared_ptr<value>> take(void);
+
+	// PRIVATE
+		struct location
+		{
+			uint64_t offset;
+			uint64_t length;
+		};
+
+		bool keep_records;
+		// raw_reader has no virtual destructor, so the builder is owned as itself
+		std::unique_ptr<struct_builder> builder;
+		std::unique_ptr<raw_reader> events;
+		raw_reader *reader;
+		offset_scanner scanner;
+		uint64_t fed;
+		std::deque<location> located;
+		std::vector<std::unique_ptr<key_index>> indexes;
+		uint64_t record_start;
+		size_t records;
+		// Set when the top level is an untyped array, whose elements are the records
+		bool unwrapped;
+		// Event state when only offsets are kept
+		bool typed;
+		bool has_key;
+		std::string member_key;
+		std::vector<std::pair<key_index *, std::string>> found;
+
+		void completed(size_t depth, std::string const *key, std::string const *text, std::shared_ptr<value> const &data);
+		void record_end(std::shared_ptr<value> const &data);
+};
+
+offset_index index_file(std::string const &source_path, std::string const &sidecar_path, size_t sample_interval = 64);
+
+}
+
+#endif
+
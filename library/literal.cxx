@@ -0,0 +1,29 @@
+#include "literal.h"
+#include "read.h"
+
+namespace luxem
+{
+
+std::string literal_text::str(void) const
+{
+	if (!quoted) return std::string(pointer, length);
+	std::string out;
+	out.reserve(length);
+	for (size_t at = 0; at < length; ++at)
+	{
+		if (pointer[at] == '\\') ++at;
+		out += pointer[at];
+	}
+	return out;
+}
+
+std::shared_ptr<value> literal_node::build(void) const
+{
+	auto end = grammar.skip_value(begin);
+	return read_struct(grammar.text + begin, end - begin)[0];
+}
+
+std::vector<std::shared_ptr<value>> literal::read(void) const
+	{ return read_struct(grammar.text, grammar.length); }
+
+}
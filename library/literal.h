@@ -0,0 +1,290 @@
+#ifndef luxem_cxx_literal_h
+#define luxem_cxx_literal_h
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <stdexcept>
+#include <cstdint>
+#include <limits>
+
+#include "struct.h"
+#include "misc.h"
+
+namespace luxem
+{
+
+// The reader's grammar as constexpr functions; errors throw, which fails compilation in a constant expression
+struct literal_grammar
+{
+	char const *text;
+	size_t length;
+
+	// Skips whitespace, comments, and commas unless a colon is expected
+	constexpr size_t skip(size_t at, bool commas = true) const
+	{
+		while (at < length)
+		{
+			if (is_space(text[at]) || (commas && (text[at] == ','))) ++at;
+			else if (text[at] == '*')
+			{
+				for (++at; (at < length) && (text[at] != '*'); ++at) {}
+				if (at >= length) throw std::runtime_error("Unterminated comment.");
+				++at;
+			}
+			else break;
+		}
+		return at;
+	}
+
+	// End of the quoted or bare word starting at at
+	constexpr size_t skip_word(size_t at) const
+	{
+		if (text[at] == '"')
+		{
+			for (++at; ; ++at)
+			{
+				if (at >= length) throw std::runtime_error("Unterminated quoted string.");
+				if (text[at] == '\\')
+				{
+					if (++at >= length) throw std::runtime_error("Unterminated escape.");
+					continue;
+				}
+				if (text[at] == '"') return at + 1;
+			}
+		}
+		while ((at < length) && !is_delimiter(text[at])) ++at;
+		return at;
+	}
+
+	// Start of the value proper, after any type
+	constexpr size_t skip_type(size_t at) const
+	{
+		if ((at >= length) || (text[at] != '(')) return at;
+		while ((at < length) && (text[at] != ')')) ++at;
+		if (at >= length) throw std::runtime_error("Unterminated type.");
+		at = skip(at + 1);
+		if ((at < length) && (text[at] == '(')) throw std::runtime_error("Multiple types.");
+		return at;
+	}
+
+	// Validates the value starting at at and returns the position just past it
+	constexpr size_t skip_value(size_t at) const
+	{
+		at = skip_type(at);
+		if (at >= length) throw std::runtime_error("Unexpected end of document.");
+		switch (text[at])
+		{
+			case '{':
+				for (at = skip(at + 1); ; )
+				{
+					if (at >= length) throw std::runtime_error("Unexpected end of document.");
+					if (text[at] == '}') return at + 1;
+					auto key_end = skip_word(at);
+					if (key_end == at) throw std::runtime_error("Expected key.");
+					at = skip(key_end, false);
+					if ((at >= length) || (text[at] != ':')) throw std::runtime_error("Expected ':' after key.");
+					at = skip(skip_value(skip(at + 1)));
+				}
+			case '[':
+				for (at = skip(at + 1); ; )
+				{
+					if (at >= length) throw std::runtime_error("Unexpected end of document.");
+					if (text[at] == ']') return at + 1;
+					at = skip(skip_value(at));
+				}
+			case '}': case ']': case ')': case ':':
+				throw std::runtime_error("Unexpected delimiter.");
+			default:
+				return skip_word(at);
+		}
+	}
+
+	constexpr size_t count_documents(void) const
+	{
+		size_t count = 0;
+		for (size_t at = skip(0); at < length; at = skip(skip_value(at))) ++count;
+		return count;
+	}
+
+	// Compares the unescaped text of the word at [at, end) with other
+	constexpr bool word_equals(size_t at, size_t end, char const *other, size_t other_length) const
+	{
+		bool quoted = text[at] == '"';
+		if (quoted) { ++at; --end; }
+		size_t index = 0;
+		for (; at < end; ++at, ++index)
+		{
+			if (quoted && (text[at] == '\\')) ++at;
+			if ((index >= other_length) || (text[at] != other[index])) return false;
+		}
+		return index == other_length;
+	}
+
+	static constexpr size_t measure(char const *other)
+	{
+		size_t out = 0;
+		while (other[out]) ++out;
+		return out;
+	}
+};
+
+// A key, type or primitive inside a literal, still in its source form
+struct literal_text
+{
+	char const *pointer;
+	size_t length;
+	bool quoted;
+
+	// Compares the unescaped text
+	constexpr bool equals(char const *other) const
+	{
+		return quoted ?
+			literal_grammar{pointer - 1, length + 2}.word_equals(0, length + 2, other, literal_grammar::measure(other)) :
+			literal_grammar{pointer, length}.word_equals(0, length, other, literal_grammar::measure(other));
+	}
+
+	constexpr int64_t get_int(void) const
+	{
+		size_t at = 0;
+		bool negative = (length > 0) && (pointer[0] == '-');
+		if (negative || ((length > 0) && (pointer[0] == '+'))) ++at;
+		if (at >= length) throw std::runtime_error("Literal primitive is not an integer.");
+		// Accumulated as a negative number, so the most negative value fits; out of range is not an integer, as in primitive::get_int
+		int64_t out = 0;
+		for (; at < length; ++at)
+		{
+			if ((pointer[at] < '0') || (pointer[at] > '9')) throw std::runtime_error("Literal primitive is not an integer.");
+			int digit = pointer[at] - '0';
+			if (out < (std::numeric_limits<int64_t>::min() + digit) / 10) throw std::runtime_error("Literal primitive is not an integer.");
+			out = out * 10 - digit;
+		}
+		if (negative) return out;
+		if (out == std::numeric_limits<int64_t>::min()) throw std::runtime_error("Literal primitive is not an integer.");
+		return -out;
+	}
+
+	constexpr bool get_bool(void) const
+	{
+		if (equals("true")) return true;
+		if (equals("false")) return false;
+		throw std::runtime_error("Literal primitive is not a bool.");
+	}
+
+	// Unescaped
+	std::string str(void) const;
+};
+
+// A read-only view of one value in a literal; navigating it allocates nothing and can happen at compile time
+struct literal_node
+{
+	constexpr literal_node(literal_grammar grammar, size_t begin) : grammar(grammar), begin(begin) {}
+
+	constexpr bool has_type(void) const { return grammar.text[begin] == '('; }
+
+	constexpr literal_text get_type(void) const
+	{
+		if (!has_type()) throw std::runtime_error("Literal value has no type.");
+		size_t end = begin + 1;
+		while (grammar.text[end] != ')') ++end;
+		return literal_text{grammar.text + begin + 1, end - begin - 1, false};
+	}
+
+	constexpr bool is_object(void) const { return grammar.text[content()] == '{'; }
+	constexpr bool is_array(void) const { return grammar.text[content()] == '['; }
+	constexpr bool is_primitive(void) const { return !is_object() && !is_array(); }
+
+	// Number of elements or members
+	constexpr size_t size(void) const
+	{
+		if (is_primitive()) throw std::runtime_error("Literal primitive has no elements.");
+		size_t count = 0;
+		for (size_t at = first(); !closes(at); at = next(at)) ++count;
+		return count;
+	}
+
+	constexpr literal_node operator [](size_t index) const
+	{
+		if (!is_array()) throw std::runtime_error("Literal value is not an array.");
+		for (size_t at = first(); !closes(at); at = next(at))
+			if (index-- == 0) return literal_node(grammar, at);
+		throw std::runtime_error("Literal array index out of range.");
+	}
+
+	constexpr bool has(char const *key) const { return find(key) != grammar.length; }
+
+	constexpr literal_node operator [](char const *key) const
+	{
+		auto at = find(key);
+		if (at == grammar.length) throw std::runtime_error("Literal object has no such key.");
+		return literal_node(grammar, at);
+	}
+
+	constexpr literal_text get_primitive(void) const
+	{
+		if (!is_primitive()) throw std::runtime_error("Literal value is not a primitive.");
+		auto at = content();
+		auto end = grammar.skip_word(at);
+		if (grammar.text[at] == '"') return literal_text{grammar.text + at + 1, end - at - 2, true};
+		return literal_text{grammar.text + at, end - at, false};
+	}
+
+	// The same tree read_struct would build from this value
+	std::shared_ptr<value> build(void) const;
+
+	private:
+		literal_grammar grammar;
+		size_t begin;
+
+		constexpr size_t content(void) const { return grammar.skip_type(begin); }
+		constexpr size_t first(void) const { return grammar.skip(content() + 1); }
+		constexpr bool closes(size_t at) const { return (grammar.text[at] == '}') || (grammar.text[at] == ']'); }
+
+		// Position of the member's value if at is a key, of the next element otherwise
+		constexpr size_t member_value(size_t at) const { return grammar.skip(grammar.skip(grammar.skip_word(at), false) + 1); }
+		constexpr size_t next(size_t at) const
+			{ return grammar.skip(grammar.skip_value(is_object() ? member_value(at) : at)); }
+
+		constexpr size_t find(char const *key) const
+		{
+			if (!is_object()) throw std::runtime_error("Literal value is not an object.");
+			auto key_length = literal_grammar::measure(key);
+			for (size_t at = first(); !closes(at); at = next(at))
+				if (grammar.word_equals(at, grammar.skip_word(at), key, key_length)) return member_value(at);
+			return grammar.length;
+		}
+};
+
+// Luxem text checked when the literal is constructed; declared constexpr, syntax errors fail the build
+// and startup does no parsing or allocation
+struct literal
+{
+	template <size_t text_size> constexpr literal(char const (&text)[text_size]) :
+		grammar{text, text_size - 1}, count(grammar.count_documents()) {}
+	constexpr literal(char const *text, size_t length) :
+		grammar{text, length}, count(grammar.count_documents()) {}
+
+	constexpr char const *get_text(void) const { return grammar.text; }
+	constexpr size_t get_length(void) const { return grammar.length; }
+
+	// Number of documents
+	constexpr size_t size(void) const { return count; }
+
+	constexpr literal_node operator [](size_t index) const
+	{
+		for (size_t at = grammar.skip(0); at < grammar.length; at = grammar.skip(grammar.skip_value(at)))
+			if (index-- == 0) return literal_node(grammar, at);
+		throw std::runtime_error("Literal document index out of range.");
+	}
+
+	// Builds the trees read_struct would; the text is known to be valid
+	std::vector<std::shared_ptr<value>> read(void) const;
+
+	private:
+		literal_grammar grammar;
+		size_t count;
+};
+
+}
+
+#endif
@@ -2,4 +2,20 @@
 #include "read.h"
 #include "write.h"
 #include "misc.h"
+#include "walk.h"
+#include "parallel.h"
+#include "persistent.h"
+#include "diff.h"
+#include "index.h"
+#include "stream.h"
+#include "compress.h"
+#include "schema.h"
+#include "ascii16.h"
+#include "serialize.h"
+#include "literal.h"
 
+#include "image.h"
+#include "pipeline.h"
+#include "columnar.h"
+#include "dedup.h"
+#include "registry.h"
@@ -1,5 +1,7 @@
 #include "misc.h"
 
+#include <sstream>
+
 namespace luxem
 {
 
@@ -9,5 +11,26 @@ finally::finally(std::function<void(void)> const &callback) : callback(callback)
 
 finally::~finally(void) { callback(); }
 
+error::error(void) : kind(code::none), offset(0), detail(nullptr), detail_length(0) {}
+
+error::error(code kind, size_t offset, char const *detail, size_t detail_length) : 
+	kind(kind), offset(offset), detail(detail), detail_length(detail_length) {}
+
+error::operator bool(void) const { return kind != code::none; }
+
+error::code error::get_code(void) const { return kind; }
+
+size_t error::get_offset(void) const { return offset; }
+
+std::string error::get_message(void) const
+{
+	if (kind == code::none) return {};
+	std::stringstream message;
+	if (kind != code::output) message << "Encountered error at offset " << offset << ": ";
+	if (detail) message.write(detail, detail_length);
+	else message << "Callback provided no error message.";
+	return message.str();
+}
+
 }
 
@@ -2,9 +2,27 @@
 #define luxem_cxx_misc_h
 
 #include <functional>
+#include <string>
+#include <vector>
+#include <array>
+#include <cstddef>
+#include <utility>
 
 namespace luxem
 {
+
+// The grammar's character classes, shared by the reader, the offset scanner and literals
+constexpr bool is_space(char character)
+	{ return (character == ' ') || (character == '\t') || (character == '\n') || (character == '\r'); }
+
+// Characters which end a bare word
+constexpr bool is_delimiter(char character)
+{
+	return is_space(character) ||
+		(character == '{') || (character == '}') || (character == '[') || (character == ']') ||
+		(character == '(') || (character == ')') || (character == ',') || (character == ':') ||
+		(character == '"') || (character == '*');
+}
 	
 struct finally
 {
@@ -15,6 +33,101 @@ struct finally
 	~finally(void);
 };
 
+// Result of the non-throwing reader and writer calls; the message is only formatted when requested
+struct error
+{
+	enum class code
+	{
+		none,
+		syntax,
+		handler,
+		output
+	};
+
+	error(void);
+	error(code kind, size_t offset, char const *detail, size_t detail_length);
+
+	explicit operator bool(void) const;
+	code get_code(void) const;
+	size_t get_offset(void) const;
+	std::string get_message(void) const;
+
+	// PRIVATE
+		code kind;
+		size_t offset;
+		char const *detail;
+		size_t detail_length;
+};
+
+// Lends each thread one instance to reuse between calls; a call nested in another, as from a handler, gets a new one
+template <typename instance_type> struct thread_pooled
+{
+	template <typename body_type> static auto use(body_type const &body) -> decltype(body(std::declval<instance_type &>()))
+	{
+		thread_local slot pooled;
+		if (pooled.busy)
+		{
+			instance_type instance;
+			return body(instance);
+		}
+		pooled.busy = true;
+		release guard{pooled};
+		// Reset before rather than after use, so a body that threw leaves nothing behind for the next call
+		pooled.instance.reset();
+		return body(pooled.instance);
+	}
+
+	private:
+		struct slot
+		{
+			instance_type instance;
+			bool busy = false;
+		};
+
+		struct release
+		{
+			slot &pooled;
+			~release(void) { pooled.busy = false; }
+		};
+};
+
+template <typename element_type, size_t inline_count = 16> struct small_stack
+{
+	small_stack(void) : count(0) {}
+
+	bool empty(void) const { return count == 0; }
+	size_t size(void) const { return count; }
+
+	void push_back(element_type const &element)
+	{
+		if (count < inline_count) inline_elements[count] = element;
+		else overflow.push_back(element);
+		++count;
+	}
+
+	void pop_back(void)
+	{
+		--count;
+		if (count >= inline_count) overflow.pop_back();
+	}
+
+	// Keeps the overflow capacity, so a reused stack stops allocating once it has seen its deepest tree
+	void clear(void) { count = 0; overflow.clear(); }
+
+	element_type &back(void) { return (*this)[count - 1]; }
+	element_type const &back(void) const { return (*this)[count - 1]; }
+
+	element_type &operator [](size_t index)
+		{ return index < inline_count ? inline_elements[index] : overflow[index - inline_count]; }
+	element_type const &operator [](size_t index) const
+		{ return index < inline_count ? inline_elements[index] : overflow[index - inline_count]; }
+
+	private:
+		size_t count;
+		std::array<element_type, inline_count> inline_elements;
+		std::vector<element_type> overflow;
+};
+
 }
 
 #endif
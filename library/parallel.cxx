@@ -0,0 +1,166 @@
+#include "parallel.h"
+
+#include <deque>
+#include <exception>
+#include <algorithm>
+
+namespace luxem
+{
+
+struct thread_pool::task_group
+{
+	std::atomic<size_t> pending;
+	std::mutex error_mutex;
+	std::exception_ptr error;
+
+	task_group(void) : pending(0) {}
+};
+
+struct thread_pool::task_queue
+{
+	struct task
+	{
+		task_group *group;
+		std::function<void(void)> body;
+	};
+
+	std::mutex mutex;
+	std::deque<task> tasks;
+};
+
+static thread_local thread_pool *current_pool = nullptr;
+static thread_local size_t current_queue = 0;
+
+thread_pool::thread_pool(size_t thread_count) : queued(0), stopping(false)
+{
+	if (thread_count == 0) thread_count = std::max(1u, std::thread::hardware_concurrency());
+	// The last queue is shared by threads outside the pool
+	for (size_t index = 0; index < thread_count + 1; ++index)
+		queues.emplace_back(std::make_unique<task_queue>());
+	for (size_t index = 0; index < thread_count; ++index)
+		threads.emplace_back([this, index]() { work(index); });
+}
+
+thread_pool::~thread_pool(void)
+{
+	{
+		std::lock_guard<std::mutex> lock(sleep_mutex);
+		stopping = true;
+	}
+	sleep_condition.notify_all();
+	for (auto &thread : threads) thread.join();
+}
+
+size_t thread_pool::get_thread_count(void) const { return threads.size(); }
+
+size_t thread_pool::get_home(void) const
+	{ return current_pool == this ? current_queue : queues.size() - 1; }
+
+bool thread_pool::run_one(size_t home)
+{
+	task_queue::task task;
+	bool found = false;
+	{
+		auto &queue = *queues[home];
+		std::lock_guard<std::mutex> lock(queue.mutex);
+		if (!queue.tasks.empty())
+		{
+			task = std::move(queue.tasks.back());
+			queue.tasks.pop_back();
+			found = true;
+		}
+	}
+	for (size_t offset = 1; !found && (offset < queues.size()); ++offset)
+	{
+		// Steal the oldest task, which is the largest range still unsplit
+		auto &queue = *queues[(home + offset) % queues.size()];
+		std::lock_guard<std::mutex> lock(queue.mutex);
+		if (!queue.tasks.empty())
+		{
+			task = std::move(queue.tasks.front());
+			queue.tasks.pop_front();
+			found = true;
+		}
+	}
+	if (!found) return false;
+	--queued;
+
+	try { task.body(); }
+	catch (...)
+	{
+		std::lock_guard<std::mutex> lock(task.group->error_mutex);
+		if (!task.group->error) task.group->error = std::current_exception();
+	}
+	--task.group->pending;
+	return true;
+}
+
+void thread_pool::work(size_t index)
+{
+	current_pool = this;
+	current_queue = index;
+	while (true)
+	{
+		if (run_one(index)) continue;
+		std::unique_lock<std::mutex> lock(sleep_mutex);
+		sleep_condition.wait(lock, [this]() { return stopping || (queued > 0); });
+		if (stopping) return;
+	}
+}
+
+static void split_chunks(
+	thread_pool &pool,
+	thread_pool::task_group &group,
+	size_t first_chunk,
+	size_t end_chunk,
+	size_t size,
+	size_t grain,
+	std::function<void(size_t begin, size_t end)> const &body)
+{
+	while (end_chunk - first_chunk > 1)
+	{
+		size_t middle = first_chunk + (end_chunk - first_chunk) / 2;
+		++group.pending;
+		++pool.queued;
+		{
+			auto &queue = *pool.queues[pool.get_home()];
+			std::lock_guard<std::mutex> lock(queue.mutex);
+			queue.tasks.push_back({&group, [&pool, &group, middle, end_chunk, size, grain, &body]()
+				{ split_chunks(pool, group, middle, end_chunk, size, grain, body); }});
+		}
+		// Sleepers check queued under this mutex, so taking it orders the increment before their wait
+		{ std::lock_guard<std::mutex> lock(pool.sleep_mutex); }
+		pool.sleep_condition.notify_one();
+		end_chunk = middle;
+	}
+	body(first_chunk * grain, std::min(end_chunk * grain, size));
+}
+
+void parallel_split(thread_pool &pool, size_t size, size_t grain, std::function<void(size_t begin, size_t end)> const &body)
+{
+	if (grain == 0) grain = 1;
+	size_t chunk_count = (size + grain - 1) / grain;
+	if (chunk_count <= 1)
+	{
+		if (size > 0) body(0, size);
+		return;
+	}
+
+	thread_pool::task_group group;
+	try { split_chunks(pool, group, 0, chunk_count, size, grain, body); }
+	catch (...)
+	{
+		std::lock_guard<std::mutex> lock(group.error_mutex);
+		if (!group.error) group.error = std::current_exception();
+	}
+
+	// Help instead of blocking, so nested parallel calls from inside a pool thread can't deadlock
+	auto home = pool.get_home();
+	while (group.pending > 0)
+		if (!pool.run_one(home)) std::this_thread::yield();
+
+	if (group.error) std::rethrow_exception(group.error);
+}
+
+}
+
@@ -0,0 +1,130 @@
+#ifndef luxem_cxx_parallel_h
+#define luxem_cxx_parallel_h
+
+#include <functional>
+#include <memory>
+#include <vector>
+#include <thread>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+
+#include "struct.h"
+
+namespace luxem
+{
+
+size_t const parallel_grain = 512;
+
+struct thread_pool
+{
+	thread_pool(size_t thread_count = 0);
+	~thread_pool(void);
+
+	thread_pool(thread_pool const &) = delete;
+	thread_pool(thread_pool &&) = delete;
+	thread_pool &operator =(thread_pool const &) = delete;
+	thread_pool &operator =(thread_pool &&) = delete;
+
+	size_t get_thread_count(void) const;
+
+	// PRIVATE
+		struct task_group;
+		struct task_queue;
+
+		std::vector<std::unique_ptr<task_queue>> queues;
+		std::vector<std::thread> threads;
+		std::atomic<size_t> queued;
+		std::atomic<bool> stopping;
+		std::mutex sleep_mutex;
+		std::condition_variable sleep_condition;
+
+		void work(size_t index);
+		bool run_one(size_t home);
+		size_t get_home(void) const;
+};
+
+void parallel_split(thread_pool &pool, size_t size, size_t grain, std::function<void(size_t begin, size_t end)> const &body);
+
+template <typename body_type> void parallel_chunks(thread_pool &pool, array &data, size_t grain, body_type &&body)
+{
+	auto &elements = data.get_data();
+	if (grain == 0) grain = 1;
+	parallel_split(pool, elements.size(), grain, [&elements, &body, grain](size_t begin, size_t end)
+		{ body(begin / grain, begin, elements.begin() + begin, elements.begin() + end); });
+}
+
+template <typename body_type> void parallel_chunks(thread_pool &pool, object &data, size_t grain, body_type &&body)
+{
+	auto &members = data.get_data();
+	if (grain == 0) grain = 1;
+	std::vector<od::iterator> boundaries;
+	boundaries.reserve(members.size() / grain + 2);
+	size_t count = 0;
+	for (auto member = members.begin(); member != members.end(); ++member, ++count)
+		if (count % grain == 0) boundaries.push_back(member);
+	boundaries.push_back(members.end());
+	parallel_split(pool, members.size(), grain, [&boundaries, &body, grain](size_t begin, size_t end)
+		{ body(begin / grain, begin, boundaries[begin / grain], boundaries[(end + grain - 1) / grain]); });
+}
+
+inline size_t parallel_key(size_t first, ad::iterator const &begin, ad::iterator const &element) { return first + (element - begin); }
+inline std::string const &parallel_key(size_t, od::iterator const &, od::iterator const &element) { return element->first; }
+inline std::shared_ptr<value> &parallel_element(ad::iterator const &element) { return *element; }
+inline std::shared_ptr<value> &parallel_element(od::iterator const &element) { return element->second; }
+
+template <typename container_type, typename callback_type> void parallel_for_each(
+	thread_pool &pool,
+	container_type &data,
+	callback_type &&callback,
+	size_t grain = parallel_grain)
+{
+	parallel_chunks(pool, data, grain, [&callback](size_t, size_t first, auto begin, auto end)
+	{
+		for (auto element = begin; element != end; ++element) 
+			callback(parallel_key(first, begin, element), parallel_element(element));
+	});
+}
+
+template <typename container_type, typename transform_type> void parallel_map(
+	thread_pool &pool,
+	container_type &data,
+	transform_type &&transform,
+	size_t grain = parallel_grain)
+{
+	parallel_chunks(pool, data, grain, [&transform](size_t, size_t first, auto begin, auto end)
+	{
+		for (auto element = begin; element != end; ++element) 
+		{
+			auto &slot = parallel_element(element);
+			slot = transform(parallel_key(first, begin, element), std::move(slot));
+		}
+	});
+}
+
+template <typename result_type, typename container_type, typename map_type, typename combine_type> result_type parallel_reduce(
+	thread_pool &pool,
+	container_type &data,
+	result_type identity,
+	map_type &&map,
+	combine_type &&combine,
+	size_t grain = parallel_grain)
+{
+	if (grain == 0) grain = 1;
+	std::vector<result_type> partials((data.get_data().size() + grain - 1) / grain, identity);
+	parallel_chunks(pool, data, grain, [&partials, &map, &combine](size_t chunk, size_t first, auto begin, auto end)
+	{
+		auto &partial = partials[chunk];
+		for (auto element = begin; element != end; ++element) 
+			partial = combine(std::move(partial), map(
+				parallel_key(first, begin, element), 
+				static_cast<std::shared_ptr<value> const &>(parallel_element(element))));
+	});
+	for (auto &partial : partials) identity = combine(std::move(identity), std::move(partial));
+	return identity;
+}
+
+}
+
+#endif
+
@@ -0,0 +1,514 @@
+#include "persistent.h"
+
+#include <sstream>
+#include <stdexcept>
+#include <algorithm>
+
+namespace luxem
+{
+
+// Containers are immutable AVL trees augmented with subtree sizes.  Objects are ordered by key and arrays by position.
+// Every update copies only the O(log n) nodes on the path to the change, so nested updates cost O(depth * log width).
+struct snapshot::tree
+{
+	std::shared_ptr<tree const> left, right;
+	std::string key;
+	snapshot data;
+	size_t size;
+	unsigned char height;
+};
+
+struct snapshot::node
+{
+	snapshot::kind node_kind;
+	bool typed;
+	std::string type;
+	std::string primitive;
+	std::shared_ptr<snapshot::tree const> children;
+};
+
+typedef std::shared_ptr<snapshot::tree const> tree_pointer;
+
+static std::string const empty_string;
+
+static size_t size_of(tree_pointer const &tree) { return tree ? tree->size : 0; }
+
+static unsigned char height_of(tree_pointer const &tree) { return tree ? tree->height : 0; }
+
+static tree_pointer make_tree(tree_pointer const &left, std::string const &key, snapshot const &data, tree_pointer const &right)
+{
+	auto out = std::make_shared<snapshot::tree>();
+	out->left = left;
+	out->right = right;
+	out->key = key;
+	out->data = data;
+	out->size = size_of(left) + 1 + size_of(right);
+	out->height = std::max(height_of(left), height_of(right)) + 1;
+	return out;
+}
+
+static tree_pointer balance(tree_pointer const &left, std::string const &key, snapshot const &data, tree_pointer const &right)
+{
+	if (height_of(left) > height_of(right) + 1)
+	{
+		if (height_of(left->left) >= height_of(left->right))
+			return make_tree(left->left, left->key, left->data, make_tree(left->right, key, data, right));
+		auto &pivot = left->right;
+		return make_tree(
+			make_tree(left->left, left->key, left->data, pivot->left),
+			pivot->key, pivot->data,
+			make_tree(pivot->right, key, data, right));
+	}
+	if (height_of(right) > height_of(left) + 1)
+	{
+		if (height_of(right->right) >= height_of(right->left))
+			return make_tree(make_tree(left, key, data, right->left), right->key, right->data, right->right);
+		auto &pivot = right->left;
+		return make_tree(
+			make_tree(left, key, data, pivot->left),
+			pivot->key, pivot->data,
+			make_tree(pivot->right, right->key, right->data, right->right));
+	}
+	return make_tree(left, key, data, right);
+}
+
+static tree_pointer remove_first(tree_pointer const &tree, std::string &key, snapshot &data)
+{
+	if (!tree->left)
+	{
+		key = tree->key;
+		data = tree->data;
+		return tree->right;
+	}
+	return balance(remove_first(tree->left, key, data), tree->key, tree->data, tree->right);
+}
+
+static tree_pointer join(tree_pointer const &left, tree_pointer const &right)
+{
+	if (!left) return right;
+	if (!right) return left;
+	std::string key;
+	snapshot data;
+	auto rest = remove_first(right, key, data);
+	return balance(left, key, data, rest);
+}
+
+static snapshot::tree const *find_key(tree_pointer const &tree, std::string const &key)
+{
+	auto current = tree.get();
+	while (current)
+	{
+		int compared = key.compare(current->key);
+		if (compared == 0) return current;
+		current = compared < 0 ? current->left.get() : current->right.get();
+	}
+	return nullptr;
+}
+
+static tree_pointer set_key(tree_pointer const &tree, std::string const &key, snapshot const &data)
+{
+	if (!tree) return make_tree({}, key, data, {});
+	int compared = key.compare(tree->key);
+	if (compared == 0) return make_tree(tree->left, key, data, tree->right);
+	if (compared < 0) return balance(set_key(tree->left, key, data), tree->key, tree->data, tree->right);
+	return balance(tree->left, tree->key, tree->data, set_key(tree->right, key, data));
+}
+
+static tree_pointer erase_key(tree_pointer const &tree, std::string const &key)
+{
+	if (!tree) return tree;
+	int compared = key.compare(tree->key);
+	if (compared == 0) return join(tree->left, tree->right);
+	if (compared < 0)
+	{
+		auto left = erase_key(tree->left, key);
+		if (left == tree->left) return tree;
+		return balance(left, tree->key, tree->data, tree->right);
+	}
+	auto right = erase_key(tree->right, key);
+	if (right == tree->right) return tree;
+	return balance(tree->left, tree->key, tree->data, right);
+}
+
+static snapshot::tree const *find_index(tree_pointer const &tree, size_t index)
+{
+	auto current = tree.get();
+	while (current)
+	{
+		auto left_size = size_of(current->left);
+		if (index == left_size) return current;
+		if (index < left_size) current = current->left.get();
+		else
+		{
+			index -= left_size + 1;
+			current = current->right.get();
+		}
+	}
+	return nullptr;
+}
+
+static tree_pointer set_index(tree_pointer const &tree, size_t index, snapshot const &data)
+{
+	auto left_size = size_of(tree->left);
+	if (index == left_size) return make_tree(tree->left, tree->key, data, tree->right);
+	if (index < left_size) return make_tree(set_index(tree->left, index, data), tree->key, tree->data, tree->right);
+	return make_tree(tree->left, tree->key, tree->data, set_index(tree->right, index - left_size - 1, data));
+}
+
+static tree_pointer insert_index(tree_pointer const &tree, size_t index, snapshot const &data)
+{
+	if (!tree) return make_tree({}, empty_string, data, {});
+	auto left_size = size_of(tree->left);
+	if (index <= left_size) return balance(insert_index(tree->left, index, data), tree->key, tree->data, tree->right);
+	return balance(tree->left, tree->key, tree->data, insert_index(tree->right, index - left_size - 1, data));
+}
+
+static tree_pointer erase_index(tree_pointer const &tree, size_t index)
+{
+	auto left_size = size_of(tree->left);
+	if (index == left_size) return join(tree->left, tree->right);
+	if (index < left_size) return balance(erase_index(tree->left, index), tree->key, tree->data, tree->right);
+	return balance(tree->left, tree->key, tree->data, erase_index(tree->right, index - left_size - 1));
+}
+
+template <typename callback_type> static void for_each_tree(snapshot::tree const *tree, size_t &index, callback_type const &callback)
+{
+	if (!tree) return;
+	for_each_tree(tree->left.get(), index, callback);
+	callback(index++, *tree);
+	for_each_tree(tree->right.get(), index, callback);
+}
+
+// Builds a perfectly balanced tree from count sorted elements in a single pass
+template <typename iterator_type, typename convert_type> static tree_pointer build_tree(
+	size_t count,
+	iterator_type &iterator,
+	convert_type const &convert)
+{
+	if (count == 0) return {};
+	auto left = build_tree(count / 2, iterator, convert);
+	auto out = std::make_shared<snapshot::tree>();
+	convert(*iterator, out->key, out->data);
+	++iterator;
+	out->right = build_tree(count - count / 2 - 1, iterator, convert);
+	out->left = std::move(left);
+	out->size = count;
+	out->height = std::max(height_of(out->left), height_of(out->right)) + 1;
+	return out;
+}
+
+static char const *kind_name(snapshot::kind node_kind)
+{
+	switch (node_kind)
+	{
+		case snapshot::kind::null: return "null";
+		case snapshot::kind::primitive: return "primitive";
+		case snapshot::kind::object: return "object";
+		case snapshot::kind::array: return "array";
+	}
+	return "unknown";
+}
+
+static snapshot::node const &expect(std::shared_ptr<snapshot::node const> const &root, snapshot::kind node_kind)
+{
+	auto found = root ? root->node_kind : snapshot::kind::null;
+	if (found != node_kind)
+	{
+		std::stringstream message;
+		message << "Expected " << kind_name(node_kind) << ", found " << kind_name(found);
+		throw std::runtime_error(message.str());
+	}
+	return *root;
+}
+
+static std::shared_ptr<snapshot::node> copy_node(snapshot::node const &base, tree_pointer &&children)
+{
+	auto out = std::make_shared<snapshot::node>();
+	out->node_kind = base.node_kind;
+	out->typed = base.typed;
+	out->type = base.type;
+	out->children = std::move(children);
+	return out;
+}
+
+static std::shared_ptr<snapshot::node> make_node(snapshot::kind node_kind, bool typed, std::string const &type)
+{
+	auto out = std::make_shared<snapshot::node>();
+	out->node_kind = node_kind;
+	out->typed = typed;
+	if (typed) out->type = type;
+	return out;
+}
+
+snapshot::snapshot(void) {}
+
+snapshot::snapshot(std::shared_ptr<node const> &&root) : root(std::move(root)) {}
+
+snapshot snapshot::make_primitive(std::string const &data)
+{
+	auto out = make_node(kind::primitive, false, empty_string);
+	out->primitive = data;
+	return snapshot(std::move(out));
+}
+
+snapshot snapshot::make_primitive(std::string const &type, std::string const &data)
+{
+	auto out = make_node(kind::primitive, true, type);
+	out->primitive = data;
+	return snapshot(std::move(out));
+}
+
+snapshot snapshot::make_object(void) { return snapshot(make_node(kind::object, false, empty_string)); }
+
+snapshot snapshot::make_object(std::string const &type) { return snapshot(make_node(kind::object, true, type)); }
+
+snapshot snapshot::make_array(void) { return snapshot(make_node(kind::array, false, empty_string)); }
+
+snapshot snapshot::make_array(std::string const &type) { return snapshot(make_node(kind::array, true, type)); }
+
+snapshot::kind snapshot::get_kind(void) const { return root ? root->node_kind : kind::null; }
+
+bool snapshot::is_null(void) const { return !root; }
+
+bool snapshot::is_primitive(void) const { return get_kind() == kind::primitive; }
+
+bool snapshot::is_object(void) const { return get_kind() == kind::object; }
+
+bool snapshot::is_array(void) const { return get_kind() == kind::array; }
+
+bool snapshot::has_type(void) const { return root && root->typed; }
+
+std::string const &snapshot::get_type(void) const { assert(has_type()); return root->type; }
+
+std::string const &snapshot::get_primitive(void) const { return expect(root, kind::primitive).primitive; }
+
+bool snapshot::same(snapshot const &other) const { return root == other.root; }
+
+size_t snapshot::size(void) const
+{
+	if (!is_object()) expect(root, kind::array);
+	return size_of(root->children);
+}
+
+bool snapshot::has(std::string const &key) const
+	{ return find_key(expect(root, kind::object).children, key); }
+
+snapshot snapshot::get(std::string const &key) const
+{
+	auto found = find_key(expect(root, kind::object).children, key);
+	if (!found) return {};
+	return found->data;
+}
+
+snapshot snapshot::get(size_t index) const
+{
+	auto found = find_index(expect(root, kind::array).children, index);
+	if (!found)
+	{
+		std::stringstream message;
+		message << "Index " << index << " is out of range in array of size " << size() << ".";
+		throw std::runtime_error(message.str());
+	}
+	return found->data;
+}
+
+snapshot snapshot::get_in(path const &location) const
+{
+	snapshot out = *this;
+	for (auto &element : location)
+	{
+		if (element.is_key) out = out.get(element.key);
+		else out = out.get(element.index);
+	}
+	return out;
+}
+
+void snapshot::for_each_member(std::function<void(std::string const &key, snapshot const &data)> const &callback) const
+{
+	size_t index = 0;
+	for_each_tree(expect(root, kind::object).children.get(), index,
+		[&callback](size_t, tree const &element) { callback(element.key, element.data); });
+}
+
+void snapshot::for_each_element(std::function<void(size_t index, snapshot const &data)> const &callback) const
+{
+	size_t index = 0;
+	for_each_tree(expect(root, kind::array).children.get(), index,
+		[&callback](size_t index, tree const &element) { callback(index, element.data); });
+}
+
+snapshot snapshot::set_type(std::string const &type) const
+{
+	if (!root) expect(root, kind::primitive);
+	auto out = copy_node(*root, tree_pointer(root->children));
+	out->typed = true;
+	out->type = type;
+	out->primitive = root->primitive;
+	return snapshot(std::move(out));
+}
+
+snapshot snapshot::set(std::string const &key, snapshot const &data) const
+{
+	auto &base = expect(root, kind::object);
+	return snapshot(copy_node(base, set_key(base.children, key, data)));
+}
+
+snapshot snapshot::erase(std::string const &key) const
+{
+	auto &base = expect(root, kind::object);
+	auto children = erase_key(base.children, key);
+	if (children == base.children) return *this;
+	return snapshot(copy_node(base, std::move(children)));
+}
+
+static void check_index(size_t index, size_t size)
+{
+	if (index < size) return;
+	std::stringstream message;
+	message << "Index " << index << " is out of range in array of size " << size << ".";
+	throw std::runtime_error(message.str());
+}
+
+snapshot snapshot::set(size_t index, snapshot const &data) const
+{
+	auto &base = expect(root, kind::array);
+	check_index(index, size_of(base.children));
+	return snapshot(copy_node(base, set_index(base.children, index, data)));
+}
+
+snapshot snapshot::insert(size_t index, snapshot const &data) const
+{
+	auto &base = expect(root, kind::array);
+	check_index(index, size_of(base.children) + 1);
+	return snapshot(copy_node(base, insert_index(base.children, index, data)));
+}
+
+snapshot snapshot::erase(size_t index) const
+{
+	auto &base = expect(root, kind::array);
+	check_index(index, size_of(base.children));
+	return snapshot(copy_node(base, erase_index(base.children, index)));
+}
+
+snapshot snapshot::push_back(snapshot const &data) const
+{
+	auto &base = expect(root, kind::array);
+	return snapshot(copy_node(base, insert_index(base.children, size_of(base.children), data)));
+}
+
+static snapshot set_in_implementation(snapshot const &base, path const &location, size_t level, snapshot const &data)
+{
+	if (level == location.size()) return data;
+	auto &element = location[level];
+	if (element.is_key)
+	{
+		auto child = base.get(element.key);
+		if (child.is_null() && (level + 1 < location.size()))
+		{
+			std::stringstream message;
+			message << "No value at " << render_path(path(location.begin(), location.begin() + level + 1)) << ".";
+			throw std::runtime_error(message.str());
+		}
+		return base.set(element.key, set_in_implementation(child, location, level + 1, data));
+	}
+	if ((level + 1 == location.size()) && (element.index == base.size())) return base.push_back(data);
+	return base.set(element.index, set_in_implementation(base.get(element.index), location, level + 1, data));
+}
+
+snapshot snapshot::set_in(path const &location, snapshot const &data) const
+	{ return set_in_implementation(*this, location, 0, data); }
+
+static snapshot erase_in_implementation(snapshot const &base, path const &location, size_t level)
+{
+	auto &element = location[level];
+	if (level + 1 == location.size())
+	{
+		if (element.is_key) return base.erase(element.key);
+		return base.erase(element.index);
+	}
+	if (element.is_key)
+	{
+		auto child = base.get(element.key);
+		if (child.is_null()) return base;
+		return base.set(element.key, erase_in_implementation(child, location, level + 1));
+	}
+	return base.set(element.index, erase_in_implementation(base.get(element.index), location, level + 1));
+}
+
+snapshot snapshot::erase_in(path const &location) const
+{
+	if (location.empty()) return {};
+	return erase_in_implementation(*this, location, 0);
+}
+
+snapshot freeze(std::shared_ptr<value> const &root)
+{
+	if (!root) return {};
+	auto typed = root->has_type();
+	auto &type = typed ? root->get_type() : empty_string;
+	if (root->is<primitive>())
+	{
+		auto out = make_node(snapshot::kind::primitive, typed, type);
+		out->primitive = root->as<primitive>().get_primitive();
+		return snapshot(std::move(out));
+	}
+	if (root->is<object>())
+	{
+		auto &data = root->as<object>().get_data();
+		auto out = make_node(snapshot::kind::object, typed, type);
+		auto iterator = data.begin();
+		out->children = build_tree(data.size(), iterator,
+			[](od::value_type const &element, std::string &key, snapshot &data)
+			{
+				key = element.first;
+				data = freeze(element.second);
+			});
+		return snapshot(std::move(out));
+	}
+	if (root->is<array>())
+	{
+		auto &data = root->as<array>().get_data();
+		auto out = make_node(snapshot::kind::array, typed, type);
+		auto iterator = data.begin();
+		out->children = build_tree(data.size(), iterator,
+			[](std::shared_ptr<value> const &element, std::string &, snapshot &data) { data = freeze(element); });
+		return snapshot(std::move(out));
+	}
+	std::stringstream message;
+	message << "Encountered unfreezable type " << root->get_name() << " while trying to freeze tree.";
+	throw std::runtime_error(message.str());
+}
+
+std::shared_ptr<value> thaw(snapshot const &root)
+{
+	switch (root.get_kind())
+	{
+		case snapshot::kind::null: return {};
+		case snapshot::kind::primitive:
+		{
+			if (root.has_type()) return std::make_shared<primitive>(std::string(root.get_type()), std::string(root.get_primitive()));
+			return std::make_shared<primitive>(std::string(root.get_primitive()));
+		}
+		case snapshot::kind::object:
+		{
+			auto out = root.has_type() ? std::make_shared<object>(root.get_type(), od{}) : std::make_shared<object>();
+			auto &data = out->get_data();
+			// Members arrive sorted, so each insertion is amortized constant with an end hint
+			root.for_each_member([&data](std::string const &key, snapshot const &element)
+				{ data.emplace_hint(data.end(), key, thaw(element)); });
+			return out;
+		}
+		case snapshot::kind::array:
+		{
+			auto out = root.has_type() ? std::make_shared<array>(root.get_type(), ad{}) : std::make_shared<array>();
+			auto &data = out->get_data();
+			data.reserve(root.size());
+			root.for_each_element([&data](size_t, snapshot const &element) { data.emplace_back(thaw(element)); });
+			return out;
+		}
+	}
+	return {};
+}
+
+}
+
@@ -0,0 +1,80 @@
+#ifndef luxem_cxx_persistent_h
+#define luxem_cxx_persistent_h
+
+#include <string>
+#include <memory>
+#include <functional>
+
+#include "struct.h"
+#include "walk.h"
+
+namespace luxem
+{
+
+struct snapshot
+{
+	enum class kind
+	{
+		null,
+		primitive,
+		object,
+		array
+	};
+
+	snapshot(void);
+
+	static snapshot make_primitive(std::string const &data);
+	static snapshot make_primitive(std::string const &type, std::string const &data);
+	static snapshot make_object(void);
+	static snapshot make_object(std::string const &type);
+	static snapshot make_array(void);
+	static snapshot make_array(std::string const &type);
+
+	kind get_kind(void) const;
+	bool is_null(void) const;
+	bool is_primitive(void) const;
+	bool is_object(void) const;
+	bool is_array(void) const;
+
+	bool has_type(void) const;
+	std::string const &get_type(void) const;
+	std::string const &get_primitive(void) const;
+
+	// True if both snapshots share the same node, which implies equal contents
+	bool same(snapshot const &other) const;
+
+	size_t size(void) const;
+	bool has(std::string const &key) const;
+	snapshot get(std::string const &key) const;
+	snapshot get(size_t index) const;
+	snapshot get_in(path const &location) const;
+
+	void for_each_member(std::function<void(std::string const &key, snapshot const &data)> const &callback) const;
+	void for_each_element(std::function<void(size_t index, snapshot const &data)> const &callback) const;
+
+	// Updates return a new version and leave this one unchanged
+	snapshot set_type(std::string const &type) const;
+	snapshot set(std::string const &key, snapshot const &data) const;
+	snapshot erase(std::string const &key) const;
+	snapshot set(size_t index, snapshot const &data) const;
+	snapshot insert(size_t index, snapshot const &data) const;
+	snapshot erase(size_t index) const;
+	snapshot push_back(snapshot const &data) const;
+	snapshot set_in(path const &location, snapshot const &data) const;
+	snapshot erase_in(path const &location) const;
+
+	// PRIVATE
+		struct node;
+		struct tree;
+		std::shared_ptr<node const> root;
+
+		snapshot(std::shared_ptr<node const> &&root);
+};
+
+snapshot freeze(std::shared_ptr<value> const &root);
+std::shared_ptr<value> thaw(snapshot const &root);
+
+}
+
+#endif
+
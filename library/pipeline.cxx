@@ -0,0 +1,168 @@
+#include "pipeline.h"
+
+#include <stdexcept>
+#include <algorithm>
+
+namespace luxem
+{
+
+pipeline::signal::signal(void) : waiting(0) {}
+
+void pipeline::signal::wait(std::function<bool(void)> const &ready)
+{
+	for (size_t attempt = 0; attempt < 64; ++attempt)
+	{
+		if (ready()) return;
+		std::this_thread::yield();
+	}
+	waiting.fetch_add(1);
+	std::atomic_thread_fence(std::memory_order_seq_cst);
+	{
+		std::unique_lock<std::mutex> lock(mutex);
+		condition.wait(lock, ready);
+	}
+	waiting.fetch_sub(1);
+}
+
+void pipeline::signal::notify(void)
+{
+	std::atomic_thread_fence(std::memory_order_seq_cst);
+	if (waiting.load() == 0) return;
+	std::lock_guard<std::mutex> lock(mutex);
+	condition.notify_all();
+}
+
+pipeline::pipeline(
+	std::function<std::shared_ptr<value>(uint64_t sequence, std::shared_ptr<value> &&document)> handler,
+	size_t thread_count,
+	size_t capacity) :
+	handler(std::move(handler)),
+	queue(std::max(capacity, size_t(1))),
+	closing(false),
+	failed(false),
+	published(0),
+	delivered(0),
+	next_delivery(0),
+	delivering(false),
+	finished(false),
+	reader([this](std::shared_ptr<value> &&document) { publish(std::move(document)); })
+{
+	// The feeding thread is busy parsing, so leave it a core
+	if (thread_count == 0) thread_count = std::max(2u, std::thread::hardware_concurrency()) - 1;
+	for (size_t index = 0; index < thread_count; ++index)
+		threads.emplace_back([this]() { work(); });
+}
+
+pipeline::~pipeline(void)
+{
+	try { finish(); }
+	catch (...) {}
+}
+
+pipeline &pipeline::set_ordered(std::function<void(uint64_t sequence, std::shared_ptr<value> &&result)> sink)
+{
+	if (published.load() > 0) throw std::runtime_error("Pipeline output must be ordered before feeding.");
+	this->sink = std::move(sink);
+	return *this;
+}
+
+struct_builder &pipeline::get_reader(void) { return reader; }
+
+uint64_t pipeline::get_published(void) const { return published.load(); }
+
+size_t pipeline::get_thread_count(void) const { return threads.size(); }
+
+void pipeline::publish(std::shared_ptr<value> &&document)
+{
+	if (finished) throw std::runtime_error("Pipeline was already finished.");
+	auto const capacity = queue.get_capacity();
+	auto const sequence = published.load(std::memory_order_relaxed);
+	// Ordered results wait for their turn, so keep the documents in flight bounded by the queue as well
+	if (sink)
+		not_full.wait([this, sequence, capacity]()
+			{ return failed.load() || (sequence - delivered.load() < capacity); });
+	record element{sequence, std::move(document)};
+	while (!failed.load() && !queue.try_push(element))
+		not_full.wait([this, capacity]() { return failed.load() || (queue.get_size() < capacity); });
+	if (failed.load()) throw std::runtime_error("Pipeline handler failed.");
+	published.store(sequence + 1);
+	not_empty.notify();
+}
+
+void pipeline::work(void)
+{
+	record element;
+	while (true)
+	{
+		if (!queue.try_pop(element))
+		{
+			// Everything was pushed before closing was set, so one more look is enough
+			if (closing.load())
+			{
+				if (!queue.try_pop(element)) return;
+			}
+			else
+			{
+				not_empty.wait([this]() { return closing.load() || (queue.get_size() > 0); });
+				continue;
+			}
+		}
+		not_full.notify();
+
+		auto sequence = element.sequence;
+		std::shared_ptr<value> result;
+		if (!failed.load())
+		{
+			try { result = handler(sequence, std::move(element.document)); }
+			catch (...) { fail(std::current_exception()); }
+		}
+		element.document.reset();
+		if (sink && !failed.load()) complete(sequence, std::move(result));
+	}
+}
+
+void pipeline::complete(uint64_t sequence, std::shared_ptr<value> &&result)
+{
+	std::unique_lock<std::mutex> lock(order_mutex);
+	pending.emplace(sequence, std::move(result));
+	// Whoever holds the next result in order delivers every consecutive one after it too
+	if (delivering) return;
+	delivering = true;
+	while (!pending.empty() && (pending.begin()->first == next_delivery) && !failed.load())
+	{
+		auto ready = std::move(pending.begin()->second);
+		pending.erase(pending.begin());
+		lock.unlock();
+		try { sink(next_delivery, std::move(ready)); }
+		catch (...) { fail(std::current_exception()); }
+		lock.lock();
+		delivered.store(++next_delivery);
+		not_full.notify();
+	}
+	delivering = false;
+}
+
+void pipeline::fail(std::exception_ptr error)
+{
+	{
+		std::lock_guard<std::mutex> lock(failure_mutex);
+		if (!failure) failure = error;
+	}
+	failed.store(true);
+	not_full.notify();
+}
+
+void pipeline::finish(void)
+{
+	if (!finished)
+	{
+		finished = true;
+		closing.store(true);
+		not_empty.notify();
+		for (auto &thread : threads) thread.join();
+		threads.clear();
+	}
+	if (failure) std::rethrow_exception(failure);
+}
+
+}
@@ -0,0 +1,174 @@
+#ifndef luxem_cxx_pipeline_h
+#define luxem_cxx_pipeline_h
+
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <vector>
+#include <map>
+#include <thread>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <exception>
+
+#include "struct.h"
+#include "read.h"
+
+namespace luxem
+{
+
+// Bounded lock-free multi-producer multi-consumer ring; capacity is rounded up to a power of two
+template <typename element_type> struct bounded_queue
+{
+	bounded_queue(size_t capacity) : mask(1), enqueue_position(0), dequeue_position(0)
+	{
+		while (mask < capacity) mask <<= 1;
+		cells.reset(new cell[mask]);
+		for (size_t index = 0; index < mask; ++index) cells[index].sequence.store(index, std::memory_order_relaxed);
+		mask -= 1;
+	}
+
+	bounded_queue(bounded_queue const &) = delete;
+	bounded_queue &operator =(bounded_queue const &) = delete;
+
+	size_t get_capacity(void) const { return mask + 1; }
+
+	// Only moves from element when it returns true
+	bool try_push(element_type &element)
+	{
+		auto position = enqueue_position.load(std::memory_order_relaxed);
+		while (true)
+		{
+			auto &target = cells[position & mask];
+			auto sequence = target.sequence.load(std::memory_order_acquire);
+			auto difference = static_cast<intptr_t>(sequence) - static_cast<intptr_t>(position);
+			if (difference == 0)
+			{
+				if (enqueue_position.compare_exchange_weak(position, position + 1, std::memory_order_relaxed))
+				{
+					target.data = std::move(element);
+					target.sequence.store(position + 1, std::memory_order_release);
+					return true;
+				}
+			}
+			else if (difference < 0) return false;
+			else position = enqueue_position.load(std::memory_order_relaxed);
+		}
+	}
+
+	bool try_pop(element_type &out)
+	{
+		auto position = dequeue_position.load(std::memory_order_relaxed);
+		while (true)
+		{
+			auto &source = cells[position & mask];
+			auto sequence = source.sequence.load(std::memory_order_acquire);
+			auto difference = static_cast<intptr_t>(sequence) - static_cast<intptr_t>(position + 1);
+			if (difference == 0)
+			{
+				if (dequeue_position.compare_exchange_weak(position, position + 1, std::memory_order_relaxed))
+				{
+					out = std::move(source.data);
+					source.sequence.store(position + mask + 1, std::memory_order_release);
+					return true;
+				}
+			}
+			else if (difference < 0) return false;
+			else position = dequeue_position.load(std::memory_order_relaxed);
+		}
+	}
+
+	// Approximate while other threads are pushing or popping, but never wraps below zero
+	size_t get_size(void) const
+	{
+		auto dequeued = dequeue_position.load(std::memory_order_acquire);
+		return enqueue_position.load(std::memory_order_acquire) - dequeued;
+	}
+
+	// PRIVATE
+		struct cell
+		{
+			std::atomic<size_t> sequence;
+			element_type data;
+		};
+
+		std::unique_ptr<cell[]> cells;
+		size_t mask;
+		alignas(64) std::atomic<size_t> enqueue_position;
+		alignas(64) std::atomic<size_t> dequeue_position;
+};
+
+// Parses on the feeding thread while handler threads process the completed top-level documents
+struct pipeline
+{
+	pipeline(
+		std::function<std::shared_ptr<value>(uint64_t sequence, std::shared_ptr<value> &&document)> handler,
+		size_t thread_count = 0,
+		size_t capacity = 256);
+	~pipeline(void);
+
+	pipeline(pipeline const &) = delete;
+	pipeline(pipeline &&) = delete;
+	pipeline &operator =(pipeline const &) = delete;
+	pipeline &operator =(pipeline &&) = delete;
+
+	// Handler results are passed to sink in document order, one call at a time; set before feeding
+	pipeline &set_ordered(std::function<void(uint64_t sequence, std::shared_ptr<value> &&result)> sink);
+
+	// Feed this directly or through a stream_feeder; it blocks while the queue is full
+	struct_builder &get_reader(void);
+
+	// Waits for every document to be handled and rethrows the first handler exception
+	void finish(void);
+
+	uint64_t get_published(void) const;
+	size_t get_thread_count(void) const;
+
+	// PRIVATE
+		struct record
+		{
+			uint64_t sequence;
+			std::shared_ptr<value> document;
+		};
+
+		// Sleeping for when spinning didn't help; wakers only lock when someone is asleep
+		struct signal
+		{
+			std::mutex mutex;
+			std::condition_variable condition;
+			std::atomic<size_t> waiting;
+
+			signal(void);
+			void wait(std::function<bool(void)> const &ready);
+			void notify(void);
+		};
+
+		std::function<std::shared_ptr<value>(uint64_t sequence, std::shared_ptr<value> &&document)> handler;
+		std::function<void(uint64_t sequence, std::shared_ptr<value> &&result)> sink;
+		bounded_queue<record> queue;
+		signal not_empty;
+		signal not_full;
+		std::atomic<bool> closing;
+		std::atomic<bool> failed;
+		std::atomic<uint64_t> published;
+		std::atomic<uint64_t> delivered;
+		std::mutex failure_mutex;
+		std::exception_ptr failure;
+		std::mutex order_mutex;
+		std::map<uint64_t, std::shared_ptr<value>> pending;
+		uint64_t next_delivery;
+		bool delivering;
+		bool finished;
+		struct_builder reader;
+		std::vector<std::thread> threads;
+
+		void publish(std::shared_ptr<value> &&document);
+		void work(void);
+		void complete(uint64_t sequence, std::shared_ptr<value> &&result);
+		void fail(std::exception_ptr error);
+};
+
+}
+
+#endif
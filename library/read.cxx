@@ -1,8 +1,12 @@
 #include "read.h"
+#include "ascii16.h"
 
 #include <sstream>
 #include <cassert>
 #include <stdexcept>
+#include <cstring>
+#include <vector>
+#include <algorithm>
 
 #include <iostream> // DEBUG
 
@@ -16,116 +20,126 @@ static char cxx_error_token;
 namespace luxem
 {
 
-static luxem_bool_t translate_object_begin(luxem_rawread_context_t *context, void *user_data)
+template <typename body_type> static luxem_bool_t translate(luxem_rawread_context_t *context, void *user_data, body_type &&body)
 {
 	raw_reader &reader = *reinterpret_cast<raw_reader *>(user_data);
 	try
 	{
-		reader.object_begin();
-		return true;
+		body(reader);
 	}
 	catch (std::exception &e)
 	{
 		reader.exception_message = e.what();
-		luxem_rawread_get_error(context)->pointer = &cxx_error_token;
-		return false;
+		reader.failed = true;
+		reader.failure_message = reader.exception_message.empty() ? nullptr : reader.exception_message.c_str();
+	}
+	catch (...)
+	{
+		reader.failed = true;
+		reader.failure_message = nullptr;
 	}
+	if (!reader.failed) return true;
+	luxem_rawread_get_error(context)->pointer = &cxx_error_token;
+	return false;
+}
+
+// Tracks just enough structure to tell whether the next token is a key or a value
+static void opened(raw_reader &reader, bool is_object)
+{
+	if (!reader.chunked) return;
+	reader.chunked->in_object.push_back(is_object);
+	reader.chunked->key_next = is_object;
+}
+
+static void completed(raw_reader &reader, bool closes)
+{
+	if (!reader.chunked) return;
+	auto &state = *reader.chunked;
+	if (closes) state.in_object.pop_back();
+	state.key_next = !state.in_object.empty() && state.in_object.back();
+}
+
+// Counted once the handler has taken the value, so a handler that threw doesn't complete it
+static void value_done(raw_reader &reader)
+	{ if (reader.depth == 0) ++reader.elements; }
+
+static luxem_bool_t translate_object_begin(luxem_rawread_context_t *context, void *user_data)
+{
+	return translate(context, user_data, [](raw_reader &reader)
+	{
+		opened(reader, true);
+		++reader.depth;
+		reader.object_begin();
+	});
 }
 
 static luxem_bool_t translate_object_end(luxem_rawread_context_t *context, void *user_data)
 {
-	raw_reader &reader = *reinterpret_cast<raw_reader *>(user_data);
-	try
+	return translate(context, user_data, [](raw_reader &reader)
 	{
+		completed(reader, true);
+		--reader.depth;
 		reader.object_end();
-		return true;
-	}
-	catch (std::exception &e)
-	{
-		reader.exception_message = e.what();
-		luxem_rawread_get_error(context)->pointer = &cxx_error_token;
-		return false;
-	}
+		value_done(reader);
+	});
 }
 
 static luxem_bool_t translate_array_begin(luxem_rawread_context_t *context, void *user_data)
 {
-	raw_reader &reader = *reinterpret_cast<raw_reader *>(user_data);
-	try
+	return translate(context, user_data, [](raw_reader &reader)
 	{
+		opened(reader, false);
+		++reader.depth;
 		reader.array_begin();
-		return true;
-	}
-	catch (std::exception &e)
-	{
-		reader.exception_message = e.what();
-		luxem_rawread_get_error(context)->pointer = &cxx_error_token;
-		return false;
-	}
+	});
 }
 
 static luxem_bool_t translate_array_end(luxem_rawread_context_t *context, void *user_data)
 {
-	raw_reader &reader = *reinterpret_cast<raw_reader *>(user_data);
-	try
+	return translate(context, user_data, [](raw_reader &reader)
 	{
+		completed(reader, true);
+		--reader.depth;
 		reader.array_end();
-		return true;
-	}
-	catch (std::exception &e)
-	{
-		reader.exception_message = e.what();
-		luxem_rawread_get_error(context)->pointer = &cxx_error_token;
-		return false;
-	}
+		value_done(reader);
+	});
 }
 
 static luxem_bool_t translate_key(luxem_rawread_context_t *context, void *user_data, luxem_string_t const *data)
 {
-	raw_reader &reader = *reinterpret_cast<raw_reader *>(user_data);
-	try
+	return translate(context, user_data, [data](raw_reader &reader)
 	{
+		if (reader.chunked) reader.chunked->key_next = false;
 		reader.key(std::string(data->pointer, data->length));
-		return true;
-	}
-	catch (std::exception &e)
-	{
-		reader.exception_message = e.what();
-		luxem_rawread_get_error(context)->pointer = &cxx_error_token;
-		return false;
-	}
+	});
 }
 
 static luxem_bool_t translate_type(luxem_rawread_context_t *context, void *user_data, luxem_string_t const *data)
-{
-	raw_reader &reader = *reinterpret_cast<raw_reader *>(user_data);
-	try
-	{
-		reader.type(std::string(data->pointer, data->length));
-		return true;
-	}
-	catch (std::exception &e)
-	{
-		reader.exception_message = e.what();
-		luxem_rawread_get_error(context)->pointer = &cxx_error_token;
-		return false;
-	}
-}
+	{ return translate(context, user_data, [data](raw_reader &reader) { reader.type(std::string(data->pointer, data->length)); }); }
 
 static luxem_bool_t translate_primitive(luxem_rawread_context_t *context, void *user_data, luxem_string_t const *data)
 {
-	raw_reader &reader = *reinterpret_cast<raw_reader *>(user_data);
-	try
+	return translate(context, user_data, [data](raw_reader &reader)
 	{
+		if (reader.chunked)
+		{
+			auto &state = *reader.chunked;
+			completed(reader, false);
+			if (state.substituting)
+			{
+				if (reader.end_chunk()) value_done(reader);
+				return;
+			}
+			if (data->length > state.chunk_size)
+			{
+				state.begin();
+				if (!reader.failed && reader.emit_chunk(data->pointer, data->length) && reader.end_chunk()) value_done(reader);
+				return;
+			}
+		}
 		reader.primitive(std::string(data->pointer, data->length));
-		return true;
-	}
-	catch (std::exception &e)
-	{
-		reader.exception_message = e.what();
-		luxem_rawread_get_error(context)->pointer = &cxx_error_token;
-		return false;
-	}
+		value_done(reader);
+	});
 }
 
 raw_reader::raw_reader
@@ -145,7 +159,17 @@ raw_reader::raw_reader
 	array_end(array_end),
 	key(key),
 	type(type),
-	primitive(primitive)
+	primitive(primitive),
+	failed(false),
+	failure_message(nullptr),
+	depth(0),
+	elements(0)
+	{ attach(); }
+
+raw_reader::~raw_reader(void)
+	{ luxem_rawread_destroy(context); }
+
+void raw_reader::attach(void)
 {
 	auto callbacks = luxem_rawread_callbacks(context);
 	callbacks->object_begin = translate_object_begin;
@@ -158,38 +182,351 @@ raw_reader::raw_reader
 	callbacks->user_data = this;
 }
 
-raw_reader::~raw_reader(void)
-	{ luxem_rawread_destroy(context); }
+void raw_reader::reset(void)
+{
+	luxem_rawread_destroy(context);
+	context = luxem_rawread_construct();
+	attach();
+	exception_message.clear();
+	failed = false;
+	failure_message = nullptr;
+	depth = 0;
+	elements = 0;
+	if (chunked) reset_chunks();
+}
+
+size_t raw_reader::get_depth(void) const { return depth; }
+
+uint64_t raw_reader::get_elements(void) const { return elements; }
 
 size_t raw_reader::feed(std::string const &data, bool finish)
 	{ return feed(data.c_str(), data.length(), finish); }
 
-static void throw_feed_error(raw_reader &reader)
+void raw_reader::fail(char const *message) noexcept
 {
-	auto message = luxem_rawread_get_error(reader.context);
+	failed = true;
+	failure_message = message;
+}
 
-	std::stringstream combined_message;
-	combined_message << "Encountered error at offset " << luxem_rawread_get_position(reader.context) << ": ";
+error raw_reader::get_error(void)
+{
+	auto message = luxem_rawread_get_error(context);
+	auto offset = luxem_rawread_get_position(context);
+	if (chunked) offset += chunked->position_adjust;
 	assert(message->pointer);
-	if (message->pointer != &cxx_error_token)
-		combined_message.write(message->pointer, message->length);
-	else if (!reader.exception_message.empty())
-		combined_message << reader.exception_message;
-	else combined_message << "Callback provided no error message.";
-	throw std::runtime_error(combined_message.str());
+	if (message->pointer != &cxx_error_token) 
+		return error(error::code::syntax, offset, message->pointer, message->length);
+	return error(error::code::handler, offset, failure_message, failure_message ? strlen(failure_message) : 0);
 }
 
-size_t raw_reader::feed(char const *pointer, size_t length, bool finish)
+error raw_reader::try_feed(char const *pointer, size_t length, size_t &eaten, bool finish) noexcept
 {
-	size_t eaten = 0;
+	failed = false;
+	eaten = 0;
+	if (chunked)
+	{
+		try
+		{
+			return feed_chunked(pointer, length, eaten, finish);
+		}
+		catch (std::exception &e)
+		{
+			exception_message = e.what();
+			failed = true;
+			failure_message = exception_message.empty() ? nullptr : exception_message.c_str();
+		}
+		catch (...)
+		{
+			failed = true;
+			failure_message = nullptr;
+		}
+		luxem_rawread_get_error(context)->pointer = &cxx_error_token;
+		return get_error();
+	}
 	luxem_string_t temp{pointer, length};
-	if (!luxem_rawread_feed(context, &temp, &eaten, finish)) { throw_feed_error(*this); }
+	if (!luxem_rawread_feed(context, &temp, &eaten, finish)) return get_error();
+	return {};
+}
+
+error raw_reader::try_feed(FILE *file) noexcept
+{
+	failed = false;
+	if (chunked)
+	{
+		// The C reader buffers whole tokens, so read here and let feed_chunked stream the large ones
+		std::vector<char> buffer;
+		try
+		{
+			buffer.resize(std::max<size_t>(chunked->chunk_size * 2 + 2, 1 << 16));
+		}
+		catch (std::exception &)
+		{
+			fail("Failed to allocate read buffer.");
+			luxem_rawread_get_error(context)->pointer = &cxx_error_token;
+			return get_error();
+		}
+		size_t used = 0;
+		while (true)
+		{
+			auto got = fread(buffer.data() + used, 1, buffer.size() - used, file);
+			bool at_end = got == 0;
+			used += got;
+			size_t eaten;
+			auto result = try_feed(buffer.data(), used, eaten, at_end);
+			if (result || at_end) return result;
+			std::memmove(buffer.data(), buffer.data() + eaten, used - eaten);
+			used -= eaten;
+			if (used == buffer.size())
+			{
+				try
+				{
+					buffer.resize(buffer.size() * 2);
+				}
+				catch (std::exception &)
+				{
+					fail("Failed to allocate read buffer.");
+					luxem_rawread_get_error(context)->pointer = &cxx_error_token;
+					return get_error();
+				}
+			}
+		}
+	}
+	if (!luxem_rawread_feed_file(context, file, nullptr, nullptr)) return get_error();
+	return {};
+}
+
+void raw_reader::set_chunked_primitives(
+	size_t chunk_size,
+	std::function<void(void)> begin,
+	std::function<void(char const *pointer, size_t length)> chunk,
+	std::function<void(void)> end,
+	bool decode_ascii16)
+{
+	if (chunk_size == 0) throw std::runtime_error("Primitive chunk size must be greater than 0.");
+	chunked = std::make_unique<chunking>();
+	chunked->chunk_size = chunk_size;
+	chunked->begin = std::move(begin);
+	chunked->chunk = std::move(chunk);
+	chunked->end = std::move(end);
+	chunked->decode_ascii16 = decode_ascii16;
+	chunked->pending.reserve(chunk_size);
+	reset_chunks();
+}
+
+void raw_reader::reset_chunks(void)
+{
+	chunked->in_object.clear();
+	chunked->key_next = false;
+	chunked->active = false;
+	chunked->quoted = false;
+	chunked->escaped = false;
+	chunked->substituting = false;
+	chunked->has_carry = false;
+	chunked->carry = 0;
+	chunked->pending.clear();
+	chunked->decoded.clear();
+	chunked->position_adjust = 0;
+}
+
+static char const unterminated_message[] = "Unterminated quoted string.";
+
+error raw_reader::feed_chunked(char const *pointer, size_t length, size_t &eaten, bool finish)
+{
+	auto &state = *chunked;
+	size_t offset = 0;
+	while (true)
+	{
+		if (state.active)
+		{
+			auto consumed = continue_chunk(pointer + offset, length - offset, finish);
+			offset += consumed;
+			state.position_adjust += consumed;
+			eaten = offset;
+			if (failed)
+			{
+				luxem_rawread_get_error(context)->pointer = &cxx_error_token;
+				return get_error();
+			}
+			if (state.active)
+			{
+				if (!finish) return {};
+				auto message = luxem_rawread_get_error(context);
+				message->pointer = unterminated_message;
+				message->length = sizeof(unterminated_message) - 1;
+				return get_error();
+			}
+
+			// Stand in for the streamed value so the parser's state moves past it
+			luxem_string_t const placeholder{"\"\"", 2};
+			size_t ignored;
+			state.substituting = true;
+			auto succeeded = luxem_rawread_feed(context, &placeholder, &ignored, false);
+			state.substituting = false;
+			state.position_adjust -= placeholder.length;
+			if (!succeeded) return get_error();
+		}
+
+		size_t part = 0;
+		luxem_string_t temp{pointer + offset, length - offset};
+		auto succeeded = luxem_rawread_feed(context, &temp, &part, finish);
+		offset += part;
+		eaten = offset;
+		if (!succeeded) return get_error();
+		if (finish) return {};
+
+		// Whatever is left is an incomplete token, stream it if it's an oversized value
+		size_t start = offset;
+		while ((start < length) && ((pointer[start] == ' ') || (pointer[start] == '\t') || (pointer[start] == '\n') || (pointer[start] == '\r')))
+			++start;
+		if (!starts_chunk(pointer + start, length - start)) return {};
+		state.position_adjust += start - offset;
+		offset = start;
+		state.active = true;
+		state.quoted = pointer[offset] == '"';
+		state.escaped = false;
+		state.has_carry = false;
+		if (state.quoted)
+		{
+			++offset;
+			++state.position_adjust;
+		}
+		eaten = offset;
+		state.begin();
+		if (failed)
+		{
+			luxem_rawread_get_error(context)->pointer = &cxx_error_token;
+			return get_error();
+		}
+	}
+}
+
+bool raw_reader::starts_chunk(char const *pointer, size_t length) const
+{
+	auto const &state = *chunked;
+	if (state.key_next || (length <= state.chunk_size)) return false;
+	if (pointer[0] != '"') return !is_delimiter(pointer[0]);
+	size_t content = 0;
+	bool escaped = false;
+	for (size_t index = 1; index < length; ++index)
+	{
+		if (escaped) escaped = false;
+		else if (pointer[index] == '\\')
+		{
+			escaped = true;
+			continue;
+		}
+		else if (pointer[index] == '"') return false;
+		++content;
+	}
+	return content > state.chunk_size;
+}
+
+size_t raw_reader::continue_chunk(char const *pointer, size_t length, bool finish)
+{
+	auto &state = *chunked;
+	if (!state.quoted)
+	{
+		size_t end = 0;
+		while ((end < length) && !is_delimiter(pointer[end])) ++end;
+		if (!emit_chunk(pointer, end)) return end;
+		if ((end < length) || finish) state.active = false;
+		return end;
+	}
+
+	size_t index = 0;
+	for (; index < length; ++index)
+	{
+		auto character = pointer[index];
+		if (state.escaped) state.escaped = false;
+		else if (character == '\\')
+		{
+			state.escaped = true;
+			continue;
+		}
+		else if (character == '"')
+		{
+			++index;
+			state.active = false;
+			break;
+		}
+		state.pending += character;
+		if (state.pending.size() == state.chunk_size)
+		{
+			if (!emit_chunk(state.pending.data(), state.pending.size())) return index + 1;
+			state.pending.clear();
+		}
+	}
+	if (!state.active && !state.pending.empty())
+	{
+		emit_chunk(state.pending.data(), state.pending.size());
+		state.pending.clear();
+	}
+	return index;
+}
+
+bool raw_reader::emit_chunk(char const *pointer, size_t length)
+{
+	auto &state = *chunked;
+	while (length > 0)
+	{
+		auto piece = std::min(length, state.chunk_size);
+		if (!state.decode_ascii16) state.chunk(pointer, piece);
+		else
+		{
+			auto source = pointer;
+			auto remaining = piece;
+			size_t used = 0;
+			state.decoded.resize((piece + (state.has_carry ? 1 : 0)) / 2);
+			auto out = reinterpret_cast<uint8_t *>(&state.decoded[0]);
+			if (state.has_carry)
+			{
+				char const pair[2] = {state.carry, *source};
+				decode_ascii16(pair, 2, out);
+				++source;
+				--remaining;
+				used = 1;
+				state.has_carry = false;
+			}
+			decode_ascii16(source, remaining & ~size_t(1), out + used);
+			used += remaining / 2;
+			if (remaining % 2)
+			{
+				state.carry = source[remaining - 1];
+				state.has_carry = true;
+			}
+			if (used > 0) state.chunk(state.decoded.data(), used);
+		}
+		if (failed) return false;
+		pointer += piece;
+		length -= piece;
+	}
+	return true;
+}
+
+bool raw_reader::end_chunk(void)
+{
+	auto &state = *chunked;
+	if (state.has_carry)
+	{
+		state.has_carry = false;
+		throw std::runtime_error("Ascii16 data has odd length.");
+	}
+	state.end();
+	return !failed;
+}
+
+size_t raw_reader::feed(char const *pointer, size_t length, bool finish)
+{
+	size_t eaten;
+	auto result = try_feed(pointer, length, eaten, finish);
+	if (result) throw std::runtime_error(result.get_message());
 	return eaten;
 }
 
 void raw_reader::feed(FILE *file)
 {
-	if (!luxem_rawread_feed_file(context, file, nullptr, nullptr)) { throw_feed_error(*this); }
+	auto result = try_feed(file);
+	if (result) throw std::runtime_error(result.get_message());
 }
 
 static void build_struct(
@@ -247,14 +584,14 @@ static void build_struct(
 	}
 }
 
-reader::object_context::object_context(std::string &&type, object_stackable &base) : value(type), base(base) {}
+reader::object_context::object_context(std::string &&type, object_stackable &base) : value(kind::object_context, std::move(type)), base(base) {}
 
-reader::object_context::object_context(object_stackable &base) : base(base) {}
+reader::object_context::object_context(object_stackable &base) : value(kind::object_context), base(base) {}
 		
+constexpr value::kind reader::object_context::node_kind;
+
 std::string const reader::object_context::name("object_context");
 
-std::string const &reader::object_context::get_name(void) const { return name; }
-		
 void reader::object_context::set_austerity_measures(bool on) { base.austerity_measures = on; }
 
 void reader::object_context::element(std::string &&key, std::function<void(std::shared_ptr<value> &&)> &&callback)
@@ -295,13 +632,26 @@ void reader::object_context::finally(std::function<void(void)> &&callback)
 	base.finish_callback = callback; 
 }
 
-reader::array_context::array_context(std::string &&type, array_stackable &base) : value(type), base(base) {}
+reader::array_context::array_context(std::string &&type, array_stackable &base) : value(kind::array_context, std::move(type)), base(base) {}
+
+reader::array_context::array_context(array_stackable &base) : value(kind::array_context), base(base) { }
 
-reader::array_context::array_context(array_stackable &base) : base(base) { }
+constexpr value::kind reader::array_context::node_kind;
 
 std::string const reader::array_context::name("array_context");
 
-std::string const &reader::array_context::get_name(void) const { return name; }
+namespace
+{
+	// struct.cxx only names the tree's own kinds, so it doesn't depend on the reader
+	struct register_context_kinds
+	{
+		register_context_kinds(void)
+		{
+			value::register_kind(reader::object_context::node_kind, reader::object_context::name);
+			value::register_kind(reader::array_context::node_kind, reader::array_context::name);
+		}
+	} const context_kinds;
+}
 
 void reader::array_context::element(std::function<void(std::shared_ptr<value> &&data)> &&callback)
 {
@@ -349,11 +699,23 @@ reader::reader(bool austerity_measures) :
 		[this](std::string &&data) { process(std::make_shared<luxem::primitive>(std::move(data))); }
 	),
 	has_key(false),
-	has_type(false)
+	has_type(false),
+	types(nullptr)
 {
 	stack.emplace_back(std::make_unique<array_stackable>());
 }
 
+void reader::reset(void)
+{
+	raw_reader::reset();
+	// Only the root keeps its handlers; everything above it belonged to the abandoned document
+	while (stack.size() > 1) stack.pop_back();
+	has_key = false;
+	current_key.clear();
+	has_type = false;
+	current_type.clear();
+}
+
 reader &reader::element(std::function<void(std::shared_ptr<value> &&data)> &&callback)
 {
 	assert(!stack.empty());
@@ -369,6 +731,12 @@ reader &reader::build_struct(std::function<void(std::shared_ptr<value> &&data)>
 	array_context(*reinterpret_cast<array_stackable *>(stack.front().get())).build_struct(std::move(callback));
 	return *this;
 }
+
+reader &reader::set_types(type_registry const *types)
+{
+	this->types = types;
+	return *this;
+}
 			
 reader::stackable::~stackable(void) {}
 
@@ -411,7 +779,13 @@ void reader::process(std::shared_ptr<value> &&data)
 {
 	assert(!stack.empty());
 	if (stack.empty()) return;
-	if (has_type) data->set_type(std::move(current_type));
+	if (has_type)
+	{
+		// Containers arrive here as contexts, so only primitives are decoded
+		auto decode_as = (types && data->is<luxem::primitive>()) ? types->find(current_type) : no_type_id;
+		data->set_type(std::move(current_type));
+		if (decode_as != no_type_id) data = types->decode(decode_as, std::move(data));
+	}
 	stack.back()->process(std::move(data), std::move(current_key));
 	has_type = false;
 	has_key = false;
@@ -423,24 +797,196 @@ void reader::pop(void)
 	stack.pop_back();
 }
 
-template <typename ...argument_types> 
-	std::vector<std::shared_ptr<luxem::value>> read_struct_implementation(argument_types ...arguments)
+struct_builder::struct_builder(void) : 
+	raw_reader(
+		[this]() { open<object>(); },
+		[this]() { close(); },
+		[this]() { open<array>(); },
+		[this]() { close(); },
+		[this](std::string &&data) { current_key = std::move(data); },
+		[this](std::string &&data) { has_type = true; current_type = std::move(data); },
+		[this](std::string &&data) { place(std::make_shared<luxem::primitive>(std::move(data))); }
+	),
+	completed(0),
+	has_type(false),
+	types(nullptr)
+	{}
+
+struct_builder::struct_builder(std::function<void(std::shared_ptr<value> &&document)> deliver) : struct_builder()
+	{ this->deliver = std::move(deliver); }
+
+void struct_builder::reset(void)
 {
-	std::vector<std::shared_ptr<luxem::value>> out;
-	reader instance;
-	instance.build_struct([&out](std::shared_ptr<luxem::value> &&data) { out.emplace_back(std::move(data)); });
-	instance.feed(std::forward<argument_types>(arguments)...);
+	raw_reader::reset();
+	stack.clear();
+	documents.clear();
+	completed = 0;
+	has_type = false;
+	current_type.clear();
+	current_key.clear();
+	if (subtrees) subtrees->clear();
+}
+
+std::vector<std::shared_ptr<value>> struct_builder::take(void)
+{
+	std::vector<std::shared_ptr<value>> out;
+	if (completed == documents.size()) out.swap(documents);
+	else
+	{
+		out.assign(std::make_move_iterator(documents.begin()), std::make_move_iterator(documents.begin() + completed));
+		documents.erase(documents.begin(), documents.begin() + completed);
+	}
+	completed = 0;
 	return out;
 }
 
+struct_builder &struct_builder::set_deduplicate(bool on)
+{
+	if (!on) subtrees.reset();
+	else if (!subtrees) subtrees.reset(new subtree_table());
+	return *this;
+}
+
+subtree_table const *struct_builder::get_subtrees(void) const { return subtrees.get(); }
+
+struct_builder &struct_builder::set_types(type_registry const *types)
+{
+	// Bound handlers are indexed by the old registry's ids
+	if (types != this->types) bound.clear();
+	this->types = types;
+	return *this;
+}
+
+struct_builder &struct_builder::on_complete(std::function<void(std::shared_ptr<value> const &node, std::string const *key)> &&callback)
+{
+	completed_callback = std::move(callback);
+	return *this;
+}
+
+value const *struct_builder::get_open(size_t depth) const
+	{ return depth < stack.size() ? stack[depth].container.get() : nullptr; }
+
+// Containers are attached to their parent when they open, so closing one is just a pop; the first of duplicate keys wins
+std::shared_ptr<value> *struct_builder::place(std::shared_ptr<value> &&data, std::string const **key)
+{
+	if (has_type)
+	{
+		// Containers are looked up when they open
+		auto typed_as = (types && data->is<luxem::primitive>()) ? types->find(current_type) : no_type_id;
+		data->set_type(std::move(current_type));
+		has_type = false;
+		if (typed_as != no_type_id)
+		{
+			data = types->decode(typed_as, std::move(data));
+			build_bound(typed_as, *data);
+		}
+	}
+	if (stack.empty())
+	{
+		documents.emplace_back(std::move(data));
+		if (documents.back()->is<luxem::primitive>())
+		{
+			if (completed_callback) completed_callback(documents.back(), nullptr);
+			complete();
+		}
+		return nullptr;
+	}
+	bool is_primitive = data->is<luxem::primitive>();
+	if (subtrees && is_primitive) data = subtrees->intern(std::move(data));
+	auto &top = stack.back();
+	std::shared_ptr<value> *slot = nullptr;
+	std::string const *placed_key = nullptr;
+	if (top.is_object)
+	{
+		auto inserted = static_cast<object *>(top.container.get())->get_data().insert(std::make_pair(std::move(current_key), std::move(data)));
+		if (inserted.second)
+		{
+			slot = &inserted.first->second;
+			placed_key = &inserted.first->first;
+		}
+	}
+	else
+	{
+		auto &elements = static_cast<array *>(top.container.get())->get_data();
+		elements.emplace_back(std::move(data));
+		slot = &elements.back();
+	}
+	if (key) *key = placed_key;
+	if (is_primitive && slot && completed_callback) completed_callback(*slot, placed_key);
+	return slot;
+}
+
+template <typename container_type> void struct_builder::open(void)
+{
+	std::shared_ptr<value> out = std::make_shared<container_type>();
+	auto typed_as = (types && has_type) ? types->find(current_type) : no_type_id;
+	std::string const *key = nullptr;
+	auto slot = place(std::shared_ptr<value>(out), &key);
+	stack.push_back(frame{std::move(out), slot, std::is_same<container_type, object>::value, typed_as, key});
+}
+
+// Nothing is added to a parent while a child is open, so the slot is still valid
+void struct_builder::close(void)
+{
+	auto &top = stack.back();
+	// Top-level documents have no slot in a parent
+	auto placed = top.slot ? top.slot : ((stack.size() == 1) ? &documents.back() : nullptr);
+	if (top.typed_as != no_type_id)
+	{
+		if (placed && types->has_decoder(top.typed_as)) *placed = types->decode(top.typed_as, std::move(*placed));
+		build_bound(top.typed_as, placed ? **placed : *top.container);
+	}
+	if (subtrees && top.slot) *top.slot = subtrees->intern(std::move(*top.slot));
+	auto key = top.key;
+	stack.pop_back();
+	if (placed && completed_callback) completed_callback(*placed, key);
+	if (stack.empty()) complete();
+}
+
+void struct_builder::complete(void)
+{
+	if (!deliver)
+	{
+		++completed;
+		return;
+	}
+	auto document = std::move(documents.back());
+	documents.pop_back();
+	deliver(std::move(document));
+}
+
+void struct_builder::build_bound(type_id id, value const &node) const
+	{ if ((id < bound.size()) && bound[id]) bound[id](node); }
+
+// Each thread keeps one builder for read_struct, so reading many small documents doesn't construct one each time
+template <typename ...argument_types> 
+	std::vector<std::shared_ptr<luxem::value>> read_struct_implementation(type_registry const *types, argument_types ...arguments)
+{
+	return thread_pooled<struct_builder>::use([&](struct_builder &instance)
+	{
+		instance.set_types(types);
+		instance.feed(std::forward<argument_types>(arguments)...);
+		return instance.take();
+	});
+}
+
 std::vector<std::shared_ptr<luxem::value>> read_struct(std::string const &data) 
-	{ return read_struct_implementation(data); }
+	{ return read_struct_implementation(nullptr, data); }
 
 std::vector<std::shared_ptr<luxem::value>> read_struct(char const *pointer, size_t length)
-	{ return read_struct_implementation(pointer, length); }
+	{ return read_struct_implementation(nullptr, pointer, length); }
 
 std::vector<std::shared_ptr<luxem::value>> read_struct(FILE *file)
-	{ return read_struct_implementation(file); }
+	{ return read_struct_implementation(nullptr, file); }
+
+std::vector<std::shared_ptr<luxem::value>> read_struct(std::string const &data, type_registry const &types)
+	{ return read_struct_implementation(&types, data); }
+
+std::vector<std::shared_ptr<luxem::value>> read_struct(char const *pointer, size_t length, type_registry const &types)
+	{ return read_struct_implementation(&types, pointer, length); }
+
+std::vector<std::shared_ptr<luxem::value>> read_struct(FILE *file, type_registry const &types)
+	{ return read_struct_implementation(&types, file); }
 
 }
 
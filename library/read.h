@@ -7,6 +7,9 @@
 #include <memory>
 
 #include "struct.h"
+#include "misc.h"
+#include "dedup.h"
+#include "registry.h"
 
 struct luxem_rawread_context_t;
 
@@ -30,6 +33,32 @@ struct raw_reader
 	size_t feed(char const *pointer, size_t length, bool finish=true);
 	void feed(FILE *file);
 
+	// Never throw; the error's message refers to reader state and is valid until the next feed
+	error try_feed(char const *pointer, size_t length, size_t &eaten, bool finish=true) noexcept;
+	error try_feed(FILE *file) noexcept;
+
+	// Called from a handler to reject the input without throwing, message must outlive the feed
+	void fail(char const *message = nullptr) noexcept;
+
+	// Abandons any partial document so the next feed starts fresh; handlers and buffers are kept
+	// The C context has no reset of its own, so it's replaced, which is a single small allocation
+	// Not to be called from a handler
+	void reset(void);
+
+	// Containers open at the current point in the input
+	size_t get_depth(void) const;
+	// Top-level values completed since construction or the last reset
+	uint64_t get_elements(void) const;
+
+	// Primitives longer than chunk_size skip the primitive callback and arrive in pieces of at most chunk_size
+	// instead, ascii16 decoded if requested, so memory stays bounded by chunk_size rather than the value
+	void set_chunked_primitives(
+		size_t chunk_size,
+		std::function<void(void)> begin,
+		std::function<void(char const *pointer, size_t length)> chunk,
+		std::function<void(void)> end,
+		bool decode_ascii16 = false);
+
 	// PRIVATE - but not actually, since cxx has near useless visibility definition
 		luxem_rawread_context_t *context;
 		std::function<void(void)> object_begin;
@@ -40,6 +69,40 @@ struct raw_reader
 		std::function<void(std::string &&data)> type;
 		std::function<void(std::string &&data)> primitive;
 		std::string exception_message;
+		bool failed;
+		char const *failure_message;
+		size_t depth;
+		uint64_t elements;
+
+		struct chunking
+		{
+			size_t chunk_size;
+			std::function<void(void)> begin;
+			std::function<void(char const *pointer, size_t length)> chunk;
+			std::function<void(void)> end;
+			bool decode_ascii16;
+			small_stack<char> in_object;
+			bool key_next;
+			bool active;
+			bool quoted;
+			bool escaped;
+			bool substituting;
+			bool has_carry;
+			char carry;
+			std::string pending;
+			std::string decoded;
+			size_t position_adjust;
+		};
+		std::unique_ptr<chunking> chunked;
+
+		void attach(void);
+		void reset_chunks(void);
+		error get_error(void);
+		error feed_chunked(char const *pointer, size_t length, size_t &eaten, bool finish);
+		size_t continue_chunk(char const *pointer, size_t length, bool finish);
+		bool starts_chunk(char const *pointer, size_t length) const;
+		bool emit_chunk(char const *pointer, size_t length);
+		bool end_chunk(void);
 };
 
 struct reader : raw_reader
@@ -51,6 +114,8 @@ struct reader : raw_reader
 
 	struct object_context : value
 	{
+		static constexpr kind node_kind = kind::object_context;
+
 		object_context(std::string &&type, object_stackable &base);
 		object_context(object_stackable &base);
 	
@@ -60,7 +125,6 @@ struct reader : raw_reader
 		object_context &operator =(object_context &&) = delete;
 
 		static std::string const name;
-		std::string const &get_name(void) const override;
 
 		void set_austerity_measures(bool on);
 
@@ -78,6 +142,8 @@ struct reader : raw_reader
 
 	struct array_context : value
 	{
+		static constexpr kind node_kind = kind::array_context;
+
 		array_context(std::string &&type, array_stackable &base);
 		array_context(array_stackable &base);
 	
@@ -87,7 +153,6 @@ struct reader : raw_reader
 		array_context &operator =(array_context &&) = delete;
 
 		static std::string const name;
-		std::string const &get_name(void) const override;
 
 		void element(std::function<void(std::shared_ptr<value> &&)> &&callback);
 		void build_struct(
@@ -99,8 +164,12 @@ struct reader : raw_reader
 	};
 
 	reader(bool austerity_measures = true);
+	// Keeps the element and build_struct handlers registered on the root
+	void reset(void);
 	reader &element(std::function<void(std::shared_ptr<value> &&data)> &&callback);
 	reader &build_struct(std::function<void(std::shared_ptr<value> &&data)> &&callback);
+	// Decodes typed primitives before they reach handlers; types must outlive the reader
+	reader &set_types(type_registry const *types);
 
 	private:
 		struct stackable
@@ -140,14 +209,88 @@ struct reader : raw_reader
 		std::string current_key;
 		bool has_type;
 		std::string current_type;
+		type_registry const *types;
 
 		void process(std::shared_ptr<value> &&data);
 		void pop(void);
 };
 
+// Assembles trees straight from raw events with an explicit stack, without contexts or per-value callbacks
+struct struct_builder : raw_reader
+{
+	struct_builder(void);
+	// Hands each document over as soon as it's complete, instead of keeping it for take
+	struct_builder(std::function<void(std::shared_ptr<value> &&document)> deliver);
+
+	// Keeps the stack's capacity, and forgets the subtrees seen when deduplicating
+	void reset(void);
+	// Moves out the documents completed so far
+	std::vector<std::shared_ptr<value>> take(void);
+
+	// Reuses an earlier node for each subtree equal to one already read, across all documents until reset;
+	// the trees built must not be modified
+	struct_builder &set_deduplicate(bool on);
+	subtree_table const *get_subtrees(void) const;
+
+	// Replaces each node whose type has a decoder as it completes, before deduplication; types must outlive the builder
+	struct_builder &set_types(type_registry const *types);
+	// Builds a data_type from each node of its bound type as soon as the node completes, rather than after the parse;
+	// the node stays in the tree.  Call after set_types
+	template <typename data_type> struct_builder &on_bound(std::function<void(type_id id, data_type &&data)> &&callback)
+	{
+		if (!types) throw std::runtime_error("Set types before handling bound types.");
+		auto id = types->expect_bound(types->find<data_type>(), typeid(data_type).name());
+		auto convert = types->converter<data_type>(id);
+		if (bound.size() <= id) bound.resize(id + 1);
+		bound[id] = [id, convert, callback](value const &node) { callback(id, (*convert)(node)); };
+		return *this;
+	}
+
+	// Called with each node once it's complete and in its parent, along with its key when the parent is an object;
+	// get_depth then counts the node's open ancestors.  Nodes dropped under a duplicate key aren't reported
+	struct_builder &on_complete(std::function<void(std::shared_ptr<value> const &node, std::string const *key)> &&callback);
+	// The container open at depth, 0 being the document; null if fewer are open
+	value const *get_open(size_t depth) const;
+
+	// PRIVATE
+		// Shares ownership, since a container under a duplicate key is dropped by its parent
+		struct frame
+		{
+			std::shared_ptr<value> container;
+			// Where the parent holds the container, null at the top level or under a duplicate key
+			std::shared_ptr<value> *slot;
+			bool is_object;
+			// Looked up when the container opens, so it isn't hashed again on close
+			type_id typed_as;
+			// Points into the parent object, null elsewhere
+			std::string const *key;
+		};
+		std::vector<frame> stack;
+		std::vector<std::shared_ptr<value>> documents;
+		size_t completed;
+		std::function<void(std::shared_ptr<value> &&document)> deliver;
+		bool has_type;
+		std::string current_type;
+		std::string current_key;
+		std::unique_ptr<subtree_table> subtrees;
+		type_registry const *types;
+		// Indexed by type id, so a completed node finds its handler without another lookup
+		std::vector<std::function<void(value const &node)>> bound;
+		std::function<void(std::shared_ptr<value> const &node, std::string const *key)> completed_callback;
+
+		std::shared_ptr<value> *place(std::shared_ptr<value> &&data, std::string const **key = nullptr);
+		template <typename container_type> void open(void);
+		void close(void);
+		void complete(void);
+		void build_bound(type_id id, value const &node) const;
+};
+
 std::vector<std::shared_ptr<luxem::value>> read_struct(std::string const &data) ;
 std::vector<std::shared_ptr<luxem::value>> read_struct(char const *pointer, size_t length);
 std::vector<std::shared_ptr<luxem::value>> read_struct(FILE *file);
+std::vector<std::shared_ptr<luxem::value>> read_struct(std::string const &data, type_registry const &types);
+std::vector<std::shared_ptr<luxem::value>> read_struct(char const *pointer, size_t length, type_registry const &types);
+std::vector<std::shared_ptr<luxem::value>> read_struct(FILE *file, type_registry const &types);
 
 }
 
@@ -0,0 +1,112 @@
+#include "registry.h"
+
+namespace luxem
+{
+
+type_registry::type_registry(void) : entries(1) {}
+
+type_id type_registry::intern(std::string const &name)
+{
+	auto found = ids.find(name);
+	if (found != ids.end()) return found->second;
+	auto id = static_cast<type_id>(entries.size());
+	entries.emplace_back();
+	entries.back().name = name;
+	ids.emplace(name, id);
+	return id;
+}
+
+type_id type_registry::find(std::string const &name) const
+{
+	auto found = ids.find(name);
+	return found == ids.end() ? no_type_id : found->second;
+}
+
+type_id type_registry::find(value const &node) const
+	{ return node.has_type() ? find(node.get_type()) : no_type_id; }
+
+std::string const &type_registry::get_name(type_id id) const
+{
+	if ((id == no_type_id) || (id >= entries.size()))
+	{
+		std::stringstream message;
+		message << "No type with id " << id << ".";
+		throw std::runtime_error(message.str());
+	}
+	return entries[id].name;
+}
+
+size_t type_registry::size(void) const { return entries.size() - 1; }
+
+type_registry &type_registry::set_decoder(std::string const &name, decoder &&decode)
+{
+	entries[intern(name)].decode = std::move(decode);
+	return *this;
+}
+
+bool type_registry::has_decoder(type_id id) const
+	{ return (id < entries.size()) && static_cast<bool>(entries[id].decode); }
+
+std::shared_ptr<value> type_registry::decode(std::shared_ptr<value> &&node) const
+	{ return decode(find(*node), std::move(node)); }
+
+std::shared_ptr<value> type_registry::decode(type_id id, std::shared_ptr<value> &&node) const
+{
+	if (!has_decoder(id)) return std::move(node);
+	auto out = entries[id].decode(std::move(node));
+	if (!out)
+	{
+		std::stringstream message;
+		message << "Decoder for type (" << entries[id].name << ") returned nothing.";
+		throw std::runtime_error(message.str());
+	}
+	return out;
+}
+
+// The number is cached alongside the text, so later reads are free; text that doesn't read back exactly is an error
+static std::shared_ptr<value> expect_native(std::shared_ptr<value> &&node, primitive::native_kind kind)
+{
+	auto &data = node->as<primitive>();
+	if (data.cache_native(kind)) return std::move(node);
+	std::stringstream message;
+	message << "Invalid (" << node->get_type() << ") value '" << data.get_primitive() << "'.";
+	throw std::runtime_error(message.str());
+}
+
+type_registry &type_registry::add_standard(void)
+{
+	set_decoder("int", [](std::shared_ptr<value> &&node)
+		{ return expect_native(std::move(node), primitive::native_kind::signed_integer); });
+	set_decoder("uint", [](std::shared_ptr<value> &&node)
+		{ return expect_native(std::move(node), primitive::native_kind::unsigned_integer); });
+	set_decoder("float", [](std::shared_ptr<value> &&node)
+		{ return expect_native(std::move(node), primitive::native_kind::floating); });
+	set_decoder("bool", [](std::shared_ptr<value> &&node)
+		{ return expect_native(std::move(node), primitive::native_kind::boolean); });
+	set_decoder("ascii16", [](std::shared_ptr<value> &&node) -> std::shared_ptr<value>
+	{
+		auto bytes = node->as<primitive>().get_ascii16();
+		return std::make_shared<primitive>(std::string(bytes.begin(), bytes.end()));
+	});
+	return *this;
+}
+
+type_id type_registry::expect_bound(type_id id, char const *native_name) const
+{
+	if (id != no_type_id) return id;
+	std::stringstream message;
+	message << "No type name is bound to C++ type " << native_name << ".";
+	throw std::runtime_error(message.str());
+}
+
+void type_registry::mismatch(type_id id, value const &node) const
+{
+	std::stringstream message;
+	message << "Expected type (" << entries[id].name << "), found ";
+	if (node.has_type()) message << "(" << node.get_type() << ")";
+	else message << "no type";
+	message << ".";
+	throw std::runtime_error(message.str());
+}
+
+}
@@ -0,0 +1,114 @@
+#ifndef luxem_cxx_registry_h
+#define luxem_cxx_registry_h
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <memory>
+#include <functional>
+#include <unordered_map>
+#include <typeindex>
+#include <sstream>
+#include <stdexcept>
+
+#include "struct.h"
+#include "write.h"
+
+namespace luxem
+{
+
+typedef uint32_t type_id;
+// The id of untyped values and of names that aren't registered
+constexpr type_id no_type_id = 0;
+
+// Maps type names to dense ids once, so typed values are dispatched by indexing a table rather than comparing names
+struct type_registry
+{
+	// Receives a node as it's read, with its type still set, and returns the node to keep in its place
+	typedef std::function<std::shared_ptr<value>(std::shared_ptr<value> &&node)> decoder;
+
+	type_registry(void);
+
+	// Ids count up from 1 in the order names are added
+	type_id intern(std::string const &name);
+	type_id find(std::string const &name) const;
+	type_id find(value const &node) const;
+	std::string const &get_name(type_id id) const;
+	size_t size(void) const;
+
+	type_registry &set_decoder(std::string const &name, decoder &&decode);
+	bool has_decoder(type_id id) const;
+	// Returns node unchanged if its type has no decoder
+	std::shared_ptr<value> decode(std::shared_ptr<value> &&node) const;
+	std::shared_ptr<value> decode(type_id id, std::shared_ptr<value> &&node) const;
+
+	// int, uint, float and bool primitives are converted and cached natively, keeping their text;
+	// ascii16 primitives are replaced with untyped primitives holding the decoded bytes
+	type_registry &add_standard(void);
+
+	// Binds a C++ type to a name, one type per name
+	template <typename data_type> type_registry &bind(
+		std::string const &name,
+		std::function<data_type(value const &node)> &&from_value,
+		std::function<void(raw_writer &writer, data_type const &data)> &&to_writer)
+	{
+		auto id = intern(name);
+		auto found = bound.find(std::type_index(typeid(data_type)));
+		if (((found != bound.end()) && (found->second != id)) ||
+			((found == bound.end()) && entries[id].from_value))
+		{
+			std::stringstream message;
+			message << "Type (" << name << ") is already bound to another C++ type.";
+			throw std::runtime_error(message.str());
+		}
+		bound[std::type_index(typeid(data_type))] = id;
+		entries[id].from_value = std::make_shared<std::function<data_type(value const &node)>>(std::move(from_value));
+		entries[id].to_writer = std::make_shared<std::function<void(raw_writer &writer, data_type const &data)>>(std::move(to_writer));
+		return *this;
+	}
+
+	template <typename data_type> type_id find(void) const
+	{
+		auto found = bound.find(std::type_index(typeid(data_type)));
+		return found == bound.end() ? no_type_id : found->second;
+	}
+
+	// Builds a data_type from a node annotated with its bound name
+	template <typename data_type> data_type get(value const &node) const
+	{
+		auto id = expect_bound(find<data_type>(), typeid(data_type).name());
+		if (!node.has_type() || (node.get_type() != entries[id].name)) mismatch(id, node);
+		return (*converter<data_type>(id))(node);
+	}
+
+	// Writes the bound name as the type, then the value
+	template <typename data_type> void write(raw_writer &writer, data_type const &data) const
+	{
+		auto id = expect_bound(find<data_type>(), typeid(data_type).name());
+		writer.type(entries[id].name);
+		(*std::static_pointer_cast<std::function<void(raw_writer &writer, data_type const &data)>>(entries[id].to_writer))(writer, data);
+	}
+
+	// PRIVATE
+		struct entry
+		{
+			std::string name;
+			decoder decode;
+			// Type-erased std::functions for the bound C++ type
+			std::shared_ptr<void> from_value;
+			std::shared_ptr<void> to_writer;
+		};
+		std::unordered_map<std::string, type_id> ids;
+		// Indexed by id; the first entry stands for no_type_id
+		std::vector<entry> entries;
+		std::unordered_map<std::type_index, type_id> bound;
+
+		type_id expect_bound(type_id id, char const *native_name) const;
+		template <typename data_type> std::shared_ptr<std::function<data_type(value const &node)>> converter(type_id id) const
+			{ return std::static_pointer_cast<std::function<data_type(value const &node)>>(entries[id].from_value); }
+		void mismatch(type_id id, value const &node) const;
+};
+
+}
+
+#endif
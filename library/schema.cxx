@@ -0,0 +1,416 @@
+#include "schema.h"
+
+#include <sstream>
+#include <stdexcept>
+#include <algorithm>
+
+namespace luxem
+{
+
+static size_t const no_node = static_cast<size_t>(-1);
+static size_t const any_node = 0;
+
+schema::node::node(kind node_kind) :
+	node_kind(node_kind),
+	primitive_format(format::string),
+	has_required_type(false),
+	open(false),
+	element(no_node)
+{
+}
+
+schema::schema(std::shared_ptr<value> const &definition)
+{
+	add(node(node::kind::any));
+	if (!definition) throw std::runtime_error("Schema is empty.");
+	root = compile(*definition);
+}
+
+schema schema::parse(std::string const &source)
+{
+	auto documents = read_struct(source);
+	if (documents.size() != 1)
+	{
+		std::stringstream message;
+		message << "Schema source must contain exactly one value, found " << documents.size() << ".";
+		throw std::runtime_error(message.str());
+	}
+	return schema(documents[0]);
+}
+
+size_t schema::add(node &&data)
+{
+	nodes.emplace_back(std::move(data));
+	return nodes.size() - 1;
+}
+
+static void throw_schema_error(std::string const &problem)
+{
+	std::stringstream message;
+	message << "Invalid schema: " << problem;
+	throw std::runtime_error(message.str());
+}
+
+static struct
+{
+	char const *name;
+	schema::format format;
+} const formats[] =
+{
+	{"string", schema::format::string},
+	{"primitive", schema::format::string},
+	{"int", schema::format::integer},
+	{"uint", schema::format::unsigned_integer},
+	{"float", schema::format::decimal},
+	{"bool", schema::format::boolean},
+	{"ascii16", schema::format::ascii16},
+};
+
+size_t schema::compile(value const &definition, bool use_type)
+{
+	if (use_type && definition.has_type())
+	{
+		auto const &type = definition.get_type();
+		if (type == "array")
+		{
+			node out(node::kind::array);
+			out.element = compile(definition, false);
+			return add(std::move(out));
+		}
+		if (type == "object")
+		{
+			node out(node::kind::object);
+			out.open = false;
+			for (auto &member : definition.as<object>().get_data())
+			{
+				bool required;
+				if (member.first == "required") required = true;
+				else if (member.first == "optional") required = false;
+				else if (member.first == "open")
+				{
+					auto const &flag = member.second->as<primitive>().get_primitive();
+					if ((flag != "true") && (flag != "false")) throw_schema_error("'open' must be true or false.");
+					out.open = flag == "true";
+					continue;
+				}
+				else throw_schema_error("Unknown object schema key '" + member.first + "'.");
+				for (auto &field : member.second->as<object>().get_data())
+				{
+					if (out.field_indices.count(field.first)) throw_schema_error("Key '" + field.first + "' is listed twice.");
+					auto child = compile(*field.second);
+					out.field_indices.emplace(field.first, out.fields.size());
+					out.fields.push_back(schema::field{field.first, child, required});
+				}
+			}
+			return add(std::move(out));
+		}
+		if (type == "enum")
+		{
+			node out(node::kind::enumeration);
+			for (auto &element : definition.as<array>().get_data())
+				out.values.push_back(element->as<primitive>().get_primitive());
+			std::sort(out.values.begin(), out.values.end());
+			return add(std::move(out));
+		}
+		if (type == "typed")
+		{
+			auto const &data = definition.as<object>().get_data();
+			auto name = data.find("type");
+			auto inner = data.find("value");
+			if ((name == data.end()) || (inner == data.end()) || (data.size() != 2))
+				throw_schema_error("'typed' requires exactly the keys 'type' and 'value'.");
+			auto out = compile(*inner->second);
+			if (nodes[out].has_required_type) throw_schema_error("Nested 'typed' schemas.");
+			nodes[out].has_required_type = true;
+			nodes[out].required_type = name->second->as<primitive>().get_primitive();
+			return out;
+		}
+		if (type == "one_of")
+		{
+			node out(node::kind::one_of);
+			for (auto &element : definition.as<array>().get_data())
+				out.alternatives.push_back(compile(*element));
+			if (out.alternatives.empty()) throw_schema_error("'one_of' has no alternatives.");
+			return add(std::move(out));
+		}
+		throw_schema_error("Unknown schema type '" + type + "'.");
+	}
+
+	if (definition.is<primitive>())
+	{
+		auto const &name = definition.as<primitive>().get_primitive();
+		if (name == "any") return add(node(node::kind::any));
+		for (auto const &candidate : formats)
+		{
+			if (name != candidate.name) continue;
+			node out(node::kind::primitive);
+			out.primitive_format = candidate.format;
+			return add(std::move(out));
+		}
+		throw_schema_error("Unknown primitive format '" + name + "'.");
+	}
+	if (definition.is<object>())
+	{
+		node out(node::kind::object);
+		for (auto &field : definition.as<object>().get_data())
+		{
+			auto child = compile(*field.second);
+			out.field_indices.emplace(field.first, out.fields.size());
+			out.fields.push_back(schema::field{field.first, child, true});
+		}
+		return add(std::move(out));
+	}
+	auto const &elements = definition.as<array>().get_data();
+	if (elements.size() != 1) throw_schema_error("An array schema must contain exactly one element schema.");
+	node out(node::kind::array);
+	out.element = compile(*elements[0]);
+	return add(std::move(out));
+}
+
+static bool is_digits(std::string const &text, size_t &position)
+{
+	auto start = position;
+	while ((position < text.size()) && (text[position] >= '0') && (text[position] <= '9')) ++position;
+	return position > start;
+}
+
+static bool matches(schema::format format, std::string const &text)
+{
+	size_t position = 0;
+	switch (format)
+	{
+		case schema::format::string:
+			return true;
+		case schema::format::integer:
+			if (!text.empty() && (text[0] == '-')) ++position;
+			return is_digits(text, position) && (position == text.size());
+		case schema::format::unsigned_integer:
+			return is_digits(text, position) && (position == text.size());
+		case schema::format::decimal:
+			if (!text.empty() && (text[0] == '-')) ++position;
+			if (!is_digits(text, position)) return false;
+			if ((position < text.size()) && (text[position] == '.'))
+			{
+				++position;
+				if (!is_digits(text, position)) return false;
+			}
+			if ((position < text.size()) && ((text[position] == 'e') || (text[position] == 'E')))
+			{
+				++position;
+				if ((position < text.size()) && ((text[position] == '-') || (text[position] == '+'))) ++position;
+				if (!is_digits(text, position)) return false;
+			}
+			return position == text.size();
+		case schema::format::boolean:
+			return (text == "true") || (text == "false");
+		case schema::format::ascii16:
+			if (text.size() % 2) return false;
+			for (auto character : text) if ((character < 'a') || (character > 'p')) return false;
+			return true;
+	}
+	return false;
+}
+
+validator::validator(schema const &definition) :
+	raw_reader(
+		[this]()
+		{
+			auto node = begin_value(value_kind::object, nullptr);
+			if (node == no_node) return;
+			frame out{node, true, 0, {}, no_node, {}};
+			out.seen.resize(this->definition.nodes[node].fields.size());
+			stack.push_back(std::move(out));
+		},
+		[this]()
+		{
+			auto &top = stack.back();
+			auto const &fields = this->definition.nodes[top.node].fields;
+			for (size_t index = 0; index < fields.size(); ++index)
+				if (fields[index].required && !top.seen[index])
+				{
+					violate("Missing required key '" + fields[index].key + "'.");
+					return;
+				}
+			stack.pop_back();
+			end_value();
+		},
+		[this]()
+		{
+			auto node = begin_value(value_kind::array, nullptr);
+			if (node == no_node) return;
+			stack.push_back(frame{node, false, 0, {}, no_node, {}});
+		},
+		[this]()
+		{
+			stack.pop_back();
+			end_value();
+		},
+		[this](std::string &&data)
+		{
+			auto &top = stack.back();
+			auto const &node = this->definition.nodes[top.node];
+			top.key = std::move(data);
+			if (node.node_kind == schema::node::kind::any)
+			{
+				top.pending = any_node;
+				return;
+			}
+			auto found = node.field_indices.find(top.key);
+			if (found == node.field_indices.end())
+			{
+				top.pending = any_node;
+				if (!node.open) violate("Unexpected key '" + top.key + "'.");
+				return;
+			}
+			if (top.seen[found->second])
+			{
+				top.pending = any_node;
+				violate("Duplicate key '" + top.key + "'.");
+				return;
+			}
+			top.seen[found->second] = true;
+			top.pending = node.fields[found->second].node;
+		},
+		[this](std::string &&data)
+		{
+			has_type = true;
+			current_type = std::move(data);
+		},
+		[this](std::string &&data)
+		{
+			if (begin_value(value_kind::primitive, &data) == no_node) return;
+			end_value();
+		}),
+	definition(definition),
+	document_count(0),
+	has_type(false)
+{
+}
+
+size_t validator::get_document_count(void) const { return document_count; }
+
+bool validator::is_valid(void) const { return violation.empty(); }
+
+std::string const &validator::get_violation(void) const { return violation; }
+
+path const &validator::get_violation_path(void) const { return violation_path; }
+
+size_t validator::expected(void) const
+{
+	if (stack.empty()) return definition.root;
+	auto const &top = stack.back();
+	if (top.is_object) return top.pending;
+	auto const &node = definition.nodes[top.node];
+	if (node.node_kind == schema::node::kind::any) return any_node;
+	return node.element;
+}
+
+size_t validator::resolve(size_t index, value_kind kind, std::string const *text) const
+{
+	auto const &node = definition.nodes[index];
+	if (node.has_required_type && (!has_type || (current_type != node.required_type))) return no_node;
+	switch (node.node_kind)
+	{
+		case schema::node::kind::any:
+			return index;
+		case schema::node::kind::primitive:
+			if ((kind != value_kind::primitive) || !matches(node.primitive_format, *text)) return no_node;
+			return index;
+		case schema::node::kind::enumeration:
+			if ((kind != value_kind::primitive) || !std::binary_search(node.values.begin(), node.values.end(), *text))
+				return no_node;
+			return index;
+		case schema::node::kind::object:
+			return kind == value_kind::object ? index : no_node;
+		case schema::node::kind::array:
+			return kind == value_kind::array ? index : no_node;
+		case schema::node::kind::one_of:
+			for (auto alternative : node.alternatives)
+			{
+				auto out = resolve(alternative, kind, text);
+				if (out != no_node) return out;
+			}
+			return no_node;
+	}
+	return no_node;
+}
+
+std::string validator::describe(size_t index) const
+{
+	static char const *const format_names[] = {"string", "int", "uint", "float", "bool", "ascii16"};
+	auto const &node = definition.nodes[index];
+	std::string out;
+	if (node.has_required_type) out = "(" + node.required_type + ") ";
+	switch (node.node_kind)
+	{
+		case schema::node::kind::any: return out + "any value";
+		case schema::node::kind::primitive: return out + format_names[static_cast<size_t>(node.primitive_format)];
+		case schema::node::kind::enumeration:
+		{
+			out += "one of";
+			for (auto const &data : node.values) out += " '" + data + "'";
+			return out;
+		}
+		case schema::node::kind::object: return out + "object";
+		case schema::node::kind::array: return out + "array";
+		case schema::node::kind::one_of:
+		{
+			for (size_t alternative = 0; alternative < node.alternatives.size(); ++alternative)
+			{
+				if (alternative > 0) out += " or ";
+				out += describe(node.alternatives[alternative]);
+			}
+			return out;
+		}
+	}
+	return out;
+}
+
+size_t validator::begin_value(value_kind kind, std::string const *text)
+{
+	auto node = expected();
+	auto out = resolve(node, kind, text);
+	if (out != no_node)
+	{
+		has_type = false;
+		return out;
+	}
+	std::string found;
+	if (has_type) found = "(" + current_type + ") ";
+	switch (kind)
+	{
+		case value_kind::object: found += "object"; break;
+		case value_kind::array: found += "array"; break;
+		case value_kind::primitive: found += "'" + *text + "'"; break;
+	}
+	violate("Expected " + describe(node) + ", found " + found + ".");
+	return no_node;
+}
+
+void validator::end_value(void)
+{
+	if (stack.empty())
+	{
+		++document_count;
+		return;
+	}
+	auto &top = stack.back();
+	if (top.is_object) top.pending = no_node;
+	else ++top.index;
+}
+
+void validator::violate(std::string &&message)
+{
+	violation_path.clear();
+	violation_path.emplace_back(document_count);
+	for (auto const &level : stack)
+	{
+		if (!level.is_object) violation_path.emplace_back(level.index);
+		else if (level.pending != no_node) violation_path.emplace_back(level.key);
+	}
+	violation = "At " + render_path(violation_path) + ": " + message;
+	fail(violation.c_str());
+}
+
+}
+
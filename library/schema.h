@@ -0,0 +1,118 @@
+#ifndef luxem_cxx_schema_h
+#define luxem_cxx_schema_h
+
+#include <string>
+#include <vector>
+#include <map>
+#include <memory>
+
+#include "struct.h"
+#include "read.h"
+#include "walk.h"
+
+namespace luxem
+{
+
+struct schema
+{
+	enum class format
+	{
+		string,
+		integer,
+		unsigned_integer,
+		decimal,
+		boolean,
+		ascii16
+	};
+
+	struct field
+	{
+		std::string key;
+		size_t node;
+		bool required;
+	};
+
+	struct node
+	{
+		enum class kind
+		{
+			any,
+			primitive,
+			enumeration,
+			object,
+			array,
+			one_of
+		};
+
+		kind node_kind;
+		format primitive_format;
+		bool has_required_type;
+		std::string required_type;
+		std::vector<std::string> values;
+		std::vector<field> fields;
+		std::map<std::string, size_t> field_indices;
+		bool open;
+		size_t element;
+		std::vector<size_t> alternatives;
+
+		node(kind node_kind);
+	};
+
+	schema(std::shared_ptr<value> const &definition);
+	static schema parse(std::string const &source);
+
+	// PRIVATE
+		std::vector<node> nodes;
+		size_t root;
+
+		size_t compile(value const &definition, bool use_type = true);
+		size_t add(node &&data);
+};
+
+struct validator : raw_reader
+{
+	validator(schema const &definition);
+
+	size_t get_document_count(void) const;
+	bool is_valid(void) const;
+	std::string const &get_violation(void) const;
+	path const &get_violation_path(void) const;
+
+	// PRIVATE
+		enum class value_kind
+		{
+			object,
+			array,
+			primitive
+		};
+
+		struct frame
+		{
+			size_t node;
+			bool is_object;
+			size_t index;
+			std::string key;
+			size_t pending;
+			std::vector<bool> seen;
+		};
+
+		schema const &definition;
+		std::vector<frame> stack;
+		size_t document_count;
+		bool has_type;
+		std::string current_type;
+		std::string violation;
+		path violation_path;
+
+		size_t expected(void) const;
+		size_t resolve(size_t node, value_kind kind, std::string const *text) const;
+		std::string describe(size_t node) const;
+		size_t begin_value(value_kind kind, std::string const *text);
+		void end_value(void);
+		void violate(std::string &&message);
+};
+
+}
+
+#endif
+
@@ -0,0 +1,239 @@
+#include "serialize.h"
+
+#include <sstream>
+#include <stdexcept>
+#include <cstring>
+
+namespace luxem
+{
+
+layout::layout(void) : pretty(false), spacer('\t'), multiple(1) {}
+
+layout layout::pretty_layout(char spacer, size_t multiple)
+{
+	layout out;
+	out.pretty = true;
+	out.spacer = spacer;
+	out.multiple = multiple;
+	return out;
+}
+
+static bool needs_escape(char character) { return (character == '"') || (character == '\\'); }
+
+static bool needs_quotes(std::string const &text)
+{
+	if (text.empty()) return true;
+	for (auto character : text)
+	{
+		switch (character)
+		{
+			case ' ': case '\t': case '\n': case '\r':
+			case '{': case '}': case '[': case ']': case '(': case ')':
+			case ',': case ':': case '"': case '*': case '\\':
+				return true;
+			default:
+				break;
+		}
+	}
+	return false;
+}
+
+struct measure_sink
+{
+	size_t size;
+
+	measure_sink(void) : size(0) {}
+	void put(char) { ++size; }
+	void append(char const *, size_t length) { size += length; }
+	void repeat(char, size_t count) { size += count; }
+	void escaped(std::string const &text)
+	{
+		size += text.size();
+		for (auto character : text) if (needs_escape(character)) ++size;
+	}
+};
+
+struct write_sink
+{
+	char *out;
+
+	write_sink(char *out) : out(out) {}
+	void put(char character) { *out++ = character; }
+	void append(char const *pointer, size_t length)
+	{
+		std::memcpy(out, pointer, length);
+		out += length;
+	}
+	void repeat(char character, size_t count)
+	{
+		std::memset(out, character, count);
+		out += count;
+	}
+	void escaped(std::string const &text)
+	{
+		for (auto character : text)
+		{
+			if (needs_escape(character)) *out++ = '\\';
+			*out++ = character;
+		}
+	}
+};
+
+// Mirrors the C writer's output so both passes agree byte for byte
+template <typename sink_type> struct serializer
+{
+	layout const &format;
+	sink_type &sink;
+
+	struct frame
+	{
+		bool is_object;
+		array::array_data::const_iterator element, element_end;
+		object::object_data::const_iterator member, member_end;
+	};
+	std::vector<frame> stack;
+
+	serializer(layout const &format, sink_type &sink) : format(format), sink(sink) {}
+
+	void indent(size_t level)
+	{
+		if (format.pretty) sink.repeat(format.spacer, level * format.multiple);
+	}
+
+	void text(std::string const &data)
+	{
+		if (!needs_quotes(data))
+		{
+			sink.append(data.data(), data.size());
+			return;
+		}
+		sink.put('"');
+		sink.escaped(data);
+		sink.put('"');
+	}
+
+	void suffix(void)
+	{
+		sink.put(',');
+		if (format.pretty) sink.put('\n');
+	}
+
+	void open(value const &data, bool in_object)
+	{
+		if (!in_object) indent(stack.size());
+		if (data.has_type())
+		{
+			sink.put('(');
+			sink.append(data.get_type().data(), data.get_type().size());
+			sink.put(')');
+			if (format.pretty) sink.put(' ');
+		}
+		if (data.is<primitive>())
+		{
+			auto const &leaf = data.as<primitive>();
+			if (leaf.has_text()) text(leaf.get_primitive());
+			else
+			{
+				// Native numbers never need quotes
+				char buffer[32];
+				sink.append(buffer, leaf.format_native(buffer));
+			}
+			suffix();
+		}
+		else if (data.is<array>())
+		{
+			sink.put('[');
+			if (format.pretty) sink.put('\n');
+			auto const &elements = data.as<array>().get_data();
+			stack.push_back(frame{false, elements.begin(), elements.end(), {}, {}});
+		}
+		else if (data.is<object>())
+		{
+			sink.put('{');
+			if (format.pretty) sink.put('\n');
+			auto const &members = data.as<object>().get_data();
+			stack.push_back(frame{true, {}, {}, members.begin(), members.end()});
+		}
+		else
+		{
+			std::stringstream message;
+			message << "Encountered unwritable type " << data.get_name() << " while trying to serialize tree.";
+			throw std::runtime_error(message.str());
+		}
+	}
+
+	void run(value const &root)
+	{
+		open(root, false);
+		while (!stack.empty())
+		{
+			auto &top = stack.back();
+			if (top.is_object ? (top.member == top.member_end) : (top.element == top.element_end))
+			{
+				char close = top.is_object ? '}' : ']';
+				stack.pop_back();
+				indent(stack.size());
+				sink.put(close);
+				suffix();
+				continue;
+			}
+			if (top.is_object)
+			{
+				auto const &member = *top.member++;
+				indent(stack.size());
+				text(member.first);
+				sink.put(':');
+				if (format.pretty) sink.put(' ');
+				open(*member.second, true);
+			}
+			else open(**top.element++, false);
+		}
+	}
+};
+
+size_t measure(value const &data, layout const &format)
+{
+	measure_sink sink;
+	serializer<measure_sink>(format, sink).run(data);
+	return sink.size;
+}
+
+size_t measure(std::vector<std::shared_ptr<value>> const &documents, layout const &format)
+{
+	measure_sink sink;
+	serializer<measure_sink> walker(format, sink);
+	for (auto const &document : documents) walker.run(*document);
+	return sink.size;
+}
+
+size_t serialize(value const &data, char *out, layout const &format)
+{
+	write_sink sink(out);
+	serializer<write_sink>(format, sink).run(data);
+	return sink.out - out;
+}
+
+size_t serialize(std::vector<std::shared_ptr<value>> const &documents, char *out, layout const &format)
+{
+	write_sink sink(out);
+	serializer<write_sink> walker(format, sink);
+	for (auto const &document : documents) walker.run(*document);
+	return sink.out - out;
+}
+
+std::string serialize(value const &data, layout const &format)
+{
+	std::string out(measure(data, format), '\0');
+	if (!out.empty()) serialize(data, &out[0], format);
+	return out;
+}
+
+std::string serialize(std::vector<std::shared_ptr<value>> const &documents, layout const &format)
+{
+	std::string out(measure(documents, format), '\0');
+	if (!out.empty()) serialize(documents, &out[0], format);
+	return out;
+}
+
+}
+
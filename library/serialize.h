@@ -0,0 +1,39 @@
+#ifndef luxem_cxx_serialize_h
+#define luxem_cxx_serialize_h
+
+#include <string>
+#include <vector>
+#include <memory>
+
+#include "struct.h"
+
+namespace luxem
+{
+
+// Formatting shared by measure and serialize, matching raw_writer::set_pretty
+struct layout
+{
+	bool pretty;
+	char spacer;
+	size_t multiple;
+
+	layout(void);
+	static layout pretty_layout(char spacer = '\t', size_t multiple = 1);
+};
+
+// Exact number of bytes serialize will produce
+size_t measure(value const &data, layout const &format = layout());
+size_t measure(std::vector<std::shared_ptr<value>> const &documents, layout const &format = layout());
+
+// Writes exactly measure(...) bytes to out and returns that count
+size_t serialize(value const &data, char *out, layout const &format = layout());
+size_t serialize(std::vector<std::shared_ptr<value>> const &documents, char *out, layout const &format = layout());
+
+// Allocates the result once, at its final size
+std::string serialize(value const &data, layout const &format = layout());
+std::string serialize(std::vector<std::shared_ptr<value>> const &documents, layout const &format = layout());
+
+}
+
+#endif
+
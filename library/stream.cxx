@@ -0,0 +1,346 @@
+#include "stream.h"
+
+#include <sstream>
+#include <stdexcept>
+#include <thread>
+#include <algorithm>
+#include <cstring>
+#include <cerrno>
+
+#include <unistd.h>
+#include <poll.h>
+#include <climits>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <sys/uio.h>
+
+namespace luxem
+{
+
+static size_t round_to_pages(size_t size)
+{
+	size_t page = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+	return (size + page - 1) / page * page;
+}
+
+#ifdef __linux__
+// Maps the same pages twice in a row, so data wrapping around the end of the ring is contiguous
+static char *map_mirrored(size_t capacity)
+{
+	int memory = memfd_create("luxem-stream", 0);
+	if (memory < 0) return nullptr;
+	char *out = nullptr;
+	if (ftruncate(memory, static_cast<off_t>(capacity)) == 0)
+	{
+		void *reserved = mmap(nullptr, capacity * 2, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+		if (reserved != MAP_FAILED)
+		{
+			char *base = static_cast<char *>(reserved);
+			if ((mmap(base, capacity, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_FIXED, memory, 0) != MAP_FAILED) &&
+				(mmap(base + capacity, capacity, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_FIXED, memory, 0) != MAP_FAILED))
+				out = base;
+			else munmap(reserved, capacity * 2);
+		}
+	}
+	close(memory);
+	return out;
+}
+#else
+static char *map_mirrored(size_t) { return nullptr; }
+#endif
+
+stream_feeder::ring::ring(size_t capacity) : base(nullptr), capacity(round_to_pages(capacity)), mirrored(false)
+{
+	base = map_mirrored(this->capacity);
+	if (base) mirrored = true;
+	else base = new char[this->capacity];
+}
+
+stream_feeder::ring::~ring(void)
+{
+	if (mirrored) munmap(base, capacity * 2);
+	else delete [] base;
+}
+
+stream_feeder::stream_feeder(raw_reader &reader, size_t capacity) :
+	reader(reader),
+	buffer(std::make_unique<ring>(capacity == 0 ? 1 : capacity)),
+	head(0),
+	used(0),
+	position(0)
+{
+}
+
+stream_feeder::~stream_feeder(void) {}
+
+size_t stream_feeder::prepare(char *&destination)
+{
+	if (!buffer->mirrored && (head + used == buffer->capacity) && (head > 0))
+	{
+		// Only the partial token is moved, never consumed data
+		std::memmove(buffer->base, buffer->base + head, used);
+		head = 0;
+	}
+	if (used == buffer->capacity)
+	{
+		auto grown = std::make_unique<ring>(buffer->capacity * 2);
+		std::memcpy(grown->base, buffer->base + head, used);
+		buffer = std::move(grown);
+		head = 0;
+	}
+	destination = buffer->base + head + used;
+	if (buffer->mirrored) return buffer->capacity - used;
+	return buffer->capacity - head - used;
+}
+
+void stream_feeder::consume(size_t length)
+{
+	used += length;
+	auto eaten = reader.feed(buffer->base + head, used, false);
+	position += eaten;
+	used -= eaten;
+	if (used == 0) head = 0;
+	else
+	{
+		head += eaten;
+		if (buffer->mirrored && (head >= buffer->capacity)) head -= buffer->capacity;
+	}
+}
+
+size_t stream_feeder::read(int descriptor)
+{
+	bool ended;
+	return read(descriptor, ended);
+}
+
+size_t stream_feeder::read(int descriptor, bool &ended, size_t limit)
+{
+	char *destination;
+	auto space = std::min(prepare(destination), limit);
+	ended = false;
+	while (true)
+	{
+		auto got = ::read(descriptor, destination, space);
+		if (got > 0)
+		{
+			consume(static_cast<size_t>(got));
+			return static_cast<size_t>(got);
+		}
+		if (got == 0)
+		{
+			ended = true;
+			return 0;
+		}
+		if (errno == EINTR) continue;
+		if ((errno == EAGAIN) || (errno == EWOULDBLOCK)) return 0;
+		std::stringstream message;
+		message << "Failed to read stream: " << strerror(errno);
+		throw std::runtime_error(message.str());
+	}
+}
+
+size_t stream_feeder::read(std::function<size_t(char *pointer, size_t length)> const &source)
+{
+	char *destination;
+	auto space = prepare(destination);
+	auto got = source(destination, space);
+	if (got > 0) consume(got);
+	return got;
+}
+
+void stream_feeder::finish(void)
+{
+	auto eaten = reader.feed(buffer->base + head, used, true);
+	position += eaten;
+	head = 0;
+	used = 0;
+}
+
+// A non-blocking descriptor with no data is waited on rather than taken as the end of input
+void stream_feeder::feed_all(int descriptor)
+{
+	bool ended = false;
+	while (true)
+	{
+		if (read(descriptor, ended) > 0) continue;
+		if (ended) break;
+		pollfd waiting{descriptor, POLLIN, 0};
+		if ((::poll(&waiting, 1, -1) < 0) && (errno != EINTR))
+		{
+			std::stringstream message;
+			message << "Failed to wait for stream: " << strerror(errno);
+			throw std::runtime_error(message.str());
+		}
+	}
+	finish();
+}
+
+void stream_feeder::feed_all(std::function<size_t(char *pointer, size_t length)> const &source)
+{
+	while (read(source) > 0) {}
+	finish();
+}
+
+void stream_feeder::follow(
+	int descriptor,
+	std::function<bool(void)> const &keep_following,
+	std::chrono::milliseconds poll_interval)
+{
+	while (true)
+	{
+		if (read(descriptor) > 0) continue;
+		if (!keep_following()) return;
+		struct stat status;
+		auto offset = lseek(descriptor, 0, SEEK_CUR);
+		if ((offset >= 0) && (fstat(descriptor, &status) == 0) && S_ISREG(status.st_mode) && (status.st_size < offset))
+			throw std::runtime_error("Followed file was truncated.");
+		std::this_thread::sleep_for(poll_interval);
+	}
+}
+
+uint64_t stream_feeder::get_position(void) const { return position; }
+
+size_t stream_feeder::get_buffered(void) const { return used; }
+
+size_t stream_feeder::get_capacity(void) const { return buffer->capacity; }
+
+bool stream_feeder::is_mirrored(void) const { return buffer->mirrored; }
+
+descriptor_reader::descriptor_reader(raw_reader &reader, int descriptor, size_t capacity) :
+	reader(reader),
+	descriptor(descriptor),
+	elements(0),
+	finished(false),
+	feeder(reader, capacity)
+	{}
+
+descriptor_reader::progress descriptor_reader::poll(size_t byte_budget, std::chrono::microseconds time_budget)
+{
+	progress out{finished ? state::finished : state::waiting, 0, 0};
+	if (finished) return out;
+	// The reader's count is only compared within the call, so a reset between calls doesn't matter
+	auto start_elements = reader.get_elements();
+	auto deadline = std::chrono::steady_clock::now() + time_budget;
+	while (true)
+	{
+		// At least one read is made, so a connection always makes progress
+		if (out.bytes > 0)
+		{
+			if ((byte_budget > 0) && (out.bytes >= byte_budget)) out.result = state::budget;
+			else if ((time_budget.count() > 0) && (std::chrono::steady_clock::now() >= deadline)) out.result = state::budget;
+			if (out.result == state::budget) break;
+		}
+		bool ended;
+		auto got = feeder.read(descriptor, ended, byte_budget > 0 ? byte_budget - out.bytes : static_cast<size_t>(-1));
+		out.bytes += got;
+		if (ended)
+		{
+			feeder.finish();
+			finished = true;
+			out.result = state::finished;
+			break;
+		}
+		if (got == 0) break;
+	}
+	out.elements = static_cast<size_t>(reader.get_elements() - start_elements);
+	elements += out.elements;
+	return out;
+}
+
+int descriptor_reader::get_descriptor(void) const { return descriptor; }
+
+bool descriptor_reader::is_finished(void) const { return finished; }
+
+bool descriptor_reader::in_element(void) const { return (reader.get_depth() > 0) || (feeder.get_buffered() > 0); }
+
+uint64_t descriptor_reader::get_elements(void) const { return elements; }
+
+stream_feeder &descriptor_reader::get_feeder(void) { return feeder; }
+
+static size_t const coalesce_size = 1 << 14;
+#ifdef IOV_MAX
+static size_t const max_vectors = IOV_MAX < 64 ? IOV_MAX : 64;
+#else
+static size_t const max_vectors = 16;
+#endif
+
+descriptor_sink::descriptor_sink(int descriptor, size_t high_water) :
+	descriptor(descriptor),
+	high_water(high_water),
+	head_offset(0),
+	queued(0),
+	written(0),
+	waiting(false)
+	{}
+
+std::function<void(std::string &&chunk)> descriptor_sink::get_callback(void)
+	{ return [this](std::string &&chunk) { write(std::move(chunk)); }; }
+
+void descriptor_sink::write(std::string &&chunk)
+{
+	if (chunk.empty()) return;
+	queued += chunk.size();
+	// The head chunk may be partly written, so only append to it if it's untouched
+	if (!chunks.empty() && (chunks.back().size() + chunk.size() <= coalesce_size) && ((chunks.size() > 1) || (head_offset == 0)))
+		chunks.back().append(chunk);
+	else chunks.emplace_back(std::move(chunk));
+	// Once the descriptor has pushed back, wait for the caller to flush rather than retrying on every write
+	if (!waiting) flush();
+}
+
+bool descriptor_sink::flush(void)
+{
+	waiting = false;
+	while (!chunks.empty())
+	{
+		iovec vectors[max_vectors];
+		size_t count = 0;
+		for (auto chunk = chunks.begin(); (chunk != chunks.end()) && (count < max_vectors); ++chunk, ++count)
+		{
+			auto offset = count == 0 ? head_offset : 0;
+			vectors[count].iov_base = const_cast<char *>(chunk->data() + offset);
+			vectors[count].iov_len = chunk->size() - offset;
+		}
+		auto sent = ::writev(descriptor, vectors, static_cast<int>(count));
+		if (sent < 0)
+		{
+			if (errno == EINTR) continue;
+			if ((errno == EAGAIN) || (errno == EWOULDBLOCK))
+			{
+				waiting = true;
+				return false;
+			}
+			std::stringstream message;
+			message << "Failed to write stream: " << strerror(errno);
+			throw std::runtime_error(message.str());
+		}
+		auto remaining = static_cast<size_t>(sent);
+		queued -= remaining;
+		written += remaining;
+		while (remaining > 0)
+		{
+			auto left = chunks.front().size() - head_offset;
+			if (remaining < left)
+			{
+				head_offset += remaining;
+				break;
+			}
+			remaining -= left;
+			chunks.pop_front();
+			head_offset = 0;
+		}
+	}
+	return true;
+}
+
+bool descriptor_sink::is_blocked(void) const { return queued >= high_water; }
+
+bool descriptor_sink::would_block(void) const { return waiting; }
+
+size_t descriptor_sink::get_queued(void) const { return queued; }
+
+size_t descriptor_sink::get_high_water(void) const { return high_water; }
+
+uint64_t descriptor_sink::get_written(void) const { return written; }
+
+}
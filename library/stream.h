@@ -0,0 +1,154 @@
+#ifndef luxem_cxx_stream_h
+#define luxem_cxx_stream_h
+
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <chrono>
+#include <string>
+#include <deque>
+
+#include "read.h"
+
+namespace luxem
+{
+
+struct stream_feeder
+{
+	stream_feeder(raw_reader &reader, size_t capacity = 1 << 16);
+	~stream_feeder(void);
+
+	stream_feeder(stream_feeder const &) = delete;
+	stream_feeder(stream_feeder &&) = delete;
+	stream_feeder &operator =(stream_feeder const &) = delete;
+	stream_feeder &operator =(stream_feeder &&) = delete;
+
+	// Reads once and feeds all complete tokens; 0 means no data was available
+	size_t read(int descriptor);
+	// Reads at most limit bytes; ended tells the end of input apart from a non-blocking descriptor with no data
+	size_t read(int descriptor, bool &ended, size_t limit = static_cast<size_t>(-1));
+	size_t read(std::function<size_t(char *pointer, size_t length)> const &source);
+	void finish(void);
+
+	void feed_all(int descriptor);
+	void feed_all(std::function<size_t(char *pointer, size_t length)> const &source);
+	void follow(
+		int descriptor,
+		std::function<bool(void)> const &keep_following,
+		std::chrono::milliseconds poll_interval = std::chrono::milliseconds(100));
+
+	uint64_t get_position(void) const;
+	size_t get_buffered(void) const;
+	size_t get_capacity(void) const;
+	bool is_mirrored(void) const;
+
+	// PRIVATE
+		struct ring
+		{
+			char *base;
+			size_t capacity;
+			bool mirrored;
+
+			ring(size_t capacity);
+			~ring(void);
+			ring(ring const &) = delete;
+			ring &operator =(ring const &) = delete;
+		};
+
+		raw_reader &reader;
+		std::unique_ptr<ring> buffer;
+		size_t head;
+		size_t used;
+		uint64_t position;
+
+		size_t prepare(char *&destination);
+		void consume(size_t length);
+};
+
+// Parses a non-blocking descriptor as it becomes readable, for event loops handling many connections on one thread
+struct descriptor_reader
+{
+	enum class state : uint8_t
+	{
+		// No more data for now; wait for the descriptor to become readable
+		waiting,
+		// A budget ran out, so data may remain; call poll again even without a new readiness event
+		budget,
+		// The input ended and the document was finished
+		finished
+	};
+
+	struct progress
+	{
+		state result;
+		size_t bytes;
+		// Top-level elements completed during the call
+		size_t elements;
+	};
+
+	// One reader can serve connections in turn; reset it before handing it to the next descriptor_reader
+	descriptor_reader(raw_reader &reader, int descriptor, size_t capacity = 1 << 16);
+
+	descriptor_reader(descriptor_reader const &) = delete;
+	descriptor_reader(descriptor_reader &&) = delete;
+	descriptor_reader &operator =(descriptor_reader const &) = delete;
+	descriptor_reader &operator =(descriptor_reader &&) = delete;
+
+	// Reads and parses until the descriptor would block, the input ends, or a budget is spent; 0 is no limit
+	progress poll(size_t byte_budget = 0, std::chrono::microseconds time_budget = std::chrono::microseconds(0));
+
+	int get_descriptor(void) const;
+	bool is_finished(void) const;
+	// Whether part of a top-level element has been read
+	bool in_element(void) const;
+	uint64_t get_elements(void) const;
+	stream_feeder &get_feeder(void);
+
+	// PRIVATE
+		raw_reader &reader;
+		int descriptor;
+		uint64_t elements;
+		bool finished;
+		stream_feeder feeder;
+};
+
+// Queues writer output for a non-blocking descriptor and writes it with writev as the descriptor accepts it
+struct descriptor_sink
+{
+	// Output is still accepted past high_water, but the sink reports itself blocked until it drains below it
+	descriptor_sink(int descriptor, size_t high_water = 1 << 20);
+
+	descriptor_sink(descriptor_sink const &) = delete;
+	descriptor_sink(descriptor_sink &&) = delete;
+	descriptor_sink &operator =(descriptor_sink const &) = delete;
+	descriptor_sink &operator =(descriptor_sink &&) = delete;
+
+	// For raw_writer's callback constructor; the sink must outlive the writer
+	std::function<void(std::string &&chunk)> get_callback(void);
+	void write(std::string &&chunk);
+
+	// Writes queued output until it's all written or the descriptor would block; true if nothing is left
+	bool flush(void);
+
+	// Stop producing while blocked, and flush when the descriptor is writable
+	bool is_blocked(void) const;
+	// Poll for writability while this is true
+	bool would_block(void) const;
+	size_t get_queued(void) const;
+	size_t get_high_water(void) const;
+	uint64_t get_written(void) const;
+
+	// PRIVATE
+		int descriptor;
+		size_t high_water;
+		// Small writes are appended to the last chunk, so each writev sends more per vector entry
+		std::deque<std::string> chunks;
+		size_t head_offset;
+		size_t queued;
+		uint64_t written;
+		bool waiting;
+};
+
+}
+
+#endif
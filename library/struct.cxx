@@ -1,10 +1,15 @@
 #include "struct.h"
+#include "walk.h"
+#include "ascii16.h"
 
 #include <sstream>
 #include <cstdlib>
-#include <list>
+#include <cstring>
+#include <cstdio>
+#include <cerrno>
 #include <algorithm>
 #include <utility>
+#include <thread>
 
 extern "C"
 {
@@ -17,29 +22,48 @@ namespace luxem
 
 std::string to_string_ascii16(uint8_t const *pointer, size_t const length)
 {
-	luxem_string_t input{(char const *)pointer, length};
-	luxem_string_t error;
-	auto converted = luxem_to_ascii16(&input, &error);
-	if (!converted)
-		throw std::runtime_error(std::string(error.pointer, error.length));
-	std::string out(converted->pointer, converted->length);
-	free((void *)converted);
+	std::string out(ascii16_encoded_size(length), '\0');
+	if (length) encode_ascii16(pointer, length, &out[0]);
 	return out;
 }
 
-value::value(void) : typed(false) {}
+value::value(kind tag) : tag(tag) {}
 
-value::value(std::string const &type) : typed(true), type(type) {}
+value::value(kind tag, std::string const &type) : type(std::make_unique<std::string>(type)), tag(tag) {}
+
+value::value(kind tag, std::string &&type) : type(std::make_unique<std::string>(std::move(type))), tag(tag) {}
 
 value::~value(void) {}
 
-bool value::has_type(void) const { return typed; }
+value::kind value::get_kind(void) const { return tag; }
+
+// Constant initialized, so kinds registered during static initialization elsewhere are never overwritten
+static std::string const *kind_names[256] = {&primitive::name, &object::name, &array::name};
+static std::string const unregistered_name("unregistered kind");
+
+void value::register_kind(kind tag, std::string const &name) { kind_names[static_cast<uint8_t>(tag)] = &name; }
+
+std::string const &value::get_name(void) const
+{
+	auto name = kind_names[static_cast<uint8_t>(tag)];
+	return name ? *name : unregistered_name;
+}
+
+bool value::has_type(void) const { return static_cast<bool>(type); }
 
-std::string const &value::get_type(void) const { assert(has_type()); return type; }
+std::string const &value::get_type(void) const { assert(has_type()); return *type; }
 	
-void value::set_type(std::string const &type) { this->type = type; typed = true; }
+void value::set_type(std::string const &type) 
+{ 
+	if (this->type) *this->type = type; 
+	else this->type = std::make_unique<std::string>(type); 
+}
 	
-void value::set_type(std::string &&type) { this->type = std::move(type); typed = true; }
+void value::set_type(std::string &&type) 
+{ 
+	if (this->type) *this->type = std::move(type); 
+	else this->type = std::make_unique<std::string>(std::move(type)); 
+}
 	
 template <typename type> type convert_to(std::string const &data)
 {
@@ -58,64 +82,277 @@ bool convert_to_bool(std::string const &data)
 		(lower != "no");
 }
 
+void convert_to(subencodings::ascii16, std::string const &data, std::vector<uint8_t> &out)
+{
+	out.resize(ascii16_decoded_size(data.length()));
+	decode_ascii16(data.data(), data.length(), out.data());
+}
+
 std::vector<uint8_t> convert_to(subencodings::ascii16, std::string const &data)
 {
-	luxem_string_t input{&data[0], data.length()};
-	luxem_string_t error;
-	auto converted = luxem_from_ascii16(&input, &error);
-	if (!converted)
-		throw std::runtime_error(std::string(error.pointer, error.length));
 	std::vector<uint8_t> out;
-	out.resize(converted->length);
-	memcpy(&out[0], converted->pointer, converted->length);
-	free((void *)converted);
+	convert_to(subencodings::ascii16{}, data, out);
 	return out;
 }
 
 std::string const primitive::name("primitive");
 
-std::string const &primitive::get_name(void) const { return name; }
+constexpr value::kind primitive::node_kind;
 
+primitive::primitive(void) : value(kind::primitive) {}
+primitive::primitive(std::string const &type) : value(kind::primitive, type) {}
 primitive::primitive(std::string &&data) :
-	data(std::move(data)) {}
+	value(kind::primitive), data(std::move(data)) {}
 primitive::primitive(std::string &&type, std::string &&data) :
-	value(std::move(type)), data(std::move(data)) {}
-	
+	value(kind::primitive, std::move(type)), data(std::move(data)) {}
+
+void primitive::set_text(std::string &&data)
+{
+	this->data = std::move(data);
+	text_state = text_set;
+	native = native_kind::none;
+}
+
+void primitive::set_int(int64_t data)
+{
+	this->data.clear();
+	text_state = text_missing;
+	native = native_kind::signed_integer;
+	number.signed_integer = data;
+}
+
+void primitive::set_uint(uint64_t data)
+{
+	this->data.clear();
+	text_state = text_missing;
+	native = native_kind::unsigned_integer;
+	number.unsigned_integer = data;
+}
+
+void primitive::set_double(double data)
+{
+	this->data.clear();
+	text_state = text_missing;
+	native = native_kind::floating;
+	number.floating = data;
+}
+
+void primitive::set_bool(bool data)
+{
+	this->data.clear();
+	text_state = text_missing;
+	native = native_kind::boolean;
+	number.boolean = data;
+}
+
+bool primitive::cache_native(native_kind kind)
+{
+	if (native == kind) return true;
+	if ((native != native_kind::none) || !read_exact(kind, number)) return false;
+	native = kind;
+	return true;
+}
+
+bool primitive::has_text(void) const
+{
+	auto state = text_state.load(std::memory_order_acquire);
+	return (state == text_set) || (state == text_formatted);
+}
+
+// Only the setters change this, so it needs no ordering
+bool primitive::text_is_set(void) const { return text_state.load(std::memory_order_relaxed) == text_set; }
+
+primitive::native_kind primitive::get_native_kind(void) const { return native; }
+
+static size_t format_unsigned(uint64_t data, char *out)
+{
+	char reversed[20];
+	size_t length = 0;
+	do
+	{
+		reversed[length++] = static_cast<char>('0' + data % 10);
+		data /= 10;
+	} while (data);
+	for (size_t index = 0; index < length; ++index) out[index] = reversed[length - 1 - index];
+	return length;
+}
+
+size_t primitive::format_native(char *out) const
+{
+	switch (native)
+	{
+		case native_kind::signed_integer:
+			if (number.signed_integer >= 0) return format_unsigned(number.signed_integer, out);
+			out[0] = '-';
+			return 1 + format_unsigned(0 - static_cast<uint64_t>(number.signed_integer), out + 1);
+		case native_kind::unsigned_integer:
+			return format_unsigned(number.unsigned_integer, out);
+		case native_kind::floating:
+		{
+			// Shortest of the usual precisions that reads back to the same double
+			int length = 0;
+			for (int precision = 15; precision <= 17; ++precision)
+			{
+				length = snprintf(out, 32, "%.*g", precision, number.floating);
+				if (strtod(out, nullptr) == number.floating) break;
+			}
+			return length;
+		}
+		case native_kind::boolean:
+			if (number.boolean)
+			{
+				memcpy(out, "true", 4);
+				return 4;
+			}
+			memcpy(out, "false", 5);
+			return 5;
+		case native_kind::none:
+			break;
+	}
+	return 0;
+}
+
+// Only exact readings are cached, so the cached number always agrees with the text
+bool primitive::read_exact(native_kind kind, number_data &out) const
+{
+	if (data.empty()) return false;
+	auto begin = data.c_str();
+	char *end = nullptr;
+	errno = 0;
+	switch (kind)
+	{
+		case native_kind::signed_integer:
+			if ((data[0] != '-') && ((data[0] < '0') || (data[0] > '9'))) return false;
+			out.signed_integer = strtoll(begin, &end, 10);
+			break;
+		case native_kind::unsigned_integer:
+			if ((data[0] < '0') || (data[0] > '9')) return false;
+			out.unsigned_integer = strtoull(begin, &end, 10);
+			break;
+		case native_kind::floating:
+			if (data.find_first_not_of("0123456789.eE+-") != std::string::npos) return false;
+			out.floating = strtod(begin, &end);
+			break;
+		case native_kind::boolean:
+			if ((data != "true") && (data != "false")) return false;
+			out.boolean = data == "true";
+			return true;
+		case native_kind::none:
+			return false;
+	}
+	return (errno != ERANGE) && (end == begin + data.size());
+}
+
 std::string const &primitive::get_primitive(void) const 
-	{ return data; }
+{
+	auto state = text_state.load(std::memory_order_acquire);
+	if ((state == text_set) || (state == text_formatted)) return data;
+	// Threads may share a primitive, so one formats the text and the others wait for it to be published
+	uint8_t expected = text_missing;
+	if (text_state.compare_exchange_strong(expected, text_formatting, std::memory_order_acquire))
+	{
+		char buffer[32];
+		data.assign(buffer, format_native(buffer));
+		text_state.store(text_formatted, std::memory_order_release);
+	}
+	else while (text_state.load(std::memory_order_acquire) != text_formatted) std::this_thread::yield();
+	return data;
+}
 
 bool primitive::get_bool(void) const 
-	{ return convert_to_bool(data); }
+{
+	if (native == native_kind::boolean) return number.boolean;
+	if (text_is_set())
+	{
+		number_data exact;
+		return read_exact(native_kind::boolean, exact) ? exact.boolean : convert_to_bool(data);
+	}
+	switch (native)
+	{
+		case native_kind::signed_integer: return number.signed_integer != 0;
+		case native_kind::unsigned_integer: return number.unsigned_integer != 0;
+		case native_kind::floating: return number.floating != 0;
+		default: return number.boolean;
+	}
+}
 
 int64_t primitive::get_int(void) const 
-	{ return convert_to<int64_t>(data); }
+{
+	if (native == native_kind::signed_integer) return number.signed_integer;
+	if (text_is_set())
+	{
+		number_data exact;
+		return read_exact(native_kind::signed_integer, exact) ? exact.signed_integer : convert_to<int64_t>(data);
+	}
+	switch (native)
+	{
+		case native_kind::unsigned_integer: return static_cast<int64_t>(number.unsigned_integer);
+		case native_kind::floating: return static_cast<int64_t>(number.floating);
+		case native_kind::boolean: return number.boolean ? 1 : 0;
+		default: return number.signed_integer;
+	}
+}
 
 uint64_t primitive::get_uint(void) const 
-	{ return convert_to<uint64_t>(data); }
+{
+	if (native == native_kind::unsigned_integer) return number.unsigned_integer;
+	if (text_is_set())
+	{
+		number_data exact;
+		return read_exact(native_kind::unsigned_integer, exact) ? exact.unsigned_integer : convert_to<uint64_t>(data);
+	}
+	switch (native)
+	{
+		case native_kind::signed_integer: return static_cast<uint64_t>(number.signed_integer);
+		case native_kind::floating: return static_cast<uint64_t>(number.floating);
+		case native_kind::boolean: return number.boolean ? 1 : 0;
+		default: return number.unsigned_integer;
+	}
+}
 
 float primitive::get_float(void) const 
-	{ return convert_to<float>(data); }
+{
+	if (text_is_set() && (native != native_kind::floating)) return convert_to<float>(data);
+	return static_cast<float>(get_double());
+}
 
 double primitive::get_double(void) const 
-	{ return convert_to<double>(data); }
+{
+	if (native == native_kind::floating) return number.floating;
+	if (text_is_set())
+	{
+		number_data exact;
+		return read_exact(native_kind::floating, exact) ? exact.floating : convert_to<double>(data);
+	}
+	switch (native)
+	{
+		case native_kind::signed_integer: return static_cast<double>(number.signed_integer);
+		case native_kind::unsigned_integer: return static_cast<double>(number.unsigned_integer);
+		case native_kind::boolean: return number.boolean ? 1 : 0;
+		default: return number.floating;
+	}
+}
 
 std::string const &primitive::get_string(void) const 
-	{ return data; }
+	{ return get_primitive(); }
 
 std::vector<uint8_t> primitive::get_ascii16(void) const 
-	{ return convert_to(subencodings::ascii16{}, data); }
+	{ return convert_to(subencodings::ascii16{}, get_primitive()); }
+
+void primitive::get_ascii16(std::vector<uint8_t> &out) const 
+	{ convert_to(subencodings::ascii16{}, get_primitive(), out); }
 
 std::string const object::name("object");
 
-object::object(void) {}
+constexpr value::kind object::node_kind;
 
-std::string const &object::get_name(void) const { return name; }
+object::object(void) : value(kind::object) {}
 
-object::object(object_data &&data) : value(), data(std::move(data)) {}
+object::object(object_data &&data) : value(kind::object), data(std::move(data)) {}
 
-object::object(std::string const &type, object_data &&data) : value(type), data(std::move(data)) {}
+object::object(std::string const &type, object_data &&data) : value(kind::object, type), data(std::move(data)) {}
 
-object::object(std::string &&type, object_data &&data) : value(std::move(type)), data(std::move(data)) {}
+object::object(std::string &&type, object_data &&data) : value(kind::object, std::move(type)), data(std::move(data)) {}
 
 object::object_data &object::get_data(void) { return data; }
 
@@ -123,122 +360,38 @@ object::object_data const &object::get_data(void) const { return data; }
 	
 std::string const array::name("array");
 
-std::string const &array::get_name(void) const { return name; }
+constexpr value::kind array::node_kind;
 
-array::array(void) {}
+array::array(void) : value(kind::array) {}
 
-array::array(array_data &&data) : value(), data(std::move(data)) {}
+array::array(array_data &&data) : value(kind::array), data(std::move(data)) {}
 
-array::array(std::string const &type, array_data &&data) : value(type), data(std::move(data)) {}
+array::array(std::string const &type, array_data &&data) : value(kind::array, type), data(std::move(data)) {}
 
-array::array(std::string &&type, array_data &&data) : value(std::move(type)), data(std::move(data)) {}
+array::array(std::string &&type, array_data &&data) : value(kind::array, std::move(type)), data(std::move(data)) {}
 
 array::array_data &array::get_data(void) { return data; }
 
 array::array_data const &array::get_data(void) const { return data; }
 
-template <typename callback_type> struct walk_stackable 
-{
-	virtual ~walk_stackable(void) {}
-	virtual bool step(std::list<std::unique_ptr<walk_stackable<callback_type>>> &stack, callback_type const &callback) = 0;
-};
-
-template 
-<
-	typename node_type, 
-	typename callback_type
-> struct object_walk_stackable;
-
-template 
-<
-	typename node_type, 
-	typename callback_type
-> struct array_walk_stackable;
-
-template // The costs of DRY in c++
-<
-	typename node_type, 
-	typename callback_type
-> static void walk_one
-(
-	std::list<std::unique_ptr<walk_stackable<callback_type>>> &stack, 
-	std::string const &key, 
-	node_type &node, 
-	callback_type const &callback
-)
-{
-	callback(key, node);
-	if (!node) return;
-	if (node->template is<object>())
-		stack.emplace_back(std::make_unique<object_walk_stackable<
-			node_type, 
-			callback_type>>(node->template as<object>()));
-	else if (node->template is<array>())
-		stack.emplace_back(std::make_unique<array_walk_stackable<
-			node_type, 
-			callback_type>>(node->template as<array>()));
-}
-
-template 
-<
-	typename node_type, 
-	typename callback_type
-> struct object_walk_stackable : walk_stackable<callback_type>
-{
-	typename std::conditional<std::is_const<node_type>::value, object const, object>::type &node;
-	typename std::conditional<std::is_const<node_type>::value, od::const_iterator, od::iterator>::type iterator;
-
-	object_walk_stackable(decltype(node) &node) : node(node), iterator(node.get_data().begin()) {}
-
-	bool step(std::list<std::unique_ptr<walk_stackable<callback_type>>> &stack, callback_type const &callback) override
-	{
-		if (iterator == node.get_data().end()) return false;
-		walk_one(stack, iterator->first, iterator->second, callback);
-		++iterator;
-		return true;
-	}
-};
+static std::string const no_key;
 
-template 
-<
-	typename node_type, 
-	typename callback_type
-> struct array_walk_stackable : walk_stackable<callback_type>
+template <typename node_type, typename callback_type> static void walk_key_adapter(walk_path const &path, node_type &node, callback_type const &callback)
 {
-	typename std::conditional<std::is_const<node_type>::value, array const, array>::type &node;
-	typename std::conditional<std::is_const<node_type>::value, ad::const_iterator, ad::iterator>::type iterator;
-
-	array_walk_stackable(decltype(node) &node) : node(node), iterator(node.get_data().begin()) {}
-
-	bool step(std::list<std::unique_ptr<walk_stackable<callback_type>>> &stack, callback_type const &callback) override
-	{
-		if (iterator == node.get_data().end()) return false;
-		walk_one(stack, {}, *iterator, callback);
-		++iterator;
-		return true;
-	}
-};
-
-template <typename node_type, typename callback_type> static void walk_implementation(node_type &root, callback_type const &callback)
-{
-	std::list<std::unique_ptr<walk_stackable<callback_type>>> stack;
-	walk_one(stack, {}, root, callback);
-	while (!stack.empty())
-		if (!stack.back()->step(stack, callback))
-			stack.pop_back();
+	if (path.empty() || !path.is_key(path.size() - 1)) callback(no_key, node);
+	else callback(path.key(path.size() - 1), node);
 }
 
 void walk(std::shared_ptr<value> &root, walk_callback const &callback) 
-	{ walk_implementation(root, callback); }
+	{ visit(root, [&callback](walk_path const &path, std::shared_ptr<value> &node) { walk_key_adapter(path, node, callback); }); }
 
 void walk(std::shared_ptr<value> const &root, const_walk_callback const &callback) 
-	{ walk_implementation(root, callback); }
+	{ visit(root, [&callback](walk_path const &path, std::shared_ptr<value> const &node) { walk_key_adapter(path, node, callback); }); }
 
 void walk(std::shared_ptr<object> const &root, const_walk_callback const &callback) 
-	{ walk_implementation(root, callback); }
+	{ walk(std::shared_ptr<value>(root), callback); }
 
 void walk(std::shared_ptr<array> const &root, const_walk_callback const &callback) 
-	{ walk_implementation(root, callback); }
+	{ walk(std::shared_ptr<value>(root), callback); }
 
 }
-
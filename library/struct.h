@@ -7,6 +7,11 @@
 #include <typeinfo>
 #include <memory>
 #include <sstream>
+#include <functional>
+#include <string>
+#include <type_traits>
+#include <cstdint>
+#include <atomic>
 
 namespace luxem
 {
@@ -35,25 +40,41 @@ template <typename data_type> inline std::string to_string_ascii16(data_type con
 	);
 }
 
+// Nodes carry a one byte kind tag instead of a vtable, and keep type names out of line
 struct value
 {
-	value(void);
-	value(std::string const &type);
-	virtual ~value(void);
+	enum class kind : uint8_t
+	{
+		primitive,
+		object,
+		array,
+		object_context,
+		array_context,
+		// New node types take kinds from here up, and register a name for them
+		first_extension = 64
+	};
+
+	static constexpr kind extension_kind(uint8_t index)
+		{ return static_cast<kind>(static_cast<uint8_t>(kind::first_extension) + index); }
+	// Names a kind for get_name, once before its nodes are used; name must outlive them, as a static name member does
+	static void register_kind(kind tag, std::string const &name);
+
+	kind get_kind(void) const;
 
 	bool has_type(void) const;
 	std::string const &get_type(void) const;
 	void set_type(std::string const &type);
 	void set_type(std::string &&type);
 
-	// derivates must also specify a static string member named 'name'
-	virtual std::string const &get_name(void) const = 0;
+	// derivates must also specify a static string member named 'name' and a static kind named 'node_kind',
+	// and register the name unless they're defined here
+	std::string const &get_name(void) const;
 
 	template <typename type> bool is(void) const 
-		{ return typeid(*this) == typeid(type); }
+		{ return tag == type::node_kind; }
 	
 	template <typename type> bool is_derived(void) const 
-		{ return dynamic_cast<type const *>(this); }
+		{ return derives(static_cast<type const *>(nullptr)); }
 
 	template <typename type> type &as(void) 
 	{ 
@@ -99,9 +120,18 @@ struct value
 		return *static_cast<type const *>(this); 
 	}
 
+	protected:
+		value(kind tag);
+		value(kind tag, std::string const &type);
+		value(kind tag, std::string &&type);
+		// Not virtual; nodes are always destroyed through their own type by shared_ptr
+		~value(void);
+
 	private:
-		bool typed;
-		std::string type;
+		std::unique_ptr<std::string> type;
+		kind tag;
+		bool derives(value const *) const { return true; }
+		template <typename type> bool derives(type const *) const { return is<type>(); }
 };
 
 struct subencodings
@@ -111,25 +141,37 @@ struct subencodings
 
 struct primitive : value
 {
-	using value::value;
+	static constexpr kind node_kind = kind::primitive;
+
+	// A primitive holds text, a native number, or both; the missing form is produced on demand and cached
+	enum class native_kind : uint8_t
+	{
+		none,
+		signed_integer,
+		unsigned_integer,
+		floating,
+		boolean
+	};
 
 	static std::string const name;
-	std::string const &get_name(void) const override;
 
+	primitive(void);
+	// An empty primitive with a type
+	primitive(std::string const &type);
 	primitive(std::string &&data);
 	primitive(std::string &&type, std::string &&data);
 
 	template <typename data_type> primitive(data_type const &data) :
-		data(to_string<data_type>(data))
-		{}
+		value(kind::primitive)
+		{ set(data); }
 	template <typename data_type> primitive(std::string const &type_name, data_type const &data) : 
-		value(type_name), data(to_string<data_type>(data))
-		{}
+		value(kind::primitive, type_name)
+		{ set(data); }
 	template <typename data_type> primitive(subencodings::ascii16, data_type const &data) :
-		data(to_string_ascii16<data_type>(data))
+		value(kind::primitive), data(to_string_ascii16<data_type>(data))
 		{}
 	template <typename data_type> primitive(std::string const &type_name, subencodings::ascii16, data_type const &data) : 
-		value(type_name), data(to_string_ascii16<data_type>(data))
+		value(kind::primitive, type_name), data(to_string_ascii16<data_type>(data))
 		{}
 
 	primitive(primitive const &) = delete;
@@ -137,11 +179,21 @@ struct primitive : value
 	primitive &operator =(primitive const &) = delete;
 	primitive &operator =(primitive &&) = delete;
 	
+	// Integers wider than a char, doubles and bools are stored natively, anything else as text
 	template <typename data_type> void set(data_type const &data)
-		{ data = to_string<data_type>(data); }
+		{ store(data, std::integral_constant<native_kind, native_kind_of<data_type>()>{}); }
 	template <typename data_type> void set(subencodings::ascii16, data_type const &data)
-		{ data = to_string_ascii16<data_type>(data); }
-
+		{ set_text(to_string_ascii16<data_type>(data)); }
+	void set_text(std::string &&data);
+	void set_int(int64_t data);
+	void set_uint(uint64_t data);
+	void set_double(double data);
+	void set_bool(bool data);
+	// Stores the number parsed from the text alongside it, so later reads of that kind don't parse;
+	// false if the text doesn't read back exactly or the primitive already holds another native kind
+	bool cache_native(native_kind kind);
+
+	// Getters don't change the value, except for formatting missing text, which is safe from several threads
 	std::string const &get_primitive(void) const;
 	bool get_bool(void) const;
 	int64_t get_int(void) const;
@@ -150,13 +202,58 @@ struct primitive : value
 	double get_double(void) const;
 	std::string const &get_string(void) const;
 	std::vector<uint8_t> get_ascii16(void) const;
+	// Decodes into an existing buffer, reusing its capacity
+	void get_ascii16(std::vector<uint8_t> &out) const;
+
+	bool has_text(void) const;
+	native_kind get_native_kind(void) const;
+	// Renders the native value without caching it, out must hold 32 characters
+	size_t format_native(char *out) const;
 
 	private:
-		std::string data;
+		template <typename data_type> static constexpr native_kind native_kind_of(void)
+		{
+			return std::is_same<data_type, bool>::value ? native_kind::boolean :
+				std::is_same<data_type, double>::value ? native_kind::floating :
+				(!std::is_integral<data_type>::value || (sizeof(data_type) == 1)) ? native_kind::none :
+				std::is_signed<data_type>::value ? native_kind::signed_integer :
+				native_kind::unsigned_integer;
+		}
+		template <typename data_type> void store(data_type const &data, std::integral_constant<native_kind, native_kind::none>)
+			{ set_text(to_string<data_type>(data)); }
+		template <typename data_type> void store(data_type const &data, std::integral_constant<native_kind, native_kind::signed_integer>)
+			{ set_int(data); }
+		template <typename data_type> void store(data_type const &data, std::integral_constant<native_kind, native_kind::unsigned_integer>)
+			{ set_uint(data); }
+		template <typename data_type> void store(data_type const &data, std::integral_constant<native_kind, native_kind::floating>)
+			{ set_double(data); }
+		template <typename data_type> void store(data_type const &data, std::integral_constant<native_kind, native_kind::boolean>)
+			{ set_bool(data); }
+
+		union number_data
+		{
+			int64_t signed_integer;
+			uint64_t unsigned_integer;
+			double floating;
+			bool boolean;
+		};
+		// Set text is authoritative; text formatted from the native value is only published once complete
+		enum text_states : uint8_t { text_set, text_missing, text_formatting, text_formatted };
+
+		bool read_exact(native_kind kind, number_data &out) const;
+		bool text_is_set(void) const;
+
+		// The flags fit in value's tail padding; short text stays in std::string's inline buffer
+		mutable std::atomic<uint8_t> text_state{text_set};
+		native_kind native = native_kind::none;
+		number_data number;
+		mutable std::string data;
 };
 
 struct object : value
 {
+	static constexpr kind node_kind = kind::object;
+
 	typedef std::map<std::string, std::shared_ptr<value>> object_data;
 
 	object(void);
@@ -170,7 +267,6 @@ struct object : value
 	object &operator =(object &&) = delete;
 	
 	static std::string const name;
-	std::string const &get_name(void) const override;
 
 	object_data &get_data(void);
 	object_data const &get_data(void) const;
@@ -183,6 +279,8 @@ typedef object::object_data od;
 
 struct array : value
 {
+	static constexpr kind node_kind = kind::array;
+
 	typedef std::vector<std::shared_ptr<value>> array_data;
 
 	array(void);
@@ -196,7 +294,6 @@ struct array : value
 	array &operator =(array &&) = delete;
 	
 	static std::string const name;
-	std::string const &get_name(void) const override;
 
 	array_data &get_data(void);
 	array_data const &get_data(void) const;
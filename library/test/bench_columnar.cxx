@@ -0,0 +1,89 @@
+#undef NDEBUG
+
+#include "../columnar.h"
+
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+#include <chrono>
+#include <cassert>
+
+// Pivoting built trees into vectors against reading straight into columns
+struct pivoted
+{
+	std::vector<int64_t> ids;
+	std::vector<double> prices;
+	std::vector<std::string> names;
+	std::vector<uint8_t> flags;
+};
+
+pivoted pivot_trees(std::string const &text)
+{
+	pivoted out;
+	auto documents = luxem::read_struct(text);
+	for (auto const &row : documents[0]->as<luxem::array>().get_data())
+	{
+		auto const &members = row->as<luxem::object>().get_data();
+		out.ids.push_back(members.at("id")->as<luxem::primitive>().get_int());
+		out.prices.push_back(members.at("price")->as<luxem::primitive>().get_double());
+		out.names.push_back(members.at("name")->as<luxem::primitive>().get_string());
+		out.flags.push_back(members.at("flag")->as<luxem::primitive>().get_bool());
+	}
+	return out;
+}
+
+std::vector<luxem::column> read_direct(std::string const &text)
+{
+	std::vector<luxem::column> columns;
+	columns.emplace_back("id", luxem::column::format::integer);
+	columns.emplace_back("price", luxem::column::format::decimal);
+	columns.emplace_back("name", luxem::column::format::string);
+	columns.emplace_back("flag", luxem::column::format::boolean);
+	return luxem::read_columns(text, std::move(columns));
+}
+
+template <typename body_type> double best_of(size_t runs, body_type const &body)
+{
+	double best = 0;
+	for (size_t run = 0; run < runs; ++run)
+	{
+		auto start = std::chrono::steady_clock::now();
+		auto kept = body();
+		auto stop = std::chrono::steady_clock::now();
+		auto elapsed = std::chrono::duration<double, std::milli>(stop - start).count();
+		if ((run == 0) || (elapsed < best)) best = elapsed;
+	}
+	return best;
+}
+
+int main(void)
+{
+	std::vector<luxem::column> source;
+	source.emplace_back("id", luxem::column::format::integer);
+	source.emplace_back("price", luxem::column::format::decimal);
+	source.emplace_back("name", luxem::column::format::string);
+	source.emplace_back("flag", luxem::column::format::boolean);
+	for (size_t index = 0; index < 50000; ++index)
+	{
+		source[0].push_int(static_cast<int64_t>(index) - 25000);
+		source[1].push_double(index * 0.25);
+		source[2].push_string("item" + std::to_string(index % 1000));
+		source[3].push_bool(index % 3 == 0);
+	}
+	auto text = luxem::write_columns(source);
+
+	auto trees = pivot_trees(text);
+	auto columns = read_direct(text);
+	assert(trees.ids == columns[0].get_ints());
+	assert(trees.prices == columns[1].get_doubles());
+	assert(trees.flags == columns[3].get_bools());
+	assert(trees.names[49999] == columns[2].get_string(49999));
+
+	auto tree_time = best_of(5, [&]() { return pivot_trees(text); });
+	auto column_time = best_of(5, [&]() { return read_direct(text); });
+	auto write_time = best_of(5, [&]() { return luxem::write_columns(source); });
+	std::cout << text.size() << " bytes: trees " << tree_time << " ms, columns " << column_time << " ms, " <<
+		tree_time / column_time << "x; writing columns " << write_time << " ms" << std::endl;
+	return 0;
+}
@@ -0,0 +1,60 @@
+#undef NDEBUG
+
+#include "../read.h"
+#include "../write.h"
+#include "../diff.h"
+
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+#include <chrono>
+#include <cassert>
+
+// Whole document parsing with the context based reader against read_struct's builder
+std::vector<std::shared_ptr<luxem::value>> read_with_contexts(std::string const &text)
+{
+	std::vector<std::shared_ptr<luxem::value>> out;
+	luxem::reader instance;
+	instance.build_struct([&out](std::shared_ptr<luxem::value> &&data) { out.emplace_back(std::move(data)); });
+	instance.feed(text);
+	return out;
+}
+
+// Trees are freed outside the timed region, since freeing costs the same either way
+template <typename body_type> double best_of(size_t runs, body_type const &body)
+{
+	double best = 0;
+	for (size_t run = 0; run < runs; ++run)
+	{
+		auto start = std::chrono::steady_clock::now();
+		auto kept = body();
+		auto stop = std::chrono::steady_clock::now();
+		auto elapsed = std::chrono::duration<double, std::milli>(stop - start).count();
+		if ((run == 0) || (elapsed < best)) best = elapsed;
+	}
+	return best;
+}
+
+int main(void)
+{
+	luxem::writer document;
+	document.array_begin();
+	for (size_t index = 0; index < 20000; ++index)
+	{
+		document.object_begin()
+			.key("id").value(index)
+			.key("name").primitive("record " + std::to_string(index))
+			.key("tags").array_begin().primitive("a").primitive("b").type("weight").value(index % 7).array_end()
+			.key("nested").object_begin().key("x").value(1.5).key("y").value(-2).object_end()
+			.object_end();
+	}
+	document.array_end();
+	auto text = document.dump();
+
+	assert(luxem::equal(*luxem::read_struct(text)[0], *read_with_contexts(text)[0]));
+	auto contexts = best_of(5, [&]() { return read_with_contexts(text); });
+	auto builder = best_of(5, [&]() { return luxem::read_struct(text); });
+	std::cout << text.size() << " bytes: contexts " << contexts << " ms, builder " << builder << " ms, " << contexts / builder << "x" << std::endl;
+	return 0;
+}
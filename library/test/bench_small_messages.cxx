@@ -0,0 +1,103 @@
+#undef NDEBUG
+
+#include "../read.h"
+#include "../write.h"
+#include "../diff.h"
+
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+#include <chrono>
+#include <algorithm>
+#include <functional>
+#include <cassert>
+
+// Per-message latency for RPC sized documents, constructing a reader or writer each time against reusing one
+std::vector<std::string> const messages{
+	"{id: 1, method: ping}",
+	"{id: 2, method: get, params: {key: user/42}}",
+	"{id: 3, method: set, params: {key: user/42, value: (int) 17, ttl: 3600}}",
+	"{id: 4, result: [1, 2, 3, 4, 5, 6, 7, 8], error: (null) \"\"}",
+	"{id: 5, method: batch, params: [{op: inc, key: a}, {op: inc, key: b}, {op: dec, key: c}], trace: \"9f3a 77c1\"}",
+};
+
+size_t const rounds = 4000;
+
+void report(std::string const &name, std::function<void(std::string const &message)> const &body)
+{
+	std::vector<double> samples;
+	samples.reserve(rounds * messages.size());
+	for (size_t round = 0; round < rounds; ++round)
+	{
+		for (auto const &message : messages)
+		{
+			auto start = std::chrono::steady_clock::now();
+			body(message);
+			auto stop = std::chrono::steady_clock::now();
+			samples.push_back(std::chrono::duration<double, std::nano>(stop - start).count());
+		}
+	}
+	std::sort(samples.begin(), samples.end());
+	std::cout << name << ": median " << samples[samples.size() / 2] << " ns, p99 " << samples[samples.size() * 99 / 100] << " ns" << std::endl;
+}
+
+int main(void)
+{
+	std::vector<std::shared_ptr<luxem::value>> trees;
+	for (auto const &message : messages)
+	{
+		assert(message.size() < 256);
+		trees.push_back(luxem::read_struct(message)[0]);
+	}
+
+	size_t sink = 0;
+	report("read, new reader", [&](std::string const &message)
+	{
+		std::vector<std::shared_ptr<luxem::value>> out;
+		luxem::reader instance;
+		instance.build_struct([&out](std::shared_ptr<luxem::value> &&data) { out.emplace_back(std::move(data)); });
+		instance.feed(message);
+		sink += out.size();
+	});
+	// Pooling on its own: the same kind of reader, constructed each time or reused
+	luxem::reader reused_reader;
+	std::vector<std::shared_ptr<luxem::value>> reused_out;
+	reused_reader.build_struct([&reused_out](std::shared_ptr<luxem::value> &&data) { reused_out.emplace_back(std::move(data)); });
+	report("read, reset reader", [&](std::string const &message)
+	{
+		reused_out.clear();
+		reused_reader.reset();
+		reused_reader.feed(message);
+		sink += reused_out.size();
+	});
+	report("read, new struct_builder", [&](std::string const &message)
+	{
+		luxem::struct_builder instance;
+		instance.feed(message);
+		sink += instance.take().size();
+	});
+	report("read, read_struct", [&](std::string const &message) { sink += luxem::read_struct(message).size(); });
+
+	luxem::writer reused;
+	std::string rendered;
+	size_t next = 0;
+	report("write, new writer", [&](std::string const &)
+	{
+		luxem::writer instance;
+		instance.value(trees[next++ % trees.size()]);
+		sink += instance.dump().size();
+	});
+	report("write, reset and dump into buffer", [&](std::string const &)
+	{
+		reused.reset().value(trees[next++ % trees.size()]);
+		reused.dump(rendered);
+		sink += rendered.size();
+	});
+	report("write, write_struct", [&](std::string const &) { sink += luxem::write_struct(trees[next++ % trees.size()]).size(); });
+
+	for (size_t index = 0; index < trees.size(); ++index)
+		assert(luxem::equal(*luxem::read_struct(luxem::write_struct(trees[index]))[0], *trees[index]));
+	assert(sink > 0);
+	return 0;
+}
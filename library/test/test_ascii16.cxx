@@ -0,0 +1,108 @@
+#undef NDEBUG
+
+#include "../ascii16.h"
+#include "../read.h"
+#include "../write.h"
+
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+#include <random>
+#include <stdexcept>
+#include <cassert>
+
+template <typename type> void assert2(type const &got, type const &expected)
+{
+	std::cout << "Expected: " << expected << std::endl;
+	std::cout << "Got     : " << got << std::endl;
+	assert(got == expected);
+}
+
+std::string reference_encode(std::vector<uint8_t> const &data)
+{
+	std::string out;
+	for (auto byte : data)
+	{
+		out += static_cast<char>('a' + (byte >> 4));
+		out += static_cast<char>('a' + (byte & 0xf));
+	}
+	return out;
+}
+
+int main(void)
+{
+	std::cout << "Kernel: " << luxem::ascii16_kernel() << std::endl;
+
+	std::mt19937 random(7);
+	// Lengths around every vector width, with unaligned starts
+	for (size_t length = 0; length < 300; ++length)
+	{
+		for (size_t skew = 0; skew < 3; ++skew)
+		{
+			std::vector<uint8_t> data(length + skew);
+			for (auto &byte : data) byte = static_cast<uint8_t>(random());
+			std::vector<uint8_t> source(data.begin() + skew, data.end());
+			auto expected = reference_encode(source);
+
+			std::string encoded(luxem::ascii16_encoded_size(length) + skew, 'x');
+			luxem::encode_ascii16(data.data() + skew, length, &encoded[skew]);
+			assert(encoded.substr(skew) == expected);
+			assert(luxem::to_string_ascii16(source) == expected);
+
+			std::vector<uint8_t> decoded(length + 1, 0xee);
+			luxem::decode_ascii16(encoded.data() + skew, expected.size(), decoded.data());
+			assert(std::vector<uint8_t>(decoded.begin(), decoded.begin() + length) == source);
+			assert(decoded[length] == 0xee);
+		}
+	}
+
+	// Bad characters are found in the vector body and in the tail
+	for (size_t position : {0, 5, 31, 32, 63, 64, 100, 198, 199})
+	{
+		for (char bad : {'q', '`', 'A', '\0', '\xff'})
+		{
+			std::string text(200, 'c');
+			text[position] = bad;
+			std::vector<uint8_t> out(100);
+			try
+			{
+				luxem::decode_ascii16(text.data(), text.size(), out.data());
+				assert(false);
+			}
+			catch (std::runtime_error &error)
+			{
+				assert2(std::string(error.what()), "Invalid ascii16 character at offset " + std::to_string(position) + ".");
+			}
+		}
+	}
+
+	try
+	{
+		luxem::primitive(std::string("abc")).get_ascii16();
+		assert(false);
+	}
+	catch (std::runtime_error &) {}
+
+	{
+		std::vector<uint8_t> blob(100000);
+		for (auto &byte : blob) byte = static_cast<uint8_t>(random());
+		luxem::writer writer;
+		writer.array_begin().value_ascii16(blob).value_ascii16("bin", std::string("\x01\xff", 2)).value_ascii16(std::vector<uint8_t>()).array_end();
+		auto parsed = luxem::read_struct(writer.dump());
+		assert2(parsed.size(), size_t(1));
+		auto &elements = parsed[0]->as<luxem::array>().get_data();
+		assert2(elements.size(), size_t(3));
+
+		std::vector<uint8_t> reused;
+		elements[0]->as<luxem::primitive>().get_ascii16(reused);
+		assert(reused == blob);
+		assert2(elements[1]->get_type(), std::string("bin"));
+		assert2(elements[1]->as<luxem::primitive>().get_primitive(), std::string("abpp"));
+		elements[2]->as<luxem::primitive>().get_ascii16(reused);
+		assert(reused.empty());
+	}
+
+	return 0;
+}
+
@@ -0,0 +1,105 @@
+#undef NDEBUG
+
+#include "../read.h"
+#include "../write.h"
+#include "../diff.h"
+
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+#include <random>
+#include <stdexcept>
+#include <cassert>
+
+template <typename type> void assert2(type const &got, type const &expected)
+{
+	std::cout << "Expected: " << expected << std::endl;
+	std::cout << "Got     : " << got << std::endl;
+	assert(got == expected);
+}
+
+std::string const words[] = {"x", "\"two words\"", "12", "\"\"", "k", "\"q\\\"\""};
+
+std::string random_document(std::mt19937 &random, int depth)
+{
+	std::string out = random() % 4 == 0 ? "(t) " : "";
+	auto choice = random() % 3;
+	if ((depth <= 0) || (choice == 0)) return out + words[random() % 6];
+	if (choice == 1)
+	{
+		out += "{";
+		for (int count = random() % 5; count > 0; --count) out += words[random() % 6] + ": " + random_document(random, depth - 1) + ", ";
+		return out + "}";
+	}
+	out += "[";
+	for (int count = random() % 5; count > 0; --count) out += random_document(random, depth - 1) + ", ";
+	return out + "]";
+}
+
+std::vector<std::shared_ptr<luxem::value>> read_with_contexts(std::string const &text)
+{
+	std::vector<std::shared_ptr<luxem::value>> out;
+	luxem::reader instance;
+	instance.build_struct([&out](std::shared_ptr<luxem::value> &&data) { out.emplace_back(std::move(data)); });
+	instance.feed(text);
+	return out;
+}
+
+int main(void)
+{
+	// Same trees as the context based reader, duplicate keys included
+	std::mt19937 random(5);
+	for (int iteration = 0; iteration < 500; ++iteration)
+	{
+		std::string text;
+		for (int count = random() % 3 + 1; count > 0; --count) text += random_document(random, 5) + ", ";
+		auto expected = read_with_contexts(text);
+		auto got = luxem::read_struct(text);
+		assert2(got.size(), expected.size());
+		for (size_t index = 0; index < got.size(); ++index) assert(luxem::equal(*got[index], *expected[index]));
+	}
+	assert2(luxem::read_struct("{a: 1, a: 2}")[0]->as<luxem::object>().get_data().at("a")->as<luxem::primitive>().get_primitive(), std::string("1"));
+
+	// Only completed documents are taken while streaming
+	{
+		luxem::struct_builder builder;
+		builder.feed(std::string("first, {a: [1, "), false);
+		auto taken = builder.take();
+		assert2(taken.size(), size_t(1));
+		assert2(taken[0]->as<luxem::primitive>().get_primitive(), std::string("first"));
+		builder.feed(std::string("2]}, (t) [], "), false);
+		taken = builder.take();
+		assert2(taken.size(), size_t(2));
+		assert2(taken[0]->as<luxem::object>().get_data().at("a")->as<luxem::array>().get_data().size(), size_t(2));
+		assert2(taken[1]->get_type(), std::string("t"));
+		assert(builder.take().empty());
+
+		builder.feed(std::string("{b: "), false);
+		builder.reset();
+		builder.feed("{c: d}");
+		taken = builder.take();
+		assert2(taken.size(), size_t(1));
+		assert(taken[0]->as<luxem::object>().get_data().count("c"));
+	}
+
+	// Nodes are reported innermost first, with their depth, their key and the open containers around them
+	{
+		luxem::struct_builder builder;
+		std::vector<std::string> seen;
+		builder.on_complete([&](std::shared_ptr<luxem::value> const &node, std::string const *key)
+		{
+			auto depth = builder.get_depth();
+			assert(!builder.get_open(depth));
+			if (depth > 0) assert(builder.get_open(depth - 1));
+			seen.push_back(std::to_string(depth) + (key ? *key : std::string("-")) + ":" +
+				(node->is<luxem::primitive>() ? node->as<luxem::primitive>().get_primitive() : node->get_name()));
+		});
+		builder.feed("{a: [x, {b: y}], a: z, c: w}, v");
+		std::vector<std::string> expected{"2-:x", "3b:y", "2-:object", "1a:array", "1c:w", "0-:object", "0-:v"};
+		assert2(seen.size(), expected.size());
+		for (size_t index = 0; index < seen.size(); ++index) assert2(seen[index], expected[index]);
+	}
+
+	return 0;
+}
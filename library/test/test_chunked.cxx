@@ -0,0 +1,205 @@
+#undef NDEBUG
+
+#include "../read.h"
+#include "../write.h"
+#include "../ascii16.h"
+
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <stdexcept>
+#include <cstdio>
+#include <cassert>
+
+template <typename type> void assert2(type const &got, type const &expected)
+{
+	std::cout << "Expected: " << expected << std::endl;
+	std::cout << "Got     : " << got << std::endl;
+	assert(got == expected);
+}
+
+size_t const chunk_size = 1000;
+
+// Records events as text, with streamed values marked so they can be told apart
+struct recorder
+{
+	luxem::raw_reader reader;
+	std::vector<std::string> events;
+	std::string streamed;
+	size_t largest_chunk;
+
+	recorder(bool decode_ascii16 = false) :
+		reader(
+			[this]() { events.push_back("{"); },
+			[this]() { events.push_back("}"); },
+			[this]() { events.push_back("["); },
+			[this]() { events.push_back("]"); },
+			[this](std::string &&data) { events.push_back("key " + data); },
+			[this](std::string &&data) { events.push_back("type " + data); },
+			[this](std::string &&data) { events.push_back("primitive " + data); }),
+		largest_chunk(0)
+	{
+		reader.set_chunked_primitives(chunk_size,
+			[this]() { streamed.clear(); },
+			[this](char const *pointer, size_t length)
+			{
+				largest_chunk = std::max(largest_chunk, length);
+				streamed.append(pointer, length);
+			},
+			[this]() { events.push_back("streamed " + streamed); },
+			decode_ascii16);
+	}
+};
+
+// Feeds like a network client would, keeping only what the reader didn't eat
+size_t feed_slices(luxem::raw_reader &reader, std::string const &text, size_t slice)
+{
+	std::string buffer;
+	size_t peak = 0;
+	for (size_t offset = 0; offset < text.size(); offset += slice)
+	{
+		buffer.append(text, offset, slice);
+		peak = std::max(peak, buffer.size());
+		buffer.erase(0, reader.feed(buffer, false));
+	}
+	reader.feed(buffer, true);
+	return peak;
+}
+
+int main(void)
+{
+	std::string word(200000, 'w');
+	std::string quoted;
+	for (size_t index = 0; index < 50000; ++index) quoted += index % 7 ? "ab" : "\"\\";
+	std::string escaped;
+	for (auto character : quoted)
+	{
+		if ((character == '"') || (character == '\\')) escaped += '\\';
+		escaped += character;
+	}
+	std::string const text = "{short: x, blob: " + word + ", \"" + std::string(1500, 'k') + "\": \"" + escaped + "\", list: [(bin) " + word + ", y]}, tail";
+	std::vector<std::string> const expected{
+		"{", "key short", "primitive x",
+		"key blob", "streamed " + word,
+		"key " + std::string(1500, 'k'), "streamed " + quoted,
+		"key list", "[", "type bin", "streamed " + word, "primitive y", "]",
+		"}", "primitive tail"};
+
+	// Streamed from small reads, the unconsumed buffer stays near the chunk size
+	for (size_t slice : {1, 7, 100, 4096})
+	{
+		recorder out;
+		auto peak = feed_slices(out.reader, text, slice);
+		assert(out.events == expected);
+		assert(out.largest_chunk <= chunk_size);
+		assert(peak < 2 * chunk_size + 2 + slice);
+	}
+
+	// Values already complete in the input are split the same way
+	{
+		recorder out;
+		out.reader.feed(text);
+		assert(out.events == expected);
+		assert(out.largest_chunk <= chunk_size);
+	}
+
+	// Ascii16 is decoded chunk by chunk, across odd chunk boundaries
+	{
+		std::vector<uint8_t> blob(100001);
+		for (size_t index = 0; index < blob.size(); ++index) blob[index] = static_cast<uint8_t>(index * 31);
+		auto encoded = luxem::to_string_ascii16(blob);
+		for (size_t slice : {3, 999, 1 << 20})
+		{
+			recorder out(true);
+			feed_slices(out.reader, "[" + encoded + ", \"" + encoded + "\"]", slice);
+			assert2(out.events.size(), size_t(4));
+			auto decoded = "streamed " + std::string(blob.begin(), blob.end());
+			assert(out.events[1] == decoded);
+			assert(out.events[2] == decoded);
+		}
+
+		recorder out(true);
+		size_t eaten;
+		std::string odd = encoded + "a";
+		auto result = out.reader.try_feed(odd.data(), odd.size(), eaten, true);
+		assert(result.get_code() == luxem::error::code::handler);
+		assert2(result.get_message().find("odd length") != std::string::npos, true);
+	}
+
+	// A streamed quoted value has to be closed
+	{
+		recorder out;
+		size_t eaten;
+		std::string open = "\"" + std::string(5000, 'q');
+		assert(!out.reader.try_feed(open.data(), open.size(), eaten, false));
+		assert2(eaten, open.size());
+		auto result = out.reader.try_feed(nullptr, 0, eaten, true);
+		assert(result.get_code() == luxem::error::code::syntax);
+	}
+
+	// Writing in pieces produces the same document as writing whole values
+	{
+		luxem::writer whole;
+		whole.object_begin().key("blob").primitive(quoted).key("bin").type("b").value_ascii16(std::string(word)).object_end();
+
+		auto write_chunked = [&](luxem::raw_writer &writer)
+		{
+			writer.object_begin().key("blob").primitive_begin();
+			for (size_t offset = 0; offset < quoted.size(); offset += 777)
+				writer.primitive_chunk(quoted.data() + offset, std::min<size_t>(777, quoted.size() - offset));
+			writer.primitive_end().key("bin").type("b").primitive_begin();
+			for (size_t offset = 0; offset < word.size(); offset += 1001)
+				writer.primitive_chunk_ascii16(word.data() + offset, std::min<size_t>(1001, word.size() - offset));
+			writer.primitive_end().object_end();
+		};
+
+		std::string streamed;
+		size_t largest_write = 0;
+		{
+			luxem::raw_writer writer([&](std::string &&chunk)
+			{
+				largest_write = std::max(largest_write, chunk.size());
+				streamed += chunk;
+			});
+			write_chunked(writer);
+		}
+		assert(streamed == whole.dump());
+		assert(largest_write < 3000);
+
+		luxem::raw_writer buffered;
+		write_chunked(buffered);
+		assert(buffered.dump() == whole.dump());
+
+		FILE *file = tmpfile();
+		{
+			luxem::raw_writer writer(file);
+			write_chunked(writer);
+		}
+		rewind(file);
+		recorder out;
+		out.reader.feed(file);
+		fclose(file);
+		assert2(out.events.size(), size_t(7));
+		assert(out.events[2] == "streamed " + quoted);
+		assert2(out.events[4], std::string("type b"));
+		assert(out.events[5] == "streamed " + luxem::to_string_ascii16(word));
+
+		luxem::raw_writer pretty_whole, pretty_chunked;
+		pretty_whole.set_pretty().array_begin().primitive("a").primitive(quoted).array_end();
+		pretty_chunked.set_pretty().array_begin().primitive("a").primitive_begin().primitive_chunk(quoted.data(), quoted.size()).primitive_end().array_end();
+		assert(pretty_chunked.dump() == pretty_whole.dump());
+
+		try
+		{
+			luxem::raw_writer writer;
+			writer.primitive_chunk("a", 1);
+			assert(false);
+		}
+		catch (std::runtime_error &) {}
+	}
+
+	return 0;
+}
+
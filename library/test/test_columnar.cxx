@@ -0,0 +1,139 @@
+#undef NDEBUG
+
+#include "../columnar.h"
+
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+#include <stdexcept>
+#include <cassert>
+
+template <typename type> void assert2(type const &got, type const &expected)
+{
+	std::cout << "Expected: " << expected << std::endl;
+	std::cout << "Got     : " << got << std::endl;
+	assert(got == expected);
+}
+
+using format = luxem::column::format;
+
+std::vector<luxem::column> spec(void)
+{
+	std::vector<luxem::column> out;
+	out.emplace_back("id", format::integer);
+	out.emplace_back("name", format::string);
+	out.emplace_back("score", format::decimal, true);
+	out.emplace_back("active", format::boolean);
+	out.emplace_back("count", format::unsigned_integer, true);
+	return out;
+}
+
+bool fails(std::string const &text, bool ignore_unknown = false)
+{
+	luxem::columnar_reader reader(spec());
+	reader.set_ignore_unknown(ignore_unknown);
+	try { reader.feed(text); }
+	catch (std::runtime_error const &) { return true; }
+	return false;
+}
+
+int main(void)
+{
+	std::string const text =
+		"[{id: 1, name: first, score: 0.5, active: true, count: 10},\n"
+		" {active: false, name: \"second, with \\\"quotes\\\"\", id: -2, score: 1e3},\n"
+		" {id: 3, name: \"\", active: true, count: (n) 7, id: 4}]\n"
+		"{id: 5, name: top, active: false}";
+
+	{
+		luxem::columnar_reader reader(spec());
+		reader.feed(text);
+		assert2(reader.get_row_count(), size_t(4));
+		auto &ids = reader.get_column("id");
+		assert(ids.get_ints() == std::vector<int64_t>({1, -2, 3, 5}));
+		auto &names = reader.get_column("name");
+		assert2(names.get_string(0), std::string("first"));
+		assert2(names.get_string(1), std::string("second, with \"quotes\""));
+		assert2(names.get_string(2), std::string());
+		assert2(names.get_offsets().size(), size_t(5));
+		auto &scores = reader.get_column("score");
+		assert2(scores.get_doubles()[1], 1000.0);
+		assert(scores.is_null(2));
+		assert(!scores.is_null(1));
+		assert(scores.get_present() == std::vector<uint8_t>({1, 1, 0, 0}));
+		assert(reader.get_column("active").get_bools() == std::vector<uint8_t>({1, 0, 1, 0}));
+		auto &counts = reader.get_column("count");
+		assert(counts.get_uints() == std::vector<uint64_t>({10, 0, 7, 0}));
+		assert(counts.is_null(1));
+
+		// Written back without the nulls, then read again to the same columns
+		auto written = luxem::write_columns(reader.get_columns());
+		assert2(written, std::string(
+			"[{id:1,name:first,score:0.5,active:true,count:10,},"
+			"{id:-2,name:\"second, with \\\"quotes\\\"\",score:1000,active:false,},"
+			"{id:3,name:\"\",active:true,count:7,},"
+			"{id:5,name:top,active:false,},],"));
+		auto again = luxem::read_columns(written, spec());
+		assert2(again[0].size(), size_t(4));
+		assert(again[0].get_ints() == ids.get_ints());
+		assert(again[1].get_text() == names.get_text());
+		assert(again[1].get_offsets() == names.get_offsets());
+		assert(again[2].get_present() == scores.get_present());
+		assert(again[4].get_uints() == counts.get_uints());
+
+		auto taken = reader.take();
+		assert2(taken[0].size(), size_t(4));
+		assert2(reader.get_row_count(), size_t(0));
+		assert2(reader.get_column("id").size(), size_t(0));
+		reader.feed(std::string("[{id: 9, name: x, active: true}]"));
+		assert2(reader.get_column("id").get_ints()[0], int64_t(9));
+	}
+
+	// Columns built directly
+	{
+		std::vector<luxem::column> columns;
+		columns.emplace_back("x", format::decimal);
+		columns.emplace_back("label", format::string, true);
+		columns[0].push_double(0.1);
+		columns[0].push_double(-2);
+		columns[1].push_null();
+		columns[1].push_string("b");
+		assert2(luxem::write_columns(columns), std::string("[{x:0.1,},{x:-2,label:b,},],"));
+		columns[0].push_double(3);
+		try
+		{
+			luxem::write_columns(columns);
+			assert(false);
+		}
+		catch (std::runtime_error const &) {}
+		try
+		{
+			columns[0].push_int(1);
+			assert(false);
+		}
+		catch (std::runtime_error const &) {}
+		try
+		{
+			columns[0].push_null();
+			assert(false);
+		}
+		catch (std::runtime_error const &) {}
+	}
+
+	assert(fails("[{id: x, name: a, active: true}]"));
+	assert(fails("[{id: 1.5, name: a, active: true}]"));
+	assert(fails("[{id: \" 1\", name: a, active: true}]"));
+	assert(fails("[{id: 1, name: a, active: yes}]"));
+	assert(fails("[{id: 1, name: a, active: true, count: -1}]"));
+	assert(fails("[{id: 1, name: a, active: true, count: 99999999999999999999}]"));
+	assert(fails("[{name: a, active: true}]"));
+	assert(fails("[{id: 1, name: a, active: true, extra: 0}]"));
+	assert(!fails("[{id: 1, name: a, active: true, extra: {deep: [0]}}]", true));
+	assert(fails("[{id: 1, name: [a], active: true}]", true));
+	assert(fails("[[{id: 1, name: a, active: true}]]"));
+	assert(fails("[4]"));
+	assert(fails("word"));
+
+	return 0;
+}
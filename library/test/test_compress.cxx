@@ -0,0 +1,135 @@
+#undef NDEBUG
+
+#include "../compress.h"
+#include "../write.h"
+
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+#include <cstdio>
+#include <cassert>
+
+#include <unistd.h>
+#include <fcntl.h>
+
+template <typename type> void assert2(type const &got, type const &expected)
+{
+	std::cout << "Expected: " << expected << std::endl;
+	std::cout << "Got     : " << got << std::endl;
+	assert(got == expected);
+}
+
+std::string make_document(size_t count)
+{
+	std::string out;
+	for (size_t index = 0; index < count; ++index)
+		out += "{id: " + std::to_string(index) + ", name: record" + std::to_string(index % 13) + ", tags: [a, b, (n) " + std::to_string(index) + "]},\n";
+	return out;
+}
+
+std::string compress(std::string const &data, luxem::compression format)
+{
+	std::string out;
+	luxem::compressor encoder([&out](char const *pointer, size_t length) { out.append(pointer, length); }, format);
+	for (size_t offset = 0; offset < data.size(); offset += 1000)
+		encoder.write(data.data() + offset, std::min<size_t>(1000, data.size() - offset));
+	encoder.finish();
+	return out;
+}
+
+std::string decompress(std::string const &data)
+{
+	size_t offset = 0;
+	luxem::decompressor decoder([&data, &offset](char *pointer, size_t length)
+	{
+		length = std::min(length, data.size() - offset);
+		data.copy(pointer, length, offset);
+		offset += length;
+		return length;
+	});
+	std::string out;
+	char buffer[777];
+	while (auto got = decoder.read(buffer, sizeof(buffer))) out.append(buffer, got);
+	return out;
+}
+
+std::string parse_file(std::string const &path, bool background)
+{
+	int descriptor = open(path.c_str(), O_RDONLY);
+	assert(descriptor >= 0);
+	luxem::writer out;
+	luxem::reader reader;
+	reader.build_struct([&out](std::shared_ptr<luxem::value> &&data) { out.value(data); });
+	luxem::feed_compressed(reader, descriptor, background);
+	close(descriptor);
+	return out.dump();
+}
+
+void write_file(std::string const &path, std::string const &data)
+{
+	FILE *file = fopen(path.c_str(), "wb");
+	assert(file);
+	fwrite(data.data(), 1, data.size(), file);
+	fclose(file);
+}
+
+void check_format(luxem::compression format)
+{
+	if (!luxem::compression_supported(format))
+	{
+		std::cout << "Skipping unsupported compression format" << std::endl;
+		return;
+	}
+
+	auto document = make_document(20000);
+	luxem::writer plain;
+	for (auto &element : luxem::read_struct(document)) plain.value(element);
+	auto expected = plain.dump();
+
+	auto compressed = compress(document, format);
+	assert(luxem::detect_compression(compressed.data(), compressed.size()) ==
+		(format == luxem::compression::none ? luxem::compression::none : format));
+	assert(decompress(compressed) == document);
+
+	// Concatenated frames decode as one stream
+	assert2(decompress(compress("a, b, ", format) + compress("c", format)), std::string("a, b, c"));
+
+	std::string const path = "test_compress_fixture";
+	write_file(path, compressed);
+	assert(parse_file(path, true) == expected);
+	assert(parse_file(path, false) == expected);
+
+	if (format != luxem::compression::none)
+	{
+		write_file(path, compressed.substr(0, compressed.size() / 2));
+		try
+		{
+			parse_file(path, true);
+			assert(false);
+		}
+		catch (std::runtime_error &) {}
+	}
+	std::remove(path.c_str());
+
+	// A writer can stream straight into a compressed sink
+	std::string sunk;
+	{
+		luxem::compressor encoder([&sunk](char const *pointer, size_t length) { sunk.append(pointer, length); }, format);
+		{
+			luxem::writer writer([&encoder](std::string &&chunk) { encoder.write(chunk); });
+			for (auto &element : luxem::read_struct(document)) writer.value(element);
+		}
+		encoder.finish();
+	}
+	assert(decompress(sunk) == expected);
+}
+
+int main(void)
+{
+	check_format(luxem::compression::none);
+	check_format(luxem::compression::gzip);
+	check_format(luxem::compression::zstd);
+	return 0;
+}
+
@@ -0,0 +1,129 @@
+#undef NDEBUG
+
+#include "../read.h"
+#include "../write.h"
+#include "../diff.h"
+#include "../dedup.h"
+
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+#include <cassert>
+
+template <typename type> void assert2(type const &got, type const &expected)
+{
+	std::cout << "Expected: " << expected << std::endl;
+	std::cout << "Got     : " << got << std::endl;
+	assert(got == expected);
+}
+
+std::string render(std::shared_ptr<luxem::value> const &data)
+	{ return luxem::writer().value(data).dump(); }
+
+std::string make_state(size_t count)
+{
+	std::string out = "[";
+	for (size_t index = 0; index < count; ++index)
+		out += "{id: " + std::to_string(index) + ", state: (status) active, extra: {}, "
+			"config: {retries: 3, backoff: [1, 2, 4], target: {host: \"example.com\", port: 443}}},";
+	return out + "]";
+}
+
+int main(void)
+{
+	auto text = make_state(1000);
+
+	luxem::struct_builder plain;
+	plain.feed(text);
+	auto separate = plain.take();
+	assert(!plain.get_subtrees());
+
+	luxem::struct_builder builder;
+	builder.set_deduplicate(true);
+	builder.feed(text);
+	auto shared = builder.take();
+	assert(luxem::equal(*separate[0], *shared[0]));
+
+	auto const &records = shared[0]->as<luxem::array>().get_data();
+	auto const &first = records[0]->as<luxem::object>().get_data();
+	auto const &last = records[999]->as<luxem::object>().get_data();
+	assert(first.at("config") == last.at("config"));
+	assert(first.at("state") == last.at("state"));
+	assert(first.at("extra") == last.at("extra"));
+	assert(first.at("id") != last.at("id"));
+	assert2(last.at("state")->get_type(), std::string("status"));
+	// Equal primitives are shared wherever they appear
+	assert(records[3]->as<luxem::object>().get_data().at("id") ==
+		first.at("config")->as<luxem::object>().get_data().at("retries"));
+
+	auto before = luxem::report_memory(separate);
+	auto after = luxem::report_memory(shared);
+	std::cout << "Separate: " << before.distinct_nodes << " nodes, " << before.distinct_bytes << " bytes" << std::endl;
+	std::cout << "Shared  : " << after.distinct_nodes << " nodes, " << after.distinct_bytes << " bytes" << std::endl;
+	assert2(before.nodes, before.distinct_nodes);
+	assert2(before.bytes, before.distinct_bytes);
+	assert2(after.nodes, before.nodes);
+	assert2(after.bytes, before.bytes);
+	assert(after.distinct_nodes < before.distinct_nodes / 3);
+	assert(after.distinct_bytes < before.distinct_bytes / 2);
+	assert(builder.get_subtrees()->get_hits() > 0);
+
+	// The table carries across documents until reset
+	builder.feed(std::string("{retries: 3, backoff: [1, 2, 4], target: {host: \"example.com\", port: 443}}"));
+	auto again = builder.take();
+	assert(again[0]->as<luxem::object>().get_data().at("target") ==
+		first.at("config")->as<luxem::object>().get_data().at("target"));
+	builder.reset();
+	assert2(builder.get_subtrees()->size(), size_t(0));
+
+	// Types are part of a node's identity
+	builder.feed(std::string("[(n) 3, 3, (m) 3, (n) 3, (n) [], []]"));
+	auto typed = builder.take()[0]->as<luxem::array>().get_data();
+	assert(typed[0] != typed[1]);
+	assert(typed[0] != typed[2]);
+	assert(typed[0] == typed[3]);
+	assert(typed[4] != typed[5]);
+
+	// Duplicate keys keep the first value, as without deduplicating
+	builder.feed(std::string("{a: {x: 1}, a: {x: 2}, b: {x: 1}}"));
+	auto duplicated = builder.take();
+	assert2(render(duplicated[0]), std::string("{a:{x:1,},b:{x:1,},},"));
+	auto const &members = duplicated[0]->as<luxem::object>().get_data();
+	assert(members.at("a") == members.at("b"));
+
+	// Delivered documents that are dropped aren't kept alive by the table, however long the stream
+	{
+		std::weak_ptr<luxem::value> earlier;
+		size_t delivered = 0;
+		luxem::struct_builder streaming([&](std::shared_ptr<luxem::value> &&document)
+		{
+			if (delivered++ == 0) earlier = document;
+		});
+		streaming.set_deduplicate(true);
+		for (size_t index = 0; index < 5000; ++index)
+		{
+			streaming.feed("{id: " + std::to_string(index) + ", config: {retries: 3, tags: [a, b]}}", true);
+			assert(earlier.expired());
+		}
+		assert2(delivered, size_t(5000));
+		assert2(streaming.get_subtrees()->size(), size_t(0));
+		assert(streaming.get_subtrees()->nodes.size() < 2048);
+
+		// Documents that are still held keep sharing
+		std::vector<std::shared_ptr<luxem::value>> held;
+		luxem::struct_builder holding([&held](std::shared_ptr<luxem::value> &&document) { held.push_back(std::move(document)); });
+		holding.set_deduplicate(true);
+		holding.feed(std::string("{config: {retries: 3}}, {config: {retries: 3}}"));
+		assert(held[0]->as<luxem::object>().get_data().at("config") == held[1]->as<luxem::object>().get_data().at("config"));
+	}
+
+	// Trees built some other way
+	auto copy = luxem::clone(separate[0]);
+	luxem::deduplicate(copy);
+	assert(luxem::equal(*copy, *separate[0]));
+	auto deduplicated = luxem::report_memory(*copy);
+	assert2(deduplicated.distinct_nodes, after.distinct_nodes);
+
+	return 0;
+}
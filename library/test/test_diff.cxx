@@ -0,0 +1,159 @@
+#undef NDEBUG
+
+#include "../diff.h"
+#include "../read.h"
+#include "../write.h"
+
+#include <iostream>
+#include <memory>
+#include <random>
+#include <cassert>
+
+template <typename type> void assert2(type const &got, type const &expected)
+{
+	std::cout << "Expected: " << expected << std::endl;
+	std::cout << "Got     : " << got << std::endl;
+	assert(got == expected);
+}
+
+std::string render(std::shared_ptr<luxem::value> const &data)
+	{ return luxem::writer().value(data).dump(); }
+
+void check_round_trip(std::shared_ptr<luxem::value> const &from, std::shared_ptr<luxem::value> const &to)
+{
+	auto patch = luxem::diff(from, to);
+	auto encoded = render(patch);
+	auto target = luxem::clone(from);
+	luxem::apply(target, luxem::read_struct(encoded)[0]);
+	if (!luxem::equal(*target, *to))
+	{
+		std::cout << "from : " << render(from) << std::endl;
+		std::cout << "to   : " << render(to) << std::endl;
+		std::cout << "patch: " << encoded << std::endl;
+		std::cout << "got  : " << render(target) << std::endl;
+		assert(false);
+	}
+}
+
+std::shared_ptr<luxem::value> random_tree(std::mt19937 &random, int depth)
+{
+	auto choice = random() % 4;
+	if ((depth <= 0) || (choice == 0)) return std::make_shared<luxem::primitive>(int(random() % 5));
+	if (choice == 1)
+	{
+		luxem::od data;
+		for (int count = random() % 5; count > 0; --count)
+			data[std::string(1, 'a' + random() % 6)] = random_tree(random, depth - 1);
+		return std::make_shared<luxem::object>(std::move(data));
+	}
+	luxem::ad data;
+	for (int count = random() % 6; count > 0; --count) data.push_back(random_tree(random, depth - 1));
+	if (choice == 3) return std::make_shared<luxem::array>("typed", std::move(data));
+	return std::make_shared<luxem::array>(std::move(data));
+}
+
+void random_edit(std::mt19937 &random, std::shared_ptr<luxem::value> &node, int depth)
+{
+	if (node->is<luxem::object>())
+	{
+		auto &data = node->as<luxem::object>().get_data();
+		if (!data.empty() && (random() % 2))
+		{
+			auto member = std::next(data.begin(), random() % data.size());
+			if (random() % 3 == 0) data.erase(member);
+			else random_edit(random, member->second, depth - 1);
+			return;
+		}
+		data[std::string(1, 'a' + random() % 6)] = random_tree(random, depth);
+		return;
+	}
+	if (node->is<luxem::array>())
+	{
+		auto &data = node->as<luxem::array>().get_data();
+		auto edit = random() % 4;
+		if (!data.empty() && (edit == 0))
+		{
+			auto from = random() % data.size();
+			auto to = random() % data.size();
+			auto moved = data[from];
+			data.erase(data.begin() + from);
+			data.insert(data.begin() + to, moved);
+			return;
+		}
+		if (!data.empty() && (edit == 1))
+		{
+			data.erase(data.begin() + random() % data.size());
+			return;
+		}
+		if (!data.empty() && (edit == 2))
+		{
+			random_edit(random, data[random() % data.size()], depth - 1);
+			return;
+		}
+		data.insert(data.begin() + random() % (data.size() + 1), random_tree(random, depth));
+		return;
+	}
+	node = random_tree(random, depth);
+}
+
+int main(void)
+{
+	{
+		auto records = std::make_shared<luxem::array>();
+		for (int index = 0; index < 1000; ++index)
+			records->get_data().push_back(std::make_shared<luxem::object>(luxem::od{
+				{"id", std::make_shared<luxem::primitive>(index)},
+				{"name", std::make_shared<luxem::primitive>("record" + std::to_string(index))}
+			}));
+		std::shared_ptr<luxem::value> from = records;
+		auto to = luxem::clone(from);
+		to->as<luxem::array>().get_data()[500]->as<luxem::object>().get_data()["name"] =
+			std::make_shared<luxem::primitive>("renamed");
+		auto patch = luxem::diff(from, to);
+		assert2(render(patch), std::string("[(set)[500,name,renamed,],],"));
+		check_round_trip(from, to);
+
+		auto moved = luxem::clone(from);
+		auto &moved_data = moved->as<luxem::array>().get_data();
+		auto element = moved_data[10];
+		moved_data.erase(moved_data.begin() + 10);
+		moved_data.insert(moved_data.begin() + 900, element);
+		patch = luxem::diff(from, moved);
+		assert2(patch->get_data().size(), size_t(1));
+		assert2(patch->get_data()[0]->get_type(), std::string("move"));
+		check_round_trip(from, moved);
+
+		// Shared subtrees are skipped without being compared
+		auto shared = std::make_shared<luxem::array>(luxem::ad(records->get_data()));
+		shared->get_data().push_back(std::make_shared<luxem::primitive>("appended"));
+		assert2(render(luxem::diff(from, shared)), std::string("[(insert)[1000,appended,],],"));
+	}
+
+	{
+		std::shared_ptr<luxem::value> from = luxem::read_struct("{a: 1, b: [1, 2, 3], c: {d: x}}")[0];
+		std::shared_ptr<luxem::value> to = luxem::read_struct("{a: 1, b: [3, 1, 2, 4], e: (t) y}")[0];
+		check_round_trip(from, to);
+		check_round_trip(from, std::make_shared<luxem::primitive>("replaced"));
+		assert2(luxem::diff(from, luxem::clone(from))->get_data().size(), size_t(0));
+	}
+
+	std::mt19937 random(4);
+	for (int trial = 0; trial < 2000; ++trial)
+	{
+		auto from = random_tree(random, 4);
+		auto to = luxem::clone(from);
+		for (int edits = random() % 4 + 1; edits > 0; --edits) random_edit(random, to, 4);
+		check_round_trip(from, to);
+	}
+
+	try
+	{
+		std::shared_ptr<luxem::value> target = luxem::read_struct("{a: 1}")[0];
+		luxem::apply(target, luxem::read_struct("[(remove)[b]]")[0]);
+		assert(false);
+	}
+	catch (std::runtime_error &) {}
+
+	return 0;
+}
+
@@ -0,0 +1,123 @@
+#undef NDEBUG
+
+#include "../read.h"
+#include "../write.h"
+
+#include <iostream>
+#include <memory>
+#include <string>
+#include <stdexcept>
+#include <cassert>
+
+template <typename type> void assert2(type const &got, type const &expected)
+{
+	std::cout << "Expected: " << expected << std::endl;
+	std::cout << "Got     : " << got << std::endl;
+	assert(got == expected);
+}
+
+struct counting_reader : luxem::raw_reader
+{
+	size_t primitives;
+
+	counting_reader(void) :
+		raw_reader(
+			[]() {}, []() {}, []() {}, []() {},
+			[](std::string &&) {}, [](std::string &&) {},
+			[this](std::string &&data)
+			{
+				if (data == "bad") fail("Rejected primitive.");
+				else if (data == "throw") throw std::runtime_error("Thrown from handler.");
+				else ++primitives;
+			}),
+		primitives(0)
+		{}
+};
+
+int main(void)
+{
+	{
+		counting_reader reader;
+		size_t eaten;
+		auto result = reader.try_feed("a, b, [c, d]", 12, eaten);
+		assert(!result);
+		assert(result.get_code() == luxem::error::code::none);
+		assert2(reader.primitives, size_t(4));
+		assert2(eaten, size_t(12));
+	}
+
+	{
+		counting_reader reader;
+		size_t eaten;
+		std::string text = "a, {b: c";
+		auto result = reader.try_feed(text.c_str(), text.size(), eaten);
+		assert(result);
+		assert(result.get_code() == luxem::error::code::syntax);
+		assert(result.get_message().find("Encountered error at offset") == 0);
+	}
+
+	{
+		counting_reader reader;
+		size_t eaten;
+		std::string text = "a, bad, c";
+		auto result = reader.try_feed(text.c_str(), text.size(), eaten);
+		assert(result);
+		assert(result.get_code() == luxem::error::code::handler);
+		assert2(reader.primitives, size_t(1));
+		auto message = result.get_message();
+		assert(message.find("Rejected primitive.") != std::string::npos);
+	}
+
+	{
+		counting_reader reader;
+		size_t eaten;
+		std::string text = "a, throw, c";
+		auto result = reader.try_feed(text.c_str(), text.size(), eaten);
+		assert(result.get_code() == luxem::error::code::handler);
+		assert(result.get_message().find("Thrown from handler.") != std::string::npos);
+	}
+
+	{
+		// The throwing interface reports the same errors
+		counting_reader reader;
+		try
+		{
+			reader.feed(std::string("a, bad"));
+			assert(false);
+		}
+		catch (std::runtime_error &error)
+		{
+			assert(std::string(error.what()).find("Rejected primitive.") != std::string::npos);
+		}
+	}
+
+	{
+		luxem::raw_writer *self = nullptr;
+		std::string out;
+		luxem::raw_writer writer([&self, &out](std::string &&chunk)
+		{
+			if (chunk.find("full") != std::string::npos) self->fail("Output is full.");
+			else if (chunk.find("throw") != std::string::npos) throw std::runtime_error("Thrown from output.");
+			else out += chunk;
+		});
+		self = &writer;
+		assert(!writer.try_primitive("a", 1));
+		auto result = writer.try_primitive("full", 4);
+		assert(result.get_code() == luxem::error::code::output);
+		assert2(result.get_message(), std::string("Output is full."));
+		assert2(writer.try_primitive("throw", 5).get_message(), std::string("Thrown from output."));
+		try
+		{
+			writer.primitive("full");
+			assert(false);
+		}
+		catch (std::runtime_error &error)
+		{
+			assert2(std::string(error.what()), std::string("Output is full."));
+		}
+		assert(out.find("a") == 0);
+	}
+
+	return 0;
+}
+
@@ -2,6 +2,7 @@
 
 #include "../read.h"
 #include "../write.h"
+#include "../walk.h"
 
 #include <iostream>
 #include <memory>
@@ -178,6 +179,41 @@ int main(void)
 		assert(walk_count == 20 * 2);
 	}
 
+	{
+		size_t enter_count = 0, leave_count = 0;
+		std::string horse_path;
+		assert(luxem::visit(input,
+			[&](luxem::walk_path const &path, std::shared_ptr<luxem::value> const &value)
+			{
+				++enter_count;
+				if (value->has_type() && (value->get_type() == "horse")) horse_path = path.render();
+				if (value->has_type() && (value->get_type() == "peanut")) return luxem::walk_result::skip;
+				return luxem::walk_result::proceed;
+			},
+			[&](luxem::walk_path const &, std::shared_ptr<luxem::value> const &) { ++leave_count; }));
+		assert2(enter_count, size_t(18));
+		assert2(leave_count, enter_count);
+		assert2(horse_path, std::string("[12]"));
+	}
+
+	{
+		std::string stop_path;
+		luxem::walker walker;
+		for (int repeat = 0; repeat < 2; ++repeat)
+		{
+			assert(!walker.walk(input, [&](luxem::walk_path const &path, std::shared_ptr<luxem::value> const &value)
+			{
+				if (!path.empty() && path.is_key(path.size() - 1) && (path.key(path.size() - 1) == "equestrianism"))
+				{
+					stop_path = path.render();
+					return luxem::walk_result::stop;
+				}
+				return luxem::walk_result::proceed;
+			}));
+			assert2(stop_path, std::string("[12].equestrianism"));
+		}
+	}
+
 	return 0;
 }
 
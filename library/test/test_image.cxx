@@ -0,0 +1,163 @@
+#undef NDEBUG
+
+#include "../image.h"
+#include "../read.h"
+#include "../diff.h"
+
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+#include <random>
+#include <stdexcept>
+#include <cstdio>
+#include <cstring>
+#include <cassert>
+
+template <typename type> void assert2(type const &got, type const &expected)
+{
+	std::cout << "Expected: " << expected << std::endl;
+	std::cout << "Got     : " << got << std::endl;
+	assert(got == expected);
+}
+
+std::string const texts[] = {"x", "", "two words", "quo\"te", "key", "12.5", "-7", "ünï", "zz"};
+
+std::shared_ptr<luxem::value> random_tree(std::mt19937 &random, int depth)
+{
+	auto choice = random() % 4;
+	auto const &text = texts[random() % (sizeof(texts) / sizeof(texts[0]))];
+	if ((depth <= 0) || (choice == 0))
+	{
+		if (random() % 3 == 0) return std::make_shared<luxem::primitive>("t", std::string(text));
+		return std::make_shared<luxem::primitive>(std::string(text));
+	}
+	if (choice == 1)
+	{
+		luxem::od data;
+		for (int count = random() % 6; count > 0; --count)
+			data[texts[random() % (sizeof(texts) / sizeof(texts[0]))]] = random_tree(random, depth - 1);
+		if (random() % 2) return std::make_shared<luxem::object>("record", std::move(data));
+		return std::make_shared<luxem::object>(std::move(data));
+	}
+	luxem::ad data;
+	for (int count = random() % 6; count > 0; --count) data.push_back(random_tree(random, depth - 1));
+	return std::make_shared<luxem::array>(std::move(data));
+}
+
+int main(void)
+{
+	// Images rebuild the same trees
+	std::mt19937 random(11);
+	for (int iteration = 0; iteration < 200; ++iteration)
+	{
+		std::vector<std::shared_ptr<luxem::value>> documents;
+		for (int count = random() % 3 + 1; count > 0; --count) documents.push_back(random_tree(random, 5));
+		auto data = luxem::build_image(documents);
+		luxem::image view(data.data(), data.size());
+		assert2(view.size(), documents.size());
+		auto built = view.build();
+		for (size_t index = 0; index < documents.size(); ++index) assert(luxem::equal(*built[index], *documents[index]));
+	}
+
+	// Queried in place from a mapped file
+	auto documents = luxem::read_struct(
+		"{name: reference, revision: (version) 3, ratio: 0.25, enabled: no, "
+		"rows: [{id: 1, label: one}, {id: 2, label: (tag) two}], empty: {}}, tail");
+	documents.push_back(std::make_shared<luxem::primitive>(int64_t(-9000000000)));
+	documents.push_back(std::make_shared<luxem::primitive>(2.5));
+	documents.push_back(std::make_shared<luxem::primitive>(true));
+	std::string path = "test_image.lxim";
+	luxem::save_image(documents, path);
+	{
+		auto view = luxem::image::map(path);
+		assert2(view.size(), size_t(5));
+		auto root = view[0];
+		assert(root.is_object());
+		assert2(root.size(), size_t(6));
+		assert(root["name"].get_primitive() == "reference");
+		assert(root["revision"].get_type() == "version");
+		assert2(root["revision"].get_int(), int64_t(3));
+		assert2(root["ratio"].get_double(), 0.25);
+		assert2(root["enabled"].get_bool(), false);
+		assert(!root.has("missing"));
+		assert(root.has("empty"));
+		assert2(root["empty"].size(), size_t(0));
+		auto rows = root["rows"];
+		assert(rows.is_array());
+		assert2(rows.size(), size_t(2));
+		assert2(rows[1]["id"].get_uint(), uint64_t(2));
+		assert(rows[1]["label"].get_type() == "tag");
+		assert2(std::string(rows[1]["label"].get_primitive().pointer), std::string("two"));
+		assert(root.get_key(0) == "empty");
+		assert(view[1].get_primitive() == "tail");
+		assert2(view[2].get_int(), int64_t(-9000000000));
+		assert(view[2].get_primitive() == "-9000000000");
+		assert2(view[3].get_double(), 2.5);
+		assert2(view[4].get_bool(), true);
+		assert(luxem::equal(*root["rows"].build(), *documents[0]->as<luxem::object>().get_data().at("rows")));
+
+		try
+		{
+			root["missing"];
+			assert(false);
+		}
+		catch (std::runtime_error const &) {}
+		try
+		{
+			rows[2];
+			assert(false);
+		}
+		catch (std::runtime_error const &) {}
+	}
+	std::remove(path.c_str());
+
+	// Bad images are rejected without reading out of bounds
+	{
+		auto data = luxem::build_image(documents);
+		for (size_t cut : {size_t(0), size_t(10), data.size() - 8})
+		{
+			try
+			{
+				luxem::image(data.data(), cut);
+				assert(false);
+			}
+			catch (std::runtime_error const &) {}
+		}
+		auto broken = data;
+		broken[0] = 'X';
+		try
+		{
+			luxem::image(broken.data(), broken.size());
+			assert(false);
+		}
+		catch (std::runtime_error const &) {}
+	}
+
+	// A child pointing at itself is rejected rather than followed around the cycle
+	for (auto text : {"[x]", "{a: b}"})
+	{
+		auto data = luxem::build_image(luxem::read_struct(text));
+		uint64_t roots, root;
+		std::memcpy(&roots, &data[24], 8);
+		std::memcpy(&root, &data[roots], 8);
+		// After the node header, its type and its size: the first element, or the first key and then its value
+		std::memcpy(&data[root + 8 + ((text[0] == '[') ? 2 : 3) * 8], &root, 8);
+		luxem::image view(data.data(), data.size());
+		try
+		{
+			view.build();
+			assert(false);
+		}
+		catch (std::runtime_error const &) {}
+		try
+		{
+			if (text[0] == '[') view[0][0];
+			else view[0]["a"];
+			assert(false);
+		}
+		catch (std::runtime_error const &) {}
+	}
+
+	return 0;
+}
@@ -0,0 +1,227 @@
+#undef NDEBUG
+
+#include "../index.h"
+#include "../write.h"
+#include "../misc.h"
+
+#include <iostream>
+#include <memory>
+#include <string>
+#include <cstdio>
+#include <cassert>
+
+template <typename type> void assert2(type const &got, type const &expected)
+{
+	std::cout << "Expected: " << expected << std::endl;
+	std::cout << "Got     : " << got << std::endl;
+	assert(got == expected);
+}
+
+std::string render(std::shared_ptr<luxem::value> const &data)
+	{ return luxem::writer().value(data).dump(); }
+
+void append(std::string const &path, std::string const &text)
+{
+	FILE *file = fopen(path.c_str(), "ab");
+	assert(file);
+	fwrite(text.data(), 1, text.size(), file);
+	fclose(file);
+}
+
+std::string record(size_t index)
+{
+	return "{id: " + std::to_string(index) + ", note: \"} ] *" + std::to_string(index) + "\\\"\"}, "
+		"*comment, with } *(tag) [" + std::to_string(index) + "], " + "word" + std::to_string(index) + ",\n";
+}
+
+int main(void)
+{
+	std::string const source_path = "test_index_source.luxem";
+	std::string const sidecar_path = "test_index_source.luxem.idx";
+	std::remove(source_path.c_str());
+	std::remove(sidecar_path.c_str());
+	luxem::finally cleanup([&]()
+	{
+		std::remove(source_path.c_str());
+		std::remove(sidecar_path.c_str());
+	});
+
+	std::string text;
+	for (size_t index = 0; index < 1000; ++index) text += record(index);
+	append(source_path, text);
+
+	{
+		auto index = luxem::index_file(source_path, sidecar_path, 16);
+		assert2(index.get_count(), size_t(3000));
+		assert2(index.get_samples().size(), size_t(188));
+		assert2(index.get_indexed_size(), uint64_t(text.size() - 2));
+
+		FILE *source = fopen(source_path.c_str(), "rb");
+		assert(source);
+		luxem::finally close_source([source]() { fclose(source); });
+		assert2(render(index.read(source, 1500)), std::string("{id:500,note:\"} ] *500\\\"\",},"));
+		assert2(render(index.read(source, 1501)), std::string("(tag)[500,],"));
+		assert2(render(index.read(source, 2999)), std::string("word999,"));
+		auto range = index.read(source, 47, 4);
+		assert2(range.size(), size_t(4));
+		assert2(render(range[0]), std::string("word15,"));
+		assert2(render(range[3]), std::string("word16,"));
+		try
+		{
+			index.read(source, 3000);
+			assert(false);
+		}
+		catch (std::runtime_error &) {}
+	}
+
+	{
+		// Appending resumes from the last complete record, including a record cut short by the previous write
+		append(source_path, "tail");
+		auto index = luxem::index_file(source_path, sidecar_path, 16);
+		assert2(index.get_count(), size_t(3000));
+		append(source_path, "ed, [x]");
+		index = luxem::index_file(source_path, sidecar_path, 16);
+		assert2(index.get_count(), size_t(3002));
+		auto loaded = luxem::offset_index::load(sidecar_path);
+		assert2(loaded.get_count(), size_t(3002));
+		assert(loaded.get_samples() == index.get_samples());
+
+		FILE *source = fopen(source_path.c_str(), "rb");
+		assert(source);
+		luxem::finally close_source([source]() { fclose(source); });
+		assert(index.is_current(source));
+		assert2(render(index.read(source, 3000)), std::string("tailed,"));
+		assert2(render(index.read(source, 3001)), std::string("[x,],"));
+
+		luxem::offset_index fed(16);
+		size_t primitives = 0;
+		luxem::raw_reader reader(
+			[]() {}, []() {}, []() {}, []() {},
+			[](std::string &&) {}, [](std::string &&) {},
+			[&primitives](std::string &&) { ++primitives; });
+		fed.feed(reader, source);
+		assert2(primitives, size_t(4002));
+		assert(fed.get_samples() == index.get_samples());
+	}
+
+	{
+		// Rewriting the file rather than appending restarts the index
+		std::remove(source_path.c_str());
+		append(source_path, "a, b, c");
+		auto index = luxem::index_file(source_path, sidecar_path, 16);
+		assert2(index.get_count(), size_t(2));
+
+		FILE *source = fopen(source_path.c_str(), "rb");
+		assert(source);
+		luxem::finally close_source([source]() { fclose(source); });
+		assert2(render(index.read(source, 2)), std::string("c,"));
+	}
+
+	{
+		// Records are the elements of untyped top-level arrays, and other top-level values
+		std::string const source =
+			"[{id: 3, name: x}, {id: 1, name: \"b, ]\"}, {id: 3, id: 4, name: dup}, *{id: 5}* {name: none},\n"
+			"{id: {nested: 6}}, 7, (t) {id: 9}, [{id: 8}]]\n"
+			"{id: 20, inner: {id: 99}} (rows) [{id: 30}] word";
+		luxem::indexing_reader reader;
+		auto &ids = reader.add_index("id");
+		auto &names = reader.add_index("name", true);
+		reader.feed(source);
+		assert2(reader.get_record_count(), size_t(11));
+		assert2(ids.size(), size_t(5));
+		assert2(names.size(), size_t(4));
+		assert(&reader.get_index("name") == &names);
+
+		auto first = ids.find("3");
+		assert(first);
+		assert2(first->record, size_t(0));
+		assert2(source.substr(first->offset, first->length), std::string("{id: 3, name: x}"));
+		assert2(render(first->data), std::string("{id:3,name:x,},"));
+		auto both = ids.find_all("3");
+		assert2(both.size(), size_t(2));
+		assert2(both[1]->record, size_t(2));
+		assert(!ids.find("4"));
+		assert(!ids.find("5"));
+		assert(!ids.find("6"));
+		assert(!ids.find("8"));
+		assert(!ids.find("99"));
+		assert(!ids.find("30"));
+		assert2(render(ids.find("9")->data), std::string("(t){id:9,},"));
+		assert2(source.substr(ids.find("9")->offset, ids.find("9")->length), std::string("(t) {id: 9}"));
+		assert2(ids.find("20")->record, size_t(8));
+
+		auto named = names.range("b", "y");
+		assert2(named.size(), size_t(4));
+		assert2(named[0]->data->as<luxem::object>().get_data().at("name")->as<luxem::primitive>().get_primitive(), std::string("b, ]"));
+		assert2(source.substr(named[0]->offset, named[0]->length), std::string("{id: 1, name: \"b, ]\"}"));
+		assert2(names.range("c", "x").size(), size_t(2));
+		try
+		{
+			ids.range("0", "9");
+			assert(false);
+		}
+		catch (std::runtime_error &) {}
+
+		auto documents = reader.take();
+		assert2(documents.size(), size_t(4));
+		assert2(documents[0]->as<luxem::array>().get_data().size(), size_t(8));
+		assert(documents[0]->as<luxem::array>().get_data()[0] == first->data);
+
+		// Keeping only offsets finds the same records
+		luxem::indexing_reader located(false);
+		auto &located_ids = located.add_index("id");
+		located.feed(source);
+		assert2(located.get_record_count(), size_t(11));
+		assert2(located_ids.size(), ids.size());
+		for (auto id : {"1", "3", "9", "20"})
+		{
+			assert2(located_ids.find_all(id).size(), ids.find_all(id).size());
+			assert2(located_ids.find(id)->record, ids.find(id)->record);
+			assert2(located_ids.find(id)->offset, ids.find(id)->offset);
+			assert(!located_ids.find(id)->data);
+		}
+		assert(!located_ids.find("30"));
+	}
+
+	{
+		// Without keeping records, entries locate them in the source
+		std::string text = "[";
+		for (size_t index = 0; index < 2000; ++index)
+			text += "{id: " + std::to_string(index % 1000) + ", note: \"*" + std::string(index % 13, ']') + "\"},\n";
+		text += "]";
+		std::remove(source_path.c_str());
+		append(source_path, text);
+
+		FILE *source = fopen(source_path.c_str(), "rb");
+		assert(source);
+		luxem::finally close_source([source]() { fclose(source); });
+		luxem::indexing_reader reader(false);
+		auto &ids = reader.add_index("id");
+		reader.feed(source);
+		assert2(reader.get_record_count(), size_t(2000));
+		assert2(ids.size(), size_t(2000));
+		assert(!ids.find("1")->data);
+		auto matches = ids.find_all("742");
+		assert2(matches.size(), size_t(2));
+		assert2(render(luxem::key_index::read(source, *matches[1])), std::string("{id:742,note:\"*\",},"));
+		assert2(render(luxem::key_index::read(source, *matches[0])), std::string("{id:742,note:\"*]\",},"));
+		assert(reader.take().empty());
+
+		// Fed in pieces, keeping unconsumed tails
+		luxem::indexing_reader pieces(false);
+		auto &piece_ids = pieces.add_index("id");
+		std::string pending;
+		for (size_t offset = 0; offset < text.size(); offset += 37)
+		{
+			pending += text.substr(offset, 37);
+			pending.erase(0, pieces.feed(pending, false));
+		}
+		pieces.feed(pending, true);
+		assert2(pieces.get_record_count(), size_t(2000));
+		assert2(piece_ids.find_all("742")[1]->offset, matches[1]->offset);
+		assert2(piece_ids.find("999")->length, ids.find("999")->length);
+	}
+
+	return 0;
+}
+
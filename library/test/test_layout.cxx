@@ -0,0 +1,116 @@
+#undef NDEBUG
+
+#include "../struct.h"
+#include "../read.h"
+
+#include <iostream>
+#include <memory>
+#include <string>
+#include <stdexcept>
+#include <type_traits>
+#include <cassert>
+
+template <typename type> void assert2(type const &got, type const &expected)
+{
+	std::cout << "Expected: " << expected << std::endl;
+	std::cout << "Got     : " << got << std::endl;
+	assert(got == expected);
+}
+
+// A node type defined outside the library
+struct blob : luxem::value
+{
+	static constexpr kind node_kind = extension_kind(0);
+	static std::string const name;
+
+	blob(void) : value(node_kind) {}
+};
+
+constexpr luxem::value::kind blob::node_kind;
+std::string const blob::name("blob");
+
+int main(void)
+{
+	// No vtable and no inline type name: the primitive flags share the header word with the tag
+	static_assert(!std::is_polymorphic<luxem::value>::value, "values must not carry a vtable");
+	static_assert(sizeof(luxem::value) <= 2 * sizeof(void *), "value header grew");
+	static_assert(sizeof(luxem::primitive) <= sizeof(luxem::value) + sizeof(double) + sizeof(std::string), "primitive grew");
+	static_assert(sizeof(luxem::array) <= sizeof(luxem::value) + sizeof(luxem::array::array_data), "array grew");
+	static_assert(sizeof(luxem::object) <= sizeof(luxem::value) + sizeof(luxem::object::object_data), "object grew");
+	std::cout << "Sizes: value " << sizeof(luxem::value) << ", primitive " << sizeof(luxem::primitive) << 
+		", array " << sizeof(luxem::array) << ", object " << sizeof(luxem::object) << std::endl;
+
+	auto tree = luxem::read_struct("(t) {a: [x, (u) y], b: z}")[0];
+	assert(tree->is<luxem::object>());
+	assert(!tree->is<luxem::array>());
+	assert(tree->is_derived<luxem::value>());
+	assert(tree->get_kind() == luxem::value::kind::object);
+	assert2(tree->get_name(), std::string("object"));
+	assert2(tree->get_type(), std::string("t"));
+
+	auto const &list = tree->as<luxem::object>().get_data().at("a")->as<luxem::array>();
+	assert2(list.get_name(), std::string("array"));
+	assert(!list.has_type());
+	assert(!list.get_data()[0]->has_type());
+	assert2(list.get_data()[1]->get_type(), std::string("u"));
+	assert2(list.get_data()[1]->as<luxem::primitive>().get_primitive(), std::string("y"));
+
+	try
+	{
+		list.get_data()[0]->as<luxem::object>();
+		assert(false);
+	}
+	catch (std::runtime_error const &error)
+	{
+		assert2(std::string(error.what()), std::string("Expected object, found primitive"));
+	}
+
+	// Types can be added and replaced after construction
+	luxem::primitive leaf(std::string("text"));
+	assert(!leaf.has_type());
+	leaf.set_type("first");
+	assert2(leaf.get_type(), std::string("first"));
+	leaf.set_type(std::string("second"));
+	assert2(leaf.get_type(), std::string("second"));
+	assert2(luxem::primitive(std::string("typed"), std::string("data")).get_type(), std::string("typed"));
+	std::string const type_name("typed");
+	luxem::primitive empty(type_name);
+	assert2(empty.get_type(), type_name);
+	assert2(empty.get_primitive(), std::string(""));
+
+	// Contexts are tagged too
+	luxem::reader reader;
+	bool seen = false;
+	reader.element([&](std::shared_ptr<luxem::value> &&data)
+	{
+		assert(data->is<luxem::reader::array_context>());
+		assert2(data->get_name(), std::string("array_context"));
+		assert2(data->get_type(), std::string("list"));
+		seen = true;
+	});
+	reader.feed("(list) []");
+	assert(seen);
+
+	// Extension kinds are named once registered
+	{
+		auto node = std::make_shared<blob>();
+		assert2(node->get_name(), std::string("unregistered kind"));
+		luxem::value::register_kind(blob::node_kind, blob::name);
+		assert2(node->get_name(), std::string("blob"));
+		assert(node->is<blob>());
+		assert(!node->is<luxem::object>());
+		std::shared_ptr<luxem::value> base = node;
+		assert(&base->as<blob>() == node.get());
+		try
+		{
+			base->as<luxem::array>();
+			assert(false);
+		}
+		catch (std::runtime_error const &error)
+		{
+			assert2(std::string(error.what()), std::string("Expected array, found blob"));
+		}
+	}
+
+	return 0;
+}
@@ -0,0 +1,111 @@
+#undef NDEBUG
+
+#include "../literal.h"
+#include "../read.h"
+#include "../diff.h"
+
+#include <iostream>
+#include <memory>
+#include <string>
+#include <limits>
+#include <stdexcept>
+#include <cassert>
+
+template <typename type> void assert2(type const &got, type const &expected)
+{
+	std::cout << "Expected: " << expected << std::endl;
+	std::cout << "Got     : " << got << std::endl;
+	assert(got == expected);
+}
+
+constexpr luxem::literal defaults(R"(
+	*Defaults for the server*
+	{
+		port: (int) 8080,
+		verbose: false,
+		"name with space": "a \"quoted\" name",
+		paths: [/usr/lib, /lib, (optional) /opt/lib],
+		limits: {},
+	},
+	second_document
+)");
+
+// Everything here is worked out by the compiler
+static_assert(defaults.size() == 2, "");
+static_assert(defaults[0].is_object(), "");
+static_assert(defaults[0].size() == 5, "");
+static_assert(defaults[0]["port"].get_primitive().get_int() == 8080, "");
+static_assert(defaults[0]["port"].get_type().equals("int"), "");
+static_assert(!defaults[0]["verbose"].get_primitive().get_bool(), "");
+static_assert(defaults[0]["name with space"].get_primitive().equals("a \"quoted\" name"), "");
+static_assert(defaults[0]["paths"].size() == 3, "");
+static_assert(defaults[0]["paths"][2].get_type().equals("optional"), "");
+static_assert(defaults[0]["paths"][1].get_primitive().equals("/lib"), "");
+static_assert(defaults[0]["limits"].size() == 0, "");
+static_assert(!defaults[0].has("missing"), "");
+static_assert(defaults[1].get_primitive().equals("second_document"), "");
+
+// Typed aggregates can be filled from a literal at compile time
+struct server_settings
+{
+	int64_t port;
+	bool verbose;
+	size_t path_count;
+};
+constexpr server_settings settings{
+	defaults[0]["port"].get_primitive().get_int(),
+	defaults[0]["verbose"].get_primitive().get_bool(),
+	defaults[0]["paths"].size()};
+static_assert(settings.port == 8080, "");
+
+// Integers reach both limits
+constexpr luxem::literal limits("-9223372036854775808, 9223372036854775807, -0");
+static_assert(limits[0].get_primitive().get_int() == std::numeric_limits<int64_t>::min(), "");
+static_assert(limits[1].get_primitive().get_int() == std::numeric_limits<int64_t>::max(), "");
+static_assert(limits[2].get_primitive().get_int() == 0, "");
+
+int main(void)
+{
+	// Built trees match read_struct
+	auto documents = luxem::read_struct(defaults.get_text(), defaults.get_length());
+	auto built = defaults.read();
+	assert2(built.size(), documents.size());
+	for (size_t index = 0; index < built.size(); ++index) assert(luxem::equal(*built[index], *documents[index]));
+	assert(luxem::equal(*defaults[0]["paths"].build(), *documents[0]->as<luxem::object>().get_data().at("paths")));
+	assert2(defaults[0]["paths"][2].build()->get_type(), std::string("optional"));
+	assert2(defaults[0]["name with space"].get_primitive().str(), std::string("a \"quoted\" name"));
+
+	// Literals made at runtime are checked the same way, raising instead of failing the build
+	for (auto bad : {"{a: }", "[1, 2", "{a b}", "\"open", "(t) (u) x", "*comment", "{(t) k: v}"})
+	{
+		try
+		{
+			luxem::literal(bad, std::string(bad).size());
+			std::cout << "Accepted " << bad << std::endl;
+			assert(false);
+		}
+		catch (std::runtime_error const &) {}
+	}
+
+	// One past either limit is not an integer
+	for (auto bad : {"9223372036854775808", "-9223372036854775809", "99999999999999999999"})
+	{
+		luxem::literal out_of_range(bad, std::string(bad).size());
+		try
+		{
+			out_of_range[0].get_primitive().get_int();
+			std::cout << "Accepted " << bad << std::endl;
+			assert(false);
+		}
+		catch (std::runtime_error const &) {}
+	}
+
+	try
+	{
+		defaults[0]["missing"];
+		assert(false);
+	}
+	catch (std::runtime_error const &) {}
+
+	return 0;
+}
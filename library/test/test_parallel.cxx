@@ -0,0 +1,107 @@
+#undef NDEBUG
+
+#include "../parallel.h"
+
+#include <iostream>
+#include <memory>
+#include <string>
+#include <atomic>
+#include <stdexcept>
+#include <cassert>
+
+template <typename type> void assert2(type const &got, type const &expected)
+{
+	std::cout << "Expected: " << expected << std::endl;
+	std::cout << "Got     : " << got << std::endl;
+	assert(got == expected);
+}
+
+int main(void)
+{
+	luxem::thread_pool pool(4);
+	assert2(pool.get_thread_count(), size_t(4));
+
+	auto numbers = std::make_shared<luxem::array>();
+	for (int index = 0; index < 10000; ++index)
+		numbers->get_data().emplace_back(std::make_shared<luxem::primitive>(index));
+
+	luxem::parallel_map(pool, *numbers, [](size_t, std::shared_ptr<luxem::value> &&element)
+	{
+		return std::make_shared<luxem::primitive>(element->as<luxem::primitive>().get_int() * 2);
+	}, 100);
+	for (int index = 0; index < 10000; ++index)
+		assert(numbers->get_data()[index]->as<luxem::primitive>().get_int() == index * 2);
+
+	auto sum = luxem::parallel_reduce(pool, *numbers, int64_t(0),
+		[](size_t, std::shared_ptr<luxem::value> const &element) { return element->as<luxem::primitive>().get_int(); },
+		[](int64_t left, int64_t right) { return left + right; }, 100);
+	assert2(sum, int64_t(9999 * 10000));
+
+	// Order-sensitive combine checks that partials are combined in element order
+	auto small = std::make_shared<luxem::array>();
+	for (int index = 0; index < 10; ++index)
+		small->get_data().emplace_back(std::make_shared<luxem::primitive>(index));
+	auto concatenated = luxem::parallel_reduce(pool, *small, std::string(),
+		[](size_t, std::shared_ptr<luxem::value> const &element) { return element->as<luxem::primitive>().get_string(); },
+		[](std::string left, std::string const &right) { return left + right; }, 3);
+	assert2(concatenated, std::string("0123456789"));
+
+	auto records = std::make_shared<luxem::object>();
+	for (int index = 0; index < 1000; ++index)
+		records->get_data()[std::to_string(index)] = std::make_shared<luxem::object>(luxem::od{
+			{"secret", std::make_shared<luxem::primitive>("hunter2")},
+			{"items", std::make_shared<luxem::array>(luxem::ad{
+				std::make_shared<luxem::primitive>(1),
+				std::make_shared<luxem::primitive>(2)})}
+		});
+
+	std::atomic<size_t> nested_count(0);
+	luxem::parallel_for_each(pool, *records, [&](std::string const &, std::shared_ptr<luxem::value> &record)
+	{
+		auto &members = record->as<luxem::object>().get_data();
+		members["secret"] = std::make_shared<luxem::primitive>("redacted");
+		luxem::parallel_for_each(pool, members["items"]->as<luxem::array>(),
+			[&](size_t, std::shared_ptr<luxem::value> &) { ++nested_count; }, 1);
+	}, 16);
+	assert2(nested_count.load(), size_t(2000));
+
+	auto redacted = luxem::parallel_reduce(pool, *records, size_t(0),
+		[](std::string const &, std::shared_ptr<luxem::value> const &record)
+		{
+			return record->as<luxem::object>().get_data().at("secret")->as<luxem::primitive>().get_string() == "redacted" ?
+				size_t(1) : size_t(0);
+		},
+		[](size_t left, size_t right) { return left + right; }, 7);
+	assert2(redacted, size_t(1000));
+
+	try
+	{
+		luxem::parallel_for_each(pool, *numbers, [](size_t index, std::shared_ptr<luxem::value> &)
+			{ if (index == 5000) throw std::runtime_error("expected"); }, 10);
+		assert(false);
+	}
+	catch (std::runtime_error &error) { assert2(std::string(error.what()), std::string("expected")); }
+
+	// Elements sharing one primitive may read it at once, including the first formatting of a native value
+	for (int round = 0; round < 50; ++round)
+	{
+		auto native = std::make_shared<luxem::primitive>(int64_t(-1234567) - round);
+		auto text = std::make_shared<luxem::primitive>(std::string("2.5"));
+		luxem::array shared;
+		for (int index = 0; index < 64; ++index) shared.get_data().push_back(index % 2 ? native : text);
+		std::atomic<size_t> correct(0);
+		luxem::parallel_for_each(pool, shared, [&](size_t, std::shared_ptr<luxem::value> &element)
+		{
+			auto const &leaf = element->as<luxem::primitive>();
+			if (leaf.get_primitive() == ((element == native) ? std::to_string(int64_t(-1234567) - round) : std::string("2.5")) &&
+				(leaf.get_double() == ((element == native) ? double(-1234567 - round) : 2.5)))
+				++correct;
+		}, 1);
+		assert2(correct.load(), size_t(64));
+		assert(native->has_text());
+		assert(text->get_native_kind() == luxem::primitive::native_kind::none);
+	}
+
+	return 0;
+}
+
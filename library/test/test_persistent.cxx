@@ -0,0 +1,87 @@
+#undef NDEBUG
+
+#include "../persistent.h"
+#include "../read.h"
+#include "../write.h"
+
+#include <iostream>
+#include <memory>
+#include <cassert>
+
+template <typename type> void assert2(type const &got, type const &expected)
+{
+	std::cout << "Expected: " << expected << std::endl;
+	std::cout << "Got     : " << got << std::endl;
+	assert(got == expected);
+}
+
+std::string render(luxem::snapshot const &data)
+	{ return luxem::writer().value(luxem::thaw(data)).dump(); }
+
+int main(void)
+{
+	auto source = luxem::read_struct("{a: {b: 1, c: [x, y, z]}, d: (t) 2}");
+	auto version1 = luxem::freeze(source[0]);
+	assert2(render(version1), luxem::writer().value(source[0]).dump());
+	assert2(version1.get_in({"d"}).get_type(), std::string("t"));
+
+	auto version2 = version1.set_in({"a", "c", 1}, luxem::snapshot::make_primitive("Y"));
+	assert2(version1.get_in({"a", "c", 1}).get_primitive(), std::string("y"));
+	assert2(version2.get_in({"a", "c", 1}).get_primitive(), std::string("Y"));
+	assert(version2.get("d").same(version1.get("d")));
+	assert(version2.get_in({"a", "b"}).same(version1.get_in({"a", "b"})));
+	assert(!version2.get("a").same(version1.get("a")));
+
+	auto version3 = version2.set_in({"a", "c", 3}, luxem::snapshot::make_primitive("w")).erase_in({"d"});
+	assert2(version3.get_in({"a", "c"}).size(), size_t(4));
+	assert(!version3.has("d"));
+	assert(version2.has("d"));
+
+	auto list = luxem::snapshot::make_array();
+	for (size_t index = 0; index < 1000; ++index)
+		list = list.push_back(luxem::snapshot::make_primitive(std::to_string(index)));
+	auto edited = list.insert(0, luxem::snapshot::make_primitive("first")).erase(500).set(999, luxem::snapshot::make_primitive("last"));
+	assert2(list.size(), size_t(1000));
+	assert2(edited.size(), size_t(1000));
+	assert2(edited.get(0).get_primitive(), std::string("first"));
+	assert2(edited.get(1).get_primitive(), std::string("0"));
+	assert2(edited.get(500).get_primitive(), std::string("500"));
+	assert2(edited.get(499).get_primitive(), std::string("498"));
+	assert2(edited.get(999).get_primitive(), std::string("last"));
+	assert(edited.get(998).same(list.get(998)));
+	size_t expected_index = 0;
+	list.for_each_element([&expected_index](size_t index, luxem::snapshot const &element)
+	{
+		assert2(index, expected_index);
+		assert2(element.get_primitive(), std::to_string(expected_index));
+		++expected_index;
+	});
+
+	auto members = luxem::snapshot::make_object("config");
+	for (size_t index = 0; index < 100; ++index)
+		members = members.set("key" + std::to_string(index), luxem::snapshot::make_primitive(std::to_string(index)));
+	for (size_t index = 0; index < 100; index += 2)
+		members = members.erase("key" + std::to_string(index));
+	assert2(members.size(), size_t(50));
+	assert(!members.has("key10"));
+	assert2(members.get("key11").get_primitive(), std::string("11"));
+	std::string previous;
+	members.for_each_member([&previous](std::string const &key, luxem::snapshot const &)
+	{
+		assert(previous < key);
+		previous = key;
+	});
+	auto thawed = luxem::thaw(members);
+	assert2(thawed->get_type(), std::string("config"));
+	assert2(thawed->as<luxem::object>().get_data().size(), size_t(50));
+
+	try
+	{
+		version1.get_in({"a", "b", 0});
+		assert(false);
+	}
+	catch (std::runtime_error &) {}
+
+	return 0;
+}
+
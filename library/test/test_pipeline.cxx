@@ -0,0 +1,189 @@
+#undef NDEBUG
+
+#include "../pipeline.h"
+#include "../stream.h"
+#include "../write.h"
+
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+#include <thread>
+#include <atomic>
+#include <chrono>
+#include <algorithm>
+#include <stdexcept>
+#include <cstring>
+#include <cassert>
+
+template <typename type> void assert2(type const &got, type const &expected)
+{
+	std::cout << "Expected: " << expected << std::endl;
+	std::cout << "Got     : " << got << std::endl;
+	assert(got == expected);
+}
+
+std::string make_document(size_t count)
+{
+	std::string out;
+	for (size_t index = 0; index < count; ++index)
+		out += "{id: " + std::to_string(index) + ", text: \"" + std::string(index % 37, 'x') + "\", tags: [a, b]},\n";
+	return out;
+}
+
+int64_t get_id(luxem::value const &data)
+	{ return data.as<luxem::object>().get_data().at("id")->as<luxem::primitive>().get_int(); }
+
+int main(void)
+{
+	size_t const count = 3000;
+	auto document = make_document(count);
+
+	// The queue on its own
+	{
+		luxem::bounded_queue<int> queue(5);
+		assert2(queue.get_capacity(), size_t(8));
+		for (int index = 0; index < 8; ++index) assert(queue.try_push(index));
+		int extra = 8;
+		assert(!queue.try_push(extra));
+		assert2(extra, 8);
+		assert2(queue.get_size(), size_t(8));
+		int out = -1;
+		for (int index = 0; index < 8; ++index)
+		{
+			assert(queue.try_pop(out));
+			assert2(out, index);
+		}
+		assert(!queue.try_pop(out));
+	}
+
+	// Every document is handled exactly once
+	{
+		std::vector<std::atomic<int>> seen(count);
+		for (auto &flag : seen) flag.store(0);
+		std::atomic<int64_t> id_sum(0);
+		{
+			luxem::pipeline pipeline([&seen, &id_sum](uint64_t sequence, std::shared_ptr<luxem::value> &&data)
+			{
+				seen[sequence].fetch_add(1);
+				id_sum.fetch_add(get_id(*data));
+				return std::shared_ptr<luxem::value>();
+			}, 3, 16);
+			assert2(pipeline.get_thread_count(), size_t(3));
+			pipeline.get_reader().feed(document);
+			pipeline.finish();
+			assert2(pipeline.get_published(), uint64_t(count));
+		}
+		for (auto &flag : seen) assert2(flag.load(), 1);
+		assert2(id_sum.load(), int64_t(count * (count - 1) / 2));
+	}
+
+	// Ordered results arrive in document order despite uneven handlers, fed in pieces through a stream_feeder
+	{
+		std::vector<int64_t> ids;
+		luxem::pipeline pipeline([](uint64_t sequence, std::shared_ptr<luxem::value> &&data)
+		{
+			if (sequence % 7 == 0) std::this_thread::sleep_for(std::chrono::microseconds(sequence % 50));
+			return std::make_shared<luxem::primitive>(get_id(*data) * 2);
+		}, 4, 8);
+		uint64_t expected_sequence = 0;
+		pipeline.set_ordered([&ids, &expected_sequence](uint64_t sequence, std::shared_ptr<luxem::value> &&result)
+		{
+			assert2(sequence, expected_sequence++);
+			ids.push_back(result->as<luxem::primitive>().get_int());
+		});
+		luxem::stream_feeder feeder(pipeline.get_reader(), 4096);
+		size_t offset = 0;
+		feeder.feed_all([&document, &offset](char *pointer, size_t length)
+		{
+			length = std::min(length, std::min<size_t>(113, document.size() - offset));
+			std::memcpy(pointer, document.data() + offset, length);
+			offset += length;
+			return length;
+		});
+		pipeline.finish();
+		assert2(ids.size(), count);
+		for (size_t index = 0; index < count; ++index) assert2(ids[index], int64_t(index * 2));
+	}
+
+	// A slow handler holds the parser back instead of letting documents pile up
+	{
+		std::atomic<size_t> handled(0);
+		size_t most = 0;
+		luxem::pipeline pipeline([&handled](uint64_t, std::shared_ptr<luxem::value> &&)
+		{
+			std::this_thread::sleep_for(std::chrono::microseconds(200));
+			handled.fetch_add(1);
+			return std::shared_ptr<luxem::value>();
+		}, 1, 4);
+		auto &reader = pipeline.get_reader();
+		for (size_t index = 0; index < 64; ++index)
+		{
+			reader.feed("{id: " + std::to_string(index) + "}", false);
+			most = std::max(most, pipeline.get_published() - handled.load());
+		}
+		reader.feed(std::string(), true);
+		pipeline.finish();
+		assert2(handled.load(), size_t(64));
+		// Queued plus the one being handled
+		assert(most <= 5);
+	}
+
+	// Handler exceptions stop the parse and come out of finish
+	{
+		luxem::pipeline pipeline([](uint64_t sequence, std::shared_ptr<luxem::value> &&)
+		{
+			if (sequence == 10) throw std::runtime_error("bad record");
+			return std::shared_ptr<luxem::value>();
+		}, 2, 4);
+		bool parse_stopped = false;
+		try { pipeline.get_reader().feed(document); }
+		catch (std::runtime_error const &) { parse_stopped = true; }
+		assert(parse_stopped);
+		bool rethrown = false;
+		try { pipeline.finish(); }
+		catch (std::runtime_error const &error)
+		{
+			assert2(std::string(error.what()), std::string("bad record"));
+			rethrown = true;
+		}
+		assert(rethrown);
+	}
+
+	// Deduplicated nodes reach several handler threads at once, which may all read them
+	{
+		luxem::type_registry types;
+		types.add_standard();
+		std::atomic<int64_t> total(0);
+		std::atomic<size_t> handled(0);
+		{
+			luxem::pipeline pipeline([&total, &handled](uint64_t, std::shared_ptr<luxem::value> &&data)
+			{
+				auto const &members = data->as<luxem::object>().get_data();
+				auto const &limit = members.at("limit")->as<luxem::primitive>();
+				auto const &ratio = members.at("ratio")->as<luxem::primitive>();
+				if ((limit.get_primitive() == "250") && (ratio.get_double() == 2.5) && (ratio.get_int() == 2)) total.fetch_add(limit.get_int());
+				handled.fetch_add(1);
+				return std::shared_ptr<luxem::value>();
+			}, 4, 16);
+			auto &reader = pipeline.get_reader();
+			reader.set_deduplicate(true).set_types(&types);
+			std::string text;
+			for (size_t index = 0; index < 2000; ++index) text += "{id: " + std::to_string(index) + ", limit: (int) 250, ratio: 2.5},\n";
+			reader.feed(text);
+			pipeline.finish();
+			assert(reader.get_subtrees()->get_hits() > 0);
+		}
+		assert2(handled.load(), size_t(2000));
+		assert2(total.load(), int64_t(2000 * 250));
+	}
+
+	// Nothing fed
+	{
+		luxem::pipeline pipeline([](uint64_t, std::shared_ptr<luxem::value> &&) { return std::shared_ptr<luxem::value>(); });
+		pipeline.finish();
+		assert2(pipeline.get_published(), uint64_t(0));
+	}
+
+	return 0;
+}
@@ -0,0 +1,121 @@
+#undef NDEBUG
+
+#include "../struct.h"
+#include "../read.h"
+#include "../write.h"
+#include "../serialize.h"
+
+#include <iostream>
+#include <memory>
+#include <string>
+#include <limits>
+#include <cmath>
+#include <cassert>
+
+template <typename type> void assert2(type const &got, type const &expected)
+{
+	std::cout << "Expected: " << expected << std::endl;
+	std::cout << "Got     : " << got << std::endl;
+	assert(got == expected);
+}
+
+using kind = luxem::primitive::native_kind;
+
+int main(void)
+{
+	{
+		luxem::primitive number(int64_t(-42));
+		assert(number.get_native_kind() == kind::signed_integer);
+		assert(!number.has_text());
+		assert2(number.get_int(), int64_t(-42));
+		assert2(number.get_double(), -42.0);
+		assert(!number.has_text());
+		assert2(number.get_primitive(), std::string("-42"));
+		assert(number.has_text());
+		assert2(number.get_int(), int64_t(-42));
+	}
+
+	assert2(luxem::primitive(std::numeric_limits<int64_t>::min()).get_primitive(), std::string("-9223372036854775808"));
+	assert2(luxem::primitive(std::numeric_limits<uint64_t>::max()).get_primitive(), std::string("18446744073709551615"));
+	assert2(luxem::primitive(0u).get_primitive(), std::string("0"));
+	assert2(luxem::primitive(true).get_primitive(), std::string("true"));
+	assert(luxem::primitive(short(3)).get_native_kind() == kind::signed_integer);
+	assert(luxem::primitive(size_t(3)).get_native_kind() == kind::unsigned_integer);
+	assert(luxem::primitive('c').get_native_kind() == kind::none);
+	assert(luxem::primitive(4.7f).get_native_kind() == kind::none);
+	assert(luxem::primitive("text").get_native_kind() == kind::none);
+
+	// Doubles are rendered with the fewest digits that read back exactly
+	for (double number : {0.1, 4.7, -2e300, 1.0 / 3, 123456789.0, 1e-300, 0.0})
+	{
+		luxem::primitive leaf(number);
+		auto text = leaf.get_primitive();
+		assert2(std::stod(text), number);
+		assert2(luxem::primitive(std::string(text)).get_double(), number);
+	}
+	assert2(luxem::primitive(0.1).get_primitive(), std::string("0.1"));
+	assert2(luxem::primitive(1e20).get_primitive(), std::string("1e+20"));
+
+	// Getters never cache; parsed text is cached on request, only when it reads back exactly
+	{
+		luxem::primitive leaf(std::string("12"));
+		assert2(leaf.get_int(), int64_t(12));
+		assert(leaf.get_native_kind() == kind::none);
+		assert(leaf.cache_native(kind::signed_integer));
+		assert(leaf.get_native_kind() == kind::signed_integer);
+		assert(leaf.cache_native(kind::signed_integer));
+		assert(!leaf.cache_native(kind::floating));
+		assert2(leaf.get_double(), 12.0);
+		assert2(leaf.get_primitive(), std::string("12"));
+	}
+	{
+		luxem::primitive leaf(std::string("4.7"));
+		assert(!leaf.cache_native(kind::signed_integer));
+		assert(leaf.get_native_kind() == kind::none);
+		assert(leaf.cache_native(kind::floating));
+		assert2(leaf.get_double(), 4.7);
+		assert2(leaf.get_int(), int64_t(4));
+	}
+	{
+		luxem::primitive leaf(std::string("007"));
+		assert2(leaf.get_uint(), uint64_t(7));
+		assert2(leaf.get_primitive(), std::string("007"));
+	}
+	{
+		luxem::primitive leaf(std::string("no"));
+		assert2(leaf.get_bool(), false);
+		assert(!leaf.cache_native(kind::boolean));
+		assert(leaf.get_native_kind() == kind::none);
+	}
+
+	// Setting replaces both forms
+	{
+		luxem::primitive leaf(std::string("old"));
+		leaf.set(uint64_t(9));
+		assert(!leaf.has_text());
+		assert2(leaf.get_uint(), uint64_t(9));
+		leaf.set(std::string("new"));
+		assert2(leaf.get_primitive(), std::string("new"));
+		assert(leaf.get_native_kind() == kind::none);
+		leaf.set_bool(false);
+		assert2(leaf.get_int(), int64_t(0));
+	}
+
+	// Writers format natives directly, matching the text form
+	{
+		luxem::ad natives;
+		natives.push_back(std::make_shared<luxem::primitive>(int64_t(-5)));
+		natives.push_back(std::make_shared<luxem::primitive>("count", 17u));
+		natives.push_back(std::make_shared<luxem::primitive>(2.5));
+		natives.push_back(std::make_shared<luxem::primitive>(false));
+		auto tree = std::make_shared<luxem::array>(std::move(natives));
+		auto written = luxem::writer().value(tree).dump();
+		assert2(written, std::string("[-5,(count)17,2.5,false,],"));
+		assert2(luxem::serialize(*tree), written);
+		assert2(luxem::measure(*tree), written.size());
+		for (auto const &element : tree->get_data()) assert(!element->as<luxem::primitive>().has_text());
+	}
+
+	return 0;
+}
+
@@ -0,0 +1,227 @@
+#undef NDEBUG
+
+#include "../registry.h"
+#include "../read.h"
+#include "../write.h"
+
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+#include <stdexcept>
+#include <cassert>
+
+template <typename type> void assert2(type const &got, type const &expected)
+{
+	std::cout << "Expected: " << expected << std::endl;
+	std::cout << "Got     : " << got << std::endl;
+	assert(got == expected);
+}
+
+struct point
+{
+	int64_t x;
+	int64_t y;
+};
+
+struct other {};
+
+template <typename exception_type, typename callback_type> bool throws(callback_type const &callback)
+{
+	try { callback(); }
+	catch (exception_type const &error)
+	{
+		std::cout << "Threw: " << error.what() << std::endl;
+		return true;
+	}
+	return false;
+}
+
+luxem::type_registry make_registry(void)
+{
+	luxem::type_registry types;
+	types.add_standard();
+	types.bind<point>("point",
+		[](luxem::value const &node)
+		{
+			auto const &members = node.as<luxem::object>().get_data();
+			return point{members.at("x")->as<luxem::primitive>().get_int(), members.at("y")->as<luxem::primitive>().get_int()};
+		},
+		[](luxem::raw_writer &writer, point const &data)
+		{
+			writer.object_begin();
+			writer.key("x");
+			writer.primitive(std::to_string(data.x));
+			writer.key("y");
+			writer.primitive(std::to_string(data.y));
+			writer.object_end();
+		});
+	return types;
+}
+
+int main(void)
+{
+	// Ids
+	{
+		luxem::type_registry types;
+		assert2(types.size(), size_t(0));
+		auto first = types.intern("first");
+		auto second = types.intern("second");
+		assert2(first, luxem::type_id(1));
+		assert2(second, luxem::type_id(2));
+		assert2(types.intern("first"), first);
+		assert2(types.find("second"), second);
+		assert2(types.find("third"), luxem::no_type_id);
+		assert2(types.get_name(second), std::string("second"));
+		assert(throws<std::runtime_error>([&types]() { types.get_name(9); }));
+		assert2(types.find(luxem::primitive("second", std::string("x"))), second);
+		assert2(types.find(luxem::primitive(std::string("x"))), luxem::no_type_id);
+		assert(!types.has_decoder(first));
+	}
+
+	auto types = make_registry();
+	auto bytes = luxem::primitive(luxem::subencodings::ascii16(), std::string("hi there")).get_primitive();
+
+	// Standard decoders while building trees
+	{
+		auto got = luxem::read_struct("(int) -12, (uint) 7, (float) 1.5, (bool) true, (ascii16) " + bytes + ", (other) 3, 4", types);
+		assert2(got.size(), size_t(7));
+		assert(got[0]->as<luxem::primitive>().get_native_kind() == luxem::primitive::native_kind::signed_integer);
+		assert2(got[0]->as<luxem::primitive>().get_int(), int64_t(-12));
+		assert2(got[0]->get_type(), std::string("int"));
+		assert(got[1]->as<luxem::primitive>().get_native_kind() == luxem::primitive::native_kind::unsigned_integer);
+		assert(got[2]->as<luxem::primitive>().get_native_kind() == luxem::primitive::native_kind::floating);
+		assert(got[3]->as<luxem::primitive>().get_native_kind() == luxem::primitive::native_kind::boolean);
+		assert2(got[4]->as<luxem::primitive>().get_primitive(), std::string("hi there"));
+		assert(!got[4]->has_type());
+		assert2(got[5]->get_type(), std::string("other"));
+		assert(got[5]->as<luxem::primitive>().get_native_kind() == luxem::primitive::native_kind::none);
+		assert(!got[6]->has_type());
+
+		// Without a registry nothing changes
+		auto plain = luxem::read_struct("(int) -12, (ascii16) " + bytes);
+		assert(plain[0]->as<luxem::primitive>().get_native_kind() == luxem::primitive::native_kind::none);
+		assert2(plain[1]->get_type(), std::string("ascii16"));
+
+		assert(throws<std::runtime_error>([&types]() { luxem::read_struct("(int) nope", types); }));
+		assert(throws<std::runtime_error>([&types]() { luxem::read_struct("(uint) -1", types); }));
+		assert(throws<std::runtime_error>([&types]() { luxem::read_struct("(int) {}", types); }));
+	}
+
+	// Container decoders, nested and at the top level, with deduplication
+	{
+		luxem::type_registry counting;
+		size_t decoded = 0;
+		counting.set_decoder("pair", [&decoded](std::shared_ptr<luxem::value> &&node) -> std::shared_ptr<luxem::value>
+		{
+			++decoded;
+			if (!node->is<luxem::array>()) return std::move(node);
+			auto const &elements = node->as<luxem::array>().get_data();
+			return std::make_shared<luxem::primitive>(
+				"sum", elements[0]->as<luxem::primitive>().get_int() + elements[1]->as<luxem::primitive>().get_int());
+		});
+		luxem::struct_builder builder;
+		builder.set_types(&counting).set_deduplicate(true);
+		builder.feed(std::string("(pair) [1, 2], {a: (pair) [3, 4], b: (pair) [3, 4], c: [(pair) [5, 6]], d: (pair) {}}"), false);
+		builder.feed(std::string(), true);
+		auto got = builder.take();
+		assert2(got.size(), size_t(2));
+		assert2(decoded, size_t(5));
+		assert2(got[0]->as<luxem::primitive>().get_int(), int64_t(3));
+		assert2(got[0]->get_type(), std::string("sum"));
+		auto const &members = got[1]->as<luxem::object>().get_data();
+		assert2(members.at("a")->as<luxem::primitive>().get_int(), int64_t(7));
+		// Decoded nodes are what gets interned
+		assert(members.at("a") == members.at("b"));
+		assert2(members.at("c")->as<luxem::array>().get_data()[0]->as<luxem::primitive>().get_int(), int64_t(11));
+		assert(members.at("d")->is<luxem::object>());
+	}
+
+	// A decoder returning nothing
+	{
+		luxem::type_registry broken;
+		broken.set_decoder("gone", [](std::shared_ptr<luxem::value> &&) { return std::shared_ptr<luxem::value>(); });
+		assert(throws<std::runtime_error>([&broken]() { luxem::read_struct("(gone) x", broken); }));
+	}
+
+	// Typed primitives reach reader handlers decoded
+	{
+		std::vector<std::shared_ptr<luxem::value>> got;
+		// Containers arrive as contexts and aren't decoded
+		luxem::reader reader(false);
+		reader.set_types(&types);
+		reader.element([&got](std::shared_ptr<luxem::value> &&data) { got.push_back(std::move(data)); });
+		reader.feed("(int) 5, (ascii16) " + bytes + ", (point) {x: 1, y: 2}");
+		assert2(got.size(), size_t(3));
+		assert(got[0]->as<luxem::primitive>().get_native_kind() == luxem::primitive::native_kind::signed_integer);
+		assert2(got[1]->as<luxem::primitive>().get_primitive(), std::string("hi there"));
+		assert2(got[2]->get_type(), std::string("point"));
+	}
+
+	// C++ types both ways
+	{
+		luxem::raw_writer writer;
+		writer.array_begin();
+		types.write(writer, point{1, 2});
+		types.write(writer, point{-3, 4});
+		writer.array_end();
+		auto text = writer.dump();
+		assert2(text, std::string("[(point){x:1,y:2,},(point){x:-3,y:4,},],"));
+
+		auto got = luxem::read_struct(text, types);
+		auto const &elements = got[0]->as<luxem::array>().get_data();
+		auto second = types.get<point>(*elements[1]);
+		assert2(second.x, int64_t(-3));
+		assert2(second.y, int64_t(4));
+		assert2(types.find<point>(), types.find("point"));
+		assert2(types.find<other>(), luxem::no_type_id);
+
+		assert(throws<std::runtime_error>([&types]() { types.get<point>(luxem::primitive("int", std::string("1"))); }));
+		assert(throws<std::runtime_error>([&types]() { types.get<point>(luxem::object()); }));
+		assert(throws<std::runtime_error>([&types, &writer]() { types.write(writer, other{}); }));
+		assert(throws<std::runtime_error>([&types]()
+		{
+			types.bind<other>("point", [](luxem::value const &) { return other{}; }, [](luxem::raw_writer &, other const &) {});
+		}));
+	}
+
+	// C++ types built during the parse, nested and at the top level, each as soon as it completes
+	{
+		std::vector<point> points;
+		std::vector<size_t> documents_then;
+		std::vector<std::shared_ptr<luxem::value>> got;
+		luxem::struct_builder builder([&got](std::shared_ptr<luxem::value> &&document) { got.push_back(std::move(document)); });
+		assert(throws<std::runtime_error>([&builder]()
+			{ builder.on_bound<point>([](luxem::type_id, point &&) {}); }));
+		builder.set_types(&types);
+		assert(throws<std::runtime_error>([&builder]()
+			{ builder.on_bound<other>([](luxem::type_id, other &&) {}); }));
+		builder.on_bound<point>([&](luxem::type_id id, point &&data)
+		{
+			assert2(id, types.find<point>());
+			points.push_back(data);
+			documents_then.push_back(got.size());
+		});
+		builder.feed(std::string("(point) {x: 1, y: 2}, [(point) {x: 3, y: 4}, {a: (point) {x: 5, y: 6}}], (int) 7"), true);
+		assert2(points.size(), size_t(3));
+		assert2(points[1].x, int64_t(3));
+		assert2(points[2].y, int64_t(6));
+		// The nested points arrive while their document is still open
+		assert2(documents_then[1], size_t(1));
+		assert2(documents_then[2], size_t(1));
+		assert2(got.size(), size_t(3));
+		assert2(got[1]->as<luxem::array>().get_data()[0]->get_type(), std::string("point"));
+
+		// Handlers stay across reset, and go with a different registry
+		points.clear();
+		builder.reset();
+		builder.feed(std::string("(point) {x: 8, y: 9}"), true);
+		assert2(points.size(), size_t(1));
+		auto fresh = make_registry();
+		builder.set_types(&fresh);
+		builder.feed(std::string("(point) {x: 8, y: 9}"), true);
+		assert2(points.size(), size_t(1));
+	}
+
+	return 0;
+}
@@ -0,0 +1,129 @@
+#undef NDEBUG
+
+#include "../read.h"
+#include "../write.h"
+#include "../diff.h"
+
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+#include <stdexcept>
+#include <cassert>
+
+template <typename type> void assert2(type const &got, type const &expected)
+{
+	std::cout << "Expected: " << expected << std::endl;
+	std::cout << "Got     : " << got << std::endl;
+	assert(got == expected);
+}
+
+int main(void)
+{
+	// A raw reader abandoned mid document starts clean after reset
+	{
+		std::vector<std::string> events;
+		luxem::raw_reader reader(
+			[&]() { events.push_back("{"); },
+			[&]() { events.push_back("}"); },
+			[&]() { events.push_back("["); },
+			[&]() { events.push_back("]"); },
+			[&](std::string &&data) { events.push_back("key " + data); },
+			[&](std::string &&data) { events.push_back("type " + data); },
+			[&](std::string &&data) { events.push_back("primitive " + data); });
+		reader.feed(std::string("{a: [(t) "), false);
+		reader.reset();
+		events.clear();
+		reader.feed("[x]");
+		assert(events == (std::vector<std::string>{"[", "primitive x", "]"}));
+
+		try
+		{
+			reader.feed("]");
+			assert(false);
+		}
+		catch (std::runtime_error const &) {}
+		reader.reset();
+		events.clear();
+		reader.feed("y");
+		assert(events == std::vector<std::string>{"primitive y"});
+	}
+
+	// Chunking state is cleared too
+	{
+		std::string streamed;
+		luxem::raw_reader reader({}, {}, {}, {}, {}, {}, [&](std::string &&data) { streamed = "whole " + data; });
+		reader.set_chunked_primitives(4, [&]() { streamed.clear(); }, [&](char const *pointer, size_t length) { streamed.append(pointer, length); }, []() {});
+		reader.feed(std::string("\"abcdefgh"), false);
+		reader.reset();
+		reader.feed("abcdefghij");
+		assert2(streamed, std::string("abcdefghij"));
+		reader.feed("ab");
+		assert2(streamed, std::string("whole ab"));
+	}
+
+	// A reader keeps its root handlers across resets
+	{
+		std::vector<std::shared_ptr<luxem::value>> out;
+		luxem::reader reader;
+		reader.build_struct([&](std::shared_ptr<luxem::value> &&data) { out.push_back(std::move(data)); });
+		reader.feed(std::string("{a: [1, 2"), false);
+		assert(out.empty());
+		reader.reset();
+		reader.feed("(t) {b: c}");
+		assert2(out.size(), size_t(1));
+		assert2(out[0]->get_type(), std::string("t"));
+		assert(out[0]->as<luxem::object>().get_data().count("b"));
+	}
+
+	// read_struct recovers after a failed parse on the same thread
+	{
+		try
+		{
+			luxem::read_struct("{a: }}");
+			assert(false);
+		}
+		catch (std::runtime_error const &) {}
+		auto parsed = luxem::read_struct("[x], {y: z}");
+		assert2(parsed.size(), size_t(2));
+		assert(parsed[0]->is<luxem::array>());
+		assert(luxem::equal(*parsed[1], *luxem::read_struct("{y: z}")[0]));
+	}
+
+	// Writers keep their output and formatting across resets
+	{
+		luxem::writer buffered;
+		buffered.set_pretty(' ', 2).array_begin().primitive("a");
+		buffered.reset().array_begin().primitive("b").array_end();
+		luxem::writer fresh;
+		fresh.set_pretty(' ', 2).array_begin().primitive("b").array_end();
+		assert2(buffered.dump(), fresh.dump());
+
+		std::string reused;
+		reused.reserve(1024);
+		auto capacity = reused.capacity();
+		buffered.dump(reused);
+		assert2(reused, fresh.dump());
+		assert2(reused.capacity(), capacity);
+
+		std::string out;
+		luxem::writer streamed([&](std::string &&chunk) { out += chunk; });
+		streamed.object_begin().key("k");
+		streamed.reset();
+		out.clear();
+		streamed.primitive("v");
+		assert2(out, std::string("v,"));
+	}
+
+	// write_struct matches a fresh writer
+	{
+		auto documents = luxem::read_struct("{a: [1, (t) 2]}, x, []");
+		luxem::writer fresh;
+		for (auto const &document : documents) fresh.value(document);
+		assert2(luxem::write_struct(documents), fresh.dump());
+		assert2(luxem::write_struct(documents[1]), std::string("x,"));
+		assert2(luxem::write_struct(documents), fresh.dump());
+	}
+
+	return 0;
+}
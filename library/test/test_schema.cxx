@@ -0,0 +1,96 @@
+#undef NDEBUG
+
+#include "../schema.h"
+
+#include <iostream>
+#include <memory>
+#include <string>
+#include <stdexcept>
+#include <cassert>
+
+template <typename type> void assert2(type const &got, type const &expected)
+{
+	std::cout << "Expected: " << expected << std::endl;
+	std::cout << "Got     : " << got << std::endl;
+	assert(got == expected);
+}
+
+luxem::schema const message_schema = luxem::schema::parse(R"(
+	(object) {
+		required: {
+			id: uint,
+			kind: (enum) [create, delete],
+			payload: (one_of) [(typed) {type: blob, value: ascii16}, {x: float, y: float}],
+			tags: [string],
+		},
+		optional: {
+			extra: any,
+			retries: int,
+		},
+	}
+)");
+
+std::string validate(std::string const &text, size_t *offset = nullptr)
+{
+	luxem::validator checker(message_schema);
+	size_t eaten;
+	auto result = checker.try_feed(text.c_str(), text.size(), eaten);
+	if (!result)
+	{
+		assert(checker.is_valid());
+		return {};
+	}
+	assert(result.get_code() == luxem::error::code::handler);
+	assert2(result.get_message().find(checker.get_violation()) != std::string::npos, true);
+	if (offset) *offset = result.get_offset();
+	return checker.get_violation();
+}
+
+int main(void)
+{
+	assert2(validate(
+		"{id: 4, kind: create, payload: (blob) abcd, tags: [a, b]},"
+		"{id: 5, kind: delete, payload: {x: 1.5, y: -2e3}, tags: [], retries: -1, extra: {any: [thing, {}]}}"),
+		std::string());
+
+	assert2(validate("{id: -4, kind: create, payload: (blob) ab, tags: []}"),
+		std::string("At [0].id: Expected uint, found '-4'."));
+	assert2(validate("{id: 4, kind: update, payload: (blob) ab, tags: []}"),
+		std::string("At [0].kind: Expected one of 'create' 'delete', found 'update'."));
+	assert2(validate("{id: 4, kind: create, payload: ab, tags: []}"),
+		std::string("At [0].payload: Expected (blob) ascii16 or object, found 'ab'."));
+	assert2(validate("{id: 4, kind: create, payload: {x: 1, y: z}, tags: []}"),
+		std::string("At [0].payload.y: Expected float, found 'z'."));
+	assert2(validate("{id: 4, kind: create, payload: (blob) ab, tags: [a, [b]]}"),
+		std::string("At [0].tags[1]: Expected string, found array."));
+	assert2(validate("{id: 4, kind: create, payload: (blob) ab}"),
+		std::string("At [0]: Missing required key 'tags'."));
+	assert2(validate("{id: 4, kind: create, payload: (blob) ab, tags: [], id: 5}"),
+		std::string("At [0].id: Duplicate key 'id'."));
+	assert2(validate("{id: 1, kind: create, payload: (blob) ab, tags: []}, {id: 2, color: red}"),
+		std::string("At [1].color: Unexpected key 'color'."));
+
+	// Rejection happens at the offending token, before the rest of the input is parsed
+	size_t offset = 0;
+	std::string early = "{id: x, kind: create, payload: (blob) ab, tags: [" + std::string(100000, 'a') + "]}";
+	validate(early, &offset);
+	assert(offset < 100);
+
+	{
+		auto open_schema = luxem::schema::parse("[(object) {required: {a: bool}, open: true}]");
+		luxem::validator checker(open_schema);
+		checker.feed(std::string("[{a: true, b: 1}, {a: false}], []"));
+		assert(checker.is_valid());
+		assert2(checker.get_document_count(), size_t(2));
+	}
+
+	try
+	{
+		luxem::schema::parse("(object) {required: {a: number}}");
+		assert(false);
+	}
+	catch (std::runtime_error &) {}
+
+	return 0;
+}
+
@@ -0,0 +1,90 @@
+#undef NDEBUG
+
+#include "../serialize.h"
+#include "../read.h"
+#include "../write.h"
+#include "../diff.h"
+
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+#include <random>
+#include <cassert>
+
+template <typename type> void assert2(type const &got, type const &expected)
+{
+	std::cout << "Expected: " << expected << std::endl;
+	std::cout << "Got     : " << got << std::endl;
+	assert(got == expected);
+}
+
+std::string const texts[] = {"x", "", "two words", "quo\"te", "back\\slash", "a:b", "(p)", "*", "ünï", "line\nbreak", "12.5"};
+
+std::shared_ptr<luxem::value> random_tree(std::mt19937 &random, int depth)
+{
+	auto choice = random() % 4;
+	auto const &text = texts[random() % (sizeof(texts) / sizeof(texts[0]))];
+	if ((depth <= 0) || (choice == 0))
+	{
+		if (random() % 3 == 0) return std::make_shared<luxem::primitive>("t", std::string(text));
+		return std::make_shared<luxem::primitive>(std::string(text));
+	}
+	if (choice == 1)
+	{
+		luxem::od data;
+		for (int count = random() % 5; count > 0; --count)
+			data[texts[random() % (sizeof(texts) / sizeof(texts[0]))]] = random_tree(random, depth - 1);
+		return std::make_shared<luxem::object>(std::move(data));
+	}
+	luxem::ad data;
+	for (int count = random() % 6; count > 0; --count) data.push_back(random_tree(random, depth - 1));
+	if (choice == 3) return std::make_shared<luxem::array>("typed", std::move(data));
+	return std::make_shared<luxem::array>(std::move(data));
+}
+
+int main(void)
+{
+	std::mt19937 random(37);
+	for (int iteration = 0; iteration < 300; ++iteration)
+	{
+		std::vector<std::shared_ptr<luxem::value>> documents;
+		for (int count = random() % 3 + 1; count > 0; --count) documents.push_back(random_tree(random, 5));
+
+		luxem::writer expected;
+		for (auto const &document : documents) expected.value(document);
+		auto compact = luxem::serialize(documents);
+		assert2(compact, expected.dump());
+		assert2(luxem::measure(documents), compact.size());
+		assert2(luxem::serialize(*documents[0]), luxem::writer().value(documents[0]).dump());
+
+		for (auto format : {luxem::layout::pretty_layout(), luxem::layout::pretty_layout(' ', 2)})
+		{
+			auto pretty = luxem::serialize(documents, format);
+			luxem::writer expected_pretty;
+			expected_pretty.set_pretty(format.spacer, format.multiple);
+			for (auto const &document : documents) expected_pretty.value(document);
+			assert2(pretty, expected_pretty.dump());
+			assert2(luxem::serialize(*documents[0], format), luxem::writer().set_pretty(format.spacer, format.multiple).value(documents[0]).dump());
+			assert2(luxem::measure(documents, format), pretty.size());
+			auto parsed = luxem::read_struct(pretty);
+			assert2(parsed.size(), documents.size());
+			for (size_t index = 0; index < parsed.size(); ++index)
+				assert(luxem::equal(*parsed[index], *documents[index]));
+		}
+	}
+
+	// Writing into a preallocated frame touches exactly the measured bytes
+	{
+		auto tree = luxem::read_struct("{a: [1, (x) \"two \\\" three\"], b: {}}")[0];
+		auto size = luxem::measure(*tree);
+		std::string frame(size + 2, '#');
+		assert2(luxem::serialize(*tree, &frame[1]), size);
+		assert2(frame.front(), '#');
+		assert2(frame.back(), '#');
+		assert2(frame.substr(1, size), luxem::writer().value(tree).dump());
+	}
+
+	return 0;
+}
+
@@ -0,0 +1,401 @@
+#undef NDEBUG
+
+#include "../stream.h"
+#include "../write.h"
+
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+#include <thread>
+#include <atomic>
+#include <algorithm>
+#include <cstring>
+#include <cstdio>
+#include <cassert>
+
+#include <unistd.h>
+#include <fcntl.h>
+#include <csignal>
+#include <sys/socket.h>
+#include <sys/epoll.h>
+
+template <typename type> void assert2(type const &got, type const &expected)
+{
+	std::cout << "Expected: " << expected << std::endl;
+	std::cout << "Got     : " << got << std::endl;
+	assert(got == expected);
+}
+
+std::string render(std::vector<std::shared_ptr<luxem::value>> const &data)
+{
+	luxem::writer writer;
+	for (auto &element : data) writer.value(element);
+	return writer.dump();
+}
+
+std::string make_document(size_t count)
+{
+	std::string out;
+	for (size_t index = 0; index < count; ++index)
+		out += "{id: " + std::to_string(index) + ", text: \"" + std::string(index % 97, 'x') + "\", tags: (set) [a, b]},\n";
+	return out;
+}
+
+int main(void)
+{
+	auto document = make_document(2000);
+	auto expected = render(luxem::read_struct(document));
+
+	{
+		// Odd read sizes make tokens straddle the end of the ring
+		std::vector<std::shared_ptr<luxem::value>> got;
+		luxem::reader reader;
+		reader.build_struct([&got](std::shared_ptr<luxem::value> &&data) { got.push_back(std::move(data)); });
+		luxem::stream_feeder feeder(reader, 4096);
+		size_t offset = 0;
+		feeder.feed_all([&document, &offset](char *pointer, size_t length)
+		{
+			length = std::min(length, std::min<size_t>(61, document.size() - offset));
+			std::memcpy(pointer, document.data() + offset, length);
+			offset += length;
+			return length;
+		});
+		assert2(render(got), expected);
+		assert2(feeder.get_position(), uint64_t(document.size()));
+		assert2(feeder.get_capacity(), size_t(4096));
+	}
+
+	{
+		// A token larger than the ring grows it
+		std::string large = "before, \"" + std::string(20000, 'y') + "\", after";
+		std::vector<std::shared_ptr<luxem::value>> got;
+		luxem::reader reader;
+		reader.build_struct([&got](std::shared_ptr<luxem::value> &&data) { got.push_back(std::move(data)); });
+		luxem::stream_feeder feeder(reader, 4096);
+		size_t offset = 0;
+		feeder.feed_all([&large, &offset](char *pointer, size_t length)
+		{
+			length = std::min(length, large.size() - offset);
+			std::memcpy(pointer, large.data() + offset, length);
+			offset += length;
+			return length;
+		});
+		assert2(got.size(), size_t(3));
+		assert2(got[1]->as<luxem::primitive>().get_primitive().size(), size_t(20000));
+		assert(feeder.get_capacity() >= 20000);
+	}
+
+	{
+		int pipe_ends[2];
+		assert(pipe(pipe_ends) == 0);
+		std::thread producer([&document, &pipe_ends]()
+		{
+			for (size_t offset = 0; offset < document.size(); offset += 1000)
+			{
+				auto length = std::min<size_t>(1000, document.size() - offset);
+				assert(write(pipe_ends[1], document.data() + offset, length) == static_cast<ssize_t>(length));
+			}
+			close(pipe_ends[1]);
+		});
+		std::vector<std::shared_ptr<luxem::value>> got;
+		luxem::reader reader;
+		reader.build_struct([&got](std::shared_ptr<luxem::value> &&data) { got.push_back(std::move(data)); });
+		luxem::stream_feeder feeder(reader, 8192);
+		feeder.feed_all(pipe_ends[0]);
+		producer.join();
+		close(pipe_ends[0]);
+		assert2(render(got), expected);
+	}
+
+	// A non-blocking pipe that runs dry mid-document isn't mistaken for the end
+	{
+		int pipe_ends[2];
+		assert(pipe(pipe_ends) == 0);
+		fcntl(pipe_ends[0], F_SETFL, fcntl(pipe_ends[0], F_GETFL) | O_NONBLOCK);
+		std::thread producer([&document, &pipe_ends]()
+		{
+			for (size_t offset = 0; offset < document.size(); offset += 1000)
+			{
+				auto length = std::min<size_t>(1000, document.size() - offset);
+				assert(write(pipe_ends[1], document.data() + offset, length) == static_cast<ssize_t>(length));
+				std::this_thread::sleep_for(std::chrono::microseconds(200));
+			}
+			close(pipe_ends[1]);
+		});
+		std::vector<std::shared_ptr<luxem::value>> got;
+		luxem::reader reader;
+		reader.build_struct([&got](std::shared_ptr<luxem::value> &&data) { got.push_back(std::move(data)); });
+		luxem::stream_feeder feeder(reader, 8192);
+		feeder.feed_all(pipe_ends[0]);
+		producer.join();
+		close(pipe_ends[0]);
+		assert2(render(got), expected);
+	}
+
+	{
+		std::string const path = "test_stream_follow.luxem";
+		std::remove(path.c_str());
+		FILE *log = fopen(path.c_str(), "wb");
+		assert(log);
+		int descriptor = open(path.c_str(), O_RDONLY);
+		assert(descriptor >= 0);
+
+		std::atomic<size_t> records(0);
+		luxem::reader reader;
+		reader.build_struct([&records](std::shared_ptr<luxem::value> &&) { ++records; });
+		luxem::stream_feeder feeder(reader, 4096);
+		std::thread appender([&document, log]()
+		{
+			// Writes split records across flushes, as a live logger would
+			for (size_t offset = 0; offset < document.size(); offset += 777)
+			{
+				fwrite(document.data() + offset, 1, std::min<size_t>(777, document.size() - offset), log);
+				fflush(log);
+				std::this_thread::sleep_for(std::chrono::microseconds(200));
+			}
+		});
+		feeder.follow(descriptor, [&records]() { return records < 2000; }, std::chrono::milliseconds(1));
+		appender.join();
+		assert2(records.load(), size_t(2000));
+		fclose(log);
+		close(descriptor);
+		std::remove(path.c_str());
+	}
+
+	// A writer into a full socket queues up to the high-water mark, then resumes as the peer reads
+	{
+		int sockets[2];
+		assert(socketpair(AF_UNIX, SOCK_STREAM, 0, sockets) == 0);
+		int buffer_size = 4096;
+		setsockopt(sockets[0], SOL_SOCKET, SO_SNDBUF, &buffer_size, sizeof(buffer_size));
+		fcntl(sockets[0], F_SETFL, fcntl(sockets[0], F_GETFL) | O_NONBLOCK);
+		fcntl(sockets[1], F_SETFL, fcntl(sockets[1], F_GETFL) | O_NONBLOCK);
+
+		luxem::descriptor_sink sink(sockets[0], 16384);
+		std::string received;
+		auto drain = [&received, &sockets]()
+		{
+			char buffer[4096];
+			ssize_t got;
+			while ((got = read(sockets[1], buffer, sizeof(buffer))) > 0) received.append(buffer, got);
+		};
+
+		luxem::reader reader;
+		std::vector<std::shared_ptr<luxem::value>> records;
+		reader.build_struct([&records](std::shared_ptr<luxem::value> &&data) { records.push_back(std::move(data)); });
+		reader.feed(document);
+		assert2(records.size(), size_t(2000));
+
+		size_t most = 0;
+		size_t blocked = 0;
+		{
+			luxem::writer writer(sink.get_callback());
+			for (auto &record : records)
+			{
+				while (sink.is_blocked())
+				{
+					++blocked;
+					assert(sink.would_block());
+					drain();
+					sink.flush();
+				}
+				writer.value(record);
+				most = std::max(most, sink.get_queued());
+			}
+		}
+		while (!sink.flush()) drain();
+		drain();
+		assert(blocked > 0);
+		// At most one record past the mark
+		assert(most < 16384 + 200);
+		assert2(sink.get_queued(), size_t(0));
+		assert2(sink.get_written(), uint64_t(received.size()));
+		assert2(received, render(records));
+
+		// Nothing reads, so output stays queued
+		for (size_t index = 0; index < 64; ++index) sink.write(std::string(1000, 'y'));
+		assert(sink.would_block());
+		assert(!sink.flush());
+		assert(sink.get_queued() > 0);
+
+		// A closed peer is an error rather than a signal
+		signal(SIGPIPE, SIG_IGN);
+		close(sockets[1]);
+		bool failed = false;
+		try { sink.flush(); }
+		catch (std::runtime_error const &) { failed = true; }
+		assert(failed);
+		close(sockets[0]);
+	}
+
+	// Partial input waits for more, budgets stop early, and the end of input finishes the document
+	{
+		int sockets[2];
+		assert(socketpair(AF_UNIX, SOCK_STREAM, 0, sockets) == 0);
+		fcntl(sockets[1], F_SETFL, fcntl(sockets[1], F_GETFL) | O_NONBLOCK);
+		std::vector<std::shared_ptr<luxem::value>> got;
+		luxem::reader reader;
+		reader.build_struct([&got](std::shared_ptr<luxem::value> &&data) { got.push_back(std::move(data)); });
+		luxem::descriptor_reader connection(reader, sockets[1], 4096);
+
+		auto progress = connection.poll();
+		assert(progress.result == luxem::descriptor_reader::state::waiting);
+		assert2(progress.bytes, size_t(0));
+
+		std::string partial = "{a: 1}, [x, ";
+		assert(write(sockets[0], partial.data(), partial.size()) == static_cast<ssize_t>(partial.size()));
+		progress = connection.poll();
+		assert(progress.result == luxem::descriptor_reader::state::waiting);
+		assert2(progress.bytes, partial.size());
+		assert2(progress.elements, size_t(1));
+		assert(connection.in_element());
+
+		std::string rest = "y], top, ";
+		assert(write(sockets[0], rest.data(), rest.size()) == static_cast<ssize_t>(rest.size()));
+		progress = connection.poll(4);
+		assert(progress.result == luxem::descriptor_reader::state::budget);
+		assert2(progress.bytes, size_t(4));
+		progress = connection.poll();
+		assert2(progress.bytes, rest.size() - 4);
+		assert2(connection.get_elements(), uint64_t(3));
+
+		std::string last = "(t) \"quoted\"";
+		assert(write(sockets[0], last.data(), last.size()) == static_cast<ssize_t>(last.size()));
+		close(sockets[0]);
+		progress = connection.poll();
+		assert(progress.result == luxem::descriptor_reader::state::finished);
+		assert2(connection.get_elements(), uint64_t(4));
+		assert(!connection.in_element());
+		assert2(render(got), render(luxem::read_struct(partial + rest + last)));
+		assert(connection.poll().result == luxem::descriptor_reader::state::finished);
+		close(sockets[1]);
+	}
+
+	// One reader serves connections in turn, even after one is dropped in the middle of an element
+	{
+		std::vector<std::shared_ptr<luxem::value>> got;
+		luxem::reader reader;
+		reader.build_struct([&got](std::shared_ptr<luxem::value> &&data) { got.push_back(std::move(data)); });
+
+		int first[2];
+		assert(socketpair(AF_UNIX, SOCK_STREAM, 0, first) == 0);
+		fcntl(first[1], F_SETFL, fcntl(first[1], F_GETFL) | O_NONBLOCK);
+		std::string dropped = "a, {b: [c, ";
+		assert(write(first[0], dropped.data(), dropped.size()) == static_cast<ssize_t>(dropped.size()));
+		{
+			std::unique_ptr<luxem::descriptor_reader> connection(new luxem::descriptor_reader(reader, first[1], 4096));
+			auto progress = connection->poll();
+			assert2(progress.elements, size_t(1));
+			assert(connection->in_element());
+			assert2(reader.get_depth(), size_t(2));
+		}
+		close(first[0]);
+		close(first[1]);
+		reader.reset();
+		assert2(reader.get_depth(), size_t(0));
+		got.clear();
+
+		int second[2];
+		assert(socketpair(AF_UNIX, SOCK_STREAM, 0, second) == 0);
+		fcntl(second[1], F_SETFL, fcntl(second[1], F_GETFL) | O_NONBLOCK);
+		std::string text = "{x: 1}, [y], z";
+		assert(write(second[0], text.data(), text.size()) == static_cast<ssize_t>(text.size()));
+		close(second[0]);
+		luxem::descriptor_reader connection(reader, second[1], 4096);
+		auto progress = connection.poll();
+		assert(progress.result == luxem::descriptor_reader::state::finished);
+		assert2(progress.elements, size_t(3));
+		assert2(connection.get_elements(), uint64_t(3));
+		assert(!connection.in_element());
+		assert2(render(got), render(luxem::read_struct(text)));
+		close(second[1]);
+	}
+
+	// Chunked primitives count as elements when they end
+	{
+		size_t chunks = 0;
+		luxem::raw_reader reader(
+			[]() {}, []() {}, []() {}, []() {},
+			[](std::string &&) {}, [](std::string &&) {}, [](std::string &&) {});
+		reader.set_chunked_primitives(16, []() {}, [&chunks](char const *, size_t) { ++chunks; }, []() {});
+		reader.feed(std::string("short, ") + std::string(100, 'w') + ", [" + std::string(40, 'v') + "]");
+		assert2(reader.get_elements(), uint64_t(3));
+		assert(chunks > 0);
+	}
+
+	// Many connections on one thread, each read a little at a time
+	{
+		size_t const count = 64;
+		int poller = epoll_create1(0);
+		assert(poller >= 0);
+		std::vector<int> writers;
+		std::vector<std::unique_ptr<luxem::reader>> readers;
+		std::vector<std::unique_ptr<luxem::descriptor_reader>> connections;
+		std::vector<size_t> records(count, 0);
+		for (size_t index = 0; index < count; ++index)
+		{
+			int sockets[2];
+			assert(socketpair(AF_UNIX, SOCK_STREAM, 0, sockets) == 0);
+			fcntl(sockets[0], F_SETFL, fcntl(sockets[0], F_GETFL) | O_NONBLOCK);
+			fcntl(sockets[1], F_SETFL, fcntl(sockets[1], F_GETFL) | O_NONBLOCK);
+			writers.push_back(sockets[0]);
+			readers.emplace_back(new luxem::reader);
+			readers.back()->build_struct([&records, index](std::shared_ptr<luxem::value> &&) { ++records[index]; });
+			connections.emplace_back(new luxem::descriptor_reader(*readers.back(), sockets[1], 4096));
+			epoll_event event{};
+			event.events = EPOLLIN | EPOLLET;
+			event.data.u64 = index;
+			assert(epoll_ctl(poller, EPOLL_CTL_ADD, sockets[1], &event) == 0);
+		}
+
+		std::vector<size_t> sent(count, 0);
+		std::vector<size_t> pending;
+		size_t finished = 0;
+		while (finished < count)
+		{
+			for (size_t index = 0; index < count; ++index)
+			{
+				if (writers[index] < 0) continue;
+				auto length = std::min<size_t>(1000 + index, document.size() - sent[index]);
+				auto wrote = write(writers[index], document.data() + sent[index], length);
+				if (wrote > 0) sent[index] += static_cast<size_t>(wrote);
+				if (sent[index] == document.size())
+				{
+					close(writers[index]);
+					writers[index] = -1;
+				}
+			}
+			epoll_event events[16];
+			auto ready = epoll_wait(poller, events, 16, pending.empty() ? 100 : 0);
+			assert(ready >= 0);
+			for (int event = 0; event < ready; ++event) pending.push_back(events[event].data.u64);
+			// Connections which hit their budget stay pending, as edge triggering won't report them again
+			std::vector<size_t> again;
+			for (auto index : pending)
+			{
+				auto progress = connections[index]->poll(512);
+				assert(progress.bytes <= 512);
+				if (progress.result == luxem::descriptor_reader::state::budget) again.push_back(index);
+				else if (progress.result == luxem::descriptor_reader::state::finished)
+				{
+					epoll_ctl(poller, EPOLL_CTL_DEL, connections[index]->get_descriptor(), nullptr);
+					++finished;
+				}
+			}
+			std::sort(again.begin(), again.end());
+			again.erase(std::unique(again.begin(), again.end()), again.end());
+			pending.swap(again);
+		}
+		for (size_t index = 0; index < count; ++index)
+		{
+			assert2(records[index], size_t(2000));
+			assert2(connections[index]->get_elements(), uint64_t(2000));
+			close(connections[index]->get_descriptor());
+		}
+		close(poller);
+	}
+
+	return 0;
+}
+
@@ -0,0 +1,212 @@
+#ifndef luxem_cxx_walk_h
+#define luxem_cxx_walk_h
+
+#include <string>
+#include <memory>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "struct.h"
+#include "misc.h"
+
+namespace luxem
+{
+
+enum class walk_result
+{
+	proceed,
+	skip,
+	stop
+};
+
+struct path_element
+{
+	bool is_key;
+	std::string key;
+	size_t index;
+
+	path_element(std::string const &key) : is_key(true), key(key), index(0) {}
+	path_element(std::string &&key) : is_key(true), key(std::move(key)), index(0) {}
+	path_element(char const *key) : is_key(true), key(key), index(0) {}
+	path_element(size_t index) : is_key(false), index(index) {}
+	path_element(int index) : is_key(false), index(index) {}
+
+	bool operator ==(path_element const &other) const
+		{ return (is_key == other.is_key) && (is_key ? key == other.key : index == other.index); }
+};
+
+typedef std::vector<path_element> path;
+
+inline std::string render_path(path const &data)
+{
+	std::string out;
+	for (auto &element : data)
+	{
+		if (element.is_key) { out += '.'; out += element.key; }
+		else { out += '['; out += std::to_string(element.index); out += ']'; }
+	}
+	return out;
+}
+
+struct walk_path
+{
+	struct element
+	{
+		std::string const *key;
+		size_t index;
+	};
+
+	bool empty(void) const { return elements.empty(); }
+	size_t size(void) const { return elements.size(); }
+
+	bool is_key(size_t level) const { return elements[level].key; }
+	std::string const &key(size_t level) const { return *elements[level].key; }
+	size_t index(size_t level) const { return elements[level].index; }
+
+	path copy(void) const
+	{
+		path out;
+		out.reserve(elements.size());
+		for (size_t level = 0; level < elements.size(); ++level)
+		{
+			if (is_key(level)) out.emplace_back(key(level));
+			else out.emplace_back(index(level));
+		}
+		return out;
+	}
+
+	std::string render(void) const { return render_path(copy()); }
+
+	friend struct walker;
+	private:
+		small_stack<element> elements;
+};
+
+struct walk_ignore
+{
+	template <typename ...argument_types> void operator ()(argument_types &&...) const {}
+};
+
+struct walker
+{
+	template <typename enter_type, typename leave_type = walk_ignore>
+		bool walk(std::shared_ptr<value> &root, enter_type &&enter, leave_type &&leave = {})
+		{ return walk_implementation<std::shared_ptr<value> &>(root, enter, leave); }
+
+	template <typename enter_type, typename leave_type = walk_ignore>
+		bool walk(std::shared_ptr<value> const &root, enter_type &&enter, leave_type &&leave = {})
+	{
+		auto &mutable_root = const_cast<std::shared_ptr<value> &>(root);
+		return walk_implementation<std::shared_ptr<value> const &>(mutable_root, enter, leave);
+	}
+
+	private:
+		struct frame
+		{
+			std::shared_ptr<value> *node;
+			object *object_node;
+			array *array_node;
+			od::iterator object_iterator;
+			size_t array_index;
+		};
+
+		small_stack<frame> frames;
+		walk_path path;
+
+		template <typename enter_type, typename node_type> static walk_result enter_result(
+			std::true_type, enter_type &enter, walk_path const &path, node_type node)
+			{ enter(path, node); return walk_result::proceed; }
+
+		template <typename enter_type, typename node_type> static walk_result enter_result(
+			std::false_type, enter_type &enter, walk_path const &path, node_type node)
+			{ return enter(path, node); }
+
+		bool descend(std::shared_ptr<value> &node)
+		{
+			if (!node) return false;
+			frame top{&node, nullptr, nullptr, {}, 0};
+			if (node->is<object>())
+			{
+				top.object_node = &node->as<object>();
+				top.object_iterator = top.object_node->get_data().begin();
+			}
+			else if (node->is<array>()) top.array_node = &node->as<array>();
+			else return false;
+			frames.push_back(top);
+			return true;
+		}
+
+		template <typename node_type, typename enter_type, typename leave_type>
+			bool walk_implementation(std::shared_ptr<value> &root, enter_type &enter, leave_type &leave)
+		{
+			typedef typename std::is_void<decltype(enter(std::declval<walk_path const &>(), std::declval<node_type>()))>::type
+				ignores_result;
+
+			frames.clear();
+			path.elements.clear();
+
+			auto result = enter_result(ignores_result(), enter, path, static_cast<node_type>(root));
+			if (result == walk_result::stop) return false;
+			if ((result == walk_result::skip) || !descend(root))
+			{
+				leave(path, static_cast<node_type>(root));
+				return true;
+			}
+
+			while (!frames.empty())
+			{
+				auto &top = frames.back();
+				std::shared_ptr<value> *child;
+				if (top.object_node)
+				{
+					if (top.object_iterator == top.object_node->get_data().end()) child = nullptr;
+					else
+					{
+						child = &top.object_iterator->second;
+						path.elements.push_back({&top.object_iterator->first, 0});
+						++top.object_iterator;
+					}
+				}
+				else
+				{
+					if (top.array_index >= top.array_node->get_data().size()) child = nullptr;
+					else
+					{
+						child = &top.array_node->get_data()[top.array_index];
+						path.elements.push_back({nullptr, top.array_index});
+						++top.array_index;
+					}
+				}
+
+				if (!child)
+				{
+					auto &finished = *top.node;
+					frames.pop_back();
+					leave(path, static_cast<node_type>(finished));
+					if (!path.empty()) path.elements.pop_back();
+					continue;
+				}
+
+				result = enter_result(ignores_result(), enter, path, static_cast<node_type>(*child));
+				if (result == walk_result::stop) return false;
+				if ((result == walk_result::proceed) && descend(*child)) continue;
+				leave(path, static_cast<node_type>(*child));
+				path.elements.pop_back();
+			}
+			return true;
+		}
+};
+
+template <typename enter_type, typename leave_type = walk_ignore>
+	bool visit(std::shared_ptr<value> &root, enter_type &&enter, leave_type &&leave = {})
+	{ return walker().walk(root, enter, leave); }
+
+template <typename enter_type, typename leave_type = walk_ignore>
+	bool visit(std::shared_ptr<value> const &root, enter_type &&enter, leave_type &&leave = {})
+	{ return walker().walk(root, enter, leave); }
+
+}
+
+#endif
+
@@ -1,4 +1,9 @@
 #include "write.h"
+#include "ascii16.h"
+
+#include <cstring>
+#include <cassert>
+#include <stdexcept>
 
 extern "C"
 {
@@ -8,20 +13,74 @@ extern "C"
 namespace luxem
 {
 
-raw_writer::raw_writer(void) : context(luxem_rawwrite_construct())
-	{ luxem_rawwrite_set_buffer_out(context); }
-
-raw_writer::raw_writer(FILE *file) : context(luxem_rawwrite_construct())
-	{ luxem_rawwrite_set_file_out(context, file); }
+raw_writer::raw_writer(void) : 
+	context(luxem_rawwrite_construct()), 
+	file(nullptr), 
+	buffered(true), 
+	failed(false), 
+	failure_message(nullptr), 
+	pretty(false), 
+	chunking(false), 
+	capturing(false)
+	{ use_output(); }
+
+raw_writer::raw_writer(FILE *file) : 
+	context(luxem_rawwrite_construct()), 
+	file(file), 
+	buffered(false), 
+	failed(false), 
+	failure_message(nullptr), 
+	pretty(false), 
+	chunking(false), 
+	capturing(false)
+	{ use_output(); }
+
+raw_writer::raw_writer(std::function<void(std::string &&chunk)> const &callback) : 
+	context(luxem_rawwrite_construct()),
+	file(nullptr),
+	buffered(false),
+	callback(callback),
+	failed(false),
+	failure_message(nullptr),
+	pretty(false),
+	chunking(false),
+	capturing(false)
+	{ use_output(); }
+
+void raw_writer::use_output(void)
+{
+	if (file) luxem_rawwrite_set_file_out(context, file);
+	else if (buffered) luxem_rawwrite_set_buffer_out(context);
+	else use_callback();
+}
 
-raw_writer::raw_writer(std::function<void(std::string &&chunk)> const &callback) : context(luxem_rawwrite_construct())
+void raw_writer::use_callback(void)
 {
 	luxem_rawwrite_set_write_callback(context, [](luxem_rawwrite_context_t *context, void *user_data, luxem_string_t const *string)
 	{
 		auto writer = reinterpret_cast<raw_writer *>(user_data);
+		if (writer->capturing)
+		{
+			writer->captured.append(string->pointer, string->length);
+			return luxem_true;
+		}
 		if (!writer->callback) return luxem_true;
-		writer->callback(std::string(string->pointer, string->length));
-		return luxem_true;
+		try
+		{
+			writer->callback(std::string(string->pointer, string->length));
+		}
+		catch (std::exception &e)
+		{
+			writer->exception_message = e.what();
+			writer->failed = true;
+			writer->failure_message = writer->exception_message.empty() ? nullptr : writer->exception_message.c_str();
+		}
+		catch (...)
+		{
+			writer->failed = true;
+			writer->failure_message = nullptr;
+		}
+		return writer->failed ? luxem_false : luxem_true;
 	}, this);
 }
 	
@@ -33,42 +92,221 @@ raw_writer::~raw_writer(void)
 raw_writer &raw_writer::set_pretty(char spacer, size_t multiple)
 {
 	luxem_rawwrite_set_pretty(context, spacer, multiple);
+	pretty = true;
+	pretty_spacer = spacer;
+	pretty_multiple = multiple;
 	return *this;
 }
 
+raw_writer &raw_writer::reset(void)
+{
+	luxem_rawwrite_destroy(context);
+	context = luxem_rawwrite_construct();
+	use_output();
+	if (pretty) luxem_rawwrite_set_pretty(context, pretty_spacer, pretty_multiple);
+	exception_message.clear();
+	failed = false;
+	failure_message = nullptr;
+	chunking = false;
+	capturing = false;
+	captured.clear();
+	chunk_text.clear();
+	return *this;
+}
+
+void raw_writer::fail(char const *message) noexcept
+{
+	failed = true;
+	failure_message = message;
+}
+
+error raw_writer::try_object_begin(void) noexcept
+	{ failed = false; return get_error(luxem_rawwrite_object_begin(context)); }
+
+error raw_writer::try_object_end(void) noexcept
+	{ failed = false; return get_error(luxem_rawwrite_object_end(context)); }
+
+error raw_writer::try_array_begin(void) noexcept
+	{ failed = false; return get_error(luxem_rawwrite_array_begin(context)); }
+
+error raw_writer::try_array_end(void) noexcept
+	{ failed = false; return get_error(luxem_rawwrite_array_end(context)); }
+
+error raw_writer::try_key(char const *pointer, size_t length) noexcept
+{
+	failed = false;
+	luxem_string_t temp{pointer, length};
+	return get_error(luxem_rawwrite_key(context, &temp));
+}
+
+error raw_writer::try_type(char const *pointer, size_t length) noexcept
+{
+	failed = false;
+	luxem_string_t temp{pointer, length};
+	return get_error(luxem_rawwrite_type(context, &temp));
+}
+
+error raw_writer::try_primitive(char const *pointer, size_t length) noexcept
+{
+	failed = false;
+	luxem_string_t temp{pointer, length};
+	return get_error(luxem_rawwrite_primitive(context, &temp));
+}
+
 raw_writer &raw_writer::object_begin(void) 
-	{ check_error(luxem_rawwrite_object_begin(context)); return *this; }
+	{ check_error(try_object_begin()); return *this; }
 
 raw_writer &raw_writer::object_end(void) 
-	{ check_error(luxem_rawwrite_object_end(context)); return *this; }
+	{ check_error(try_object_end()); return *this; }
 
 raw_writer &raw_writer::array_begin(void) 
-	{ check_error(luxem_rawwrite_array_begin(context)); return *this; }
+	{ check_error(try_array_begin()); return *this; }
 
 raw_writer &raw_writer::array_end(void) 
-	{ check_error(luxem_rawwrite_array_end(context)); return *this; }
+	{ check_error(try_array_end()); return *this; }
 
 raw_writer &raw_writer::key(std::string const &data)
 {
-	luxem_string_t temp{data.c_str(), data.length()};
-	check_error(luxem_rawwrite_key(context, &temp));
+	check_error(try_key(data.c_str(), data.length()));
 	return *this;
 }
 
 raw_writer &raw_writer::type(std::string const &data)
 {
-	luxem_string_t temp{data.c_str(), data.length()};
-	check_error(luxem_rawwrite_type(context, &temp));
+	check_error(try_type(data.c_str(), data.length()));
+	return *this;
+}
+
+raw_writer &raw_writer::primitive(std::string const &data)
+{
+	check_error(try_primitive(data.c_str(), data.length()));
+	return *this;
+}
+
+raw_writer &raw_writer::primitive(char const *pointer, size_t length)
+{
+	check_error(try_primitive(pointer, length));
 	return *this;
 }
 
-raw_writer &raw_writer::primitive(std::string const &data) 
+raw_writer &raw_writer::primitive_ascii16(void const *pointer, size_t length)
 {
-	luxem_string_t temp{data.c_str(), data.length()};
-	check_error(luxem_rawwrite_primitive(context, &temp));
+	ascii16_buffer.resize(ascii16_encoded_size(length));
+	if (length) encode_ascii16(reinterpret_cast<uint8_t const *>(pointer), length, &ascii16_buffer[0]);
+	check_error(try_primitive(ascii16_buffer.data(), ascii16_buffer.length()));
 	return *this;
 }
 
+raw_writer &raw_writer::primitive_begin(void)
+{
+	if (chunking) throw std::runtime_error("A chunked primitive is already being written.");
+	chunk_text.clear();
+	if (buffered)
+	{
+		// The C writer owns the buffer, so the pieces are collected and written at the end
+		chunking = true;
+		return *this;
+	}
+
+	// Let the C writer place an empty primitive, then split its rendering around the quotes
+	captured.clear();
+	capturing = true;
+	if (file) use_callback();
+	failed = false;
+	luxem_string_t placeholder{"", 0};
+	auto succeeded = luxem_rawwrite_primitive(context, &placeholder);
+	capturing = false;
+	if (file) luxem_rawwrite_set_file_out(context, file);
+	check_error(get_error(succeeded));
+	auto split = captured.rfind("\"\"");
+	if (split == std::string::npos) throw std::runtime_error("Failed to locate chunked primitive in writer output.");
+	// The prefix is written with the first piece, which decides whether the value needs quotes
+	captured.erase(split, 2);
+	chunk_split = split;
+	chunk_started = false;
+	chunking = true;
+	return *this;
+}
+
+void raw_writer::start_chunks(bool quoted)
+{
+	if (chunk_started)
+	{
+		if (quoted && !chunk_quoted) throw std::runtime_error("Text chunk written into an unquoted ascii16 primitive.");
+		return;
+	}
+	chunk_started = true;
+	chunk_quoted = quoted;
+	auto prefix = captured.substr(0, chunk_split);
+	captured.erase(0, chunk_split);
+	if (quoted)
+	{
+		prefix += '"';
+		captured.insert(0, 1, '"');
+	}
+	output(prefix.data(), prefix.size());
+}
+
+raw_writer &raw_writer::primitive_chunk(char const *pointer, size_t length)
+{
+	if (!chunking) throw std::runtime_error("Primitive chunk written outside of primitive_begin and primitive_end.");
+	if (buffered)
+	{
+		chunk_text.append(pointer, length);
+		return *this;
+	}
+	start_chunks(true);
+	chunk_text.clear();
+	for (size_t index = 0; index < length; ++index)
+	{
+		if ((pointer[index] == '"') || (pointer[index] == '\\')) chunk_text += '\\';
+		chunk_text += pointer[index];
+	}
+	output(chunk_text.data(), chunk_text.size());
+	return *this;
+}
+
+raw_writer &raw_writer::primitive_chunk_ascii16(void const *pointer, size_t length)
+{
+	if (!chunking) throw std::runtime_error("Primitive chunk written outside of primitive_begin and primitive_end.");
+	ascii16_buffer.resize(ascii16_encoded_size(length));
+	if (length) encode_ascii16(reinterpret_cast<uint8_t const *>(pointer), length, &ascii16_buffer[0]);
+	if (buffered) chunk_text += ascii16_buffer;
+	else
+	{
+		start_chunks(false);
+		output(ascii16_buffer.data(), ascii16_buffer.size());
+	}
+	return *this;
+}
+
+raw_writer &raw_writer::primitive_end(void)
+{
+	if (!chunking) throw std::runtime_error("primitive_end called without primitive_begin.");
+	chunking = false;
+	if (buffered) check_error(try_primitive(chunk_text.data(), chunk_text.size()));
+	else
+	{
+		if (!chunk_started) start_chunks(true);
+		output(captured.data(), captured.size());
+	}
+	return *this;
+}
+
+void raw_writer::output(char const *pointer, size_t length)
+{
+	if (length == 0) return;
+	if (file)
+	{
+		if (fwrite(pointer, 1, length, file) != length) throw std::runtime_error("Failed to write to file.");
+		return;
+	}
+	if (!callback) return;
+	failed = false;
+	callback(std::string(pointer, length));
+	if (failed) throw std::runtime_error(failure_message ? failure_message : "Write callback failed.");
+}
+
 std::string raw_writer::dump(void) const
 {
 	auto temp = luxem_rawwrite_buffer_render(context);
@@ -76,6 +314,13 @@ std::string raw_writer::dump(void) const
 	free(temp);
 	return out;
 }
+
+void raw_writer::dump(std::string &out) const
+{
+	auto temp = luxem_rawwrite_buffer_render(context);
+	out.assign(temp->pointer, temp->length);
+	free(temp);
+}
 			
 raw_writer::object_guard::object_guard(object_guard &&other) : base(other.base) 
 	{ other.base = nullptr; }
@@ -99,18 +344,18 @@ raw_writer::object_guard raw_writer::scope_object(void)
 raw_writer::array_guard raw_writer::scope_array(void) 
 	{ array_begin(); return array_guard(*this); }
 
-void raw_writer::check_error(bool succeeded)
+error raw_writer::get_error(bool succeeded)
 {
-	if (!succeeded)
-	{
-		auto message = luxem_rawwrite_get_error(context);
-		assert(message->pointer);
-		if (message->pointer)
-			throw std::runtime_error(std::string(message->pointer, message->length));
-		else throw std::runtime_error("Callback provided no error message.");
-	}
+	if (succeeded) return {};
+	if (failed) return error(error::code::output, 0, failure_message, failure_message ? strlen(failure_message) : 0);
+	auto message = luxem_rawwrite_get_error(context);
+	assert(message->pointer);
+	return error(error::code::output, 0, message->pointer, message->length);
 }
 
+void raw_writer::check_error(error const &result)
+	{ if (result) throw std::runtime_error(result.get_message()); }
+
 struct array_stackable : writer::stackable
 {
 	array const &data;
@@ -157,6 +402,9 @@ writer::stackable::~stackable(void) {}
 writer &writer::set_pretty(char spacer, size_t multiple) 
 	{ raw_writer::set_pretty(spacer, multiple); return *this; }
 
+writer &writer::reset(void)
+	{ raw_writer::reset(); return *this; }
+
 writer &writer::object_begin(void)
 	{ raw_writer::object_begin(); return *this; }
 
@@ -178,6 +426,21 @@ writer &writer::type(std::string const &data)
 writer &writer::primitive(std::string const &data)
 	{ raw_writer::primitive(data); return *this; }
 
+writer &writer::primitive_ascii16(void const *pointer, size_t length)
+	{ raw_writer::primitive_ascii16(pointer, length); return *this; }
+
+writer &writer::primitive_begin(void)
+	{ raw_writer::primitive_begin(); return *this; }
+
+writer &writer::primitive_chunk(char const *pointer, size_t length)
+	{ raw_writer::primitive_chunk(pointer, length); return *this; }
+
+writer &writer::primitive_chunk_ascii16(void const *pointer, size_t length)
+	{ raw_writer::primitive_chunk_ascii16(pointer, length); return *this; }
+
+writer &writer::primitive_end(void)
+	{ raw_writer::primitive_end(); return *this; }
+
 writer &writer::value(std::shared_ptr<luxem::value> const &data)
 {
 	std::list<std::unique_ptr<stackable>> stack;
@@ -204,7 +467,15 @@ void writer::process(std::list<std::unique_ptr<writer::stackable>> &stack, luxem
 		stack.push_back(std::make_unique<object_stackable>(data.as<object>()));
 	}
 	else if (data.is<luxem::primitive>())
-		primitive(data.as<luxem::primitive>().get_primitive());
+	{
+		auto const &leaf = data.as<luxem::primitive>();
+		if (leaf.has_text()) primitive(leaf.get_primitive());
+		else
+		{
+			char buffer[32];
+			raw_writer::primitive(buffer, leaf.format_native(buffer));
+		}
+	}
 	else 
 	{
 		std::stringstream message;
@@ -213,5 +484,23 @@ void writer::process(std::list<std::unique_ptr<writer::stackable>> &stack, luxem
 	}
 }
 
+// Each thread keeps one buffered writer for write_struct
+template <typename body_type> static std::string write_pooled(body_type const &body)
+{
+	return thread_pooled<writer>::use([&body](writer &instance)
+	{
+		body(instance);
+		return instance.dump();
+	});
+}
+
+std::string write_struct(std::shared_ptr<value> const &data)
+	{ return write_pooled([&data](writer &instance) { instance.value(data); }); }
+
+std::string write_struct(std::vector<std::shared_ptr<value>> const &documents)
+{
+	return write_pooled([&documents](writer &instance) 
+		{ for (auto const &document : documents) instance.value(document); });
 }
 
+}
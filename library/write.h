@@ -5,6 +5,7 @@
 #include <memory>
 
 #include "struct.h"
+#include "misc.h"
 
 struct luxem_rawwrite_context_t;
 
@@ -29,8 +30,35 @@ struct raw_writer
 	raw_writer &key(std::string const &data);
 	raw_writer &type(std::string const &data);
 	raw_writer &primitive(std::string const &data);
+	raw_writer &primitive(char const *pointer, size_t length);
+	// Encodes straight into a buffer owned by the writer, so repeated blobs don't allocate
+	raw_writer &primitive_ascii16(void const *pointer, size_t length);
+
+	// Writes one primitive from several pieces, so huge values never need to be in memory at once
+	raw_writer &primitive_begin(void);
+	raw_writer &primitive_chunk(char const *pointer, size_t length);
+	raw_writer &primitive_chunk_ascii16(void const *pointer, size_t length);
+	raw_writer &primitive_end(void);
+
+	// Never throw; the error's message refers to writer state and is valid until the next write
+	error try_object_begin(void) noexcept;
+	error try_object_end(void) noexcept;
+	error try_array_begin(void) noexcept;
+	error try_array_end(void) noexcept;
+	error try_key(char const *pointer, size_t length) noexcept;
+	error try_type(char const *pointer, size_t length) noexcept;
+	error try_primitive(char const *pointer, size_t length) noexcept;
+
+	// Called from the output callback to stop writing without throwing, message must outlive the write
+	void fail(char const *message = nullptr) noexcept;
 
 	std::string dump(void) const;
+	// Reuses out's capacity
+	void dump(std::string &out) const;
+
+	// Discards what was written so the writer can start a new document, keeping the output and pretty settings;
+	// the C context is replaced, as in raw_reader::reset
+	raw_writer &reset(void);
 
 	private:
 		struct object_guard 
@@ -59,9 +87,30 @@ struct raw_writer
 
 	private:
 		luxem_rawwrite_context_t *context;
+		FILE *file;
+		bool buffered;
 		std::function<void(std::string &&chunk)> callback;
-
-		void check_error(bool succeeded);
+		std::string exception_message;
+		bool failed;
+		char const *failure_message;
+		bool pretty;
+		char pretty_spacer;
+		size_t pretty_multiple;
+		std::string ascii16_buffer;
+		bool chunking;
+		bool capturing;
+		std::string captured;
+		std::string chunk_text;
+		size_t chunk_split;
+		bool chunk_started;
+		bool chunk_quoted;
+
+		void use_output(void);
+		void use_callback(void);
+		void start_chunks(bool quoted);
+		void output(char const *pointer, size_t length);
+		error get_error(bool succeeded);
+		void check_error(error const &result);
 };
 
 struct writer : raw_writer
@@ -69,6 +118,7 @@ struct writer : raw_writer
 	using raw_writer::raw_writer;
 	
 	writer &set_pretty(char spacer = '\t', size_t multiple = 1);
+	writer &reset(void);
 
 	writer &object_begin(void);
 	writer &object_end(void);
@@ -77,6 +127,11 @@ struct writer : raw_writer
 	writer &key(std::string const &data);
 	writer &type(std::string const &data);
 	writer &primitive(std::string const &data);
+	writer &primitive_ascii16(void const *pointer, size_t length);
+	writer &primitive_begin(void);
+	writer &primitive_chunk(char const *pointer, size_t length);
+	writer &primitive_chunk_ascii16(void const *pointer, size_t length);
+	writer &primitive_end(void);
 
 	writer &value(std::shared_ptr<luxem::value> const &data);
 
@@ -99,9 +154,9 @@ struct writer : raw_writer
 	template <typename data_type> writer &value(std::string const &type_name, data_type const &data)
 		{ type(type_name); primitive(to_string<data_type>(data)); return *this; }
 	template <typename data_type> writer &value_ascii16(data_type const &data)
-		{ primitive(to_string_ascii16<data_type>(data)); return *this; }
+		{ return primitive_ascii16(data.data(), sizeof(typename data_type::value_type) * data.size()); }
 	template <typename data_type> writer &value_ascii16(std::string const &type_name, data_type const &data)
-		{ type(type_name); primitive(to_string_ascii16<data_type>(data)); return *this; }
+		{ type(type_name); return primitive_ascii16(data.data(), sizeof(typename data_type::value_type) * data.size()); }
 
 	friend struct array_stackable;
 	friend struct object_stackable;
@@ -115,6 +170,10 @@ struct writer : raw_writer
 		void process(std::list<std::unique_ptr<stackable>> &stack, luxem::value const &data);
 };
 
+// Writes with a per-thread writer that is reset between calls instead of constructed for each document
+std::string write_struct(std::shared_ptr<value> const &data);
+std::string write_struct(std::vector<std::shared_ptr<value>> const &documents);
+
 }
 
 #endif